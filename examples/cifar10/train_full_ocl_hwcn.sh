@@ -4,9 +4,9 @@ set -e
 TOOLS=./build/tools
 
 $TOOLS/caffe train \
-    --solver=examples/cifar10/cifar10_full_solver_ocl_hwcn.prototxt $@ --ocl=1
+    --solver=examples/cifar10/cifar10_full_solver_ocl_hwcn.prototxt $@ --ocl=0
 
 # reduce learning rate by factor of 10
 $TOOLS/caffe train \
     --solver=examples/cifar10/cifar10_full_solver_lr1_ocl_hwcn.prototxt \
-    --snapshot=examples/cifar10/cifar10_full_iter_8000.solverstate.h5 $@ --ocl=1
+    --snapshot=examples/cifar10/cifar10_full_iter_8000.solverstate.h5 $@ --ocl=0
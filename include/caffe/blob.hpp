@@ -24,7 +24,8 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), cpfp_(false),
+       cpfp_data_exp_(0), cpfp_diff_exp_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -73,6 +74,10 @@ class Blob {
   }
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
+  /// @brief The bytes taken by each value, see set_cpfp().
+  inline size_t value_size() const {
+    return cpfp_ ? sizeof(cpfp) : sizeof(Dtype);
+  }
 
   /**
    * @brief Compute the volume of a slice; i.e., the product of dimensions
@@ -216,6 +221,51 @@ class Blob {
     return diff_;
   }
 
+  /**
+   * @brief Returns a number that changes whenever the data may have been
+   *        modified, see SyncedMemory::version(). Caches of values computed
+   *        from the data, such as reformatted weights, compare against it.
+   */
+  inline uint64_t data_version() const {
+    return data_ ? data_->version() : 0;
+  }
+  inline uint64_t diff_version() const {
+    return diff_ ? diff_->version() : 0;
+  }
+
+  /**
+   * @brief Makes the blob hold cpfp values in place of Dtype ones, or Dtype
+   *        values again.
+   *
+   * A cpfp blob allocates, syncs and transfers sizeof(cpfp) bytes per value.
+   * Its values are read and written through the cpfp accessors below, and
+   * FromProto and ToProto convert them from and to floats. Switching
+   * drops the values; the producer of a blob sets it in its Reshape.
+   */
+  void set_cpfp(bool cpfp);
+  inline bool is_cpfp() const { return cpfp_; }
+  /**
+   * @brief The power of two the cpfp data, or diff, of the blob is scaled
+   *        by: a stored value x stands for x * 2^exp.
+   *
+   * The producer of the values sets the exponent along with them, see
+   * NetParameter.cpfp_scale. Unscaled blobs keep the default of 0.
+   */
+  inline int cpfp_data_exp() const { return cpfp_data_exp_; }
+  inline int cpfp_diff_exp() const { return cpfp_diff_exp_; }
+  inline void set_cpfp_data_exp(int exp) { cpfp_data_exp_ = exp; }
+  inline void set_cpfp_diff_exp(int exp) { cpfp_diff_exp_ = exp; }
+  // The accessors of cpfp values. They also serve Dtype blobs that hold
+  // cpfp values in the first half of their memory.
+  const cpfp* cpu_cpfp_data() const;
+  const cpfp* ocl_cpfp_data() const;
+  const cpfp* cpu_cpfp_diff() const;
+  const cpfp* ocl_cpfp_diff() const;
+  cpfp* mutable_cpu_cpfp_data();
+  cpfp* mutable_ocl_cpfp_data(int RW);
+  cpfp* mutable_cpu_cpfp_diff();
+  cpfp* mutable_ocl_cpfp_diff(int RW);
+
   const Dtype* cpu_data() const;
   const Dtype* cpu_data(size_t size) const;
   void set_cpu_data(Dtype* data);
@@ -281,16 +331,50 @@ class Blob {
   bool ShapeEquals(const BlobProto& other);
 
  protected:
+  // FromProto for cpfp blobs
+  void CpfpFromProto(const BlobProto& proto);
+
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
   shared_ptr<SyncedMemory> shape_data_;
   vector<int> shape_;
   int count_;
   int capacity_;
+  // The values are cpfp, capacity_ counts them.
+  bool cpfp_;
+  int cpfp_data_exp_;
+  int cpfp_diff_exp_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
 
+/**
+ * @brief Remembers the data versions of a source blob and of a blob computed
+ *        from it, e.g. weights reformatted for the FPGA, so the computation
+ *        can be skipped until either blob changes.
+ */
+class DerivedBlobVersion {
+ public:
+  DerivedBlobVersion() : source_(0), target_(0) {}
+
+  template <typename Stype, typename Ttype>
+  bool Current(const Blob<Stype>& source, const Blob<Ttype>& target) const {
+    return source_ != 0 && source.data_version() == source_ &&
+        target.data_version() == target_;
+  }
+
+  // Call after target has been recomputed from source.
+  template <typename Stype, typename Ttype>
+  void Update(const Blob<Stype>& source, const Blob<Ttype>& target) {
+    source_ = source.data_version();
+    target_ = target.data_version();
+  }
+
+ private:
+  uint64_t source_;
+  uint64_t target_;
+};
+
 }  // namespace caffe
 
 #endif  // CAFFE_BLOB_HPP_
@@ -101,9 +101,12 @@ using std::vector;
 #ifdef USE_OCL
   extern cl_uint oclNumPlatforms;
   extern vector<cl_platform_id> oclPlatform;
-  extern cl_device_id oclDevices;
-  extern cl_context oclContext;
-  extern cl_command_queue oclCommandQueue;
+  // Device, context and queue of the calling thread, set by
+  // Caffe::SetOCLDevice. Each device has a context and queue of its own, so
+  // threads driving different devices do not share any of them.
+  extern thread_local cl_device_id oclDevices;
+  extern thread_local cl_context oclContext;
+  extern thread_local cl_command_queue oclCommandQueue;
 #endif
 
 // A global initialization function that you should call in your main function.
@@ -124,7 +127,9 @@ class Caffe {
   // on OSX. Also fails on Linux with CUDA 7.0.18.
   static Caffe& Get();
 
-  enum Brew { CPU, GPU, OCL };
+  // OCL_NATIVE runs the fpga_caffe kernels in-process on the host through
+  // the native kernel registry instead of dispatching them to a device.
+  enum Brew { CPU, GPU, OCL, OCL_NATIVE };
 
   // This random number generator facade hides boost and CUDA rng
   // implementation from one another (for cross-platform compatibility).
@@ -169,8 +174,20 @@ class Caffe {
   static void SetDevice(const int device_id);
   // Prints the current GPU status.
   static void DeviceQuery();
-  // Sets up an OpenCL device
-  static void SetOCLDevice();
+  // Makes the OpenCL accelerator device_id, in the order the platform lists
+  // them, the device of the calling thread. Its context and queue are
+  // created on first use and shared by every thread using the device.
+  static void SetOCLDevice(const int device_id = 0);
+  // The number of OpenCL accelerators on the platform.
+  static int OCLDeviceCount();
+  // The OpenCL device of the calling thread, -1 before SetOCLDevice.
+  inline static int ocl_device() { return Get().ocl_device_; }
+  // In async OCL mode transfers and kernels are enqueued without waiting;
+  // the host only blocks when it touches memory the device still uses.
+  inline static bool ocl_async() { return Get().ocl_async_; }
+  inline static void set_ocl_async(bool val) { Get().ocl_async_ = val; }
+  // Blocks until every command enqueued on the OCL queue has completed.
+  static void SynchronizeOCL();
   // Check if specified device is available
   static bool CheckDevice(const int device_id);
   // Search from start_id to the highest possible device ordinal,
@@ -198,6 +215,8 @@ class Caffe {
   int solver_count_;
   int solver_rank_;
   bool multiprocess_;
+  bool ocl_async_;
+  int ocl_device_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
@@ -0,0 +1,65 @@
+#ifndef CAFFE_HOST_SYNC_HPP_
+#define CAFFE_HOST_SYNC_HPP_
+
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/solver.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class HostSyncWorker;
+
+/**
+ * @brief Data-parallel training with the gradients averaged on the host.
+ *
+ * Like NCCL for GPUs, Run trains one solver per device, each on a thread of
+ * its own with its own copy of the net. The data layers hand every solver a
+ * different share of the input, so the effective batch is batch_size times
+ * the number of devices. After each backward pass every solver copies its
+ * gradients to host memory, the solvers sum and scale them together, each
+ * taking a slice of every parameter blob, and all of them apply the same
+ * update.
+ *
+ * In Caffe::OCL mode each solver thread drives the OCL device it was given.
+ * In the other modes the devices only number the solvers, so e.g. several
+ * OCL_NATIVE solvers emulate a multi-card host.
+ */
+template <typename Dtype>
+class HostSync : public Solver<Dtype>::Callback {
+ public:
+  explicit HostSync(shared_ptr<Solver<Dtype> > root_solver);
+
+  /**
+   * Trains on devices, the root solver on the calling thread with
+   * devices[0]. Caffe::solver_count() must be the number of devices.
+   * restore is the solver state all workers resume from, or NULL.
+   */
+  void Run(const vector<int>& devices, const char* restore);
+
+ protected:
+  // Copies the parameters of the root solver to this one.
+  void Broadcast();
+  void on_start() {}
+  void on_gradients_ready();
+
+  shared_ptr<Solver<Dtype> > solver_;
+  boost::barrier* barrier_;
+  // The solvers of all devices by rank, shared by every instance of a Run
+  vector<HostSync<Dtype>*>* syncs_;
+  // Host copies of the learnable parameters, valid between the barriers of
+  // Broadcast and on_gradients_ready
+  vector<const Dtype*> data_;
+  vector<Dtype*> diff_;
+
+  friend class HostSyncWorker<Dtype>;
+
+  DISABLE_COPY_AND_ASSIGN(HostSync);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_HOST_SYNC_HPP_
@@ -8,7 +8,11 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/layer_factory.hpp"
+#include "caffe/native_kernel.hpp"
+#include "caffe/ocl_kernel_registry.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/cpfp_math.hpp"
+#include "caffe/util/hwcn_transpose.hpp"
 #include "caffe/util/math_functions.hpp"
 
 /**
@@ -48,6 +52,9 @@ class Layer {
           blobs_[i]->FromProto(layer_param_.blobs(i));
         }
       }
+#ifdef USE_OCL
+      ocl_native_kernel_ = NULL;
+#endif
     }
   virtual ~Layer() {}
 
@@ -67,6 +74,13 @@ class Layer {
   void SetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
     CheckBlobCounts(bottom, top);
+#ifdef USE_OCL
+    // Bind the kernel while the XCLProgram layer preceding this one in the
+    // net is still the selected one.
+    xcl_param_ = layer_param_.xcl_param().has_kernel_name() ?
+        layer_param_.xcl_param() : OCLKernelRegistry::Selected();
+    ocl_native_kernel_ = NULL;
+#endif
     LayerSetUp(bottom, top);
     Reshape(bottom, top);
     SetLossWeights(top);
@@ -297,6 +311,18 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+#ifdef USE_OCL
+  /** @brief Returns the xclbin and kernel_name the layer launches. */
+  inline const XCLParameter& xcl_param() const { return xcl_param_; }
+
+  /**
+   * @brief Appends the kernel_params of each crp kernel call the layer makes
+   *        in a forward and a backward pass, with backward set to the pass.
+   *        Used to estimate the layer without running it.
+   */
+  virtual void OCLKernelCalls(vector<kernel_params>* calls) const {}
+#endif
+
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -313,12 +339,66 @@ class Layer {
   vector<Dtype> loss_;
 
 #ifdef USE_OCL
-  /** The variable that stores the program for a given layer. */
-  static cl_program ocl_layer_program;
+  /** The xclbin and kernel_name this layer launches. */
+  XCLParameter xcl_param_;
+
+  /** The in-process implementation of the kernel, used in OCL_NATIVE mode. */
+  NativeKernel ocl_native_kernel_;
+
+  /**
+   * @brief Returns the layer's kernel, loading its program if needed. Not
+   *        kept, another layer may reprogram the device in the meantime.
+   */
+  cl_kernel GetOCLKernel();
 
-  /** The variable that stores the floating point implementation of the given 
-   * layer. */
-  static cl_kernel ocl_kernel;
+  /** @brief Returns the layer's kernel for Caffe::OCL_NATIVE. */
+  NativeKernel GetNativeKernel();
+
+  /**
+   * @brief Enqueues the layer's kernel once per group with the cl_mem args
+   *        followed by the group index. The tasks wait on the last command
+   *        touching any of the args; in async mode they are not waited for
+   *        here.
+   *
+   * With num_cu > 1 the tasks are dealt out to that many compute units, each
+   * on its own queue. Kernels that also take a split index and count after
+   * the group index have each group cut into slices of its output channel
+   * bursts, so a single group still keeps every unit busy.
+   */
+  void EnqueueOCLTasks(void* const* args, int num_args, int numgroups,
+      int num_cu = 1);
+
+  /**
+   * @brief Batch padding for the HWCN kernels, which take a multiple of 16
+   *        images.
+   *
+   * PadOCLImages copies the cpfp data, or diff, of blob into pad, whose last
+   * axis is the padded batch, and returns the device copy of pad. The extra
+   * images are zero. StripOCLImages copies the real images of pad back into
+   * blob. For packed kernels pad goes through packed, see PackOCLValues.
+   * Unpacked, Caffe::OCL copies between the device buffers, so the images
+   * do not go through the host.
+   */
+  const cpfp* PadOCLImages(const Blob<Dtype>* blob, bool diff,
+      Blob<cpfp>* pad, Blob<cpfp>* packed = NULL);
+  void StripOCLImages(Blob<cpfp>* pad, bool diff, Blob<Dtype>* blob,
+      Blob<cpfp>* packed = NULL);
+  // Copies the rows of x_num images of x into the rows of y_num images of y
+  // on the device, zero filling y first when it has more images.
+  void CopyOCLImages(const cpfp* x, int x_num, cpfp* y, int y_num, int rows);
+
+  /**
+   * @brief Packed buffers for the kernels built with CPFP_PACKED, see
+   *        XCLParameter.packed.
+   *
+   * PackOCLValues packs the count values at x into packed and returns the
+   * device copy. PackedOCLOutput returns the device copy of packed sized for
+   * a kernel output of count values, which UnpackOCLValues copies to y once
+   * the kernel is done.
+   */
+  const cpfp* PackOCLValues(const cpfp* x, int count, Blob<cpfp>* packed);
+  cpfp* PackedOCLOutput(int count, Blob<cpfp>* packed);
+  void UnpackOCLValues(Blob<cpfp>* packed, int count, cpfp* y);
 #endif
 
   /** @brief Using the CPU device, compute the layer output. */
@@ -460,6 +540,7 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   Dtype loss = 0;
   Reshape(bottom, top);
   switch (Caffe::mode()) {
+  case Caffe::OCL_NATIVE:
   case Caffe::OCL:
     Forward_ocl(bottom, top);
     for (int top_id = 0; top_id < top.size(); ++top_id) {
@@ -505,6 +586,7 @@ inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   switch (Caffe::mode()) {
+  case Caffe::OCL_NATIVE:
   case Caffe::OCL:
     Backward_ocl(top, propagate_down, bottom);
     break;
@@ -531,11 +613,167 @@ void Layer<Dtype>::ToProto(LayerParameter* param, bool write_diff) {
 }
 
 #ifdef USE_OCL
-// Added by Griffin
 template <typename Dtype>
-cl_program Layer<Dtype>::ocl_layer_program = NULL;
+cl_kernel Layer<Dtype>::GetOCLKernel() {
+  return OCLKernelRegistry::GetKernel(xcl_param_.xcl_name(),
+      xcl_param_.kernel_name());
+}
+
+template <typename Dtype>
+NativeKernel Layer<Dtype>::GetNativeKernel() {
+  if (!ocl_native_kernel_) {
+    ocl_native_kernel_ = NativeKernelRegistry::GetKernel(
+        xcl_param_.kernel_name() + (xcl_param_.packed() ? "_packed" : ""));
+  }
+  return ocl_native_kernel_;
+}
+
+template <typename Dtype>
+void Layer<Dtype>::EnqueueOCLTasks(void* const* args, int num_args,
+    int numgroups, int num_cu) {
+  vector<cl_kernel> kernels = OCLKernelRegistry::GetKernels(
+      xcl_param_.xcl_name(), xcl_param_.kernel_name(), num_cu);
+  cl_uint kernel_args = 0;
+  clGetKernelInfo(kernels[0], CL_KERNEL_NUM_ARGS, sizeof(cl_uint),
+      &kernel_args, NULL);
+  const bool splittable = kernel_args >= num_args + 3;
+  const int num_splits = splittable ? (num_cu + numgroups - 1) / numgroups : 1;
+  vector<cl_event> wait_list;
+  for (int i = 0; i < num_args; ++i) {
+    for (int cu = 0; cu < num_cu; ++cu) {
+      clSetKernelArg(kernels[cu], i, sizeof(cl_mem), (const void *)&args[i]);
+    }
+    SyncedMemory::AppendOCLWaitList(args[i], &wait_list);
+  }
+  vector<cl_event> events(numgroups * num_splits, 0);
+  for (int t = 0; t < events.size(); ++t) {
+    const int cu = t % num_cu;
+    cl_int g = t / num_splits;
+    cl_int split = t % num_splits;
+    clSetKernelArg(kernels[cu], num_args, sizeof(cl_int), (const void *)&g);
+    if (splittable) {
+      clSetKernelArg(kernels[cu], num_args + 1, sizeof(cl_int),
+          (const void *)&split);
+      clSetKernelArg(kernels[cu], num_args + 2, sizeof(cl_int),
+          (const void *)&num_splits);
+    }
+    clEnqueueTask(OCLKernelRegistry::GetQueue(cu), kernels[cu],
+        wait_list.size(), wait_list.empty() ? NULL : wait_list.data(),
+        &events[t]);
+  }
+  for (int cu = 1; cu < num_cu; ++cu) {
+    clFlush(OCLKernelRegistry::GetQueue(cu));
+  }
+  if (Caffe::ocl_async()) {
+    // Later commands on oclCommandQueue wait for the args through a single
+    // event, with several queues it joins the tasks of every unit.
+    cl_event done = events.back();
+    if (num_cu > 1) {
+      clEnqueueMarkerWithWaitList(oclCommandQueue, events.size(),
+          events.data(), &done);
+    } else {
+      clRetainEvent(done);
+    }
+    for (int i = 0; i < num_args; ++i) {
+      SyncedMemory::SetOCLEvent(args[i], done);
+    }
+    clReleaseEvent(done);
+  } else {
+    clWaitForEvents(events.size(), events.data());
+  }
+  for (int t = 0; t < events.size(); ++t) {
+    clReleaseEvent(events[t]);
+  }
+}
+
+template <typename Dtype>
+const cpfp* Layer<Dtype>::PadOCLImages(const Blob<Dtype>* blob, bool diff,
+    Blob<cpfp>* pad, Blob<cpfp>* packed) {
+  const int num = blob->shape(-1);
+  if (Caffe::mode() == Caffe::OCL && !packed) {
+    const cpfp* x = diff ? blob->ocl_cpfp_diff() : blob->ocl_cpfp_data();
+    cpfp* y = diff ? pad->mutable_ocl_diff(0) : pad->mutable_ocl_data(0);
+    CopyOCLImages(x, num, y, pad->shape(-1), blob->count() / num);
+    return y;
+  }
+  const cpfp* x = diff ? blob->cpu_cpfp_diff() : blob->cpu_cpfp_data();
+  cpfp* y = diff ? pad->mutable_cpu_diff() : pad->mutable_cpu_data();
+  hwcn_resize_batch(blob->count() / num, num, pad->shape(-1), x, y);
+  if (packed) {
+    return PackOCLValues(y, pad->count(), packed);
+  }
+  return diff ? pad->ocl_diff() : pad->ocl_data();
+}
+
 template <typename Dtype>
-cl_kernel  Layer<Dtype>::ocl_kernel  = NULL;
+void Layer<Dtype>::StripOCLImages(Blob<cpfp>* pad, bool diff,
+    Blob<Dtype>* blob, Blob<cpfp>* packed) {
+  if (Caffe::mode() == Caffe::OCL && !packed) {
+    const int num = blob->shape(-1);
+    const cpfp* x = diff ? pad->ocl_diff() : pad->ocl_data();
+    cpfp* y = diff ? blob->mutable_ocl_cpfp_diff(0) :
+        blob->mutable_ocl_cpfp_data(0);
+    CopyOCLImages(x, pad->shape(-1), y, num, blob->count() / num);
+    return;
+  }
+  if (packed) {
+    UnpackOCLValues(packed, pad->count(),
+        diff ? pad->mutable_cpu_diff() : pad->mutable_cpu_data());
+  }
+  const int num = blob->shape(-1);
+  const cpfp* x = diff ? pad->cpu_diff() : pad->cpu_data();
+  cpfp* y = diff ? blob->mutable_cpu_cpfp_diff() :
+      blob->mutable_cpu_cpfp_data();
+  hwcn_resize_batch(blob->count() / num, pad->shape(-1), num, x, y);
+}
+
+template <typename Dtype>
+void Layer<Dtype>::CopyOCLImages(const cpfp* x, int x_num, cpfp* y,
+    int y_num, int rows) {
+  vector<cl_event> wait_list;
+  SyncedMemory::AppendOCLWaitList(x, &wait_list);
+  SyncedMemory::AppendOCLWaitList(y, &wait_list);
+  const cl_event* wait = wait_list.empty() ? NULL : wait_list.data();
+  // oclCommandQueue is in order, the copy runs after the fill
+  if (y_num > x_num) {
+    const uint16 zero = 0;
+    clEnqueueFillBuffer(oclCommandQueue, (cl_mem)y, &zero, sizeof(zero), 0,
+        sizeof(cpfp) * rows * y_num, wait_list.size(), wait, NULL);
+  }
+  const size_t origin[3] = {0, 0, 0};
+  const size_t region[3] = {sizeof(cpfp) * std::min(x_num, y_num),
+      static_cast<size_t>(rows), 1};
+  cl_event event;
+  clEnqueueCopyBufferRect(oclCommandQueue, (cl_mem)x, (cl_mem)y, origin,
+      origin, region, sizeof(cpfp) * x_num, 0, sizeof(cpfp) * y_num, 0,
+      wait_list.size(), wait, &event);
+  if (Caffe::ocl_async()) {
+    SyncedMemory::SetOCLEvent(x, event);
+    SyncedMemory::SetOCLEvent(y, event);
+  } else {
+    clWaitForEvents(1, &event);
+  }
+  clReleaseEvent(event);
+}
+
+template <typename Dtype>
+const cpfp* Layer<Dtype>::PackOCLValues(const cpfp* x, int count,
+    Blob<cpfp>* packed) {
+  packed->Reshape(vector<int>(1, cpfp_packed_count(count)));
+  cpfp_pack(count, x, reinterpret_cast<cpfp16p*>(packed->mutable_cpu_data()));
+  return packed->ocl_data();
+}
+
+template <typename Dtype>
+cpfp* Layer<Dtype>::PackedOCLOutput(int count, Blob<cpfp>* packed) {
+  packed->Reshape(vector<int>(1, cpfp_packed_count(count)));
+  return packed->mutable_ocl_data(0);
+}
+
+template <typename Dtype>
+void Layer<Dtype>::UnpackOCLValues(Blob<cpfp>* packed, int count, cpfp* y) {
+  cpfp_unpack(count, reinterpret_cast<const cpfp16p*>(packed->cpu_data()), y);
+}
 #endif
 
 }  // namespace caffe
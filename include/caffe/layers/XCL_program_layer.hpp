@@ -10,8 +10,8 @@
 namespace caffe {
 
 /**
- * @brief Ignores bottom blobs while producing no top blobs. (This is useful
- *        to suppress outputs during testing.)
+ * @brief Selects the xclbin and kernel used by the OCL layers that follow it
+ *        in the net and do not set an xcl_param themselves.
  */
 #ifdef USE_OCL
 template <typename Dtype>
@@ -35,7 +35,6 @@ class XCLProgramLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Forward_ocl(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  bool program_;
 };
 
 #endif
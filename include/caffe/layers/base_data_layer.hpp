@@ -47,6 +47,8 @@ template <typename Dtype>
 class Batch {
  public:
   Blob<Dtype> data_, label_;
+  // data_ in HWCN order, filled when DataParameter.prefetch_hwcn is set
+  Blob<Dtype> hwcn_data_;
 };
 
 template <typename Dtype>
@@ -68,11 +70,17 @@ class BasePrefetchingDataLayer :
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Fills batch->hwcn_data_ from batch->data_.
+  void convert_batch(Batch<Dtype>* batch);
+  // Shape of the HWCN top for an N x C x H x W or N x C blob.
+  static vector<int> hwcn_shape(const vector<int>& shape);
 
   vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
   Batch<Dtype>* prefetch_current_;
+  bool prefetch_hwcn_;
+  bool prefetch_cpfp_;
 
   Blob<Dtype> transformed_data_;
 };
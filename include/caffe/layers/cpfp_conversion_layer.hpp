@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/cpfp_math.hpp"
 
 namespace caffe {
 
@@ -40,6 +41,10 @@ class CPFPConversionLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   vector<int> bottom_shape_;
   bool convert_to_;
+  // Scale the cpfp values of each bottom by a power of two, picked by the
+  // trackers from the running max of the data and of the diff.
+  bool scale_;
+  vector<CPFPExpTracker> data_exp_, diff_exp_;
 };
 
 }  // namespace caffe
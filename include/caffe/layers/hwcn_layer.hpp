@@ -6,11 +6,15 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/cpfp_math.hpp"
 
 namespace caffe {
 
 /**
  * @brief Converts from NCHW to HWCN data layout. 
+ *
+ * With hwcn_param.cpfp the HWCN side holds cpfp values and the layer does
+ * the work of a CPFPConversion layer in the same pass.
  */
 template <typename Dtype>
 class HWCNLayer : public Layer<Dtype> {
@@ -38,6 +42,15 @@ class HWCNLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   vector<int> bottom_shape_;
   bool convert_to_;
+  // Also convert between Dtype and cpfp, the HWCN side holds cpfp values.
+  bool cpfp_;
+  // Scale the cpfp values like a CPFPConversion layer, see its trackers.
+  bool scale_;
+  vector<CPFPExpTracker> data_exp_, diff_exp_;
+  // N, C and H * W of the NCHW side.
+  int num_;
+  int channels_;
+  int spatial_dim_;
 };
 
 }  // namespace caffe
@@ -8,6 +8,7 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/cpfp_math.hpp"
 
 namespace caffe {
 
@@ -42,9 +43,19 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
    *  1 / group of the output channels. Concretely 4 input channels, 8 output
    *  channels, and 2 groups separate input channels 1-2 and output channels
    *  1-4 into the first group and input channels 3-4 and output channels 5-8
-   *  into the second group (only supported in forward pass currently).
+   *  into the second group. The backward passes need the output channels
+   *  of each group in multiples of 16.
    *  - bias_term (\b optional, default true). Whether to have a bias.
-   *  - subengine: DIRECT or WINOGRAD OCL engines.
+   *  - subengine: DIRECT or WINOGRAD OCL engines. WINOGRAD runs 3x3 stride 1
+   *  layers of nets in the TEST phase on wcrp_layer_hwcn_cpfp_fw, which
+   *  needs a square input, a single group and input channels in multiples
+   *  of 16. Other layers fall back to DIRECT.
+   *  - xcl_param.packed must be false. Packed kernels (layer.mk PACKED=1)
+   *  only run OCLHWCNInnerProduct layers.
+   *
+   * A following ReLU is folded into cr_param.relu by FuseOCLLayers. Max
+   * pooling runs in an OCLPoolingHWCN layer of its own, the kernel cannot
+   * pool the outputs of a convolution in the same launch.
    */
   explicit OCLCRHWCNLayer(const LayerParameter& param)
       : ConvolutionLayer<Dtype>(param) {}
@@ -54,6 +65,7 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
+  virtual void OCLKernelCalls(vector<kernel_params>* calls) const;
 
  protected:
   virtual inline bool reverse_dimensions() { return false; }
@@ -68,13 +80,21 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   void backward_weights(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
-  void copyToHalf(const Dtype *input, cpfp *output, int size);
+  void copyToHalf(const Dtype *input, cpfp *output, int size, int exp);
   void copyToHalfWeights(const Dtype *input, cpfp *output,
-      kernel_params params);
+      kernel_params params, int exp);
   void copyToFloatWeights(cpfp *input, Dtype *output, const vector<int>,
-      kernel_params params);
+      kernel_params params, int exp);
   void RotateWeightsHalf(const Dtype *input, cpfp *output,
-      kernel_params params);
+      kernel_params params, int exp);
+  void copyToHalfWinogradWeights(const Dtype *input, cpfp *output,
+      kernel_params params, int exp);
+  // The exponent of the cpfp copies of the weights, see CRParameter.
+  int WeightsExp();
+  bool UseWinograd(const vector<Blob<Dtype>*>& bottom);
+  void AlignGroupBursts(const kernel_params& params, int burstchannels,
+      int* rpofm, int* burstoc);
+  void ReportSkip();
   void launchKernel(const cpfp *bottom, const cpfp *weights, const cpfp *bias,
       cpfp *top, int *tags, const int *params, int numgroups);
  private:
@@ -86,14 +106,33 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
   Blob<cpfp> weights_h;
   Blob<cpfp> weights_h_r;
   Blob<cpfp> bias_h, bias_placeholder, weights_placeholder;
+  // Batches padded to num_pad_ images, used when the batch is not a
+  // multiple of 16.
+  Blob<cpfp> bottom_pad_, top_pad_;
   Blob<int> param_vals;
+  // The cpfp copies above are only rebuilt after the parameters change.
+  DerivedBlobVersion weights_h_version_, weights_h_r_version_,
+      bias_h_version_;
+  // Power-of-two exponents of the cpfp copies of the parameters. The bias
+  // is added to the sums of the kernel, so it takes their exponent.
+  bool scale_, outshift_;
+  int weights_exp_, weights_r_exp_, bias_h_exp_;
+  // Pick the exponents of the convolution output and of the bottom diff
+  CPFPExpTracker top_exp_, bottom_diff_exp_;
   int conv_out_channels_;
   int conv_in_channels_;
   int conv_out_spatial_dim_;
   int weight_pad_;
   int num_cu_;
   int num_pe_;
+  int num_pad_;
   int burstoc_limit_;
+  // Forward runs on wcrp_layer_hwcn_cpfp_fw instead of the xcl_param kernel
+  bool winograd_;
+  // Output diff words seen and skipped by the backward passes, for
+  // cr_param.report_skip
+  int64_t tag_words_;
+  int64_t skip_words_;
 };
 #endif
 
@@ -8,6 +8,7 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/cpfp_math.hpp"
 
 namespace caffe {
 
@@ -31,6 +32,7 @@ class OCLHWCNInnerProductLayer : public InnerProductLayer<Dtype> {
   virtual inline const char* type() const { return "OCLHWCNInnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual void OCLKernelCalls(vector<kernel_params>* calls) const;
 
  protected:
   virtual void Forward_ocl(const vector<Blob<Dtype>*>& bottom,
@@ -44,9 +46,14 @@ class OCLHWCNInnerProductLayer : public InnerProductLayer<Dtype> {
   virtual void backward_weights(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   void copyToHalf(const Dtype *input, cpfp *output, int size, int xdim,
-      int xdim_pad);
+      int xdim_pad, int exp);
+  // The exponent of the cpfp copies of the weights, see CRParameter.
+  int WeightsExp();
   void launchKernel(const cpfp *bottom, const cpfp *weights, const cpfp *bias,
       cpfp *top, int *tags, const int *params);
+  // The device copy of the top diff for the backward kernels, through
+  // top_aux when that is in use and packed for a packed kernel.
+  const cpfp* OCLTopDiff(const Blob<Dtype>* top);
 
  private:
   kernel_params ocl_params_;
@@ -57,13 +64,30 @@ class OCLHWCNInnerProductLayer : public InnerProductLayer<Dtype> {
   bool use_aux_;
   int num_cu_;
   int num_pe_;
+  int num_pad_;
   int burstoc_limit_;
   Blob<int> relu_indices;
   Blob<cpfp> weights_h;
   Blob<cpfp> weights_h_t;
   Blob<cpfp> bias_h, bias_placeholder, weights_placeholder;
   Blob<cpfp> top_aux;
+  // Batches padded to num_pad_ images, used when M_ is not a multiple of 16.
+  // The top diff is padded through top_aux.
+  Blob<cpfp> bottom_pad_, top_pad_;
+  // The kernel buffers of a packed kernel, see XCLParameter.packed. The
+  // weights are packed along with their cpfp copies.
+  Blob<cpfp> input_packed_, weights_packed_, weights_t_packed_,
+      placeholder_packed_, diff_packed_, output_packed_;
   Blob<int> param_vals;
+  // The cpfp copies above are only rebuilt after the parameters change.
+  DerivedBlobVersion weights_h_version_, weights_h_t_version_,
+      bias_h_version_;
+  // Power-of-two exponents of the cpfp copies of the parameters. The bias
+  // is added to the sums of the kernel, so it takes their exponent.
+  bool scale_, outshift_;
+  int weights_exp_, weights_t_exp_, bias_h_exp_;
+  // Pick the exponents of the top data and of the bottom diff
+  CPFPExpTracker top_exp_, bottom_diff_exp_;
 };
 #endif
 
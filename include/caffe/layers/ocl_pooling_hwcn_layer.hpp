@@ -40,7 +40,10 @@ class OCLPoolingHWCNLayer : public PoolingLayer<Dtype> {
   Blob<cpfp> weights_placeholder;
   Blob<cpfp> bias_placeholder;
   Blob<int> param_vals;
+  // Batches padded to num_pad_ images, used when num_ is not a multiple of 16
+  Blob<cpfp> bottom_pad_, top_pad_;
   int num_;
+  int num_pad_;
 };
 #endif
 
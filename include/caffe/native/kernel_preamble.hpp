@@ -0,0 +1,30 @@
+#ifndef CAFFE_NATIVE_KERNEL_PREAMBLE_HPP_
+#define CAFFE_NATIVE_KERNEL_PREAMBLE_HPP_
+
+// The first include of every native kernel wrapper in src/caffe/native.
+// Everything the kernels and cpfp.hpp include is pulled in here so that the
+// include guards keep it at global scope when a kernel source is wrapped in
+// its own namespace. Each kernel defines non-inline helpers with the same
+// names, so every kernel gets its own translation unit and namespace.
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include "ap_int.h"
+
+#include "caffe/native_kernel.hpp"
+
+// Build the kernels exactly as xocc sees them so that the host runs the
+// bit-accurate cpfp operators instead of the float approximations.
+#define SYNTHESIS
+
+#endif  // CAFFE_NATIVE_KERNEL_PREAMBLE_HPP_
@@ -0,0 +1,89 @@
+#ifndef CAFFE_NATIVE_KERNEL_HPP_
+#define CAFFE_NATIVE_KERNEL_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace caffe {
+
+/**
+ * @brief Signature shared by the fpga_caffe kernels when they are linked
+ *        directly into libcaffe.
+ *
+ * The arguments mirror the ports an OCL layer sets with clSetKernelArg:
+ * input, weights, bias, output, tags and params, followed by the group index
+ * passed to each task. Pointers are host pointers; the translation unit that
+ * wraps a kernel casts them back to the kernel's port types.
+ *
+ * split_idx and num_splits let the host runtime cut one task into
+ * independent slices that run on different threads. A kernel that can split
+ * its work computes only slice split_idx of num_splits; a kernel that cannot
+ * runs the whole task for split_idx == 0 and returns for any other slice.
+ *
+ * This header intentionally does not include caffe/common.hpp. The kernel
+ * wrappers compile cpfp.hpp with SYNTHESIS defined and must not see the host
+ * definition of cpfp.
+ */
+typedef void (*NativeKernel)(void *input, void *weights, void *bias,
+    void *output, void *tags, int *params, int group_idx, int split_idx,
+    int num_splits);
+
+/**
+ * @brief Process-wide map from kernel_name to the in-process implementation
+ *        used by Caffe::OCL_NATIVE.
+ */
+class NativeKernelRegistry {
+ public:
+  typedef std::map<std::string, NativeKernel> KernelRegistry;
+
+  static KernelRegistry& Registry();
+
+  // Adds a kernel.
+  static void AddKernel(const std::string& name, NativeKernel kernel);
+
+  // Looks up a kernel by the kernel_name used in the XCLParameter.
+  static NativeKernel GetKernel(const std::string& name);
+
+  static std::vector<std::string> KernelList();
+
+ private:
+  // Kernel registry should never be instantiated - everything is done with
+  // its static variables.
+  NativeKernelRegistry() {}
+};
+
+class NativeKernelRegisterer {
+ public:
+  NativeKernelRegisterer(const std::string& name, NativeKernel kernel) {
+    NativeKernelRegistry::AddKernel(name, kernel);
+  }
+};
+
+/**
+ * @brief Runs native kernel tasks on a process-wide pool of host threads.
+ *
+ * Run issues one task per group_idx, each cut into slices, and returns once
+ * every slice has finished. Tasks write disjoint parts of the output, so the
+ * result does not depend on the number of threads.
+ */
+class NativeKernelRunner {
+ public:
+  static void Run(NativeKernel kernel, void *input, void *weights, void *bias,
+      void *output, void *tags, int *params, int numgroups);
+
+  // Number of worker threads; 0 (the default) uses every hardware thread and
+  // 1 runs all tasks serially on the calling thread.
+  static void set_num_threads(int num_threads);
+  static int num_threads();
+
+ private:
+  NativeKernelRunner() {}
+};
+
+#define REGISTER_NATIVE_KERNEL(name, kernel)                                   \
+  static NativeKernelRegisterer g_native_kernel_##name(#name, kernel)
+
+}  // namespace caffe
+
+#endif  // CAFFE_NATIVE_KERNEL_HPP_
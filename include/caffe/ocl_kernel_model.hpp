@@ -0,0 +1,85 @@
+#ifndef CAFFE_OCL_KERNEL_MODEL_HPP_
+#define CAFFE_OCL_KERNEL_MODEL_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// The m_axi bundles of the crp kernels, in argument order.
+enum OCLKernelPort {
+  GMEM_INPUT,
+  GMEM_OUTPUT,
+  GMEM_WEIGHTS,
+  GMEM_BIAS,
+  GMEM_TAGS,
+  GMEM_PARAMS,
+  NUM_GMEM_PORTS
+};
+
+// The build of a crp kernel. The pegrp builds change the number of PEs, the
+// 2mult build computes two output channel bursts at once, and wcrp runs the
+// forward pass as Winograd F(2, 3) along x.
+struct OCLKernelConfig {
+  int num_pe;
+  int ocfact;
+  bool winograd;
+  bool forward_only;
+};
+
+// Predicted cost of one kernel call, all groups run back to back.
+struct OCLKernelEstimate {
+  // Multiply-accumulates of the layer, not counting padding.
+  double macs;
+  // Iterations and drains of the MAC pipeline.
+  double mac_cycles;
+  // On-chip work between the MAC loops: window shifts and buffer fills.
+  double buffer_cycles;
+  // Beats and burst startups on the gmem ports.
+  double memory_cycles;
+  double gmem_bytes[NUM_GMEM_PORTS];
+  double gmem_bursts[NUM_GMEM_PORTS];
+  // Bytes moved between host and card if every operand is written before
+  // the call and the results are read back after it.
+  double pcie_bytes;
+
+  // The kernel does not overlap its loads, MAC loop and stores.
+  double cycles() const {
+    return mac_cycles + buffer_cycles + memory_cycles;
+  }
+  double ddr_bytes() const;
+  bool memory_bound() const {
+    return memory_cycles > mac_cycles + buffer_cycles;
+  }
+};
+
+/**
+ * @brief Analytical model of the crp kernels.
+ *
+ * Follows the loop nest of crp_layer_hwcn_cpfp and its variants: for every
+ * input and output channel pass and every output pixel the kernel loads the
+ * window, fills or reads back the output burst, runs the MAC pipeline over
+ * the valid taps and writes the burst out. The loads and stores are counted
+ * per port in beats of the port width plus a fixed startup per memcpy, the
+ * MAC loop at one iteration per cycle plus the adder tree drain.
+ */
+class OCLKernelModel {
+ public:
+  // The build named by kernel_name, the plain four PE kernel by default.
+  static OCLKernelConfig Config(const std::string& kernel_name);
+  // MACs the build finishes per cycle with every lane busy.
+  static double PeakMACsPerCycle(const OCLKernelConfig& config);
+  // Cost of a call with params, with params.backward selecting the pass.
+  static OCLKernelEstimate Estimate(const kernel_params& params,
+      const OCLKernelConfig& config);
+
+ private:
+  // The model should never be instantiated - everything is done with its
+  // static functions.
+  OCLKernelModel() {}
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_OCL_KERNEL_MODEL_HPP_
@@ -0,0 +1,85 @@
+#ifndef CAFFE_OCL_KERNEL_REGISTRY_HPP_
+#define CAFFE_OCL_KERNEL_REGISTRY_HPP_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+#ifdef USE_OCL
+/**
+ * @brief Process-wide cache of the programs and kernels loaded on the OCL
+ *        devices.
+ *
+ * Each xclbin is read and turned into a cl_program the first time one of its
+ * kernels is requested on a device, and each (xclbin, kernel_name) pair maps
+ * to a single cl_kernel of that device from then on. The device is the one
+ * of the calling thread, see Caffe::SetOCLDevice. A network mixing kernels
+ * of one xclbin does not reload programs between layers.
+ *
+ * A device holds max_programs xclbins at a time, one by default. Switching
+ * between resident xclbins reuses their programs and kernels. Requesting a
+ * kernel of another one once the device is full waits for the queued tasks,
+ * reprograms the device and releases every kernel of the least recently
+ * used xclbin, so callers look kernels up per launch instead of keeping
+ * them.
+ *
+ * Builds with several compute units of a kernel (NK > 1 in layer.mk) get
+ * one cl_kernel per compute unit, each with an in-order command queue of
+ * its own, so tasks on different units run concurrently. The first queue is
+ * oclCommandQueue.
+ *
+ * The registry also remembers the xcl_param of the last XCLProgram layer set
+ * up by the calling thread, until the thread exits. OCL layers without an
+ * xcl_param of their own launch that kernel.
+ */
+class OCLKernelRegistry {
+ public:
+  typedef std::map<std::string, cl_program> ProgramMap;
+  typedef std::map<std::pair<std::string, std::string>,
+      std::vector<cl_kernel> > KernelMap;
+
+  // Returns the kernel kernel_name of the xclbin xcl_name, loading the
+  // program if this is the first kernel requested from it.
+  static cl_kernel GetKernel(const std::string& xcl_name,
+      const std::string& kernel_name);
+  // Returns num_cu instances of the kernel, the first one being GetKernel.
+  static std::vector<cl_kernel> GetKernels(const std::string& xcl_name,
+      const std::string& kernel_name, int num_cu);
+  // Command queue of compute unit cu of the device, created on first use.
+  static cl_command_queue GetQueue(int cu);
+
+  // Directory holding the xclbins, used for xcl_names that are not paths.
+  static void set_xclbin_dir(const std::string& dir);
+  static std::string xclbin_dir();
+
+  // Number of xclbins a device holds before loading another one reprograms
+  // it, shared by every device.
+  static void set_max_programs(int max_programs);
+  static int max_programs();
+  // xclbins loaded on the device of the calling thread, most recently used
+  // first.
+  static std::vector<std::string> Resident();
+
+  // Makes param the kernel for the OCL layers set up after this call.
+  static void Select(const XCLParameter& param);
+  static XCLParameter Selected();
+
+  // Releases every kernel, program and compute unit queue of all devices.
+  static void Clear();
+
+ private:
+  // Kernel registry should never be instantiated - everything is done with
+  // its static variables.
+  OCLKernelRegistry() {}
+};
+#endif
+
+}  // namespace caffe
+
+#endif  // CAFFE_OCL_KERNEL_REGISTRY_HPP_
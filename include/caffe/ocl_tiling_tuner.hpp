@@ -0,0 +1,71 @@
+#ifndef CAFFE_OCL_TILING_TUNER_HPP_
+#define CAFFE_OCL_TILING_TUNER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// How a crp kernel call walks the channels of one group: input channels are
+// read burstchannels at a time in rpo passes, output channels burstoc at a
+// time in rpofm passes. Maps onto the kernel_params fields of the same
+// names, with burstoc stored in burstydim.
+struct OCLTiling {
+  int burstchannels;
+  int rpo;
+  int rpofm;
+  int burstoc;
+};
+
+// Properties of the kernel build that bound the tilings it accepts.
+struct OCLTilingLimits {
+  int num_pe;
+  int num_cu;
+  // Largest burstoc the output buffer holds for the layer's batch size.
+  int burstoc_limit;
+  // Smallest burstchannels the pass accepts, besides all of the channels.
+  int min_burstchannels;
+};
+
+/**
+ * @brief Picks the tiling of a crp kernel pass.
+ *
+ * Every tiling that passes the kernel asserts and fits the on-chip buffers is
+ * ranked by the cycles OCLKernelModel predicts, and the cheapest one wins.
+ * Results are cached by kernel name and pass shape, in memory and, if a cache
+ * file is set, on disk, so later runs skip the search and keep the tilings
+ * stable.
+ */
+class OCLTilingTuner {
+ public:
+  // True if tiling satisfies the kernel asserts and buffer sizes for the
+  // pass described by params.
+  static bool Fits(const kernel_params& params, const OCLTilingLimits& limits,
+      const OCLTiling& tiling);
+  // All tilings that fit, without output channel passes that are left empty.
+  static std::vector<OCLTiling> Candidates(const kernel_params& params,
+      const OCLTilingLimits& limits);
+  // Estimated kernel cycles of the pass with tiling.
+  static double Cost(const kernel_params& params,
+      const OCLTilingLimits& limits, const OCLTiling& tiling);
+  // Returns the cached or cheapest tiling of the pass.
+  static OCLTiling Tune(const std::string& kernel_name,
+      const kernel_params& params, const OCLTilingLimits& limits);
+  // Writes tiling into the matching fields of params.
+  static void Apply(const OCLTiling& tiling, kernel_params* params);
+
+  // File that tuned tilings are read from and appended to, empty for none.
+  static void set_cache_file(const std::string& path);
+  static std::string cache_file();
+
+ private:
+  // The tuner should never be instantiated - everything is done with its
+  // static variables.
+  OCLTilingTuner() {}
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_OCL_TILING_TUNER_HPP_
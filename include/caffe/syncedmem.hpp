@@ -47,6 +47,44 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
 #endif
 }
 
+#ifdef USE_OCL
+/**
+ * @brief Size-class pool of page aligned host blocks for Caffe::OCL, each
+ *        paired with the CL_MEM_USE_HOST_PTR buffer that wraps it.
+ *
+ * Aligned host memory lets the runtime transfer straight from the host
+ * allocation instead of staging it, and freed blocks keep their cl_mem, so
+ * blobs that are reshaped or belong to a later net reuse both. Sizes are
+ * rounded up to a quarter of a power of two, at least kAlignment. Blocks
+ * are created for the OCL device of the allocating thread and only reused
+ * on that device.
+ */
+class OCLMemoryPool {
+ public:
+  static const size_t kAlignment = 4096;
+
+  struct Stats {
+    uint64_t hits;    // Allocations served from a cached block
+    uint64_t misses;  // Allocations that created a new block
+    size_t bytes_in_use;
+    size_t bytes_cached;
+  };
+
+  // Returns a host block of at least size bytes.
+  static void* Allocate(size_t size);
+  // Returns the buffer wrapping a block handed out by Allocate.
+  static cl_mem Buffer(void* ptr);
+  // Makes the block available to later allocations of its size class.
+  static void Free(void* ptr);
+  static Stats GetStats();
+  // Releases every cached block; blocks in use are not affected.
+  static void Clear();
+
+ private:
+  OCLMemoryPool() {}
+};
+#endif
+
 
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
@@ -76,15 +114,41 @@ class SyncedMemory {
     SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  // Changes every time a mutable pointer is handed out or the data is
+  // replaced. Versions are unique across all SyncedMemory instances, so a
+  // cache keyed on one also notices when a blob reallocates.
+  uint64_t version() const { return version_; }
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
 #endif
+#ifdef USE_OCL
+  // Starts copying the first size bytes (all if 0) of host data to the
+  // device on queue without waiting. Device commands on any queue and host
+  // accesses wait for the copy to finish.
+  void async_ocl_push(const cl_command_queue& queue, size_t size);
+  // Records event as the latest device command using ocl_mem, a buffer
+  // handed out by ocl_data() or mutable_ocl_data(). Host accesses to the
+  // owning memory wait for it, so in Caffe::ocl_async() mode commands can
+  // be left running after they are enqueued.
+  static void SetOCLEvent(const void* ocl_mem, cl_event event);
+  // Appends the event ocl_mem is waiting on, if any, to wait_list.
+  static void AppendOCLWaitList(const void* ocl_mem,
+      vector<cl_event>* wait_list);
+#endif
 
  private:
   void to_cpu(size_t size);
   void check_device();
   void to_gpu();
   void to_ocl(int RW, size_t size);
+  void to_ocl_native(size_t size);
+  void ocl_write(size_t size);
+  void ocl_wait();
+  void alloc_host(size_t size);
+  void free_host();
+  void create_ocl_buffer(size_t size);
+  void release_ocl_buffer();
+  static uint64_t NextVersion();
   void* cpu_ptr_;
   void* gpu_ptr_;
   void* ocl_ptr_;
@@ -93,7 +157,16 @@ class SyncedMemory {
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
+  // True when ocl_ptr_ aliases cpu_ptr_ (Caffe::OCL_NATIVE).
+  bool ocl_native_;
+  // True when cpu_ptr_ and ocl_ptr_ belong to OCLMemoryPool.
+  bool ocl_pooled_;
+#ifdef USE_OCL
+  // Latest device command using ocl_ptr_, NULL once the host has waited.
+  cl_event ocl_event_;
+#endif
   int device_;
+  uint64_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -88,6 +88,23 @@ typedef ::testing::Types<OCLDevice<float> > TestOCLDtypesAndDevices;
 
 #endif
 
+#ifdef USE_OCL_NATIVE
+
+template <typename TypeParam>
+struct OCLNativeDevice {
+  typedef TypeParam Dtype;
+  static const Caffe::Brew device = Caffe::OCL_NATIVE;
+};
+
+template <typename Dtype>
+class OCLNativeDeviceTest : public MultiDeviceTest<OCLNativeDevice<Dtype> > {
+};
+
+typedef ::testing::Types<OCLNativeDevice<float> >
+    TestOCLNativeDtypesAndDevices;
+
+#endif
+
 }  // namespace caffe
 
 #endif  // CAFFE_TEST_TEST_CAFFE_MAIN_HPP_
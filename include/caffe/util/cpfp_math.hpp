@@ -0,0 +1,112 @@
+#ifndef CAFFE_UTIL_CPFP_MATH_H_
+#define CAFFE_UTIL_CPFP_MATH_H_
+
+#include "fpga_caffe/cpfp.hpp"
+#include "fpga_caffe/vector_types.hpp"
+
+namespace caffe {
+
+// Host implementations of the cpfp operators that reproduce the rounding,
+// saturation and flush-to-zero of the SYNTHESIS branch of cpfp.hpp bit for
+// bit. The cpfp operators themselves fall back to float arithmetic on the
+// host; use these where results have to match the FPGA exactly.
+
+// Elementwise y[i] = a[i] * b[i].
+void cpfp_mul(const int N, const cpfp* a, const cpfp* b, cpfp* y);
+
+// Elementwise y[i] = a[i] + b[i].
+void cpfp_add(const int N, const cpfp* a, const cpfp* b, cpfp* y);
+
+// Elementwise y[i] = a[i] - b[i].
+void cpfp_sub(const int N, const cpfp* a, const cpfp* b, cpfp* y);
+
+// Elementwise y[i] = max(a[i], b[i]), returning a[i] when the two are equal.
+void cpfp_max(const int N, const cpfp* a, const cpfp* b, cpfp* y);
+
+// Elementwise form of mult2_1: y1[i] = t1[i] * u[i], y2[i] = t2[i] * u[i].
+void cpfp_mult2_1(const int N, const cpfp* t1, const cpfp* t2,
+    const cpfp* u, cpfp* y1, cpfp* y2);
+
+// Bulk forms of float2cpfp and cpfp2float, identical element for element to
+// cpfp((float)x[i]) and (Dtype)float(x[i]).
+template <typename Dtype>
+void cpfp_from_float(const int N, const Dtype* x, cpfp* y);
+
+template <typename Dtype>
+void cpfp_to_float(const int N, const cpfp* x, Dtype* y);
+
+// Forms for blobs scaled by a power of two, see Blob::cpfp_data_exp():
+// y[i] = cpfp(x[i] * 2^-exp) and y[i] = float(x[i]) * 2^exp.
+template <typename Dtype>
+void cpfp_from_float(const int N, const Dtype* x, cpfp* y, const int exp);
+
+template <typename Dtype>
+void cpfp_to_float(const int N, const cpfp* x, Dtype* y, const int exp);
+
+// y[i] = x[i] * 2^exp, rounded like cpfp_from_float. Moves values from one
+// exponent to another; x and y may be the same.
+void cpfp_scale(const int N, const int exp, const cpfp* x, cpfp* y);
+
+// The largest |float(x[i])|, 0 when N is 0.
+float cpfp_amax(const int N, const cpfp* x);
+
+// The exponent that brings amax into [0.5, 1). The values below keep the
+// lower half of the cpfp range, the upper half is headroom for the sums of
+// the kernels. 0 for an amax of 0.
+int cpfp_scale_exp(float amax);
+
+// The outshift of the kernels multiplies by a normal cpfp power of two.
+const int kCPFPMinShift = 1 - EXP_OFFSET;
+const int kCPFPMaxShift = MAX_EXP - 1 - EXP_OFFSET;
+
+// Running max magnitude of a tensor stored as scaled cpfp, which picks the
+// exponent to store it with. The max decays a little at every update, so
+// the exponent follows tensors that shrink as well as ones that grow.
+//
+// Measuring the max reads the tensor back from the device, so the max is
+// sampled at one pass in every period and the passes in between leave the
+// tensor where it is.
+class CPFPExpTracker {
+ public:
+  CPFPExpTracker() : amax_(0), period_(1), passes_(0) {}
+  void set_period(int period);
+  // Counts a pass, true if its max is to be sampled with Update. The first
+  // pass is always sampled.
+  bool Sample();
+  // Adds the max magnitude of the latest values of the tensor.
+  void Update(float amax);
+  // cpfp_scale_exp of the running max, fallback until a nonzero update.
+  int exp(int fallback) const;
+  // The outshift that moves the sums of a kernel, which come out at
+  // exponent sum_exp, to exp(sum_exp). Sets out_exp to the exponent of the
+  // outputs once the shift is clamped to the range of the kernels.
+  int OutShift(int sum_exp, int* out_exp) const;
+
+ private:
+  float amax_;
+  int period_, passes_;
+};
+
+// Packs x into the (N + 15) / 16 words at y, the port format of the kernels
+// built with CPFP_PACKED. The values past N in the last word are zero.
+void cpfp_pack(const int N, const cpfp* x, cpfp16p* y);
+
+// Unpacks the first N values of the words at x.
+void cpfp_unpack(const int N, const cpfp16p* x, cpfp* y);
+
+// The number of cpfp values whose storage holds the packed words of N
+// values, for packing into a Blob<cpfp>. Rounded up to whole port beats,
+// the kernels move them as cpfp256 arrays.
+inline int cpfp_packed_count(const int N) {
+  const int lanes = (N + 15) / 16 * PACKED_WORDS;
+  return (lanes + BEAT_WORDS - 1) / BEAT_WORDS * sizeof(cpfp256) /
+      sizeof(cpfp);
+}
+
+// Scalar forms, operating on the raw FP_WIDTH bit patterns.
+uint16 cpfp_mul_bits(uint16 a, uint16 b);
+uint16 cpfp_add_bits(uint16 a, uint16 b);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CPFP_MATH_H_
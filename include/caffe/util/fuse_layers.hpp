@@ -0,0 +1,19 @@
+#ifndef _CAFFE_UTIL_FUSE_LAYERS_HPP_
+#define _CAFFE_UTIL_FUSE_LAYERS_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with the ReLU layers that follow an OCLCRHWCN layer
+// folded into it as cr_param.relu, where the ReLU runs in place or no other
+// layer reads the convolution output.
+//
+// Pooling is not fused. The conv and pool paths of crp_layer_hwcn_cpfp are
+// exclusive, a launch either convolves or pools, so an OCLPoolingHWCN layer
+// after the convolution still reads its input back from DDR.
+void FuseOCLLayers(const NetParameter& param, NetParameter* param_fused);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_FUSE_LAYERS_HPP_
@@ -0,0 +1,37 @@
+#ifndef CAFFE_UTIL_HWCN_TRANSPOSE_H_
+#define CAFFE_UTIL_HWCN_TRANSPOSE_H_
+
+#include "fpga_caffe/cpfp.hpp"
+
+namespace caffe {
+
+// Layout changes between the N x C x HW order of the host layers and the
+// HW x C x N order of the FPGA kernels. Stype and Dtype are float, double
+// or cpfp; when one of them is cpfp the values are converted on the way
+// with the rounding of cpfp_from_float and cpfp_to_float, so a transpose
+// and a conversion cost a single pass over memory. The cpfp side of a
+// conversion stands for its values times 2^exp, see Blob::cpfp_data_exp().
+//
+// The copy is tiled so both sides are walked in cache-sized blocks, and
+// large tensors are split across the NativeKernelRunner thread pool.
+
+// y[(s * C + c) * N + n] = x[(n * C + c) * HW + s]
+template <typename Stype, typename Dtype>
+void nchw_to_hwcn(const int N, const int C, const int HW, const Stype* x,
+    Dtype* y, const int exp = 0);
+
+// y[(n * C + c) * HW + s] = x[(s * C + c) * N + n]
+template <typename Stype, typename Dtype>
+void hwcn_to_nchw(const int N, const int C, const int HW, const Stype* x,
+    Dtype* y, const int exp = 0);
+
+// Changes the batch of an HWCN tensor of rows x in_num values to out_num
+// images: y[r * out_num + n] = x[r * in_num + n], with the images past
+// in_num zero. Widening pads a batch for the kernels, which take multiples
+// of 16 images, narrowing strips the padding from their results.
+void hwcn_resize_batch(const int rows, const int in_num, const int out_num,
+    const cpfp* x, cpfp* y);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HWCN_TRANSPOSE_H_
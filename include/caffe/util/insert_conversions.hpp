@@ -0,0 +1,23 @@
+#ifndef _CAFFE_UTIL_INSERT_CONVERSIONS_HPP_
+#define _CAFFE_UTIL_INSERT_CONVERSIONS_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with HWCN and CPFPConversion layers placed where the
+// layout or the precision of a blob changes. The OCL HWCN layers take and
+// make cpfp values in HWCN layout, Pad layers keep the layout they were
+// given, and all other layers work on NCHW floats. Conversion layers of the
+// input are dropped unless their top is an output of the net, and the fewest
+// conversions are added back in front of the layers that read a blob in
+// another format, reusing the names of the dropped layers. So consecutive
+// OCL layers read each other's blobs directly, whatever was between them.
+void InsertConversions(const NetParameter& param,
+    NetParameter* param_converted);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_INSERT_CONVERSIONS_HPP_
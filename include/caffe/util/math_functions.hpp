@@ -108,6 +108,10 @@ Dtype caffe_cpu_strided_dot(const int n, const Dtype* x, const int incx,
 template <typename Dtype>
 Dtype caffe_cpu_asum(const int n, const Dtype* x);
 
+// Returns the largest absolute value of the elements of vector x, 0 if empty
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x);
+
 // the branchless, type-safe version from
 // http://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
 template<typename Dtype>
@@ -14,8 +14,15 @@
 #include "ap_int.h"
 #endif
 
-#define EXP_SIZE 6 
-#define MANT_SIZE 5 
+// Default format, the one cpfp refers to and the kernels are built with.
+// Other widths are available as cpfp_t<EXP, MANT>. Builds may pick another
+// default with -DEXP_SIZE=... -DMANT_SIZE=..., up to 16 bits on the host.
+#ifndef EXP_SIZE
+#define EXP_SIZE 6
+#endif
+#ifndef MANT_SIZE
+#define MANT_SIZE 5
+#endif
 #define EXP_OFFSET ((1 << (EXP_SIZE - 1)) - 1)
 #define MAX_EXP ((1 << EXP_SIZE) - 1)
 #define MAX_MANT ((1 << MANT_SIZE) - 1)
@@ -28,7 +35,7 @@
 #define SIGN_MASK (1 << SIGN_SHIFT)
 #define FP_WIDTH (EXP_SIZE + MANT_SIZE + 1)
 #define ROUND_NEAREST_MULT 0
-#define ROUND_NEAREST_ADD 1 
+#define ROUND_NEAREST_ADD 1
 #define CPFP_MIN_VAL (1 << SIGN_SHIFT) | (MAX_EXP << EXP_SHIFT) | MAX_MANT
 #define CPFP_MAX_VAL (MAX_EXP << EXP_SHIFT) | MAX_MANT
 
@@ -43,112 +50,146 @@ typedef uint32_t uint32;
 typedef int16_t int16;
 typedef int32_t int32;
 
-class cpfp;
-
-cpfp operator*(cpfp T, float U);
-cpfp operator*(cpfp T, int U);
-cpfp operator*(cpfp T, cpfp U);
-cpfp operator+(cpfp T, cpfp U);
-cpfp operator-(cpfp T, cpfp U);
-cpfp operator/(cpfp T, cpfp U);
-cpfp operator/(cpfp T, int U);
-bool operator<(cpfp T, cpfp U);
-bool operator<=(cpfp T, cpfp U);
-bool operator>(cpfp T, cpfp U);
-bool operator>=(cpfp T, cpfp U);
-bool operator==(cpfp T, cpfp U);
-bool operator!=(cpfp T, cpfp U);
-cpfp max(cpfp T, cpfp U, short Tmask, short Umask, short *out_mask);
-cpfp max(cpfp T, cpfp U);
-cpfp max(cpfp T);
-
-/// Convert IEEE single-precision to cpfp-precision.
-inline uint32 float2cpfp(float value)
-{
-  uint32 bits;		//violating strict aliasing!
-  float *temp = &value;
-  bits = *((uint32 *)temp);
-  int32 exp = ((bits >> 23) & 0xFF) - 127;
-  uint32 sign = (bits >> (31 - SIGN_SHIFT)) & SIGN_MASK;
-  uint32 mant = (bits & 0x7FFFFF);
-  uint32 guard = (mant >> (22 - MANT_SIZE)) & 0x1;
-  uint32 round = (mant >> (21 - MANT_SIZE)) & 0x1;
-  uint32 mant_noround = mant >> (23 - MANT_SIZE);
-  uint32 last = mant_noround & 0x1;
-  uint32 sticky = (mant & (~(MAX_MANT << (23 - MANT_SIZE))) &
-      (~(MAX_MANT << (21 - MANT_SIZE)))) > 0;
-  uint32 rnd_val = guard & (round | sticky | last);
-  uint32 mant_round = (mant_noround != MAX_MANT) ? mant_noround + rnd_val :
-    ((exp < EXP_OFFSET) && rnd_val) ? 0 : mant_noround;
-  uint32 exp_add = (mant_noround != MAX_MANT) ? 0 :
-    ((exp < EXP_OFFSET) && rnd_val) ? 1 : 0;
-  uint32 eresf = (exp < (-1 * EXP_OFFSET + 1)) ? 0 : (exp <= EXP_OFFSET) ?
-    ((exp + EXP_OFFSET) + exp_add) << MANT_SIZE : (MAX_EXP - 1) << MANT_SIZE;
-  uint32 mantf = (exp < (-1 * EXP_OFFSET + 1)) ? 0 : (exp <= EXP_OFFSET) ?
-    mant_round : MAX_MANT;
-  uint32 hbits = (sign | eresf | mantf);
-  return hbits;
-}
+// Smallest host integer that holds an FP_WIDTH bit value.
+template <bool WIDE>
+struct cpfp_storage {
+  typedef uint16 type;
+};
 
-// Convert cpfp-precision to IEEE single-precision.
-inline float cpfp2float(uint32 value)
-{
-  float out;
-  uint32 sign = (value & SIGN_MASK) << (31 - SIGN_SHIFT);
-  uint32 mant = value & MANT_MASK;
-  uint32 exp = (value >> MANT_SIZE) & MAX_EXP;
-  uint32 eresf = (exp != 0) ? (exp + 127 - EXP_OFFSET) << 23 : 0;
-  uint32 mantf = (exp != 0) ? (mant) << (23 - MANT_SIZE) : 0;
-  uint32 bits = sign | eresf | mantf;
-  uint32 *temp = &bits;
+template <>
+struct cpfp_storage<true> {
+  typedef uint32 type;
+};
 
-  out = *((float *)temp);
-  return out;
-}
+#ifdef SYNTHESIS
+// Leading one detector of the close path adder, specialized below for
+// mantissa sizes ranging from 1 to 14
+template <int MANT>
+ap_uint<(MANT > 6 ? 4 : 3)> LOD(ap_uint<MANT + 2> sum_cpath,
+    ap_uint<1> *zero_flag);
+#endif
 
-class cpfp {
+/// Custom precision floating point with EXP exponent and MANT mantissa bits.
+/// Supports 1 <= MANT <= 14 and EXP + MANT + 1 <= 32.
+template <int EXP, int MANT>
+class cpfp_t {
   // Operators
-  friend cpfp operator*(cpfp T, float U);
-  friend cpfp operator*(cpfp T, int U);
-  friend cpfp operator*(cpfp T, cpfp U);
-  friend cpfp operator+(cpfp T, cpfp U);
-  friend cpfp operator-(cpfp T, cpfp U);
-  friend void mult2_1(cpfp T1, cpfp T2, cpfp U, cpfp *O1, cpfp *O2);
-  friend cpfp max(cpfp T, cpfp U, short Tmask, short Umask,
-      short *out_mask);
-  friend cpfp max(cpfp T, cpfp U);
-  friend cpfp max(cpfp T);
-  friend cpfp operator/(cpfp T, cpfp U);
-  friend cpfp operator/(cpfp T, int U);
-  friend bool operator<(cpfp T, cpfp U);
-  friend bool operator<=(cpfp T, cpfp U);
-  friend bool operator>(cpfp T, cpfp U);
-  friend bool operator>=(cpfp T, cpfp U);
-  friend bool operator==(cpfp T, cpfp U);
-  friend bool operator!=(cpfp T, cpfp U);
+  friend cpfp_t operator*(cpfp_t T, float U) {
+    return cpfp_t(float(T) * U);
+  }
+  friend cpfp_t operator*(cpfp_t T, int U) {
+    return cpfp_t(float(T) * U);
+  }
+  friend cpfp_t operator*(cpfp_t T, cpfp_t U) {
+    return mul(T, U);
+  }
+  friend cpfp_t operator+(cpfp_t T, cpfp_t U) {
+    return add(T, U);
+  }
+  friend cpfp_t operator-(cpfp_t T, cpfp_t U) {
+    return sub(T, U);
+  }
+  friend void mult2_1(cpfp_t T1, cpfp_t T2, cpfp_t U, cpfp_t *O1,
+      cpfp_t *O2) {
+    mult2(T1, T2, U, O1, O2);
+  }
+  friend cpfp_t max(cpfp_t T, cpfp_t U, short Tmask, short Umask,
+      short *out_mask) {
+    return max_tagged(T, U, Tmask, Umask, out_mask);
+  }
+  friend cpfp_t max(cpfp_t T, cpfp_t U) {
+    return max2(T, U);
+  }
+  friend cpfp_t max(cpfp_t T) {
+    return max0(T);
+  }
+  friend cpfp_t operator/(cpfp_t T, cpfp_t U) {
+    return cpfp_t(float(T) / float(U));
+  }
+  friend cpfp_t operator/(cpfp_t T, int U) {
+    return cpfp_t(float(T) / U);
+  }
+  friend bool operator<(cpfp_t T, cpfp_t U) {
+    storage_type Tdata, Udata, Tsign, Usign;
+    Tsign = T.data_ >> sign_shift;
+    Usign = U.data_ >> sign_shift;
+    Tdata = T.data_ ^ sign_mask;
+    Udata = U.data_ ^ sign_mask;
+    return ((Tdata < Udata) && (Tsign == 0) && (Usign == 0)) ||
+      ((Tdata > Udata) && (Tsign == 1) && (Usign == 1)) ||
+      ((Tsign == 1) && (Usign == 0));
+  }
+  friend bool operator<=(cpfp_t T, cpfp_t U) {
+    return (T < U) || (T == U);
+  }
+  friend bool operator>(cpfp_t T, cpfp_t U) {
+    storage_type Tdata, Udata, Tsign, Usign;
+    Tsign = T.data_ >> sign_shift;
+    Usign = U.data_ >> sign_shift;
+    Tdata = T.data_ ^ sign_mask;
+    Udata = U.data_ ^ sign_mask;
+    return ((Tdata > Udata) && (Tsign == 0) && (Usign == 0)) ||
+      ((Tdata < Udata) && (Tsign == 1) && (Usign == 1)) ||
+      ((Tsign == 0) && (Usign == 1));
+  }
+  friend bool operator>=(cpfp_t T, cpfp_t U) {
+    return (T > U) || (T == U);
+  }
+  friend bool operator==(cpfp_t T, cpfp_t U) {
+    return T.data_ == U.data_;
+  }
+  friend bool operator!=(cpfp_t T, cpfp_t U) {
+    return T.data_ != U.data_;
+  }
   public:
-    cpfp() : data_() {}
+    // Format parameters, compile time constants usable as ap_uint widths
+    static const int exp_size = EXP;
+    static const int mant_size = MANT;
+    static const int exp_offset = (1 << (EXP - 1)) - 1;
+    static const int max_exp = (1 << EXP) - 1;
+    static const int max_mant = (1 << MANT) - 1;
+    static const int mant_mask = max_mant;
+    static const int mant_norm = 1 << MANT;
+    static const int exp_shift = MANT;
+    static const int exp_mask = max_exp << MANT;
+    static const int product_size = (MANT + 1) * 2;
+    static const int sign_shift = EXP + MANT;
+    static const int sign_mask = 1 << sign_shift;
+    static const int fp_width = EXP + MANT + 1;
+    static const uint32 min_val = (1u << sign_shift) |
+      (max_exp << exp_shift) | max_mant;
+    static const uint32 max_val = (max_exp << exp_shift) | max_mant;
+
+    typedef typename cpfp_storage<(EXP + MANT + 1 > 16)>::type storage_type;
+
+    /// Convert IEEE single-precision to this precision.
+    static uint32 from_float(float value);
+
+    /// Convert this precision to IEEE single-precision.
+    static float to_float(uint32 value);
+
+    cpfp_t() : data_() {}
 
-    cpfp(float rhs) : data_(float2cpfp(rhs)) {}
-    
-    cpfp(uint16 rhs) : data_(rhs) {}
+    cpfp_t(float rhs) : data_(from_float(rhs)) {}
 
-    cpfp(int rhs) : data_(rhs) {}
+    cpfp_t(uint16 rhs) : data_(rhs) {}
 
-    cpfp(uint32 rhs) : data_(rhs) {}
+    cpfp_t(int rhs) : data_(rhs) {}
+
+    cpfp_t(uint32 rhs) : data_(rhs) {}
 
 #ifdef SYNTHESIS
-    cpfp(ap_uint<FP_WIDTH> rhs) : data_(rhs) {}
+    cpfp_t(ap_uint<fp_width> rhs) : data_(rhs) {}
 #endif
 
 #ifdef SYNTHESIS
-    ap_uint<FP_WIDTH> getdata() const {
+    ap_uint<fp_width> getdata() const {
       return data_;
     }
 #endif
 
     operator float() const {
-      return cpfp2float(data_);
+      return to_float(data_);
     }
 
     operator uint32() const {
@@ -159,93 +200,171 @@ class cpfp {
       return data_;
     }
 
-    cpfp& operator=(const int& rhs) {
+    cpfp_t& operator=(const int& rhs) {
       this->data_ = rhs;
       return *this;
     }
 
-    cpfp& operator+=(const cpfp& rhs) {
+    cpfp_t& operator+=(const cpfp_t& rhs) {
       *this = *this + rhs;
       return *this;
     }
 
-    cpfp& operator/=(const cpfp& rhs) {
+    cpfp_t& operator/=(const cpfp_t& rhs) {
       *this = *this / rhs;
       return *this;
     }
 
-    cpfp& operator/=(const int& rhs) {
+    cpfp_t& operator/=(const int& rhs) {
       *this = *this / rhs;
       return *this;
     }
- 
+
   private:
-#if FP_WIDTH <= 16
-    uint16 data_;
-#else
-    uint32 data_;
-#endif
+    static cpfp_t mul(cpfp_t T, cpfp_t U);
+    static void mult2(cpfp_t T1, cpfp_t T2, cpfp_t U, cpfp_t *O1,
+        cpfp_t *O2);
+    static cpfp_t add(cpfp_t T, cpfp_t U);
+    static cpfp_t sub(cpfp_t T, cpfp_t U);
+    static cpfp_t max2(cpfp_t T, cpfp_t U);
+    static cpfp_t max_tagged(cpfp_t T, cpfp_t U, short Tmask, short Umask,
+        short *out_mask);
+    static cpfp_t max0(cpfp_t T);
+
+    storage_type data_;
 };
 
-#ifndef SYNTHESIS
-inline
-#endif
-cpfp operator*(cpfp T, cpfp U) {
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::exp_size;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::mant_size;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::exp_offset;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::max_exp;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::max_mant;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::mant_mask;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::mant_norm;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::exp_shift;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::exp_mask;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::product_size;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::sign_shift;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::sign_mask;
+template <int EXP, int MANT> const int cpfp_t<EXP, MANT>::fp_width;
+template <int EXP, int MANT> const uint32 cpfp_t<EXP, MANT>::min_val;
+template <int EXP, int MANT> const uint32 cpfp_t<EXP, MANT>::max_val;
+
+typedef cpfp_t<EXP_SIZE, MANT_SIZE> cpfp;
+
+template <int EXP, int MANT>
+inline uint32 cpfp_t<EXP, MANT>::from_float(float value)
+{
+  uint32 bits;		//violating strict aliasing!
+  float *temp = &value;
+  bits = *((uint32 *)temp);
+  int32 exp = ((bits >> 23) & 0xFF) - 127;
+  uint32 sign = (bits >> (31 - sign_shift)) & sign_mask;
+  uint32 mant = (bits & 0x7FFFFF);
+  uint32 guard = (mant >> (22 - mant_size)) & 0x1;
+  uint32 round = (mant >> (21 - mant_size)) & 0x1;
+  uint32 mant_noround = mant >> (23 - mant_size);
+  uint32 last = mant_noround & 0x1;
+  uint32 sticky = (mant & (~(max_mant << (23 - mant_size))) &
+      (~(max_mant << (21 - mant_size)))) > 0;
+  uint32 rnd_val = guard & (round | sticky | last);
+  uint32 mant_round = (mant_noround != max_mant) ? mant_noround + rnd_val :
+    ((exp < exp_offset) && rnd_val) ? 0 : mant_noround;
+  uint32 exp_add = (mant_noround != max_mant) ? 0 :
+    ((exp < exp_offset) && rnd_val) ? 1 : 0;
+  uint32 eresf = (exp < (-1 * exp_offset + 1)) ? 0 : (exp <= exp_offset) ?
+    ((exp + exp_offset) + exp_add) << mant_size : (max_exp - 1) << mant_size;
+  uint32 mantf = (exp < (-1 * exp_offset + 1)) ? 0 : (exp <= exp_offset) ?
+    mant_round : max_mant;
+  uint32 hbits = (sign | eresf | mantf);
+  return hbits;
+}
+
+template <int EXP, int MANT>
+inline float cpfp_t<EXP, MANT>::to_float(uint32 value)
+{
+  float out;
+  uint32 sign = (value & sign_mask) << (31 - sign_shift);
+  uint32 mant = value & mant_mask;
+  uint32 exp = (value >> mant_size) & max_exp;
+  uint32 eresf = (exp != 0) ? (exp + 127 - exp_offset) << 23 : 0;
+  uint32 mantf = (exp != 0) ? (mant) << (23 - mant_size) : 0;
+  uint32 bits = sign | eresf | mantf;
+  uint32 *temp = &bits;
+
+  out = *((float *)temp);
+  return out;
+}
+
+/// Convert IEEE single-precision to cpfp-precision.
+inline uint32 float2cpfp(float value)
+{
+  return cpfp::from_float(value);
+}
+
+// Convert cpfp-precision to IEEE single-precision.
+inline float cpfp2float(uint32 value)
+{
+  return cpfp::to_float(value);
+}
+
+template <int EXP, int MANT>
+cpfp_t<EXP, MANT> cpfp_t<EXP, MANT>::mul(cpfp_t T, cpfp_t U) {
 #ifdef SYNTHESIS
 #pragma HLS INLINE off
 #pragma HLS pipeline
-  ap_uint<FP_WIDTH> Tdata_ = T.data_;
-  ap_uint<FP_WIDTH> Udata_ = U.data_;
-  ap_uint<EXP_SIZE> e1 = (Tdata_) >> EXP_SHIFT;
-  ap_uint<EXP_SIZE> e2 = (Udata_) >> EXP_SHIFT;
-  ap_uint<MANT_SIZE + 1> mant1 = Tdata_ | MANT_NORM;// M + 1 Bits
-  ap_uint<MANT_SIZE + 1> mant2 = Udata_ | MANT_NORM;// M + 1 Bits
-  ap_uint<1> sign1 = (Tdata_) >> SIGN_SHIFT;
-  ap_uint<1> sign2 = (Udata_) >> SIGN_SHIFT;
+  ap_uint<fp_width> Tdata_ = T.data_;
+  ap_uint<fp_width> Udata_ = U.data_;
+  ap_uint<exp_size> e1 = (Tdata_) >> exp_shift;
+  ap_uint<exp_size> e2 = (Udata_) >> exp_shift;
+  ap_uint<mant_size + 1> mant1 = Tdata_ | mant_norm;// M + 1 Bits
+  ap_uint<mant_size + 1> mant2 = Udata_ | mant_norm;// M + 1 Bits
+  ap_uint<1> sign1 = (Tdata_) >> sign_shift;
+  ap_uint<1> sign2 = (Udata_) >> sign_shift;
   ap_uint<1> sign_res = sign1 ^ sign2;
 
-  ap_uint<FP_WIDTH> sign = sign_res;
-  ap_uint<MANT_SIZE + 2> mantres;
-  ap_uint<MANT_SIZE> mantresf;
-  ap_uint<FP_WIDTH> eresf;
+  ap_uint<fp_width> sign = sign_res;
+  ap_uint<mant_size + 2> mantres;
+  ap_uint<mant_size> mantresf;
+  ap_uint<fp_width> eresf;
   // (M + 1) * (M + 1) multiplier
-  ap_uint<PRODUCT_SIZE> product = mant1 * mant2;
-  mantres = product >> MANT_SIZE;
+  ap_uint<product_size> product = mant1 * mant2;
+  mantres = product >> mant_size;
   // Compute resulting exponent
-  ap_int<EXP_SIZE + 2> eres = e1 + e2 - EXP_OFFSET;
+  ap_int<exp_size + 2> eres = e1 + e2 - exp_offset;
 
   // Rounding bits
-  ap_uint<1> last = (product >> MANT_SIZE) & 0x1;
-  ap_uint<1> guard = (product >> (MANT_SIZE - 1)) & 0x1;
-  ap_uint<1> sticky = ((product & (MAX_MANT >> 1)) > 0);
+  ap_uint<1> last = (product >> mant_size) & 0x1;
+  ap_uint<1> guard = (product >> (mant_size - 1)) & 0x1;
+  ap_uint<1> sticky = ((product & (max_mant >> 1)) > 0);
 
   // Shift the resulting mantissa by 1 and add 1 to the resulting exponent if
-  // there is a leading one in position MANT_SIZE + 1
-  if ((mantres >> (MANT_SIZE + 1)) & 0x1) {
-    last = (product >> (MANT_SIZE + 1)) & 0x1;
+  // there is a leading one in position mant_size + 1
+  if ((mantres >> (mant_size + 1)) & 0x1) {
+    last = (product >> (mant_size + 1)) & 0x1;
     sticky |= guard;
-    guard = (product >> MANT_SIZE) & 0x1;
-    mantres = (product >> (MANT_SIZE + 1));
+    guard = (product >> mant_size) & 0x1;
+    mantres = (product >> (mant_size + 1));
     eres++;
   }
 
   // Rounding logic
 #if ROUND_NEAREST_MULT == 1
   if (guard & (sticky | last)) {
-    if (mantres == (MAX_MANT | MANT_NORM))
+    if (mantres == (max_mant | mant_norm))
       eres++;
     mantres++;
   }
 #endif
 
-  ap_uint<EXP_SIZE> eres_t;
+  ap_uint<exp_size> eres_t;
 
   eres_t = eres;
   mantresf = mantres;
-  if (eres >= MAX_EXP) {
+  if (eres >= max_exp) {
     // Saturate results
-    eres_t = MAX_EXP - 1;
-    mantresf = MAX_MANT;
+    eres_t = max_exp - 1;
+    mantresf = max_mant;
   } else if ((e1 == 0) || (e2 == 0) || (eres <= 0)) {
     // Set result to 0 if 0 * val or if there's an underflow
     eres_t = 0;
@@ -254,125 +373,124 @@ cpfp operator*(cpfp T, cpfp U) {
 
   eresf = eres_t;
 
-  ap_uint<FP_WIDTH> res;
+  ap_uint<fp_width> res;
 
-  res = ((sign << SIGN_SHIFT) & SIGN_MASK) |
-    ((eresf << EXP_SHIFT) & EXP_MASK) | mantresf;
+  res = ((sign << sign_shift) & sign_mask) |
+    ((eresf << exp_shift) & exp_mask) | mantresf;
 
-  return cpfp(res);
+  return cpfp_t(res);
 #else
-  return cpfp(float(T) * float(U));
+  return cpfp_t(float(T) * float(U));
 #endif
 }
 
-#ifndef SYNTHESIS
-inline
-#endif
-void mult2_1(cpfp T1, cpfp T2, cpfp U, cpfp *O1, cpfp *O2) {
+template <int EXP, int MANT>
+void cpfp_t<EXP, MANT>::mult2(cpfp_t T1, cpfp_t T2, cpfp_t U,
+    cpfp_t *O1, cpfp_t *O2) {
 #ifdef SYNTHESIS
 #pragma HLS INLINE off
 #pragma HLS pipeline
-  ap_uint<FP_WIDTH> T1data_ = T1.data_;
-  ap_uint<FP_WIDTH> T2data_ = T2.data_;
-  ap_uint<FP_WIDTH> Udata_ = U.data_;
-  ap_uint<EXP_SIZE> e_T1 = (T1data_) >> EXP_SHIFT;
-  ap_uint<EXP_SIZE> e_T2 = (T2data_) >> EXP_SHIFT;
-  ap_uint<EXP_SIZE> e_U = (Udata_) >> EXP_SHIFT;
-  ap_uint<MANT_SIZE + 1> mant_T1 = T1data_ | MANT_NORM;// M + 1 Bits
-  ap_uint<MANT_SIZE + 1> mant_T2 = T2data_ | MANT_NORM;// M + 1 Bits
-  ap_uint<MANT_SIZE + 1> mant_U = Udata_ | MANT_NORM;// M + 1 Bits
-  ap_uint<1> sign_T1 = (T1data_) >> SIGN_SHIFT;
-  ap_uint<1> sign_T2 = (T2data_) >> SIGN_SHIFT;
-  ap_uint<1> sign_U = (Udata_) >> SIGN_SHIFT;
+  ap_uint<fp_width> T1data_ = T1.data_;
+  ap_uint<fp_width> T2data_ = T2.data_;
+  ap_uint<fp_width> Udata_ = U.data_;
+  ap_uint<exp_size> e_T1 = (T1data_) >> exp_shift;
+  ap_uint<exp_size> e_T2 = (T2data_) >> exp_shift;
+  ap_uint<exp_size> e_U = (Udata_) >> exp_shift;
+  ap_uint<mant_size + 1> mant_T1 = T1data_ | mant_norm;// M + 1 Bits
+  ap_uint<mant_size + 1> mant_T2 = T2data_ | mant_norm;// M + 1 Bits
+  ap_uint<mant_size + 1> mant_U = Udata_ | mant_norm;// M + 1 Bits
+  ap_uint<1> sign_T1 = (T1data_) >> sign_shift;
+  ap_uint<1> sign_T2 = (T2data_) >> sign_shift;
+  ap_uint<1> sign_U = (Udata_) >> sign_shift;
   ap_uint<1> sign_res_O1 = sign_T1 ^ sign_U;
   ap_uint<1> sign_res_O2 = sign_T2 ^ sign_U;
 
-  ap_uint<FP_WIDTH> sign_O1 = sign_res_O1;
-  ap_uint<FP_WIDTH> sign_O2 = sign_res_O2;
-  ap_uint<MANT_SIZE + 2> mantres_O1, mantres_O2;
-  ap_uint<MANT_SIZE> mantresf_O1, mantresf_O2;
-  ap_uint<FP_WIDTH> eresf_O1, eresf_O2;
+  ap_uint<fp_width> sign_O1 = sign_res_O1;
+  ap_uint<fp_width> sign_O2 = sign_res_O2;
+  ap_uint<mant_size + 2> mantres_O1, mantres_O2;
+  ap_uint<mant_size> mantresf_O1, mantresf_O2;
+  ap_uint<fp_width> eresf_O1, eresf_O2;
 
-  ap_uint<(MANT_SIZE + 1) * 3> mant_T2_temp = mant_T2;
+  ap_uint<(mant_size + 1) * 3> mant_T2_temp = mant_T2;
 
-  ap_uint<(MANT_SIZE + 1) * 3> op = (mant_T2_temp << ((MANT_SIZE + 1) * 2)) |
+  ap_uint<(mant_size + 1) * 3> op = (mant_T2_temp << ((mant_size + 1) * 2)) |
     mant_T1;
 
   // (M + 1) * (M + 1) multiplier
-  ap_uint<(MANT_SIZE + 1) * 4> product = op * mant_U;
-  mantres_O1 = product >> MANT_SIZE;
-  mantres_O2 = product >> (2 * (MANT_SIZE + 1) + MANT_SIZE);
+  ap_uint<(mant_size + 1) * 4> product = op * mant_U;
+  mantres_O1 = product >> mant_size;
+  mantres_O2 = product >> (2 * (mant_size + 1) + mant_size);
   // Compute resulting exponent
-  ap_int<EXP_SIZE + 2> eres_O1 = e_T1 + e_U - EXP_OFFSET;
-  ap_int<EXP_SIZE + 2> eres_O2 = e_T2 + e_U - EXP_OFFSET;
+  ap_int<exp_size + 2> eres_O1 = e_T1 + e_U - exp_offset;
+  ap_int<exp_size + 2> eres_O2 = e_T2 + e_U - exp_offset;
 
   // Rounding bits
-  ap_uint<1> last_O1 = (product >> MANT_SIZE) & 0x1;
-  ap_uint<1> last_O2 = (product >> (2 * (MANT_SIZE + 1) + MANT_SIZE)) & 0x1;
-  ap_uint<1> guard_O1 = (product >> (MANT_SIZE - 1)) & 0x1;
-  ap_uint<1> guard_O2 = (product >> (2 * (MANT_SIZE + 1) + MANT_SIZE - 1)) &
+  ap_uint<1> last_O1 = (product >> mant_size) & 0x1;
+  ap_uint<1> last_O2 = (product >> (2 * (mant_size + 1) + mant_size)) & 0x1;
+  ap_uint<1> guard_O1 = (product >> (mant_size - 1)) & 0x1;
+  ap_uint<1> guard_O2 = (product >> (2 * (mant_size + 1) + mant_size - 1)) &
     0x1;
-  ap_uint<1> sticky_O1 = ((product & (MAX_MANT >> 1)) > 0);
-  ap_uint<1> sticky_O2 = ((product >> (2 * (MANT_SIZE + 1))) &
-    (MAX_MANT >> 1)) > 0;
+  ap_uint<1> sticky_O1 = ((product & (max_mant >> 1)) > 0);
+  ap_uint<1> sticky_O2 = ((product >> (2 * (mant_size + 1))) &
+    (max_mant >> 1)) > 0;
 
   // Shift the resulting mantissa by 1 and add 1 to the resulting exponent if
-  // there is a leading one in position MANT_SIZE + 1
-  if ((mantres_O1 >> (MANT_SIZE + 1)) & 0x1) {
-    last_O1 = (product >> (MANT_SIZE + 1)) & 0x1;
+  // there is a leading one in position mant_size + 1
+  if ((mantres_O1 >> (mant_size + 1)) & 0x1) {
+    last_O1 = (product >> (mant_size + 1)) & 0x1;
     sticky_O1 |= guard_O1;
-    guard_O1 = (product >> MANT_SIZE) & 0x1;
-    mantres_O1 = (product >> (MANT_SIZE + 1));
+    guard_O1 = (product >> mant_size) & 0x1;
+    mantres_O1 = (product >> (mant_size + 1));
     eres_O1++;
   }
 
   // Rounding logic
 #if ROUND_NEAREST_MULT == 1
   if (guard_O1 & (sticky_O1 | last_O1)) {
-    if (mantres_O1 == (MAX_MANT | MANT_NORM))
+    if (mantres_O1 == (max_mant | mant_norm))
       eres_O1++;
     mantres_O1++;
   }
 #endif
 
   // Shift the resulting mantissa by 1 and add 1 to the resulting exponent if
-  // there is a leading one in position MANT_SIZE + 1
-  if ((mantres_O2 >> (MANT_SIZE + 1)) & 0x1) {
-    last_O2 = (product >> ((MANT_SIZE + 1) * 3)) & 0x1;
+  // there is a leading one in position mant_size + 1
+  if ((mantres_O2 >> (mant_size + 1)) & 0x1) {
+    last_O2 = (product >> ((mant_size + 1) * 3)) & 0x1;
     sticky_O2 |= guard_O2;
-    guard_O2 = (product >> (2 * (MANT_SIZE + 1) + MANT_SIZE)) & 0x1;
-    mantres_O2 = (product >> (3 * (MANT_SIZE + 1)));
+    guard_O2 = (product >> (2 * (mant_size + 1) + mant_size)) & 0x1;
+    mantres_O2 = (product >> (3 * (mant_size + 1)));
     eres_O2++;
   }
 
   // Rounding logic
 #if ROUND_NEAREST_MULT == 1
   if (guard_O2 & (sticky_O2 | last_O2)) {
-    if (mantres_O2 == (MAX_MANT | MANT_NORM))
+    if (mantres_O2 == (max_mant | mant_norm))
       eres_O2++;
     mantres_O2++;
   }
 #endif
 
-  ap_uint<EXP_SIZE> eres_t_O1, eres_t_O2;
+  ap_uint<exp_size> eres_t_O1, eres_t_O2;
 
   eres_t_O1 = eres_O1;
   eres_t_O2 = eres_O2;
   mantresf_O1 = mantres_O1;
   mantresf_O2 = mantres_O2;
-  if (eres_O1 >= MAX_EXP) {
+  if (eres_O1 >= max_exp) {
     // Saturate results
-    eres_t_O1 = MAX_EXP - 1;
-    mantresf_O1 = MAX_MANT;
+    eres_t_O1 = max_exp - 1;
+    mantresf_O1 = max_mant;
   } else if ((e_T1 == 0) || (e_U == 0) || (eres_O1 <= 0)) {
     // Set result to 0 if 0 * val or if there's an underflow
     eres_t_O1 = 0;
     mantresf_O1 = 0;
   }
-  if (eres_O2 >= MAX_EXP) {
+  if (eres_O2 >= max_exp) {
     // Saturate results
-    eres_t_O2 = MAX_EXP - 1;
-    mantresf_O2 = MAX_MANT;
+    eres_t_O2 = max_exp - 1;
+    mantresf_O2 = max_mant;
   } else if ((e_T2 == 0) || (e_U == 0) || (eres_O2 <= 0)) {
     // Set result to 0 if 0 * val or if there's an underflow
     eres_t_O2 = 0;
@@ -382,27 +500,25 @@ void mult2_1(cpfp T1, cpfp T2, cpfp U, cpfp *O1, cpfp *O2) {
   eresf_O1 = eres_t_O1;
   eresf_O2 = eres_t_O2;
 
-  ap_uint<FP_WIDTH> O1_temp, O2_temp;
+  ap_uint<fp_width> O1_temp, O2_temp;
 
-  O1_temp = ((sign_O1 << SIGN_SHIFT) & SIGN_MASK) |
-    ((eresf_O1 << EXP_SHIFT) & EXP_MASK) | mantresf_O1;
-  O2_temp = ((sign_O2 << SIGN_SHIFT) & SIGN_MASK) |
-    ((eresf_O2 << EXP_SHIFT) & EXP_MASK) | mantresf_O2;
+  O1_temp = ((sign_O1 << sign_shift) & sign_mask) |
+    ((eresf_O1 << exp_shift) & exp_mask) | mantresf_O1;
+  O2_temp = ((sign_O2 << sign_shift) & sign_mask) |
+    ((eresf_O2 << exp_shift) & exp_mask) | mantresf_O2;
 
-  *O1 = cpfp(O1_temp);
-  *O2 = cpfp(O2_temp);
+  *O1 = cpfp_t(O1_temp);
+  *O2 = cpfp_t(O2_temp);
 #else
-  *O1 = cpfp(float(T1) * float(U));
-  *O2 = cpfp(float(T2) * float(U));
+  *O1 = cpfp_t(float(T1) * float(U));
+  *O2 = cpfp_t(float(T2) * float(U));
 #endif
 }
 
-// Leading one detectors for mantissa sizes ranging from 1 to 14
-
 #ifdef SYNTHESIS
-#if MANT_SIZE == 1
-ap_uint<3> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
-  ap_uint<1> a[MANT_SIZE + 2];
+template <>
+inline ap_uint<3> LOD<1>(ap_uint<3> sum_cpath, ap_uint<1> *zero_flag) {
+  ap_uint<1> a[3];
   a[2] = (sum_cpath >> 2) & 0x1;
   a[1] = (sum_cpath >> 1) & 0x1;
   a[0] = (sum_cpath >> 0) & 0x1;
@@ -416,11 +532,10 @@ ap_uint<3> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
   result = ((b[2] & 0x1) << 2) | ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 2
-ap_uint<3> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
-  ap_uint<1> a[MANT_SIZE + 2];
+template <>
+inline ap_uint<3> LOD<2>(ap_uint<4> sum_cpath, ap_uint<1> *zero_flag) {
+  ap_uint<1> a[4];
   a[3] = (sum_cpath >> 3) & 0x1;
   a[2] = (sum_cpath >> 2) & 0x1;
   a[1] = (sum_cpath >> 1) & 0x1;
@@ -435,11 +550,10 @@ ap_uint<3> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
   result = ((b[2] & 0x1) << 2) | ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 3 
-ap_uint<3> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
-  ap_uint<1> a[MANT_SIZE + 2];
+template <>
+inline ap_uint<3> LOD<3>(ap_uint<5> sum_cpath, ap_uint<1> *zero_flag) {
+  ap_uint<1> a[5];
   a[4] = (sum_cpath >> 4) & 0x1;
   a[3] = (sum_cpath >> 3) & 0x1;
   a[2] = (sum_cpath >> 2) & 0x1;
@@ -455,11 +569,10 @@ ap_uint<3> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
   result = ((b[2] & 0x1) << 2) | ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 4
-ap_uint<3> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
-  ap_uint<1> a[MANT_SIZE + 2];
+template <>
+inline ap_uint<3> LOD<4>(ap_uint<6> sum_cpath, ap_uint<1> *zero_flag) {
+  ap_uint<1> a[6];
   a[5] = (sum_cpath >> 5) & 0x1;
   a[4] = (sum_cpath >> 4) & 0x1;
   a[3] = (sum_cpath >> 3) & 0x1;
@@ -476,12 +589,11 @@ ap_uint<3> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
   result = ((b[2] & 0x1) << 2) | ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 5
-ap_uint<3> LOD (ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
+template <>
+inline ap_uint<3> LOD<5>(ap_uint<7> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[7];
   a[6] = (sum_cpath >> 6) & 0x1;
   a[5] = (sum_cpath >> 5) & 0x1;
   a[4] = (sum_cpath >> 4) & 0x1;
@@ -500,12 +612,11 @@ ap_uint<3> LOD (ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag){
   result = ((b[2] & 0x1) << 2) | ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 6
-ap_uint<3> LOD (ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> * zero_flag){
+template <>
+inline ap_uint<3> LOD<6>(ap_uint<8> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[8];
   a[7] = (sum_cpath >> 7) & 0x1;
   a[6] = (sum_cpath >> 6) & 0x1;
   a[5] = (sum_cpath >> 5) & 0x1;
@@ -526,12 +637,11 @@ ap_uint<3> LOD (ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> * zero_flag){
   result = ((b[2] & 0x1) << 2) | ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 7
-ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
+template <>
+inline ap_uint<4> LOD<7>(ap_uint<9> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[9];
   ap_uint<4> b[4];
   a[8] = (sum_cpath >> 8) & 0x1;
   a[7] = (sum_cpath >> 7) & 0x1;
@@ -554,12 +664,11 @@ ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
     ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 8
-ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
+template <>
+inline ap_uint<4> LOD<8>(ap_uint<10> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[10];
   ap_uint<4> b[4];
   a[9] = (sum_cpath >> 9) & 0x1;
   a[8] = (sum_cpath >> 8) & 0x1;
@@ -586,12 +695,11 @@ ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
     ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 9 
-ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
+template <>
+inline ap_uint<4> LOD<9>(ap_uint<11> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[11];
   ap_uint<4> b[4];
   a[10] = (sum_cpath >> 10) & 0x1;
   a[9] = (sum_cpath >> 9) & 0x1;
@@ -619,12 +727,11 @@ ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
     ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 10
-ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
+template <>
+inline ap_uint<4> LOD<10>(ap_uint<12> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[12];
   ap_uint<4> b[4];
   a[11] = (sum_cpath >> 11) & 0x1;
   a[10] = (sum_cpath >> 10) & 0x1;
@@ -653,12 +760,11 @@ ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
     ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 11
-ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
+template <>
+inline ap_uint<4> LOD<11>(ap_uint<13> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[13];
   ap_uint<4> b[4];
   a[12] = (sum_cpath >> 12) & 0x1;
   a[11] = (sum_cpath >> 11) & 0x1;
@@ -689,12 +795,11 @@ ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
     ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 12
-ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
+template <>
+inline ap_uint<4> LOD<12>(ap_uint<14> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[14];
   ap_uint<4> b[4];
   a[13] = (sum_cpath >> 13) & 0x1;
   a[12] = (sum_cpath >> 12) & 0x1;
@@ -727,12 +832,11 @@ ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
     ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 13
-ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
+template <>
+inline ap_uint<4> LOD<13>(ap_uint<15> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[15];
   ap_uint<4> b[4];
   a[14] = (sum_cpath >> 14) & 0x1;
   a[13] = (sum_cpath >> 13) & 0x1;
@@ -767,12 +871,11 @@ ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
     ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
-#if MANT_SIZE == 14
-ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
+template <>
+inline ap_uint<4> LOD<14>(ap_uint<16> sum_cpath, ap_uint<1> *zero_flag) {
 #pragma HLS INLINE
-  ap_uint<1> a[MANT_SIZE + 2];
+  ap_uint<1> a[16];
   ap_uint<4> b[4];
   a[15] = (sum_cpath >> 15) & 0x1;
   a[14] = (sum_cpath >> 14) & 0x1;
@@ -809,25 +912,22 @@ ap_uint<4> LOD(ap_uint<MANT_SIZE + 2> sum_cpath, ap_uint<1> *zero_flag) {
     ((b[1] & 0x1) << 1) | (b[0] & 0x1);
   return result;
 }
-#endif
 
 #endif
 
-#ifndef SYNTHESIS
-inline
-#endif
-cpfp operator+(cpfp T, cpfp U) {
+template <int EXP, int MANT>
+cpfp_t<EXP, MANT> cpfp_t<EXP, MANT>::add(cpfp_t T, cpfp_t U) {
 #ifdef SYNTHESIS
 #pragma HLS INLINE off
 #pragma HLS pipeline
-  ap_uint<FP_WIDTH> Tdata_ = T.data_;
-  ap_uint<FP_WIDTH> Udata_ = U.data_;
-  ap_uint<EXP_SIZE> e1 = Tdata_ >> EXP_SHIFT;
-  ap_uint<EXP_SIZE> e2 = Udata_ >> EXP_SHIFT;
-  ap_uint<MANT_SIZE> mant1 = Tdata_;
-  ap_uint<MANT_SIZE> mant2 = Udata_;
-  ap_uint<1> sign1 = Tdata_ >> SIGN_SHIFT;
-  ap_uint<1> sign2 = Udata_ >> SIGN_SHIFT;
+  ap_uint<fp_width> Tdata_ = T.data_;
+  ap_uint<fp_width> Udata_ = U.data_;
+  ap_uint<exp_size> e1 = Tdata_ >> exp_shift;
+  ap_uint<exp_size> e2 = Udata_ >> exp_shift;
+  ap_uint<mant_size> mant1 = Tdata_;
+  ap_uint<mant_size> mant2 = Udata_;
+  ap_uint<1> sign1 = Tdata_ >> sign_shift;
+  ap_uint<1> sign2 = Udata_ >> sign_shift;
 
   // EOP = 1 -> add, EOP = 0 -> sub
   ap_uint<1> EOP = sign1 == sign2; 
@@ -835,18 +935,18 @@ cpfp operator+(cpfp T, cpfp U) {
   // 1 if e1 is bigger, 0 if e2 is bigger
   ap_uint<1> exp_cmp = (e1 >= e2) ? 1 : 0;
   ap_uint<1> guard, round;
-  ap_uint<MANT_SIZE> mantresf;
-  ap_uint<MANT_SIZE + EXP_SIZE> eresf;
+  ap_uint<mant_size> mantresf;
+  ap_uint<mant_size + exp_size> eresf;
 
-  ap_uint<MANT_SIZE + 5> sum_fpath;
+  ap_uint<mant_size + 5> sum_fpath;
   ap_uint<1> sum_fpath_sign = 0;
 
   ap_int<2> Rshifter = 0;
   ap_uint<5> Lshifter = 0;
  
-  ap_uint<MANT_SIZE> mant1_s, mant2_s;
+  ap_uint<mant_size> mant1_s, mant2_s;
   ap_uint<1> sign1_s, sign2_s;
-  ap_uint<EXP_SIZE> e1_s, e2_s;
+  ap_uint<exp_size> e1_s, e2_s;
 
   mant1_s = (exp_cmp) ? mant1 : mant2;
   mant2_s = (exp_cmp) ? mant2 : mant1;
@@ -855,20 +955,20 @@ cpfp operator+(cpfp T, cpfp U) {
   sign1_s = (exp_cmp) ? sign1 : sign2;
   sign2_s = (exp_cmp) ? sign2 : sign1;
 
-  ap_uint<EXP_SIZE> eres = e1_s;
-  ap_uint<EXP_SIZE> diff = e1_s - e2_s; 
+  ap_uint<exp_size> eres = e1_s;
+  ap_uint<exp_size> diff = e1_s - e2_s; 
 
   // Flag for determining if we're in the far or close path
   ap_uint<1> fpath_flag = (diff > 1) || EOP;
 
-  ap_uint<MANT_SIZE + 4> mant1_large = (e1_s != 0) ?
-    (ap_uint<MANT_SIZE + 4>)(mant1_s | MANT_NORM) : (ap_uint<MANT_SIZE + 4>)0;
-  ap_uint<PRODUCT_SIZE + 6> mant2_large = (e2_s != 0) ?
-    (ap_uint<PRODUCT_SIZE>)(mant2_s | MANT_NORM) : (ap_uint<PRODUCT_SIZE>)0;
+  ap_uint<mant_size + 4> mant1_large = (e1_s != 0) ?
+    (ap_uint<mant_size + 4>)(mant1_s | mant_norm) : (ap_uint<mant_size + 4>)0;
+  ap_uint<product_size + 6> mant2_large = (e2_s != 0) ?
+    (ap_uint<product_size>)(mant2_s | mant_norm) : (ap_uint<product_size>)0;
 
   // Close path, sub and (diff = 0 or diff = 1)
-  ap_uint<MANT_SIZE + 2> mant1_cpath;
-  ap_uint<MANT_SIZE + 2> mant2_cpath;
+  ap_uint<mant_size + 2> mant1_cpath;
+  ap_uint<mant_size + 2> mant2_cpath;
 
   mant1_cpath = mant1_large << 1;
 
@@ -879,13 +979,13 @@ cpfp operator+(cpfp T, cpfp U) {
     // mant1 and mant2 are aligned, shift by same amount
     mant2_cpath = mant2_large << 1;
 
-  ap_int<MANT_SIZE + 4> sum_cpath_t;
+  ap_int<mant_size + 4> sum_cpath_t;
  
   sum_cpath_t = mant1_cpath - mant2_cpath;
 
   ap_uint<1> sum_cpath_sign;
 
-  ap_uint<MANT_SIZE + 2> sum_cpath;
+  ap_uint<mant_size + 2> sum_cpath;
 
   // If the result is negative then mant1 < mant2, need to complement the 
   // result and set the sign to sign2_s
@@ -899,49 +999,49 @@ cpfp operator+(cpfp T, cpfp U) {
 
   ap_uint<1> zero_flag = 0;
   // Determine amount to shift by with leading one detector
-  Lshifter = LOD(sum_cpath, &zero_flag);
+  Lshifter = LOD<mant_size>(sum_cpath, &zero_flag);
 
-  ap_uint<MANT_SIZE> sum_cpath_f = ((sum_cpath) << Lshifter) >> 1;
+  ap_uint<mant_size> sum_cpath_f = ((sum_cpath) << Lshifter) >> 1;
 
   // Far path
 
-  // saturate difference at MANT_SIZE + 4 bits
+  // saturate difference at mant_size + 4 bits
   // bit -1: guard
   // bit -2: round
   // bit -3: position for sticky bit
 
-  ap_uint<EXP_SIZE> diff_sat = (diff > (MANT_SIZE + 4)) ?
-    (ap_uint<EXP_SIZE>)(MANT_SIZE + 4) : diff;
+  ap_uint<exp_size> diff_sat = (diff > (mant_size + 4)) ?
+    (ap_uint<exp_size>)(mant_size + 4) : diff;
 
-  ap_uint<PRODUCT_SIZE + 6> mant2_a =
-    (mant2_large) << ((MANT_SIZE + 4) - diff_sat);
+  ap_uint<product_size + 6> mant2_a =
+    (mant2_large) << ((mant_size + 4) - diff_sat);
 
   ap_uint<1> sticky;
  
   // Compute sticky bit for round-to-nearest
 #if ROUND_NEAREST_ADD == 1
-  sticky = (mant2_a & ((1 << (MANT_SIZE + 1)) - 1)) > 0;
+  sticky = (mant2_a & ((1 << (mant_size + 1)) - 1)) > 0;
 #else
   sticky = 0;
 #endif
 
   // Shift mant1 by 3 to match width of mant2
-  ap_uint<MANT_SIZE + 4> mant1_fpath = (mant1_large) << 3;
+  ap_uint<mant_size + 4> mant1_fpath = (mant1_large) << 3;
   // Shift mant2 back and or sticky to bit -3 position
-  ap_uint<MANT_SIZE + 4> mant2_fpath = (mant2_a >> (MANT_SIZE + 1)) | sticky;
+  ap_uint<mant_size + 4> mant2_fpath = (mant2_a >> (mant_size + 1)) | sticky;
 
   if (EOP) 
     sum_fpath = mant1_fpath + mant2_fpath;
   else
     sum_fpath = mant1_fpath - mant2_fpath; 
 
-  ap_uint<MANT_SIZE + 2> sum_t = (sum_fpath >> 3);
+  ap_uint<mant_size + 2> sum_t = (sum_fpath >> 3);
   // Extract rounding bits
   guard = (sum_fpath >> 2) & 0x1;
   round = (sum_fpath >> 1) & 0x1;
   sticky = sum_fpath & 0x1;
 
-  if ((sum_t >> (MANT_SIZE + 1)) & 0x1) {
+  if ((sum_t >> (mant_size + 1)) & 0x1) {
     // Carry generated, need to shift output to the right, and shift rounding
     // bits
     Rshifter = 1;
@@ -949,7 +1049,7 @@ cpfp operator+(cpfp T, cpfp U) {
     round = guard;
     guard = sum_t & 0x1;
     sum_t = (sum_fpath >> 4);
-  } else if (((sum_t >> (MANT_SIZE)) & 0x1) == 0) {
+  } else if (((sum_t >> (mant_size)) & 0x1) == 0) {
     // Leading 0 at output, need to shift to the left by 1 bit, shift rounding
     // bits accordingly
     Rshifter = -1;
@@ -964,30 +1064,30 @@ cpfp operator+(cpfp T, cpfp U) {
   // Rounding logic
 #if ROUND_NEAREST_ADD == 1
   if (guard & (last | round | sticky)) {
-    if (sum_t == (MAX_MANT | MANT_NORM))
+    if (sum_t == (max_mant | mant_norm))
       rnd_ovfl = 1;
     sum_t++;
   }
 #endif
 
-  ap_uint<MANT_SIZE> sum_fpath_f = sum_t;
+  ap_uint<mant_size> sum_fpath_f = sum_t;
 
   // Select sign based off of close or far path in use
-  ap_uint<FP_WIDTH> sign = (fpath_flag) ? sign1_s :
+  ap_uint<fp_width> sign = (fpath_flag) ? sign1_s :
     sum_cpath_sign;
 
-  ap_uint<EXP_SIZE> eres_t;
+  ap_uint<exp_size> eres_t;
 
   // Compute resulting exponent for far path/close path
-  ap_uint<EXP_SIZE> eres_fpath_f = eres + Rshifter + rnd_ovfl;
-  ap_uint<EXP_SIZE> eres_cpath_f = eres - Lshifter;
+  ap_uint<exp_size> eres_fpath_f = eres + Rshifter + rnd_ovfl;
+  ap_uint<exp_size> eres_cpath_f = eres - Lshifter;
   if (fpath_flag) {
     eres_t = eres_fpath_f;
     mantresf = sum_fpath_f;
-    if (eres + Rshifter + rnd_ovfl >= MAX_EXP) {
+    if (eres + Rshifter + rnd_ovfl >= max_exp) {
       // Saturate result if the exponent overflows
-      eres_t = MAX_EXP - 1;
-      mantresf = MAX_MANT;
+      eres_t = max_exp - 1;
+      mantresf = max_mant;
     } else if (eres + Rshifter + rnd_ovfl <= 0) {
       // Set result to 0 if the resulting exponent underflows
       eres_t = 0;
@@ -1010,31 +1110,29 @@ cpfp operator+(cpfp T, cpfp U) {
 
   eresf = eres_t;
 
-  ap_uint<FP_WIDTH> res;
-  res = ((sign << SIGN_SHIFT) & SIGN_MASK) |
-    ((eresf << EXP_SHIFT) & EXP_MASK) | mantresf;
+  ap_uint<fp_width> res;
+  res = ((sign << sign_shift) & sign_mask) |
+    ((eresf << exp_shift) & exp_mask) | mantresf;
 
-  return cpfp(res);
+  return cpfp_t(res);
 #else
-  return cpfp(float(T) + float(U));
+  return cpfp_t(float(T) + float(U));
 #endif
 }
 
-#ifndef SYNTHESIS
-inline
-#endif
-cpfp operator-(cpfp T, cpfp U) {
+template <int EXP, int MANT>
+cpfp_t<EXP, MANT> cpfp_t<EXP, MANT>::sub(cpfp_t T, cpfp_t U) {
 #ifdef SYNTHESIS
 #pragma HLS INLINE off
 #pragma HLS pipeline
-  ap_uint<FP_WIDTH> Tdata_ = T.data_;
-  ap_uint<FP_WIDTH> Udata_ = U.data_;
-  ap_uint<EXP_SIZE> e1 = Tdata_ >> EXP_SHIFT;
-  ap_uint<EXP_SIZE> e2 = Udata_ >> EXP_SHIFT;
-  ap_uint<MANT_SIZE> mant1 = Tdata_;
-  ap_uint<MANT_SIZE> mant2 = Udata_;
-  ap_uint<1> sign1 = Tdata_ >> SIGN_SHIFT;
-  ap_uint<1> sign2 = (Udata_ >> SIGN_SHIFT) ^ 1;
+  ap_uint<fp_width> Tdata_ = T.data_;
+  ap_uint<fp_width> Udata_ = U.data_;
+  ap_uint<exp_size> e1 = Tdata_ >> exp_shift;
+  ap_uint<exp_size> e2 = Udata_ >> exp_shift;
+  ap_uint<mant_size> mant1 = Tdata_;
+  ap_uint<mant_size> mant2 = Udata_;
+  ap_uint<1> sign1 = Tdata_ >> sign_shift;
+  ap_uint<1> sign2 = (Udata_ >> sign_shift) ^ 1;
 
   // EOP = 1 -> add, EOP = 0 -> sub
   ap_uint<1> EOP = sign1 == sign2; 
@@ -1042,18 +1140,18 @@ cpfp operator-(cpfp T, cpfp U) {
   // 1 if e1 is bigger, 0 if e2 is bigger
   ap_uint<1> exp_cmp = (e1 >= e2) ? 1 : 0;
   ap_uint<1> guard, round;
-  ap_uint<MANT_SIZE> mantresf;
-  ap_uint<MANT_SIZE + EXP_SIZE> eresf;
+  ap_uint<mant_size> mantresf;
+  ap_uint<mant_size + exp_size> eresf;
 
-  ap_uint<MANT_SIZE + 5> sum_fpath;
+  ap_uint<mant_size + 5> sum_fpath;
   ap_uint<1> sum_fpath_sign = 0;
 
   ap_int<2> Rshifter = 0;
   ap_uint<5> Lshifter = 0;
  
-  ap_uint<MANT_SIZE> mant1_s, mant2_s;
+  ap_uint<mant_size> mant1_s, mant2_s;
   ap_uint<1> sign1_s, sign2_s;
-  ap_uint<EXP_SIZE> e1_s, e2_s;
+  ap_uint<exp_size> e1_s, e2_s;
 
   mant1_s = (exp_cmp) ? mant1 : mant2;
   mant2_s = (exp_cmp) ? mant2 : mant1;
@@ -1062,20 +1160,20 @@ cpfp operator-(cpfp T, cpfp U) {
   sign1_s = (exp_cmp) ? sign1 : sign2;
   sign2_s = (exp_cmp) ? sign2 : sign1;
 
-  ap_uint<EXP_SIZE> eres = e1_s;
-  ap_uint<EXP_SIZE> diff = e1_s - e2_s; 
+  ap_uint<exp_size> eres = e1_s;
+  ap_uint<exp_size> diff = e1_s - e2_s; 
 
   // Flag for determining if we're in the far or close path
   ap_uint<1> fpath_flag = (diff > 1) || EOP;
 
-  ap_uint<MANT_SIZE + 4> mant1_large = (e1_s != 0) ?
-    (ap_uint<MANT_SIZE + 4>)(mant1_s | MANT_NORM) : (ap_uint<MANT_SIZE + 4>)0;
-  ap_uint<PRODUCT_SIZE + 6> mant2_large = (e2_s != 0) ?
-    (ap_uint<PRODUCT_SIZE>)(mant2_s | MANT_NORM) : (ap_uint<PRODUCT_SIZE>)0;
+  ap_uint<mant_size + 4> mant1_large = (e1_s != 0) ?
+    (ap_uint<mant_size + 4>)(mant1_s | mant_norm) : (ap_uint<mant_size + 4>)0;
+  ap_uint<product_size + 6> mant2_large = (e2_s != 0) ?
+    (ap_uint<product_size>)(mant2_s | mant_norm) : (ap_uint<product_size>)0;
 
   // Close path, sub and (diff = 0 or diff = 1)
-  ap_uint<MANT_SIZE + 2> mant1_cpath;
-  ap_uint<MANT_SIZE + 2> mant2_cpath;
+  ap_uint<mant_size + 2> mant1_cpath;
+  ap_uint<mant_size + 2> mant2_cpath;
 
   mant1_cpath = mant1_large << 1;
 
@@ -1086,13 +1184,13 @@ cpfp operator-(cpfp T, cpfp U) {
     // mant1 and mant2 are aligned, shift by same amount
     mant2_cpath = mant2_large << 1;
 
-  ap_int<MANT_SIZE + 4> sum_cpath_t;
+  ap_int<mant_size + 4> sum_cpath_t;
  
   sum_cpath_t = mant1_cpath - mant2_cpath;
 
   ap_uint<1> sum_cpath_sign;
 
-  ap_uint<MANT_SIZE + 2> sum_cpath;
+  ap_uint<mant_size + 2> sum_cpath;
 
   // If the result is negative then mant1 < mant2, need to complement the 
   // result and set the sign to sign2_s
@@ -1106,49 +1204,49 @@ cpfp operator-(cpfp T, cpfp U) {
 
   ap_uint<1> zero_flag = 0;
   // Determine amount to shift by with leading one detector
-  Lshifter = LOD(sum_cpath, &zero_flag);
+  Lshifter = LOD<mant_size>(sum_cpath, &zero_flag);
 
-  ap_uint<MANT_SIZE> sum_cpath_f = ((sum_cpath) << Lshifter) >> 1;
+  ap_uint<mant_size> sum_cpath_f = ((sum_cpath) << Lshifter) >> 1;
 
   // Far path
 
-  // saturate difference at MANT_SIZE + 4 bits
+  // saturate difference at mant_size + 4 bits
   // bit -1: guard
   // bit -2: round
   // bit -3: position for sticky bit
 
-  ap_uint<EXP_SIZE> diff_sat = (diff > (MANT_SIZE + 4)) ?
-    (ap_uint<EXP_SIZE>)(MANT_SIZE + 4) : diff;
+  ap_uint<exp_size> diff_sat = (diff > (mant_size + 4)) ?
+    (ap_uint<exp_size>)(mant_size + 4) : diff;
 
-  ap_uint<PRODUCT_SIZE + 6> mant2_a =
-    (mant2_large) << ((MANT_SIZE + 4) - diff_sat);
+  ap_uint<product_size + 6> mant2_a =
+    (mant2_large) << ((mant_size + 4) - diff_sat);
 
   ap_uint<1> sticky;
  
   // Compute sticky bit for round-to-nearest
 #if ROUND_NEAREST_ADD == 1
-  sticky = (mant2_a & ((1 << (MANT_SIZE + 1)) - 1)) > 0;
+  sticky = (mant2_a & ((1 << (mant_size + 1)) - 1)) > 0;
 #else
   sticky = 0;
 #endif
 
   // Shift mant1 by 3 to match width of mant2
-  ap_uint<MANT_SIZE + 4> mant1_fpath = (mant1_large) << 3;
+  ap_uint<mant_size + 4> mant1_fpath = (mant1_large) << 3;
   // Shift mant2 back and or sticky to bit -3 position
-  ap_uint<MANT_SIZE + 4> mant2_fpath = (mant2_a >> (MANT_SIZE + 1)) | sticky;
+  ap_uint<mant_size + 4> mant2_fpath = (mant2_a >> (mant_size + 1)) | sticky;
 
   if (EOP) 
     sum_fpath = mant1_fpath + mant2_fpath;
   else
     sum_fpath = mant1_fpath - mant2_fpath; 
 
-  ap_uint<MANT_SIZE + 2> sum_t = (sum_fpath >> 3);
+  ap_uint<mant_size + 2> sum_t = (sum_fpath >> 3);
   // Extract rounding bits
   guard = (sum_fpath >> 2) & 0x1;
   round = (sum_fpath >> 1) & 0x1;
   sticky = sum_fpath & 0x1;
 
-  if ((sum_t >> (MANT_SIZE + 1)) & 0x1) {
+  if ((sum_t >> (mant_size + 1)) & 0x1) {
     // Carry generated, need to shift output to the right, and shift rounding
     // bits
     Rshifter = 1;
@@ -1156,7 +1254,7 @@ cpfp operator-(cpfp T, cpfp U) {
     round = guard;
     guard = sum_t & 0x1;
     sum_t = (sum_fpath >> 4);
-  } else if (((sum_t >> (MANT_SIZE)) & 0x1) == 0) {
+  } else if (((sum_t >> (mant_size)) & 0x1) == 0) {
     // Leading 0 at output, need to shift to the left by 1 bit, shift rounding
     // bits accordingly
     Rshifter = -1;
@@ -1171,30 +1269,30 @@ cpfp operator-(cpfp T, cpfp U) {
   // Rounding logic
 #if ROUND_NEAREST_ADD == 1
   if (guard & (last | round | sticky)) {
-    if (sum_t == (MAX_MANT | MANT_NORM))
+    if (sum_t == (max_mant | mant_norm))
       rnd_ovfl = 1;
     sum_t++;
   }
 #endif
 
-  ap_uint<MANT_SIZE> sum_fpath_f = sum_t;
+  ap_uint<mant_size> sum_fpath_f = sum_t;
 
   // Select sign based off of close or far path in use
-  ap_uint<FP_WIDTH> sign = (fpath_flag) ? sign1_s :
+  ap_uint<fp_width> sign = (fpath_flag) ? sign1_s :
     sum_cpath_sign;
 
-  ap_uint<EXP_SIZE> eres_t;
+  ap_uint<exp_size> eres_t;
 
   // Compute resulting exponent for far path/close path
-  ap_uint<EXP_SIZE> eres_fpath_f = eres + Rshifter + rnd_ovfl;
-  ap_uint<EXP_SIZE> eres_cpath_f = eres - Lshifter;
+  ap_uint<exp_size> eres_fpath_f = eres + Rshifter + rnd_ovfl;
+  ap_uint<exp_size> eres_cpath_f = eres - Lshifter;
   if (fpath_flag) {
     eres_t = eres_fpath_f;
     mantresf = sum_fpath_f;
-    if (eres + Rshifter + rnd_ovfl >= MAX_EXP) {
+    if (eres + Rshifter + rnd_ovfl >= max_exp) {
       // Saturate result if the exponent overflows
-      eres_t = MAX_EXP - 1;
-      mantresf = MAX_MANT;
+      eres_t = max_exp - 1;
+      mantresf = max_mant;
     } else if (eres + Rshifter + rnd_ovfl <= 0) {
       // Set result to 0 if the resulting exponent underflows
       eres_t = 0;
@@ -1217,60 +1315,30 @@ cpfp operator-(cpfp T, cpfp U) {
 
   eresf = eres_t;
 
-  ap_uint<FP_WIDTH> res;
-  res = ((sign << SIGN_SHIFT) & SIGN_MASK) |
-    ((eresf << EXP_SHIFT) & EXP_MASK) | mantresf;
+  ap_uint<fp_width> res;
+  res = ((sign << sign_shift) & sign_mask) |
+    ((eresf << exp_shift) & exp_mask) | mantresf;
 
-  return cpfp(res);
+  return cpfp_t(res);
 #else
-  return cpfp(float(T) - float(U));
+  return cpfp_t(float(T) - float(U));
 #endif
 }
 
-#ifndef SYNTHESIS
-inline
-#endif
-bool operator==(cpfp T, cpfp U) {
-#ifdef SYNTHESIS
-  ap_uint<FP_WIDTH> Tdata_ = T.data_;
-  ap_uint<FP_WIDTH> Udata_ = U.data_;
-#else
-  int32 Tdata_ = T.data_;
-  int32 Udata_ = U.data_;
-#endif
-  return (Tdata_ == Udata_);
-}
-
-#ifndef SYNTHESIS
-inline
-#endif
-bool operator!=(cpfp T, cpfp U) {
-#ifdef SYNTHESIS
-  ap_uint<FP_WIDTH> Tdata_ = T.data_;
-  ap_uint<FP_WIDTH> Udata_ = U.data_;
-#else
-  uint32 Tdata_ = T.data_;
-  uint32 Udata_ = U.data_;
-#endif
-  return (Tdata_ != Udata_);
-}
-
 // Returns the max of T and U
-#ifndef SYNTHESIS
-inline
-#endif
-cpfp max(cpfp T, cpfp U) {
+template <int EXP, int MANT>
+cpfp_t<EXP, MANT> cpfp_t<EXP, MANT>::max2(cpfp_t T, cpfp_t U) {
 #ifdef SYNTHESIS
 #pragma HLS INLINE off
 #pragma HLS pipeline
-  cpfp res;
+  cpfp_t res;
 
   if (T < U)
     res = U;
   else
     res = T;  
 #else
-  cpfp res;
+  cpfp_t res;
   if (T < U)
     res = U;
   else
@@ -1280,14 +1348,13 @@ cpfp max(cpfp T, cpfp U) {
 }
 
 // Returns the max of T and U and stores the resulting mask in out_mask
-#ifndef SYNTHESIS
-inline
-#endif
-cpfp max(cpfp T, cpfp U, short Tmask, short Umask, short *out_mask) {
+template <int EXP, int MANT>
+cpfp_t<EXP, MANT> cpfp_t<EXP, MANT>::max_tagged(cpfp_t T, cpfp_t U,
+    short Tmask, short Umask, short *out_mask) {
 #ifdef SYNTHESIS
 #pragma HLS INLINE off
 #pragma HLS pipeline
-  cpfp res;
+  cpfp_t res;
   short res_mask;
   if (T < U) {
     res = U;
@@ -1297,7 +1364,7 @@ cpfp max(cpfp T, cpfp U, short Tmask, short Umask, short *out_mask) {
     res_mask = Tmask;
   }  
 #else
-  cpfp res;
+  cpfp_t res;
   short res_mask;
   if (T < U) {
     res = U;
@@ -1312,84 +1379,28 @@ cpfp max(cpfp T, cpfp U, short Tmask, short Umask, short *out_mask) {
 }
 
 // Compares T with 0
-#ifndef SYNTHESIS
-inline
-#endif
-cpfp max(cpfp T) {
+template <int EXP, int MANT>
+cpfp_t<EXP, MANT> cpfp_t<EXP, MANT>::max0(cpfp_t T) {
 #ifdef SYNTHESIS
 #pragma HLS INLINE off
 #pragma HLS pipeline
-  ap_uint<FP_WIDTH> Tdata_ = T.data_;
-  ap_uint<1> sign1 = Tdata_ >> SIGN_SHIFT;
+  ap_uint<fp_width> Tdata_ = T.data_;
+  ap_uint<1> sign1 = Tdata_ >> sign_shift;
 
-  cpfp res;
+  cpfp_t res;
   if (sign1)
-    res = cpfp(0);
+    res = cpfp_t(0);
   else
     res = T;
 #else
-  cpfp res;
-  uint32 sign = T.data_ >> SIGN_SHIFT;
+  cpfp_t res;
+  uint32 sign = T.data_ >> sign_shift;
   if (sign == 1)
-    res = cpfp(0);
+    res = cpfp_t(0);
   else
     res = T;
 #endif
   return res;
 }
 
-inline cpfp operator*(cpfp T, float U) {
-  return cpfp(float(T) * U);
-}
-
-inline cpfp operator*(cpfp T, int U) {
-  return cpfp(float(T) * U);
-}
-
-inline cpfp operator/(cpfp T, cpfp U) {
-  return cpfp(float(T) / float(U));
-}
-
-inline cpfp operator/(cpfp T, int U) {
-  return cpfp(float(T) / U);
-}
-
-inline bool operator>(cpfp T, cpfp U) {
-#if (EXP_SIZE + MANT_SIZE + 1) > 16
-  uint32 Tdata, Udata, Tsign, Usign;
-#else
-  uint16 Tdata, Udata, Tsign, Usign;
-#endif
-  Tsign = T.data_ >> SIGN_SHIFT;
-  Usign = U.data_ >> SIGN_SHIFT;
-  Tdata = T.data_ ^ SIGN_MASK;
-  Udata = U.data_ ^ SIGN_MASK;
-  return ((Tdata > Udata) && (Tsign == 0) && (Usign == 0)) ||
-    ((Tdata < Udata) && (Tsign == 1) && (Usign == 1)) ||
-    ((Tsign == 0) && (Usign == 1));
-}
-
-inline bool operator>=(cpfp T, cpfp U) {
-  return (T > U) || (T == U);
-}
-
-inline bool operator<(cpfp T, cpfp U) {
-#if (EXP_SIZE + MANT_SIZE + 1) > 16
-  uint32 Tdata, Udata, Tsign, Usign;
-#else
-  uint16 Tdata, Udata, Tsign, Usign;
-#endif
-  Tsign = T.data_ >> SIGN_SHIFT;
-  Usign = U.data_ >> SIGN_SHIFT;
-  Tdata = T.data_ ^ SIGN_MASK;
-  Udata = U.data_ ^ SIGN_MASK;
-  return ((Tdata < Udata) && (Tsign == 0) && (Usign == 0)) ||
-    ((Tdata > Udata) && (Tsign == 1) && (Usign == 1)) ||
-    ((Tsign == 1) && (Usign == 0));
-}
-
-inline bool operator<=(cpfp T, cpfp U) {
-  return (T < U) || (T == U);
-}
-
 #endif  // CPFP_HPP_
@@ -29,6 +29,7 @@ typedef struct {
   int pad;
   int pool;
   int pksize;
+  int outshift;
 } kernel_params;
 
 #endif  // LAYER_HPP_
@@ -63,25 +63,28 @@ struct short16 {
   }
 };
 
-struct cpfp16 {
-  cpfp s0;
-  cpfp s1;
-  cpfp s2;
-  cpfp s3;
-  cpfp s4;
-  cpfp s5;
-  cpfp s6;
-  cpfp s7;
-  cpfp s8;
-  cpfp s9;
-  cpfp sa;
-  cpfp sb;
-  cpfp sc;
-  cpfp sd;
-  cpfp se;
-  cpfp sf;
+template <int EXP, int MANT>
+struct cpfp16_t {
+  typedef cpfp_t<EXP, MANT> value_type;
+
+  value_type s0;
+  value_type s1;
+  value_type s2;
+  value_type s3;
+  value_type s4;
+  value_type s5;
+  value_type s6;
+  value_type s7;
+  value_type s8;
+  value_type s9;
+  value_type sa;
+  value_type sb;
+  value_type sc;
+  value_type sd;
+  value_type se;
+  value_type sf;
   
-  cpfp16& operator=(const cpfp& rhs) {
+  cpfp16_t& operator=(const value_type& rhs) {
     s0 = rhs;
     s1 = rhs;
     s2 = rhs;
@@ -101,7 +104,7 @@ struct cpfp16 {
     return *this;
   }
 
-  cpfp16& operator+=(const cpfp rhs[16]) { 
+  cpfp16_t& operator+=(const value_type rhs[16]) { 
 #pragma HLS INLINE
     s0 += rhs[0];
     s1 += rhs[1];
@@ -123,11 +126,14 @@ struct cpfp16 {
   }
 };
 
+typedef cpfp16_t<EXP_SIZE, MANT_SIZE> cpfp16;
+
 /* Implements 16 parallel max(rhs, 0) functions */
 
-cpfp16 max(const cpfp16 rhs) {
+template <int EXP, int MANT>
+cpfp16_t<EXP, MANT> max(const cpfp16_t<EXP, MANT> rhs) {
 #pragma HLS INLINE
-  cpfp16 val;
+  cpfp16_t<EXP, MANT> val;
   val.s0 = max(rhs.s0);
   val.s1 = max(rhs.s1);
   val.s2 = max(rhs.s2);
@@ -149,9 +155,11 @@ cpfp16 max(const cpfp16 rhs) {
 
 /* Implements 16 parallel max(a, b) functions */
 
-cpfp16 max(const cpfp16 T, const cpfp16 U) {
+template <int EXP, int MANT>
+cpfp16_t<EXP, MANT> max(const cpfp16_t<EXP, MANT> T,
+    const cpfp16_t<EXP, MANT> U) {
 #pragma HLS INLINE
-  cpfp16 val;
+  cpfp16_t<EXP, MANT> val;
   val.s0 = max(T.s0, U.s0);
   val.s1 = max(T.s1, U.s1);
   val.s2 = max(T.s2, U.s2);
@@ -173,10 +181,12 @@ cpfp16 max(const cpfp16 T, const cpfp16 U) {
 
 /* Implements 16 parallel max(a, b) functions with tags computed */
 
-cpfp16 max(const cpfp16 T, const cpfp16 U, const short16 Tmask,
-    const short16 Umask, short16 *out_mask) {
+template <int EXP, int MANT>
+cpfp16_t<EXP, MANT> max(const cpfp16_t<EXP, MANT> T,
+    const cpfp16_t<EXP, MANT> U, const short16 Tmask, const short16 Umask,
+    short16 *out_mask) {
 #pragma HLS INLINE
-  cpfp16 val;
+  cpfp16_t<EXP, MANT> val;
   short16 res_mask;
   val.s0 = max(T.s0, U.s0, Tmask.s0, Umask.s0, &(res_mask.s0));
   val.s1 = max(T.s1, U.s1, Tmask.s1, Umask.s1, &(res_mask.s1));
@@ -198,8 +208,10 @@ cpfp16 max(const cpfp16 T, const cpfp16 U, const short16 Tmask,
   return val;
 }
 
-cpfp16 operator+(cpfp16 T, cpfp U[16]) {
-  cpfp16 retval;
+template <int EXP, int MANT>
+cpfp16_t<EXP, MANT> operator+(cpfp16_t<EXP, MANT> T,
+    cpfp_t<EXP, MANT> U[16]) {
+  cpfp16_t<EXP, MANT> retval;
   retval.s0 = T.s0 + U[0];
   retval.s1 = T.s1 + U[1];
   retval.s2 = T.s2 + U[2];
@@ -219,8 +231,10 @@ cpfp16 operator+(cpfp16 T, cpfp U[16]) {
   return retval;
 }
 
-cpfp16 operator*(cpfp16 T, cpfp16 U) {
-  cpfp16 retval;
+template <int EXP, int MANT>
+cpfp16_t<EXP, MANT> operator*(cpfp16_t<EXP, MANT> T,
+    cpfp16_t<EXP, MANT> U) {
+  cpfp16_t<EXP, MANT> retval;
   retval.s0 = T.s0 * U.s0;
   retval.s1 = T.s1 * U.s1;
   retval.s2 = T.s2 * U.s2;
@@ -240,8 +254,185 @@ cpfp16 operator*(cpfp16 T, cpfp16 U) {
   return retval;
 }
 
-struct cpfp32 {
-  cpfp16 l, u;
+template <int EXP, int MANT>
+struct cpfp32_t {
+  cpfp16_t<EXP, MANT> l, u;
 };
 
+typedef cpfp32_t<EXP_SIZE, MANT_SIZE> cpfp32;
+
+/* Packed word of 16 cpfp values, FP_WIDTH bits apiece. Value i takes bits
+ * FP_WIDTH * i to FP_WIDTH * (i + 1) - 1 of the little endian words, so the
+ * 12 bit default format keeps 16 values in 192 bits instead of 256 */
+
+#define PACKED_WORDS ((16 * FP_WIDTH + 63) / 64)
+
+struct cpfp16p {
+  uint64_t w[PACKED_WORDS];
+};
+
+inline cpfp16p pack16(const cpfp16 val) {
+#pragma HLS INLINE
+  const uint64_t mask = (uint64_t(1) << FP_WIDTH) - 1;
+  const uint32 v[16] = {val.s0, val.s1, val.s2, val.s3, val.s4, val.s5,
+    val.s6, val.s7, val.s8, val.s9, val.sa, val.sb, val.sc, val.sd, val.se,
+    val.sf};
+  cpfp16p word;
+  for (int j = 0; j < PACKED_WORDS; ++j)
+    word.w[j] = 0;
+  for (int i = 0; i < 16; ++i) {
+#pragma HLS UNROLL
+    const int pos = i * FP_WIDTH;
+    const uint64_t bits = v[i] & mask;
+    word.w[pos / 64] |= bits << (pos % 64);
+    if (pos % 64 + FP_WIDTH > 64)
+      word.w[pos / 64 + 1] |= bits >> (64 - pos % 64);
+  }
+  return word;
+}
+
+inline cpfp16 unpack16(const cpfp16p word) {
+#pragma HLS INLINE
+  const uint64_t mask = (uint64_t(1) << FP_WIDTH) - 1;
+  uint32 v[16];
+#pragma HLS ARRAY_PARTITION variable=v complete
+  for (int i = 0; i < 16; ++i) {
+#pragma HLS UNROLL
+    const int pos = i * FP_WIDTH;
+    uint64_t bits = word.w[pos / 64] >> (pos % 64);
+    if (pos % 64 + FP_WIDTH > 64)
+      bits |= word.w[pos / 64 + 1] << (64 - pos % 64);
+    v[i] = bits & mask;
+  }
+  cpfp16 val;
+  val.s0 = cpfp(v[0]);
+  val.s1 = cpfp(v[1]);
+  val.s2 = cpfp(v[2]);
+  val.s3 = cpfp(v[3]);
+  val.s4 = cpfp(v[4]);
+  val.s5 = cpfp(v[5]);
+  val.s6 = cpfp(v[6]);
+  val.s7 = cpfp(v[7]);
+  val.s8 = cpfp(v[8]);
+  val.s9 = cpfp(v[9]);
+  val.sa = cpfp(v[10]);
+  val.sb = cpfp(v[11]);
+  val.sc = cpfp(v[12]);
+  val.sd = cpfp(v[13]);
+  val.se = cpfp(v[14]);
+  val.sf = cpfp(v[15]);
+  return val;
+}
+
+/* 256 bit beat of the packed m_axi ports. The packed words are laid end to
+ * end over the 64 bit lanes of the beats, word i taking lanes
+ * PACKED_WORDS * i to PACKED_WORDS * (i + 1) - 1, so with 12 bit values every
+ * 4 words fill 3 beats. On the host this is the layout of cpfp16p arrays */
+
+#define BEAT_WORDS 4
+
+/* Smallest run of packed words that fills whole beats,
+ * BEAT_WORDS / gcd(PACKED_WORDS, BEAT_WORDS), 4 words in 3 beats for 12 bit
+ * values. Runs starting on a multiple of it never share a beat */
+
+#define PACKED_ALIGN_WORDS ((PACKED_WORDS % 4 == 0) ? 1 : \
+    (PACKED_WORDS % 2 == 0) ? 2 : 4)
+
+struct cpfp256 {
+  uint64_t w[BEAT_WORDS];
+};
+
+/* Burst transfers between the on-chip cpfp16 buffers and the m_axi ports of
+ * the kernels, n words of 16 values starting idx words into the port. Kernels
+ * built with CPFP_PACKED take port16 arrays of packed beats, unpacked on the
+ * way in and packed on the way out */
+
+#ifdef CPFP_PACKED
+typedef cpfp256 port16;
+#else
+typedef cpfp16 port16;
+#endif
+
+inline void port_read(cpfp16 *dst, const cpfp16 *src, int idx, int n) {
+#pragma HLS INLINE
+  memcpy(dst, src + idx, sizeof(cpfp16) * n);
+}
+
+inline void port_read(cpfp16 *dst, const cpfp256 *src, int idx, int n) {
+#pragma HLS INLINE
+  const int first = idx * PACKED_WORDS;
+  const int last = (idx + n) * PACKED_WORDS;
+  // Lanes read but not yet unpacked, at most a word less one plus a beat
+  uint64_t lanes[PACKED_WORDS + BEAT_WORDS];
+#pragma HLS ARRAY_PARTITION variable=lanes complete
+  int fill = 0;
+  int i = 0;
+  for (int b = first / BEAT_WORDS; b * BEAT_WORDS < last; ++b) {
+#pragma HLS pipeline
+    const cpfp256 beat = src[b];
+    for (int j = 0; j < BEAT_WORDS; ++j) {
+#pragma HLS UNROLL
+      const int lane = b * BEAT_WORDS + j;
+      if (lane >= first && lane < last)
+        lanes[fill++] = beat.w[j];
+    }
+    for (int k = 0; k < (BEAT_WORDS + PACKED_WORDS - 1) / PACKED_WORDS; ++k) {
+#pragma HLS UNROLL
+      if (fill >= PACKED_WORDS) {
+        cpfp16p word;
+        for (int j = 0; j < PACKED_WORDS; ++j)
+          word.w[j] = lanes[j];
+        dst[i++] = unpack16(word);
+        fill -= PACKED_WORDS;
+        for (int j = 0; j < BEAT_WORDS; ++j)
+          lanes[j] = lanes[j + PACKED_WORDS];
+      }
+    }
+  }
+}
+
+inline void port_write(cpfp16 *dst, int idx, const cpfp16 *src, int n) {
+#pragma HLS INLINE
+  memcpy(dst + idx, src, sizeof(cpfp16) * n);
+}
+
+/* The beats at either end of the run can hold words of neighbouring runs,
+ * those are read back and written with their other lanes unchanged */
+
+inline void port_write(cpfp256 *dst, int idx, const cpfp16 *src, int n) {
+#pragma HLS INLINE
+  const int first = idx * PACKED_WORDS;
+  const int last = (idx + n) * PACKED_WORDS;
+  // Lanes packed but not yet written, the ones before first are placeholders
+  uint64_t lanes[PACKED_WORDS + BEAT_WORDS];
+#pragma HLS ARRAY_PARTITION variable=lanes complete
+  int fill = first % BEAT_WORDS;
+  int i = 0;
+  for (int b = first / BEAT_WORDS; b * BEAT_WORDS < last; ++b) {
+#pragma HLS pipeline
+    for (int k = 0; k < (BEAT_WORDS + PACKED_WORDS - 1) / PACKED_WORDS; ++k) {
+#pragma HLS UNROLL
+      if (fill < BEAT_WORDS && i < n) {
+        const cpfp16p word = pack16(src[i++]);
+        for (int j = 0; j < PACKED_WORDS; ++j)
+          lanes[fill + j] = word.w[j];
+        fill += PACKED_WORDS;
+      }
+    }
+    cpfp256 beat;
+    if (b * BEAT_WORDS < first || (b + 1) * BEAT_WORDS > last)
+      beat = dst[b];
+    for (int j = 0; j < BEAT_WORDS; ++j) {
+#pragma HLS UNROLL
+      const int lane = b * BEAT_WORDS + j;
+      if (lane >= first && lane < last)
+        beat.w[j] = lanes[j];
+    }
+    dst[b] = beat;
+    fill -= BEAT_WORDS;
+    for (int j = 0; j < PACKED_WORDS - 1; ++j)
+      lanes[j] = lanes[j + BEAT_WORDS];
+  }
+}
+
 #endif // VECTOR_TYPES_HPP
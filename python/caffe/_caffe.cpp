@@ -51,6 +51,7 @@ const int NPY_DTYPE = NPY_FLOAT32;
 void set_mode_cpu() { Caffe::set_mode(Caffe::CPU); }
 void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
 void set_mode_ocl() { Caffe::set_mode(Caffe::OCL); }
+void set_mode_ocl_native() { Caffe::set_mode(Caffe::OCL_NATIVE); }
 
 void InitLog() {
   ::google::InitGoogleLogging("");
@@ -394,8 +395,10 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::def("set_mode_cpu", &set_mode_cpu);
   bp::def("set_mode_gpu", &set_mode_gpu);
   bp::def("set_mode_ocl", &set_mode_ocl);
+  bp::def("set_mode_ocl_native", &set_mode_ocl_native);
   bp::def("set_random_seed", &set_random_seed);
   bp::def("set_device", &Caffe::SetDevice);
+  bp::def("set_ocl_device", &Caffe::SetOCLDevice);
   bp::def("solver_count", &Caffe::solver_count);
   bp::def("set_solver_count", &Caffe::set_solver_count);
   bp::def("solver_rank", &Caffe::solver_rank);
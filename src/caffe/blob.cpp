@@ -1,4 +1,5 @@
 #include <climits>
+#include <cmath>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -39,8 +40,22 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
   }
   if (count_ > capacity_) {
     capacity_ = count_;
-    data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
-    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_.reset(new SyncedMemory(capacity_ * value_size()));
+    diff_.reset(new SyncedMemory(capacity_ * value_size()));
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_cpfp(bool cpfp) {
+  if (cpfp == cpfp_) {
+    return;
+  }
+  cpfp_ = cpfp;
+  capacity_ = 0;
+  data_.reset();
+  diff_.reset();
+  if (!shape_.empty()) {
+    Reshape(shape_);
   }
 }
 
@@ -63,14 +78,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), cpfp_(false), cpfp_data_exp_(0), cpfp_diff_exp_(0) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), cpfp_(false), cpfp_data_exp_(0), cpfp_diff_exp_(0) {
   Reshape(shape);
 }
 
@@ -83,20 +98,23 @@ const int* Blob<Dtype>::gpu_shape() const {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)data_->cpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data(size_t size) const {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)data_->cpu_data(size);
 }
 
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   // Make sure CPU and GPU sizes remain equal
-  size_t size = count_ * sizeof(Dtype);
+  size_t size = count_ * value_size();
   if (data_->size() != size) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
@@ -104,29 +122,83 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
   data_->set_cpu_data(data);
 }
 
+template <typename Dtype>
+const cpfp* Blob<Dtype>::cpu_cpfp_data() const {
+  CHECK(data_);
+  return (const cpfp*)data_->cpu_data(sizeof(cpfp) * count_);
+}
+
+template <typename Dtype>
+const cpfp* Blob<Dtype>::ocl_cpfp_data() const {
+  CHECK(data_);
+  return (const cpfp*)data_->ocl_data(sizeof(cpfp) * count_);
+}
+
+template <typename Dtype>
+const cpfp* Blob<Dtype>::cpu_cpfp_diff() const {
+  CHECK(diff_);
+  return (const cpfp*)diff_->cpu_data(sizeof(cpfp) * count_);
+}
+
+template <typename Dtype>
+const cpfp* Blob<Dtype>::ocl_cpfp_diff() const {
+  CHECK(diff_);
+  return (const cpfp*)diff_->ocl_data(sizeof(cpfp) * count_);
+}
+
+template <typename Dtype>
+cpfp* Blob<Dtype>::mutable_cpu_cpfp_data() {
+  CHECK(data_);
+  return static_cast<cpfp*>(data_->mutable_cpu_data(sizeof(cpfp) * count_));
+}
+
+template <typename Dtype>
+cpfp* Blob<Dtype>::mutable_ocl_cpfp_data(int RW) {
+  CHECK(data_);
+  return static_cast<cpfp*>(
+      data_->mutable_ocl_data(RW, sizeof(cpfp) * count_));
+}
+
+template <typename Dtype>
+cpfp* Blob<Dtype>::mutable_cpu_cpfp_diff() {
+  CHECK(diff_);
+  return static_cast<cpfp*>(diff_->mutable_cpu_data(sizeof(cpfp) * count_));
+}
+
+template <typename Dtype>
+cpfp* Blob<Dtype>::mutable_ocl_cpfp_diff(int RW) {
+  CHECK(diff_);
+  return static_cast<cpfp*>(
+      diff_->mutable_ocl_data(RW, sizeof(cpfp) * count_));
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)data_->gpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::ocl_data() const {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)data_->ocl_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::ocl_data(size_t size) const {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)data_->ocl_data(size);
 }
 
 template <typename Dtype>
 void Blob<Dtype>::set_gpu_data(Dtype* data) {
   CHECK(data);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   // Make sure CPU and GPU sizes remain equal
-  size_t size = count_ * sizeof(Dtype);
+  size_t size = count_ * value_size();
   if (data_->size() != size) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
@@ -137,117 +209,151 @@ void Blob<Dtype>::set_gpu_data(Dtype* data) {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)diff_->cpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff(size_t size) const {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)diff_->cpu_data(size);
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_diff() const {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)diff_->gpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::ocl_diff() const {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)diff_->ocl_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::ocl_diff(size_t size) const {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return (const Dtype*)diff_->ocl_data(size);
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(data_->mutable_cpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data(size_t size) {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(data_->mutable_cpu_data(size));
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(data_->mutable_gpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_data() {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(data_->mutable_ocl_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_data(int RW) {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(data_->mutable_ocl_data(RW));
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_data(int RW, size_t size) {
   CHECK(data_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(data_->mutable_ocl_data(RW, size));
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff() {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(diff_->mutable_cpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff(size_t size) {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(diff_->mutable_cpu_data(size));
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_diff() {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(diff_->mutable_gpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_diff() {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(diff_->mutable_ocl_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_diff(int RW) {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(diff_->mutable_ocl_data(RW));
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_diff(int RW, size_t size) {
   CHECK(diff_);
+  CHECK(!cpfp_) << "Use the cpfp accessors of cpfp blobs";
   return static_cast<Dtype*>(diff_->mutable_ocl_data(RW, size));
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  set_cpfp(other.is_cpfp());
+  cpfp_data_exp_ = other.cpfp_data_exp();
   data_ = other.data();
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK_EQ(cpfp_, other.is_cpfp());
+  cpfp_diff_exp_ = other.cpfp_diff_exp();
   diff_ = other.diff();
 }
 
+// Sums float(x[i]) * 2^exp, or its absolute value or square, for the
+// statistics of cpfp blobs.
+enum CpfpSumKind { kCpfpAbs, kCpfpSquare };
+
+static float cpfp_sum(int n, const cpfp* x, int exp, CpfpSumKind kind) {
+  float sum = 0;
+  for (int i = 0; i < n; ++i) {
+    const float value = float(x[i]);
+    sum += (kind == kCpfpAbs) ? std::fabs(value) : value * value;
+  }
+  return std::ldexp(sum, (kind == kCpfpAbs) ? exp : 2 * exp);
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -258,6 +364,7 @@ template <> void Blob<cpfp>::Update() { NOT_IMPLEMENTED; }
 
 template <typename Dtype>
 void Blob<Dtype>::Update() {
+  CHECK(!cpfp_) << "Cannot update cpfp values";
   // We will perform update based on where the data is located.
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
@@ -305,6 +412,11 @@ template <> char Blob<char>::asum_data() const {
 template <typename Dtype>
 Dtype Blob<Dtype>::asum_data() const {
   if (!data_) { return 0; }
+  if (cpfp_) {
+    return data_->head() == SyncedMemory::UNINITIALIZED ? 0 :
+        cpfp_sum(count_, cpu_cpfp_data(), cpfp_data_exp_,
+            kCpfpAbs);
+  }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_data());
@@ -350,6 +462,11 @@ template <> char Blob<char>::asum_diff() const {
 template <typename Dtype>
 Dtype Blob<Dtype>::asum_diff() const {
   if (!diff_) { return 0; }
+  if (cpfp_) {
+    return diff_->head() == SyncedMemory::UNINITIALIZED ? 0 :
+        cpfp_sum(count_, cpu_cpfp_diff(), cpfp_diff_exp_,
+            kCpfpAbs);
+  }
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_diff());
@@ -397,6 +514,11 @@ Dtype Blob<Dtype>::sumsq_data() const {
   Dtype sumsq;
   const Dtype* data;
   if (!data_) { return 0; }
+  if (cpfp_) {
+    return data_->head() == SyncedMemory::UNINITIALIZED ? 0 :
+        cpfp_sum(count_, cpu_cpfp_data(), cpfp_data_exp_,
+            kCpfpSquare);
+  }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = cpu_data();
@@ -444,6 +566,11 @@ Dtype Blob<Dtype>::sumsq_diff() const {
   Dtype sumsq;
   const Dtype* diff;
   if (!diff_) { return 0; }
+  if (cpfp_) {
+    return diff_->head() == SyncedMemory::UNINITIALIZED ? 0 :
+        cpfp_sum(count_, cpu_cpfp_diff(), cpfp_diff_exp_,
+            kCpfpSquare);
+  }
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     diff = cpu_diff();
@@ -486,6 +613,7 @@ template <typename Dtype>
 void Blob<Dtype>::scale_data(Dtype scale_factor) {
   Dtype* data;
   if (!data_) { return; }
+  CHECK(!cpfp_) << "Cannot scale cpfp values";
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = mutable_cpu_data();
@@ -527,6 +655,7 @@ template <typename Dtype>
 void Blob<Dtype>::scale_diff(Dtype scale_factor) {
   Dtype* diff;
   if (!diff_) { return; }
+  CHECK(!cpfp_) << "Cannot scale cpfp values";
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     diff = mutable_cpu_diff();
@@ -580,6 +709,17 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
       LOG(FATAL) << "Trying to copy blobs of different sizes.";
     }
   }
+  CHECK_EQ(cpfp_, source.is_cpfp());
+  if (cpfp_) {
+    if (copy_diff) {
+      caffe_copy(count_, source.cpu_cpfp_diff(), mutable_cpu_cpfp_diff());
+      cpfp_diff_exp_ = source.cpfp_diff_exp();
+    } else {
+      caffe_copy(count_, source.cpu_cpfp_data(), mutable_cpu_cpfp_data());
+      cpfp_data_exp_ = source.cpfp_data_exp();
+    }
+    return;
+  }
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
@@ -590,6 +730,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
           static_cast<Dtype*>(data_->mutable_gpu_data()));
     }
     break;
+  case Caffe::OCL_NATIVE:
   case Caffe::OCL:
   case Caffe::CPU:
     if (copy_diff) {
@@ -628,6 +769,10 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   } else {
     CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
   }
+  if (cpfp_) {
+    CpfpFromProto(proto);
+    return;
+  }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
   if (proto.double_data_size() > 0) {
@@ -656,6 +801,37 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
 }
 
+template <typename Dtype>
+void Blob<Dtype>::CpfpFromProto(const BlobProto& proto) {
+  cpfp_data_exp_ = 0;
+  cpfp_diff_exp_ = 0;
+  cpfp* data_vec = mutable_cpu_cpfp_data();
+  if (proto.double_data_size() > 0) {
+    CHECK_EQ(count_, proto.double_data_size());
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = cpfp(static_cast<float>(proto.double_data(i)));
+    }
+  } else {
+    CHECK_EQ(count_, proto.data_size());
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = cpfp(proto.data(i));
+    }
+  }
+  if (proto.double_diff_size() > 0) {
+    CHECK_EQ(count_, proto.double_diff_size());
+    cpfp* diff_vec = mutable_cpu_cpfp_diff();
+    for (int i = 0; i < count_; ++i) {
+      diff_vec[i] = cpfp(static_cast<float>(proto.double_diff(i)));
+    }
+  } else if (proto.diff_size() > 0) {
+    CHECK_EQ(count_, proto.diff_size());
+    cpfp* diff_vec = mutable_cpu_cpfp_diff();
+    for (int i = 0; i < count_; ++i) {
+      diff_vec[i] = cpfp(proto.diff(i));
+    }
+  }
+}
+
 template <>
 void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   proto->clear_shape();
@@ -664,6 +840,19 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
+  if (cpfp_) {
+    const cpfp* data_vec = cpu_cpfp_data();
+    for (int i = 0; i < count_; ++i) {
+      proto->add_double_data(std::ldexp(float(data_vec[i]), cpfp_data_exp_));
+    }
+    if (write_diff) {
+      const cpfp* diff_vec = cpu_cpfp_diff();
+      for (int i = 0; i < count_; ++i) {
+        proto->add_double_diff(std::ldexp(float(diff_vec[i]), cpfp_diff_exp_));
+      }
+    }
+    return;
+  }
   const double* data_vec = cpu_data();
   for (int i = 0; i < count_; ++i) {
     proto->add_double_data(data_vec[i]);
@@ -684,6 +873,19 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
+  if (cpfp_) {
+    const cpfp* data_vec = cpu_cpfp_data();
+    for (int i = 0; i < count_; ++i) {
+      proto->add_data(std::ldexp(float(data_vec[i]), cpfp_data_exp_));
+    }
+    if (write_diff) {
+      const cpfp* diff_vec = cpu_cpfp_diff();
+      for (int i = 0; i < count_; ++i) {
+        proto->add_diff(std::ldexp(float(diff_vec[i]), cpfp_diff_exp_));
+      }
+    }
+    return;
+  }
   const float* data_vec = cpu_data();
   for (int i = 0; i < count_; ++i) {
     proto->add_data(data_vec[i]);
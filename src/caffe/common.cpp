@@ -14,9 +14,9 @@ namespace caffe {
 #ifdef USE_OCL
   cl_uint oclNumPlatforms;
   std::vector<cl_platform_id> oclPlatform;
-  cl_device_id oclDevices;
-  cl_context oclContext;
-  cl_command_queue oclCommandQueue;
+  thread_local cl_device_id oclDevices = NULL;
+  thread_local cl_context oclContext = NULL;
+  thread_local cl_command_queue oclCommandQueue = NULL;
 #endif
 
 // Make sure each thread can have different values.
@@ -88,35 +88,105 @@ int convertToString(const std::string filename, char **str) {
 
 #ifdef USE_OCL
 
-void Caffe::SetOCLDevice() {
+namespace {
+
+struct OCLDeviceState {
+  cl_device_id device;
+  cl_context context;
+  cl_command_queue queue;
+};
+
+boost::mutex ocl_devices_mutex_;
+// The accelerators of the platform, with contexts for the ones in use
+vector<OCLDeviceState> ocl_devices_;
+
+// Lists the accelerators once, callers hold ocl_devices_mutex_.
+void InitOCLPlatform() {
+  if (!oclPlatform.empty()) {
+    return;
+  }
   cl_int status;
-  oclPlatform.resize(1);
   status = clGetPlatformIDs(0, NULL, &oclNumPlatforms);
   if (status) {
-    LOG(FATAL) << "clGetPlatformIDs Error: " << status;    
+    LOG(FATAL) << "clGetPlatformIDs Error: " << status;
   }
+  oclPlatform.resize(1);
   status = clGetPlatformIDs(1, &(oclPlatform[0]), NULL);
   if (status) {
-    LOG(FATAL) << "clGetPlatformIDs Error: " << status;    
+    LOG(FATAL) << "clGetPlatformIDs Error: " << status;
   }
-  status = clGetDeviceIDs(oclPlatform[0], CL_DEVICE_TYPE_ACCELERATOR, 1,
-      &oclDevices, NULL);
+  cl_uint num_devices = 0;
+  status = clGetDeviceIDs(oclPlatform[0], CL_DEVICE_TYPE_ACCELERATOR, 0,
+      NULL, &num_devices);
   if (status) {
-    LOG(FATAL) << "clGetDeviceIDs Error: " << status;    
+    LOG(FATAL) << "clGetDeviceIDs Error: " << status;
   }
-  oclContext = clCreateContext(NULL, 1, &oclDevices, NULL, NULL, &status);
+  vector<cl_device_id> devices(num_devices);
+  status = clGetDeviceIDs(oclPlatform[0], CL_DEVICE_TYPE_ACCELERATOR,
+      num_devices, devices.data(), NULL);
   if (status) {
-    LOG(FATAL) << "clCreateContext Error: " << status;    
+    LOG(FATAL) << "clGetDeviceIDs Error: " << status;
   }
-  oclCommandQueue = clCreateCommandQueue(oclContext, oclDevices, 0, &status);
-  if (status) {
-    LOG(FATAL) << "clCreateCommandQueue Error: " << status;    
+  ocl_devices_.resize(num_devices);
+  for (int i = 0; i < num_devices; ++i) {
+    ocl_devices_[i].device = devices[i];
+    ocl_devices_[i].context = NULL;
+    ocl_devices_[i].queue = NULL;
+  }
+}
+
+}  // namespace
+
+void Caffe::SetOCLDevice(const int device_id) {
+  boost::mutex::scoped_lock lock(ocl_devices_mutex_);
+  InitOCLPlatform();
+  CHECK_GE(device_id, 0);
+  CHECK_LT(device_id, ocl_devices_.size()) << "No OCL accelerator "
+      << device_id << ", the platform has " << ocl_devices_.size();
+  OCLDeviceState& state = ocl_devices_[device_id];
+  if (!state.context) {
+    cl_int status;
+    state.context = clCreateContext(NULL, 1, &state.device, NULL, NULL,
+        &status);
+    if (status) {
+      LOG(FATAL) << "clCreateContext Error: " << status;
+    }
+    state.queue = clCreateCommandQueue(state.context, state.device, 0,
+        &status);
+    if (status) {
+      LOG(FATAL) << "clCreateCommandQueue Error: " << status;
+    }
+  }
+  oclDevices = state.device;
+  oclContext = state.context;
+  oclCommandQueue = state.queue;
+  Get().ocl_device_ = device_id;
+}
+
+int Caffe::OCLDeviceCount() {
+  boost::mutex::scoped_lock lock(ocl_devices_mutex_);
+  InitOCLPlatform();
+  return ocl_devices_.size();
+}
+
+void Caffe::SynchronizeOCL() {
+  if (mode() == OCL) {
+    clFinish(oclCommandQueue);
   }
 }
 
 #else
 
-void Caffe::SetOCLDevice(void) {
+void Caffe::SetOCLDevice(const int device_id) {
+  NO_OCL;
+}
+
+int Caffe::OCLDeviceCount() {
+  NO_OCL;
+  return 0;
+}
+
+void Caffe::SynchronizeOCL() {
   NO_OCL;
 }
 
@@ -127,7 +197,8 @@ void Caffe::SetOCLDevice(void) {
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), solver_rank_(0), multiprocess_(false) { }
+      solver_count_(1), solver_rank_(0), multiprocess_(false),
+      ocl_async_(false), ocl_device_(-1) { }
 
 Caffe::~Caffe() { }
 
@@ -181,7 +252,8 @@ void* Caffe::RNG::generator() {
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
     mode_(Caffe::CPU),
-    solver_count_(1), solver_rank_(0), multiprocess_(false) {
+    solver_count_(1), solver_rank_(0), multiprocess_(false),
+    ocl_async_(false), ocl_device_(-1) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
@@ -0,0 +1,158 @@
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "caffe/host_sync.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/solver_factory.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Sets the OCL device of the calling thread in Caffe::OCL mode, workers
+// started afterwards inherit it.
+static void SelectDevice(int device) {
+#ifdef USE_OCL
+  if (Caffe::mode() == Caffe::OCL) {
+    Caffe::SetOCLDevice(device);
+  }
+#endif
+}
+
+template <typename Dtype>
+HostSync<Dtype>::HostSync(shared_ptr<Solver<Dtype> > root_solver)
+  : solver_(root_solver), barrier_(), syncs_() {
+}
+
+template <typename Dtype>
+void HostSync<Dtype>::Broadcast() {
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  const int rank = Caffe::solver_rank();
+  if (rank == 0) {
+    // Only the owning thread may move a blob off its device
+    data_.resize(params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      data_[i] = params[i]->cpu_data();
+    }
+  }
+  barrier_->wait();
+  if (rank != 0) {
+    const HostSync<Dtype>* root = (*syncs_)[0];
+    for (int i = 0; i < params.size(); ++i) {
+      caffe_copy(params[i]->count(), root->data_[i],
+          params[i]->mutable_cpu_data());
+    }
+  }
+  barrier_->wait();
+}
+
+template <typename Dtype>
+void HostSync<Dtype>::on_gradients_ready() {
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  diff_.resize(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    diff_[i] = params[i]->mutable_cpu_diff();
+  }
+  barrier_->wait();
+  // Every solver averages its slice of each blob and writes it back to all
+  // the others.
+  const vector<HostSync<Dtype>*>& syncs = *syncs_;
+  const int size = syncs.size();
+  const int rank = Caffe::solver_rank();
+  const Dtype scale = Dtype(1) / size;
+  for (int i = 0; i < params.size(); ++i) {
+    const int count = params[i]->count();
+    const int begin = static_cast<int64_t>(count) * rank / size;
+    const int end = static_cast<int64_t>(count) * (rank + 1) / size;
+    if (begin == end) {
+      continue;
+    }
+    Dtype* sum = diff_[i] + begin;
+    for (int r = 0; r < size; ++r) {
+      if (r != rank) {
+        caffe_axpy(end - begin, Dtype(1), syncs[r]->diff_[i] + begin, sum);
+      }
+    }
+    caffe_scal(end - begin, scale, sum);
+    for (int r = 0; r < size; ++r) {
+      if (r != rank) {
+        caffe_copy(end - begin, sum, syncs[r]->diff_[i] + begin);
+      }
+    }
+  }
+  barrier_->wait();
+}
+
+template <typename Dtype>
+class HostSyncWorker : public InternalThread {
+ public:
+  HostSyncWorker(shared_ptr<Solver<Dtype> > rank0, int device,
+      boost::barrier* barrier, vector<HostSync<Dtype>*>* syncs,
+      const char* restore)
+    : rank0_(rank0), device_(device), barrier_(barrier), syncs_(syncs),
+      restore_(restore) {
+  }
+  virtual ~HostSyncWorker() {}
+
+ protected:
+  void InternalThreadEntry() {
+    SolverParameter param(rank0_->param());
+    param.set_device_id(device_);
+    param.set_type(rank0_->type());
+    shared_ptr<Solver<Dtype> > s(SolverRegistry<Dtype>::CreateSolver(param));
+    CHECK_EQ(s->type(), rank0_->type());
+    if (restore_) {
+      s->Restore(restore_);
+    }
+    HostSync<Dtype> sync(s);
+    sync.barrier_ = barrier_;
+    sync.syncs_ = syncs_;
+    s->add_callback(&sync);
+    (*syncs_)[Caffe::solver_rank()] = &sync;
+    // Wait for the other solvers
+    barrier_->wait();
+    sync.Broadcast();
+    s->Step(param.max_iter() - s->iter());
+    barrier_->wait();
+  }
+
+  shared_ptr<Solver<Dtype> > rank0_;
+  int device_;
+  boost::barrier* barrier_;
+  vector<HostSync<Dtype>*>* syncs_;
+  const char* restore_;
+};
+
+template <typename Dtype>
+void HostSync<Dtype>::Run(const vector<int>& devices, const char* restore) {
+  CHECK_EQ(Caffe::solver_count(), devices.size());
+  boost::barrier barrier(static_cast<int>(devices.size()));
+  vector<HostSync<Dtype>*> syncs(devices.size());
+  vector<shared_ptr<HostSyncWorker<Dtype> > > workers(devices.size());
+  for (int i = 1; i < devices.size(); ++i) {
+    SelectDevice(devices[i]);
+    Caffe::set_solver_rank(i);
+    HostSyncWorker<Dtype>* w = new HostSyncWorker<Dtype>(solver_, devices[i],
+        &barrier, &syncs, restore);
+    w->StartInternalThread();
+    workers[i].reset(w);
+  }
+  SelectDevice(devices[0]);
+  Caffe::set_solver_rank(0);
+  barrier_ = &barrier;
+  syncs_ = &syncs;
+  syncs[0] = this;
+  solver_->add_callback(this);
+  // Wait for the workers to build their solvers
+  barrier.wait();
+  Broadcast();
+  solver_->Solve();
+  barrier.wait();
+  for (int i = 1; i < devices.size(); ++i) {
+    workers[i]->StopInternalThread();
+  }
+}
+
+INSTANTIATE_CLASS(HostSync);
+
+}  // namespace caffe
@@ -30,20 +30,30 @@ void InternalThread::StartInternalThread() {
   int solver_count = Caffe::solver_count();
   int solver_rank = Caffe::solver_rank();
   bool multiprocess = Caffe::multiprocess();
+  int ocl_device = Caffe::ocl_device();
+  bool ocl_async = Caffe::ocl_async();
 
   try {
     thread_.reset(new boost::thread(&InternalThread::entry, this, device, mode,
-          rand_seed, solver_count, solver_rank, multiprocess));
+          rand_seed, solver_count, solver_rank, multiprocess, ocl_device,
+          ocl_async));
   } catch (std::exception& e) {
     LOG(FATAL) << "Thread exception: " << e.what();
   }
 }
 
 void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
-    int solver_count, int solver_rank, bool multiprocess) {
+    int solver_count, int solver_rank, bool multiprocess, int ocl_device,
+    bool ocl_async) {
 #ifndef CPU_ONLY
   CUDA_CHECK(cudaSetDevice(device));
 #endif
+#ifdef USE_OCL
+  if (ocl_device >= 0) {
+    Caffe::SetOCLDevice(ocl_device);
+  }
+#endif
+  Caffe::set_ocl_async(ocl_async);
   Caffe::set_mode(mode);
   Caffe::set_random_seed(rand_seed);
   Caffe::set_solver_count(solver_count);
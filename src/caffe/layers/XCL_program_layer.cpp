@@ -11,31 +11,18 @@ namespace caffe {
 template <typename Dtype>
 void XCLProgramLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  program_ = true; 
+  OCLKernelRegistry::Select(this->layer_param_.xcl_param());
 }
 
 template <typename Dtype>
 void XCLProgramLayer<Dtype>::Forward_ocl(const vector <Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  XCLParameter xcl_param = this->layer_param_.xcl_param();
-  if (program_) {
-    cl_int error;
-
-    string path(".build_release/opencl/src/caffe/layers/");
-
-    char *sourceStr;
-    size_t sourceSize = caffe::convertToString(path + xcl_param.xcl_name(),
-        &sourceStr);
-
-    this->ocl_layer_program = clCreateProgramWithBinary(oclContext, 1,
-        &oclDevices, &sourceSize, (const unsigned char **)&sourceStr, NULL,
-        &error);
-
-    delete[] sourceStr;
-    this->ocl_kernel = clCreateKernel(this->ocl_layer_program,
-        xcl_param.kernel_name().c_str(), &error);
-    if (xcl_param.once())
-      program_ = false;
+  // Layers set up after this one hold their own handle to the kernel, the
+  // forward pass only makes sure the program is loaded before they run.
+  if (Caffe::mode() == Caffe::OCL_NATIVE) {
+    this->GetNativeKernel();
+  } else {
+    this->GetOCLKernel();
   }
 }
 
@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -8,6 +9,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/hwcn_transpose.hpp"
 
 namespace caffe {
 
@@ -37,7 +39,11 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
       prefetch_(param.data_param().prefetch()),
-      prefetch_free_(), prefetch_full_(), prefetch_current_() {
+      prefetch_free_(), prefetch_full_(), prefetch_current_(),
+      prefetch_hwcn_(param.data_param().has_prefetch_hwcn()),
+      prefetch_cpfp_(param.data_param().prefetch_hwcn().cpfp()) {
+  CHECK(param.data_param().prefetch_hwcn().convert_to())
+      << "prefetch_hwcn only converts to HWCN";
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new Batch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
@@ -48,6 +54,12 @@ template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
+  if (prefetch_hwcn_) {
+    CHECK(Caffe::mode() != Caffe::GPU)
+        << "prefetch_hwcn is only supported in CPU and OCL modes";
+    top[0]->set_cpfp(prefetch_cpfp_);
+    top[0]->Reshape(hwcn_shape(top[0]->shape()));
+  }
 
   // Before starting the prefetch thread, we make cpu_data and gpu_data
   // calls so that the prefetch thread does not accidentally make simultaneous
@@ -55,6 +67,15 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // seems to cause failures if we do not so.
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i]->data_.mutable_cpu_data();
+    if (prefetch_hwcn_) {
+      prefetch_[i]->hwcn_data_.set_cpfp(prefetch_cpfp_);
+      prefetch_[i]->hwcn_data_.Reshape(top[0]->shape());
+      if (prefetch_cpfp_) {
+        prefetch_[i]->hwcn_data_.mutable_cpu_cpfp_data();
+      } else {
+        prefetch_[i]->hwcn_data_.mutable_cpu_data();
+      }
+    }
     if (this->output_labels_) {
       prefetch_[i]->label_.mutable_cpu_data();
     }
@@ -83,11 +104,29 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
     CUDA_CHECK(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
   }
 #endif
+#ifdef USE_OCL
+  // A queue of its own lets the writes run while the net's kernels execute
+  cl_command_queue queue = NULL;
+  if (prefetch_hwcn_ && Caffe::mode() == Caffe::OCL) {
+    cl_int error;
+    queue = clCreateCommandQueue(oclContext, oclDevices, 0, &error);
+    CHECK_EQ(error, CL_SUCCESS) << "Could not create the transfer queue";
+  }
+#endif
 
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
       load_batch(batch);
+      if (prefetch_hwcn_) {
+        convert_batch(batch);
+#ifdef USE_OCL
+        if (queue) {
+          batch->hwcn_data_.data()->async_ocl_push(queue,
+              batch->hwcn_data_.count() * batch->hwcn_data_.value_size());
+        }
+#endif
+      }
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
@@ -107,6 +146,39 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
     CUDA_CHECK(cudaStreamDestroy(stream));
   }
 #endif
+#ifdef USE_OCL
+  if (queue) {
+    clFinish(queue);
+    clReleaseCommandQueue(queue);
+  }
+#endif
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::convert_batch(Batch<Dtype>* batch) {
+  const vector<int>& shape = batch->data_.shape();
+  const int num = shape[0];
+  const int channels = shape[1];
+  const int spatial_dim = batch->data_.count(2);
+  batch->hwcn_data_.Reshape(hwcn_shape(shape));
+  const Dtype* data = batch->data_.cpu_data();
+  if (prefetch_cpfp_) {
+    cpfp* hwcn_data = batch->hwcn_data_.mutable_cpu_cpfp_data();
+    nchw_to_hwcn(num, channels, spatial_dim, data, hwcn_data);
+  } else {
+    nchw_to_hwcn(num, channels, spatial_dim, data,
+        batch->hwcn_data_.mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+vector<int> BasePrefetchingDataLayer<Dtype>::hwcn_shape(
+    const vector<int>& shape) {
+  vector<int> hwcn(shape.rbegin(), shape.rend());
+  if (hwcn.size() == 4) {
+    std::swap(hwcn[0], hwcn[1]);
+  }
+  return hwcn;
 }
 
 template <typename Dtype>
@@ -116,9 +188,16 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     prefetch_free_.push(prefetch_current_);
   }
   prefetch_current_ = prefetch_full_.pop("Waiting for data");
-  // Reshape to loaded data.
-  top[0]->ReshapeLike(prefetch_current_->data_);
-  top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
+  if (prefetch_hwcn_) {
+    // Sharing the memory keeps the device copy started by the prefetch
+    // thread, the next OCL layer reads it without another transfer.
+    top[0]->ReshapeLike(prefetch_current_->hwcn_data_);
+    top[0]->ShareData(prefetch_current_->hwcn_data_);
+  } else {
+    // Reshape to loaded data.
+    top[0]->ReshapeLike(prefetch_current_->data_);
+    top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
+  }
   if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(prefetch_current_->label_);
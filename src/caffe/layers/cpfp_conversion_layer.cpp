@@ -2,6 +2,8 @@
 #include <vector>
 
 #include "caffe/layers/cpfp_conversion_layer.hpp"
+#include "caffe/util/cpfp_math.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -12,6 +14,9 @@ void CPFPConversionLayer<Dtype>::LayerSetUp(
     this->layer_param_.cpfp_conversion_param();
 
   convert_to_ = cpfp_param.convert_to(); 
+  scale_ = cpfp_param.scale();
+  data_exp_.resize(bottom.size());
+  diff_exp_.resize(bottom.size());
 }
 
 template <typename Dtype>
@@ -20,6 +25,7 @@ void CPFPConversionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   bottom_shape_ = bottom[0]->shape();
 
   for (int top_id = 0; top_id < top.size(); ++top_id) {
+    top[top_id]->set_cpfp(convert_to_);
     top[top_id]->Reshape(bottom[0]->shape());
   }
 } 
@@ -30,21 +36,20 @@ void CPFPConversionLayer<Dtype>::Forward_cpu(
   for (int i = 0; i < bottom.size(); ++i) {
     const int count = bottom[i]->count();
     if (convert_to_) {
-      int outsize = sizeof(cpfp) * count;
       const Dtype *bottom_data = bottom[i]->cpu_data();
-      cpfp *top_data =
-        reinterpret_cast<cpfp *>(top[i]->mutable_cpu_data(outsize));
-      for (int j = 0; j < count; ++j) {
-        top_data[j] = cpfp((float)bottom_data[j]);
+      cpfp *top_data = top[i]->mutable_cpu_cpfp_data();
+      int exp = 0;
+      if (scale_) {
+        data_exp_[i].Update(caffe_cpu_amax(count, bottom_data));
+        exp = data_exp_[i].exp(0);
       }
+      cpfp_from_float(count, bottom_data, top_data, exp);
+      top[i]->set_cpfp_data_exp(exp);
     } else {
-      int insize = sizeof(cpfp) * count;
-      const cpfp *bottom_data =
-        reinterpret_cast<const cpfp *>(bottom[i]->cpu_data(insize));
+      const cpfp *bottom_data = bottom[i]->cpu_cpfp_data();
       Dtype *top_data = top[i]->mutable_cpu_data();
-      for (int j = 0; j < count; ++j) {
-        top_data[j] = (Dtype)(float(bottom_data[j]));
-      }
+      cpfp_to_float(count, bottom_data, top_data,
+          bottom[i]->cpfp_data_exp());
     }
   }
 }
@@ -57,21 +62,19 @@ void CPFPConversionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     for (int i = 0; i < bottom.size(); ++i) {  
       const int count = bottom[i]->count();
       if (convert_to_) {
-        int outsize = sizeof(cpfp) * count;
         Dtype *bottom_diff = bottom[i]->mutable_cpu_diff();
-        const cpfp *top_diff =
-          reinterpret_cast<const cpfp *>(top[i]->cpu_diff(outsize));
-        for (int j = 0; j < count; ++j) {
-          bottom_diff[j] = (Dtype)(float(top_diff[j]));
-        }
+        const cpfp *top_diff = top[i]->cpu_cpfp_diff();
+        cpfp_to_float(count, top_diff, bottom_diff, top[i]->cpfp_diff_exp());
       } else {
-        int insize = sizeof(cpfp) * count;
-        cpfp *bottom_diff =
-          reinterpret_cast<cpfp *>(bottom[i]->mutable_cpu_diff(insize));
+        cpfp *bottom_diff = bottom[i]->mutable_cpu_cpfp_diff();
         const Dtype *top_diff = top[i]->cpu_diff();
-        for (int j = 0; j < count; ++j) {
-          bottom_diff[j] = cpfp((float)top_diff[j]);
+        int exp = 0;
+        if (scale_) {
+          diff_exp_[i].Update(caffe_cpu_amax(count, top_diff));
+          exp = diff_exp_[i].exp(0);
         }
+        cpfp_from_float(count, top_diff, bottom_diff, exp);
+        bottom[i]->set_cpfp_diff_exp(exp);
       }
     }
   }
@@ -2,6 +2,8 @@
 #include <vector>
 
 #include "caffe/layers/hwcn_layer.hpp"
+#include "caffe/util/hwcn_transpose.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -12,7 +14,25 @@ void HWCNLayer<Dtype>::LayerSetUp(
     this->layer_param_.hwcn_param();
 
   convert_to_ = hwcn_param.convert_to();
+  cpfp_ = hwcn_param.cpfp();
+  scale_ = cpfp_ && hwcn_param.scale();
+  data_exp_.resize(bottom.size());
+  diff_exp_.resize(bottom.size());
   bottom_shape_ = bottom[0]->shape();
+  // Sizes of the NCHW side; 2-D blobs are N x C with a single pixel.
+  vector<int> shape = bottom_shape_;
+  if (!convert_to_) {
+    std::reverse(shape.begin(), shape.end());
+    if (shape.size() == 4) {
+      std::swap(shape[2], shape[3]);
+    }
+  }
+  num_ = shape[0];
+  channels_ = shape[1];
+  spatial_dim_ = 1;
+  for (int i = 2; i < shape.size(); ++i) {
+    spatial_dim_ *= shape[i];
+  }
 }
 
 template <typename Dtype>
@@ -39,6 +59,7 @@ void HWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 
   for (int top_id = 0; top_id < top.size(); ++top_id) {
+    top[top_id]->set_cpfp(convert_to_ && cpfp_);
     top[top_id]->Reshape(top_shape);
   }
 } 
@@ -47,41 +68,27 @@ template <typename Dtype>
 void HWCNLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* top_data = top[i]->mutable_cpu_data();
-    std::vector<int> shape = bottom_shape_;
-    if (convert_to_) {
-      if (shape.size() == 2) {
-        shape.push_back(1);
-        shape.push_back(1);
-      }
-      for (int n = 0; n < shape[0]; ++n) {
-        for (int c = 0; c < shape[1]; ++c) {
-          for (int h = 0; h < shape[2]; ++h) {
-            for (int w = 0; w < shape[3]; ++w) {
-              int bot_idx = ((n * shape[1] + c) * shape[2] + h) * shape[3] + w;
-              int top_idx = ((h * shape[3] + w) * shape[1] + c) * shape[0] + n;
-              top_data[top_idx] = bottom_data[bot_idx];
-            }
-          }
-        }
+    if (convert_to_ && cpfp_) {
+      const Dtype* bottom_data = bottom[i]->cpu_data();
+      cpfp* top_data = top[i]->mutable_cpu_cpfp_data();
+      int exp = 0;
+      if (scale_) {
+        data_exp_[i].Update(caffe_cpu_amax(bottom[i]->count(), bottom_data));
+        exp = data_exp_[i].exp(0);
       }
+      nchw_to_hwcn(num_, channels_, spatial_dim_, bottom_data, top_data, exp);
+      top[i]->set_cpfp_data_exp(exp);
+    } else if (convert_to_) {
+      nchw_to_hwcn(num_, channels_, spatial_dim_, bottom[i]->cpu_data(),
+          top[i]->mutable_cpu_data());
+    } else if (cpfp_) {
+      const cpfp* bottom_data = bottom[i]->cpu_cpfp_data();
+      Dtype* top_data = top[i]->mutable_cpu_data();
+      hwcn_to_nchw(num_, channels_, spatial_dim_, bottom_data, top_data,
+          bottom[i]->cpfp_data_exp());
     } else {
-      if (shape.size() == 2) {
-        shape.insert(shape.begin(), 1);
-        shape.insert(shape.begin(), 1);
-      }
-      for (int n = 0; n < shape[3]; ++n) {
-        for (int c = 0; c < shape[2]; ++c) {
-          for (int h = 0; h < shape[0]; ++h) {
-            for (int w = 0; w < shape[1]; ++w) {
-              int bot_idx = ((h * shape[1] + w) * shape[2] + c) * shape[3] + n;
-              int top_idx = ((n * shape[2] + c) * shape[0] + h) * shape[1] + w;
-              top_data[top_idx] = bottom_data[bot_idx];
-            }
-          }
-        }
-      }     
+      hwcn_to_nchw(num_, channels_, spatial_dim_, bottom[i]->cpu_data(),
+          top[i]->mutable_cpu_data());
     }
   }
 }
@@ -90,48 +97,31 @@ template <typename Dtype>
 void HWCNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  if (propagate_down[0]) {
-    for (int i = 0; i < bottom.size(); ++i) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (convert_to_ && cpfp_) {
+      const cpfp* top_diff = top[i]->cpu_cpfp_diff();
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+      hwcn_to_nchw(num_, channels_, spatial_dim_, top_diff, bottom_diff,
+          top[i]->cpfp_diff_exp());
+    } else if (convert_to_) {
+      hwcn_to_nchw(num_, channels_, spatial_dim_, top[i]->cpu_diff(),
+          bottom[i]->mutable_cpu_diff());
+    } else if (cpfp_) {
       const Dtype* top_diff = top[i]->cpu_diff();
-      std::vector<int> shape = bottom_shape_;
-      if (convert_to_) {
-        if (shape.size() == 2) {
-          shape.push_back(1);
-          shape.push_back(1);
-        }
-        for (int n = 0; n < shape[0]; ++n) {
-          for (int c = 0; c < shape[1]; ++c) {
-            for (int h = 0; h < shape[2]; ++h) {
-              for (int w = 0; w < shape[3]; ++w) {
-                int bot_idx = ((n * shape[1] + c) * shape[2] + h) * shape[3]
-                  + w;
-                int top_idx = ((h * shape[3] + w) * shape[1] + c) * shape[0]
-                  + n;
-                bottom_diff[bot_idx] = top_diff[top_idx];
-              }
-            }
-          }
-        }
-      } else {
-        if (shape.size() == 2) {
-          shape.insert(shape.begin(), 1);
-          shape.insert(shape.begin(), 1);
-        }
-        for (int n = 0; n < shape[3]; ++n) {
-          for (int c = 0; c < shape[2]; ++c) {
-            for (int h = 0; h < shape[0]; ++h) {
-              for (int w = 0; w < shape[1]; ++w) {
-                int bot_idx = ((h * shape[1] + w) * shape[2] + c) * shape[3]
-                  + n;
-                int top_idx = ((n * shape[2] + c) * shape[0] + h) * shape[1]
-                  + w;
-                bottom_diff[bot_idx] = top_diff[top_idx];
-              }
-            }
-          }
-        }     
+      cpfp* bottom_diff = bottom[i]->mutable_cpu_cpfp_diff();
+      int exp = 0;
+      if (scale_) {
+        diff_exp_[i].Update(caffe_cpu_amax(top[i]->count(), top_diff));
+        exp = diff_exp_[i].exp(0);
       }
+      nchw_to_hwcn(num_, channels_, spatial_dim_, top_diff, bottom_diff, exp);
+      bottom[i]->set_cpfp_diff_exp(exp);
+    } else {
+      nchw_to_hwcn(num_, channels_, spatial_dim_, top[i]->cpu_diff(),
+          bottom[i]->mutable_cpu_diff());
     }
   }
 }
@@ -1,7 +1,10 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/ocl_cr_hwcn_layer.hpp"
+#include "caffe/ocl_tiling_tuner.hpp"
+#include "caffe/util/cpfp_math.hpp"
 
 namespace caffe {
 
@@ -10,6 +13,8 @@ namespace caffe {
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  CHECK(!this->xcl_param_.packed())
+      << "Only OCLHWCNInnerProduct layers run packed kernels";
   // Configure the kernel size, padding, stride, and inputs.
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   const int num_axes = bottom[0]->num_axes();
@@ -159,25 +164,42 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   CRParameter cr_param = this->layer_param_.cr_param();
   int num_ = bottom[0]->shape(3);
+  // The kernels take whole words of 16 images, other batch sizes are padded
+  // with zero images on the way in and stripped on the way out.
+  num_pad_ = (num_ + 15) / 16 * 16;
   num_cu_ = cr_param.num_cu();
   num_pe_ = cr_param.num_pe();
+  scale_ = cr_param.cpfp_scale();
+  // The exponents are tracked per layer, not per bottom
+  CHECK(!scale_ || bottom.size() == 1)
+      << "cpfp_scale needs a single bottom";
+  top_exp_.set_period(cr_param.cpfp_scale_period());
+  bottom_diff_exp_.set_period(cr_param.cpfp_scale_period());
+  weights_exp_ = 0;
+  weights_r_exp_ = 0;
+  bias_h_exp_ = 0;
   switch(num_pe_) {
-    case 4:   burstoc_limit_ = (16 * 256) / num_;
+    case 4:   burstoc_limit_ = (16 * 256) / num_pad_;
               break;
-    case 8:   burstoc_limit_ = (32 * 256) / num_;
+    case 8:   burstoc_limit_ = (32 * 256) / num_pad_;
               break;
-    case 16:  burstoc_limit_ = (64 * 256) / num_;
+    case 16:  burstoc_limit_ = (64 * 256) / num_pad_;
               break;
   }
+  // The heuristic tiling is sized for full batches, below a word of images
+  // the tuner picks the tiling of lowest latency instead.
+  const bool tune = cr_param.autotune() || num_ < 16;
   kernel_params *forward_params = &ocl_params_;
-  CHECK(num_ % 16 == 0);
 
   forward_params->ydim = bottom[0]->shape(0);
   forward_params->xdim = bottom[0]->shape(1);
   forward_params->inchannels = bottom[0]->shape(2) / this->group_;
   forward_params->outchannels = this->num_output_ / this->group_;
-  forward_params->numimages = num_;
+  forward_params->numimages = num_pad_;
   forward_params->ksize = (this->blobs_[0])->shape(3);  
+  forward_params->stride = stride_data[0];
+  forward_params->pad = pad_data[0];
+  forward_params->numgroups = this->group_;
  
   int rpofm = num_cu_;
   int burstoc = 1;
@@ -209,20 +231,28 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     burstchannels_ = tchannel;
   }
 
-  CHECK(burstoc * (num_ / 16) >= 16);
+  OCLTilingLimits limits = {num_pe_, num_cu_, burstoc_limit_, 4};
+  if (tune) {
+    OCLTiling tiling = OCLTilingTuner::Tune(this->xcl_param_.kernel_name(),
+        *forward_params, limits);
+    burstchannels_ = tiling.burstchannels;
+    rpofm = tiling.rpofm;
+    burstoc = tiling.burstoc;
+  }
+  AlignGroupBursts(*forward_params, burstchannels_, &rpofm, &burstoc);
+
+  CHECK(burstoc * (num_pad_ / 16) >= 16);
   CHECK(burstoc * burstchannels_ * ksize * ksize >= 16);
   forward_params->rpofm = rpofm;
   forward_params->xtile_pad = 0;
   forward_params->burstydim = burstoc;
-  forward_params->stride = stride_data[0];
-  forward_params->pad = pad_data[0];
   forward_params->burstchannels = burstchannels_;
   forward_params->rpo = forward_params->inchannels / burstchannels_;
-  forward_params->numgroups = this->group_;
   forward_params->fc = 0;
   forward_params->relu = cr_param.relu();
   forward_params->pool = 0;
   forward_params->pksize = 2;
+  forward_params->outshift = 0;
 
   // Backward params
   this->bottom_shape_ = &bottom[0]->shape();
@@ -233,7 +263,7 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_params->outchannels = this->num_output_ / this->group_;
   backward_params->inchannels = bottom[0]->shape(2) / this->group_;
   backward_params->ksize = (this->blobs_[0])->shape(3);
-  backward_params->numimages = num_;
+  backward_params->numimages = num_pad_;
   backward_params->rpofm = rpofm;
   backward_params->xtile_pad = 0;
   backward_params->burstydim = burstoc;
@@ -246,6 +276,7 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_params->relu = cr_param.relu();
   backward_params->pool = 0;
   backward_params->pksize = 2;
+  backward_params->outshift = 0;
 
   // backward wrt data
   kernel_params *backward_params_bi = &ocl_params_bi_;
@@ -254,7 +285,7 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_params_bi->inchannels = this->num_output_ / this->group_;
   backward_params_bi->outchannels = bottom[0]->shape(2) / this->group_;
   backward_params_bi->ksize = (this->blobs_[0])->shape(3);
-  backward_params_bi->numimages = num_;
+  backward_params_bi->numimages = num_pad_;
   backward_params_bi->xtile_pad = 0;
   backward_params_bi->stride = stride_data[0];
   if ((pad_data[0] == 0) && (stride_data[0] == 1)) {
@@ -262,6 +293,7 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   } else {
     backward_params_bi->pad = pad_data[0];
   }
+  backward_params_bi->numgroups = this->group_;
 
   rpofm = num_cu_;
   burstoc = 1;
@@ -300,15 +332,26 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     burstchannels_ = tchannel;
   }
 
-  CHECK(burstoc * (num_ / 16) >= 16);
+  if (tune) {
+    // The backward pass wrt data needs whole 16 channel words
+    limits.min_burstchannels = 16;
+    OCLTiling tiling = OCLTilingTuner::Tune(this->xcl_param_.kernel_name(),
+        *backward_params_bi, limits);
+    burstchannels_ = tiling.burstchannels;
+    rpofm = tiling.rpofm;
+    burstoc = tiling.burstoc;
+  }
+  AlignGroupBursts(*backward_params_bi, burstchannels_, &rpofm, &burstoc);
+
+  CHECK(burstoc * (num_pad_ / 16) >= 16);
 
   backward_params_bi->burstchannels = burstchannels_;
   backward_params_bi->rpo = backward_params_bi->inchannels / burstchannels_;
-  backward_params_bi->numgroups = this->group_;
   backward_params_bi->fc = 0;
   backward_params_bi->relu = cr_param.relu();
   backward_params_bi->pool = 0;
   backward_params_bi->pksize = 2;
+  backward_params_bi->outshift = 0;
   backward_params_bi->rpofm = rpofm;
   backward_params_bi->burstydim = burstoc;
 
@@ -325,7 +368,7 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   bias_params->inchannels = backward_params_bi->inchannels;
   bias_params->outchannels = 1;
   bias_params->burstchannels = burstchannels_;
-  bias_params->numimages = num_;
+  bias_params->numimages = num_pad_;
   bias_params->ksize = 1;
   bias_params->rpo = bias_params->inchannels / burstchannels_;
   bias_params->numgroups = this->group_;
@@ -333,12 +376,45 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   bias_params->relu = cr_param.relu();
   bias_params->pool = 0;
   bias_params->pksize = 2;
+  bias_params->outshift = 0;
+
+  tag_words_ = 0;
+  skip_words_ = 0;
+  winograd_ = conv_param.subengine() == ConvolutionParameter_SubEngine_WINOGRAD
+    && UseWinograd(bottom);
+  // Of the kernels only crp_layer_hwcn_cpfp applies outshift, the outputs of
+  // the others stay at the exponent of the sums.
+  outshift_ = scale_ && !winograd_ &&
+    this->xcl_param_.kernel_name() == "crp_layer_hwcn_cpfp";
+  if (winograd_) {
+    // The kernel buffers hold 256 words of outputs, 512 words of a filter
+    // column and 2048 words of a 3 row input window per bank. Output channel
+    // bursts divide outchannels so that the input channel bursts of the last
+    // one line up with the others.
+    int imgfact = num_pad_ / 16;
+    int ic = forward_params->inchannels;
+    int oc = forward_params->outchannels;
+    burstoc = std::min(oc, std::min(256 / imgfact, 512 / 3));
+    while (oc % burstoc != 0)
+      burstoc--;
+    burstchannels_ = ic;
+    while (ic % burstchannels_ != 0 || 3 * (burstchannels_ / 4) * imgfact >
+        2048 || 3 * (burstchannels_ / 16) * burstoc > 512)
+      burstchannels_ -= 16;
+    forward_params->burstydim = burstoc;
+    forward_params->rpofm = oc / burstoc;
+    forward_params->burstchannels = burstchannels_;
+    forward_params->rpo = ic / burstchannels_;
+    this->xcl_param_.set_xcl_name("wcrp_layer_hwcn_cpfp_fw.xclbin");
+    this->xcl_param_.set_kernel_name("wcrp_layer_hwcn_cpfp_fw");
+  }
 
+  // The bias pass reads a word of ones per output pixel and group
   vector<int> shape(4);
-  shape[0] = bottom[0]->shape(0);
-  shape[1] = bottom[0]->shape(1);
-  shape[2] = 1;
-  shape[3] = bottom[0]->shape(3);
+  shape[0] = this->output_shape_[0];
+  shape[1] = this->output_shape_[1];
+  shape[2] = this->group_;
+  shape[3] = num_pad_;
 
   weights_placeholder.Reshape(shape);
 
@@ -364,9 +440,72 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   bias_h.Reshape((this->blobs_[1])->shape());
 }
 
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::AlignGroupBursts(const kernel_params& params,
+    int burstchannels, int* rpofm, int* burstoc) {
+  // The kernel places the filters of group g at outchannels * g. With more
+  // than one input burst a partial last output burst spills into the next
+  // group, so grouped layers burst a divisor of their output channels.
+  const int outchannels = params.outchannels;
+  if (this->group_ == 1 || params.inchannels / burstchannels == 1)
+    return;
+  // The divisor still has to pass the burst size CHECKs of LayerSetUp, and
+  // when it grows past the heuristic burst it must fit the weight buffer,
+  // which holds the burst channels in whole words of 16.
+  const int min_burstoc = (16 + params.numimages / 16 - 1) /
+      (params.numimages / 16);
+  const int max_burstoc = std::min(burstoc_limit_, 8 * 256 /
+      (params.ksize * params.ksize * ((burstchannels + 15) / 16)));
+  int best = 0;
+  for (int d = std::min(*burstoc, outchannels); d >= min_burstoc; --d) {
+    if (outchannels % d == 0) {
+      best = d;
+      break;
+    }
+  }
+  for (int d = *burstoc + 1; best == 0 && d <= max_burstoc &&
+      d <= outchannels; ++d) {
+    if (outchannels % d == 0)
+      best = d;
+  }
+  CHECK_GT(best, 0) << this->layer_param_.name() << ": no output burst "
+      << "divides the " << outchannels << " channels of each of the "
+      << this->group_ << " groups within [" << min_burstoc << ", "
+      << max_burstoc << "], try another batch size or group width";
+  *burstoc = best;
+  *rpofm = outchannels / *burstoc;
+}
+
+template <typename Dtype>
+bool OCLCRHWCNLayer<Dtype>::UseWinograd(const vector<Blob<Dtype>*>& bottom) {
+  const kernel_params& params = ocl_params_;
+  string reason;
+  if (params.ksize != 3 || params.stride != 1) {
+    reason = "the filters are not 3x3 with stride 1";
+  } else if (bottom[0]->shape(0) != bottom[0]->shape(1)) {
+    reason = "the input is not square";
+  } else if (params.numgroups != 1) {
+    reason = "the convolution is grouped";
+  } else if (params.inchannels % 16 != 0) {
+    reason = "the input channels are not a multiple of 16";
+  } else if (this->layer_param_.phase() != TEST) {
+    // The kernel writes no ReLU tags for the backward passes
+    reason = "the Winograd kernel is forward only";
+  }
+  if (!reason.empty()) {
+    LOG(INFO) << this->layer_param_.name() << " uses the DIRECT engine, "
+        << reason << ".";
+  }
+  return reason.empty();
+}
+
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  // The kernel params of LayerSetUp are tiled for num_pad_ images
+  CHECK_EQ(num_pad_, (bottom[0]->shape(3) + 15) / 16 * 16)
+      << this->layer_param_.name() << ": the batch size is fixed at setup, "
+      << "create the net again to change it";
   // Shape the tops.
   vector<int> top_shape;
   for (int i = 0; i < this->num_spatial_axes_; ++i) {
@@ -376,6 +515,7 @@ void OCLCRHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top_shape.push_back(this->num_output_);
   top_shape.push_back(bottom[0]->shape(3));
   for (int top_id = 0; top_id < top.size(); ++top_id) {
+    top[top_id]->set_cpfp(true);
     top[top_id]->Reshape(top_shape);
   }
 
@@ -386,42 +526,37 @@ void OCLCRHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   shape[0] = top[0]->shape(0);
   shape[1] = top[0]->shape(1);
   shape[2] = top[0]->shape(2);
-  if (top[0]->shape(3) % 32 != 0)
-    shape[3] = top[0]->shape(3) / 32 + 1;
+  if (num_pad_ % 32 != 0)
+    shape[3] = num_pad_ / 32 + 1;
   else
-    shape[3] = top[0]->shape(3) / 32;
+    shape[3] = num_pad_ / 32;
 
   relu_indices.Reshape(shape);
   bias_placeholder.Reshape(1, 1, 1, 1);
+
+  if (num_pad_ != bottom[0]->shape(3)) {
+    shape = bottom[0]->shape();
+    shape[3] = num_pad_;
+    bottom_pad_.Reshape(shape);
+    top_shape[3] = num_pad_;
+    top_pad_.Reshape(top_shape);
+  }
 }
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::launchKernel(const cpfp *bottom,
     const cpfp *weights, const cpfp *bias, cpfp *top, int *tags,
     const int *params, int numgroups) {
-  std::vector<cl_event> events;
-
-  int events_size = numgroups;
-  events.resize(events_size, 0);
-  
-  clSetKernelArg(this->ocl_kernel, 0, sizeof(cl_mem),
-    (const void *)&bottom);
-  clSetKernelArg(this->ocl_kernel, 1, sizeof(cl_mem),
-    (const void *)&weights);
-  clSetKernelArg(this->ocl_kernel, 2, sizeof(cl_mem),
-    (const void *)&bias);
-  clSetKernelArg(this->ocl_kernel, 3, sizeof(cl_mem),
-    (const void *)&top);
-  clSetKernelArg(this->ocl_kernel, 4, sizeof(cl_mem),
-    (const void *)&tags);
-  clSetKernelArg(this->ocl_kernel, 5, sizeof(cl_mem),
-    (const void *)&params);
-  for (int g = 0; g < numgroups; ++g) {
-    clSetKernelArg(this->ocl_kernel, 6, sizeof(cl_int),
-        (const void *)&g);
-    clEnqueueTask(oclCommandQueue, this->ocl_kernel, 0, NULL, &(events[g]));
+  if (Caffe::mode() == Caffe::OCL_NATIVE) {
+    NativeKernelRunner::Run(this->GetNativeKernel(), (void *)bottom,
+        (void *)weights, (void *)bias, (void *)top, (void *)tags,
+        (int *)params, numgroups);
+    return;
   }
-  clWaitForEvents(events.size(), events.data()); 
+
+  void *args[] = {(void *)bottom, (void *)weights, (void *)bias,
+      (void *)top, (void *)tags, (void *)params};
+  this->EnqueueOCLTasks(args, 6, numgroups, num_cu_);
 }
 
 template <typename Dtype>
@@ -441,15 +576,20 @@ void OCLCRHWCNLayer<Dtype>::compute_output_shape() {
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::copyToHalf(const Dtype *input, cpfp *output,
-    int size) {
-  for (int i = 0; i < size; ++i)
-    output[i] = cpfp((float)input[i]);
+    int size, int exp) {
+  cpfp_from_float(size, input, output, exp);
+}
+
+template <typename Dtype>
+int OCLCRHWCNLayer<Dtype>::WeightsExp() {
+  return scale_ ? cpfp_scale_exp(caffe_cpu_amax(this->blobs_[0]->count(),
+      this->blobs_[0]->cpu_data())) : 0;
 }
 
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::copyToHalfWeights(const Dtype *input,
-    cpfp *output, kernel_params params) {
+    cpfp *output, kernel_params params, int exp) {
   int oc = params.outchannels * params.numgroups;
   int ic = params.inchannels;
   int bc = params.burstchannels;
@@ -458,6 +598,9 @@ void OCLCRHWCNLayer<Dtype>::copyToHalfWeights(const Dtype *input,
   int ksize = params.ksize;
   int burstoc = params.burstydim;
   int rpofm = params.rpofm;
+  // Convert in bulk, the loops below only reorder
+  std::vector<cpfp> input_h(oc * ic * ksize * ksize);
+  cpfp_from_float(input_h.size(), input, input_h.data(), exp);
   for (int g = 0; g < params.numgroups; ++g) {
     int o_head = params.outchannels * g;
     for (int o = 0; o < rpofm; ++o) {
@@ -473,7 +616,7 @@ void OCLCRHWCNLayer<Dtype>::copyToHalfWeights(const Dtype *input,
                 int out_idx = (o * burstoc + o_head) * ksize * ksize * ic_new +
                   n * bc_new * ksize * ksize * burstoc + burst_idx;
                 if (m < bc / num_pe_ && o * burstoc + b + o_head < oc) {
-                  output[out_idx] = cpfp((float)input[in_idx]);
+                  output[out_idx] = input_h[in_idx];
                 } else {
                   output[out_idx] = cpfp(0);
                 }
@@ -486,31 +629,72 @@ void OCLCRHWCNLayer<Dtype>::copyToHalfWeights(const Dtype *input,
   }
 }
 
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::copyToHalfWinogradWeights(const Dtype *input,
+    cpfp *output, kernel_params params, int exp) {
+  int oc = params.outchannels;
+  int ic = params.inchannels;
+  int bc = params.burstchannels;
+  int ksize = params.ksize;
+  int burstoc = params.burstydim;
+  std::vector<cpfp> input_h(oc * ic * ksize * ksize);
+  cpfp_from_float(input_h.size(), input, input_h.data(), exp);
+  // The kernel streams the filters a column at a time and transforms them on
+  // chip, within a burst the channels interleave like its input banks.
+  for (int q = 0; q < ksize; ++q) {
+    for (int o = 0; o < oc / burstoc; ++o) {
+      for (int n = 0; n < ic / bc; ++n) {
+        for (int b = 0; b < burstoc; ++b) {
+          for (int p = 0; p < ksize; ++p) {
+            for (int k = 0; k < bc / 4; ++k) {
+              for (int m = 0; m < 4; ++m) {
+                int in_idx = (((o * burstoc + b) * ic + n * bc + m * (bc / 4)
+                  + k) * ksize + p) * ksize + q;
+                int out_idx = (q * oc + o * burstoc) * ksize * ic +
+                  n * bc * ksize * burstoc + (b * ksize + p) * bc + k * 4 + m;
+                output[out_idx] = input_h[in_idx];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::RotateWeightsHalf(const Dtype *input,
-    cpfp *output, kernel_params params) {
-  int oc = params.outchannels * params.numgroups;
+    cpfp *output, kernel_params params, int exp) {
+  int oc = params.outchannels;
   int ic = params.inchannels;
   int bc = params.burstchannels;
   int ksize = params.ksize;
   int rpofm = params.rpofm;
   int burstoc = params.burstydim;
-  for (int o = 0; o < rpofm; ++o) {
-    for (int b = 0; b < burstoc; ++b) {
-      for (int n = 0; n < ic / bc; ++n) {
-        for (int k = 0; k < ksize * ksize; ++k) {
-          for (int m = 0; m < bc / num_pe_; ++m) {
-            for (int j = 0; j < num_pe_; ++j) {
-              int in_idx = ((n * bc + m + j * bc / num_pe_) * oc + o *
-                burstoc + b) * ksize * ksize + k;
-              int burst_idx = (ksize * ksize - 1 - k) * bc + m * num_pe_ + j +
-                b * ksize * ksize * bc;
-              int out_idx = o * burstoc * ksize * ksize * ic +
-                n * bc * ksize * ksize * burstoc + burst_idx;
-              if (o * burstoc + b < oc) 
-                output[out_idx] = cpfp((float)input[in_idx]);
-              else
-                output[out_idx] = 0;
+  std::vector<cpfp> input_h(oc * ic * params.numgroups * ksize * ksize);
+  cpfp_from_float(input_h.size(), input, input_h.data(), exp);
+  // Groups are written in order, so the zeros a partial last burst writes
+  // past the end of a group are overwritten by the next one.
+  for (int g = 0; g < params.numgroups; ++g) {
+    int i_head = ic * g;
+    int o_head = oc * g;
+    for (int o = 0; o < rpofm; ++o) {
+      for (int b = 0; b < burstoc; ++b) {
+        for (int n = 0; n < ic / bc; ++n) {
+          for (int k = 0; k < ksize * ksize; ++k) {
+            for (int m = 0; m < bc / num_pe_; ++m) {
+              for (int j = 0; j < num_pe_; ++j) {
+                int in_idx = ((i_head + n * bc + m + j * bc / num_pe_) * oc +
+                  o * burstoc + b) * ksize * ksize + k;
+                int burst_idx = (ksize * ksize - 1 - k) * bc + m * num_pe_ +
+                  j + b * ksize * ksize * bc;
+                int out_idx = (o * burstoc + o_head) * ksize * ksize * ic +
+                  n * bc * ksize * ksize * burstoc + burst_idx;
+                if (o * burstoc + b < oc)
+                  output[out_idx] = input_h[in_idx];
+                else
+                  output[out_idx] = 0;
+              }
             }
           }
         }
@@ -521,8 +705,7 @@ void OCLCRHWCNLayer<Dtype>::RotateWeightsHalf(const Dtype *input,
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::copyToFloatWeights(cpfp *input,
-    Dtype *output, const vector<int> shape, kernel_params params) {
-  int oc = params.outchannels * params.numgroups;
+    Dtype *output, const vector<int> shape, kernel_params params, int exp) {
   int ic = params.inchannels;
   int bc = params.burstchannels;
   int ic_new = weight_pad_;
@@ -530,21 +713,27 @@ void OCLCRHWCNLayer<Dtype>::copyToFloatWeights(cpfp *input,
   int ksize = params.ksize;
   int rpofm = params.rpofm;
   int burstoc = params.burstydim;
+  std::vector<Dtype> input_f(rpofm * burstoc * params.numgroups * ksize *
+      ksize * ic_new);
+  cpfp_to_float(input_f.size(), input, input_f.data(), exp);
 
-  for (int o = 0; o < rpofm; ++o) {
-    for (int b = 0; b < burstoc; ++b) {
-      for (int n = 0; n < ic_new / bc_new; ++n) {
-        for (int k = 0; k < params.ksize * params.ksize; ++k) {
-          for (int m = 0; m < bc / num_pe_; ++m) {
-            for (int j = 0; j < num_pe_; ++j) {
-              int in_idx = ((o * burstoc + b) * ic + n * bc + m + j *
-                (bc / num_pe_)) * ksize * ksize + k;
-              int burst_idx = k * bc_new + m * num_pe_ + j + b * ksize * ksize
-                * bc_new;
-              int out_idx = o * burstoc * ksize * ksize * ic_new + 
-                n * ksize * ksize * burstoc * bc_new + burst_idx;
-              if (o * burstoc + b < oc)
-                output[in_idx] = (Dtype)float(input[out_idx]);
+  for (int g = 0; g < params.numgroups; ++g) {
+    int o_head = params.outchannels * g;
+    for (int o = 0; o < rpofm; ++o) {
+      for (int b = 0; b < burstoc; ++b) {
+        for (int n = 0; n < ic_new / bc_new; ++n) {
+          for (int k = 0; k < params.ksize * params.ksize; ++k) {
+            for (int m = 0; m < bc / num_pe_; ++m) {
+              for (int j = 0; j < num_pe_; ++j) {
+                int in_idx = ((o * burstoc + b + o_head) * ic + n * bc + m +
+                  j * (bc / num_pe_)) * ksize * ksize + k;
+                int burst_idx = k * bc_new + m * num_pe_ + j + b * ksize *
+                  ksize * bc_new;
+                int out_idx = (o * burstoc + o_head) * ksize * ksize * ic_new +
+                  n * ksize * ksize * burstoc * bc_new + burst_idx;
+                if (o * burstoc + b < params.outchannels)
+                  output[in_idx] = input_f[out_idx];
+              }
             }
           }
         }
@@ -577,23 +766,34 @@ void OCLCRHWCNLayer<Dtype>::backward_bias(const vector<Blob<Dtype>*>& top,
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t outsize = sizeof(cpfp) * top[0]->count();
+  const bool padded = num_pad_ != top[0]->shape(3);
 
   const cpfp *top_diff;
   int *relu_vals;
   for (int i = 0; i < bottom.size(); i++) {
-    top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+    top_diff = padded ? this->PadOCLImages(top[i], true, &top_pad_) :
+      top[i]->ocl_cpfp_diff();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weights_data, (const cpfp *)bias_diff, bias_diff,
         relu_vals, cr_params_b, numgroups);
   } 
   bias_diff = bias_h.mutable_cpu_diff();
   Dtype *bias_diff_out = this->blobs_[1]->mutable_cpu_diff();
+  const float scale = std::ldexp(1.0f, top[0]->cpfp_diff_exp());
 
-  for (int i = 0; i < bias_h.count() / num_pe_; ++i) {
-    for (int j = 0; j < num_pe_; ++j) {
-      bias_diff_out[i + j * bias_h.count() / num_pe_] =
-        (Dtype)float(bias_diff[i * num_pe_ + j]);
+  // Each burst of channels of each group comes back interleaved across the
+  // processing elements.
+  int ic = params->inchannels;
+  int bc = params->burstchannels;
+  for (int g = 0; g < numgroups; ++g) {
+    for (int n = 0; n < ic / bc; ++n) {
+      for (int m = 0; m < bc / num_pe_; ++m) {
+        for (int j = 0; j < num_pe_; ++j) {
+          bias_diff_out[g * ic + n * bc + m + j * (bc / num_pe_)] =
+            (Dtype)(float(bias_diff[g * ic + n * bc + m * num_pe_ + j]) *
+                scale);
+        }
+      }
     }
   }
 }
@@ -602,8 +802,16 @@ template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::backward_data(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   kernel_params *params = &ocl_params_bi_;
-  RotateWeightsHalf(this->blobs_[0]->cpu_data(),
-      weights_h_r.mutable_cpu_data(), ocl_params_bi_);
+  if (!weights_h_r_version_.Current(*this->blobs_[0], weights_h_r)) {
+    weights_r_exp_ = WeightsExp();
+    RotateWeightsHalf(this->blobs_[0]->cpu_data(),
+        weights_h_r.mutable_cpu_data(), ocl_params_bi_, weights_r_exp_);
+    weights_h_r_version_.Update(*this->blobs_[0], weights_h_r);
+  }
+  const int sum_exp = top[0]->cpfp_diff_exp() + weights_r_exp_;
+  int bottom_exp = sum_exp;
+  params->outshift = outshift_ ?
+    bottom_diff_exp_.OutShift(sum_exp, &bottom_exp) : 0;
 
   const cpfp *weight_data_r = weights_h_r.ocl_data();
   vector<int> shape(1);
@@ -625,19 +833,26 @@ void OCLCRHWCNLayer<Dtype>::backward_data(const vector<Blob<Dtype>*>& top,
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
+  const bool padded = num_pad_ != bottom[0]->shape(3);
 
   const cpfp *top_diff;
   int *relu_vals;
   cpfp *bottom_diff;
   for (int i = 0; i < bottom.size(); i++) {
-    bottom_diff =
-      reinterpret_cast<cpfp *>(bottom[i]->mutable_ocl_diff(0, insize));
-    top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+    bottom_diff = padded ? bottom_pad_.mutable_ocl_diff(0) :
+      bottom[i]->mutable_ocl_cpfp_diff(0);
+    top_diff = padded ? this->PadOCLImages(top[i], true, &top_pad_) :
+      top[i]->ocl_cpfp_diff();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weight_data_r, bias_data, bottom_diff, relu_vals,
         cr_params_b, numgroups);
+    if (padded)
+      this->StripOCLImages(&bottom_pad_, true, bottom[i]);
+    bottom[i]->set_cpfp_diff_exp(bottom_exp);
+    if (outshift_ && bottom_diff_exp_.Sample()) {
+      bottom_diff_exp_.Update(std::ldexp(cpfp_amax(bottom[i]->count(),
+          bottom[i]->cpu_cpfp_diff()), bottom_exp));
+    }
   }
 }
 
@@ -667,23 +882,26 @@ void OCLCRHWCNLayer<Dtype>::backward_weights(const vector<Blob<Dtype>*>& top,
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
+  const bool padded = num_pad_ != bottom[0]->shape(3);
 
   const cpfp *top_diff;
   int *relu_vals;
   const cpfp *bottom_data;
+  // The zero images added by padding add nothing to the weight gradients.
   for (int i = 0; i < bottom.size(); i++) {
-    bottom_data =
-      reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
-    top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+    bottom_data = padded ? this->PadOCLImages(bottom[i], false, &bottom_pad_) :
+      bottom[i]->ocl_cpfp_data();
+    top_diff = padded ? this->PadOCLImages(top[i], true, &top_pad_) :
+      top[i]->ocl_cpfp_diff();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(bottom_data, top_diff, bias_data, weight_diff, relu_vals,
         cr_params_b, numgroups);
   }
   weight_diff = weights_h.mutable_cpu_diff();
+  // The kernel leaves the gradients at the exponent of its sums
   copyToFloatWeights(weight_diff, weight_diff_dtype,
-      this->blobs_[0]->shape(), ocl_params_bw_);
+      this->blobs_[0]->shape(), ocl_params_bw_,
+      top[0]->cpfp_diff_exp() + bottom[0]->cpfp_data_exp());
 }
 
 
@@ -691,10 +909,28 @@ template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::Forward_ocl(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   kernel_params *params = &ocl_params_;
-  copyToHalfWeights(this->blobs_[0]->cpu_data(),
-      weights_h.mutable_cpu_data(), ocl_params_);
-  copyToHalf(this->blobs_[1]->mutable_cpu_data(), bias_h.mutable_cpu_data(),
-      params->outchannels * params->numgroups);
+  if (!weights_h_version_.Current(*this->blobs_[0], weights_h)) {
+    weights_exp_ = WeightsExp();
+    if (winograd_) {
+      copyToHalfWinogradWeights(this->blobs_[0]->cpu_data(),
+          weights_h.mutable_cpu_data(), ocl_params_, weights_exp_);
+    } else {
+      copyToHalfWeights(this->blobs_[0]->cpu_data(),
+          weights_h.mutable_cpu_data(), ocl_params_, weights_exp_);
+    }
+    weights_h_version_.Update(*this->blobs_[0], weights_h);
+  }
+  // The kernel sums at the exponent of the input plus that of the weights
+  const int sum_exp = bottom[0]->cpfp_data_exp() + weights_exp_;
+  int top_exp = sum_exp;
+  params->outshift = outshift_ ? top_exp_.OutShift(sum_exp, &top_exp) : 0;
+  if (!bias_h_version_.Current(*this->blobs_[1], bias_h) ||
+      bias_h_exp_ != sum_exp) {
+    copyToHalf(this->blobs_[1]->cpu_data(), bias_h.mutable_cpu_data(),
+        params->outchannels * params->numgroups, sum_exp);
+    bias_h_exp_ = sum_exp;
+    bias_h_version_.Update(*this->blobs_[1], bias_h);
+  }
   const cpfp *weight_data = weights_h.ocl_data();
   const cpfp *bias_data = bias_h.ocl_data();
 
@@ -712,24 +948,36 @@ void OCLCRHWCNLayer<Dtype>::Forward_ocl(const vector<Blob<Dtype>*>& bottom,
   }
   const int* cr_params = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
+  const bool padded = num_pad_ != bottom[0]->shape(3);
 
   cpfp *top_data;
   int *relu_vals;
   for (int i = 0; i < bottom.size(); i++) {
-    const cpfp* bottom_data =
-      reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
-    top_data = reinterpret_cast<cpfp *>(top[i]->mutable_ocl_data(0, outsize));
+    const cpfp* bottom_data = padded ?
+      this->PadOCLImages(bottom[i], false, &bottom_pad_) :
+      bottom[i]->ocl_cpfp_data();
+    top_data = padded ? top_pad_.mutable_ocl_data(0) :
+      top[i]->mutable_ocl_cpfp_data(0);
     relu_vals = relu_indices.mutable_ocl_data(0);
     launchKernel(bottom_data, weight_data, bias_data, top_data, relu_vals,
         cr_params, numgroups);
+    if (padded)
+      this->StripOCLImages(&top_pad_, false, top[i]);
+    top[i]->set_cpfp_data_exp(top_exp);
+    if (outshift_ && top_exp_.Sample()) {
+      top_exp_.Update(std::ldexp(cpfp_amax(top[i]->count(),
+          top[i]->cpu_cpfp_data()), top_exp));
+    }
   }
 }
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::Backward_ocl(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  // The groups of the bias and data passes start on whole words of channels
+  CHECK(this->group_ == 1 || (this->num_output_ / this->group_) % 16 == 0)
+      << "Grouped backward needs output channels per group in multiples of "
+      << "16";
   if (this->bias_term_ && this->param_propagate_down_[1])
     backward_bias(top, propagate_down, bottom);
   
@@ -738,6 +986,40 @@ void OCLCRHWCNLayer<Dtype>::Backward_ocl(const vector<Blob<Dtype>*>& top,
 
   if (propagate_down[0])
     backward_data(top, propagate_down, bottom);
+
+  const CRParameter& cr_param = this->layer_param_.cr_param();
+  if (cr_param.relu() && cr_param.report_skip())
+    ReportSkip();
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::ReportSkip() {
+  // The kernel skips a word of 16 images wherever its ReLU tag is clear
+  const short* tags = reinterpret_cast<const short*>(relu_indices.cpu_data());
+  const int count = relu_indices.count(0, 3) * (num_pad_ / 16);
+  int skipped = 0;
+  for (int i = 0; i < count; ++i)
+    skipped += (tags[i] == 0);
+  tag_words_ += count;
+  skip_words_ += skipped;
+  LOG(INFO) << this->layer_param_.name() << " skips " << 100.0 * skipped /
+      count << "% of the output diff words, " << 100.0 * skip_words_ /
+      tag_words_ << "% so far";
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::OCLKernelCalls(
+    vector<kernel_params>* calls) const {
+  calls->push_back(ocl_params_);
+  calls->back().backward = 0;
+  if (this->bias_term_) {
+    calls->push_back(ocl_params_bb_);
+    calls->back().backward = 1;
+  }
+  calls->push_back(ocl_params_bw_);
+  calls->back().backward = 1;
+  calls->push_back(ocl_params_bi_);
+  calls->back().backward = 2;
 }
 
 
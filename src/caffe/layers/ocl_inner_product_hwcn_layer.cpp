@@ -1,7 +1,10 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/ocl_inner_product_hwcn_layer.hpp"
+#include "caffe/ocl_tiling_tuner.hpp"
+#include "caffe/util/cpfp_math.hpp"
 
 namespace caffe {
 
@@ -59,6 +62,19 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   CRParameter cr_param = this->layer_param_.cr_param();
   num_cu_ = cr_param.num_cu();
   num_pe_ = cr_param.num_pe();
+  scale_ = cr_param.cpfp_scale();
+  // Of the kernels only crp_layer_hwcn_cpfp applies outshift, the outputs of
+  // the others stay at the exponent of the sums.
+  outshift_ = scale_ &&
+    this->xcl_param_.kernel_name() == "crp_layer_hwcn_cpfp";
+  top_exp_.set_period(cr_param.cpfp_scale_period());
+  bottom_diff_exp_.set_period(cr_param.cpfp_scale_period());
+  weights_exp_ = 0;
+  weights_t_exp_ = 0;
+  bias_h_exp_ = 0;
+  // Batches that are not a multiple of 16 images run padded with zero images
+  num_pad_ = (this->M_ + 15) / 16 * 16;
+  use_aux_ = false;
   switch(num_pe_) {
     case 4:   burstoc_limit_ = 16;
               break;
@@ -67,8 +83,7 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
     case 16:  burstoc_limit_ = 64;
               break;
   }
-  CHECK(this->M_ % 16 == 0);
-  int num_ = this->M_;
+  int num_ = num_pad_;
   kernel_params *params = &ocl_params_;
   params->inchannels = this->K_;
   params->numgroups = 1;
@@ -81,7 +96,7 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   params->pad = 0;
   params->relu = cr_param.relu();
   params->outchannels = this->N_;
-  params->numimages = this->M_;
+  params->numimages = num_pad_;
   int burstchannels_ = 8 * 256 * 256 / (params->numimages);
 
   if (burstchannels_ > params->inchannels) {
@@ -115,12 +130,24 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
     }
   }
 
+  // The heuristic tiling is sized for full batches, below a word of images
+  // the tuner picks the tiling of lowest latency instead.
+  if (cr_param.autotune() || this->M_ < 16) {
+    OCLTilingLimits limits = {num_pe_, num_cu_, burstoc_limit_, 4};
+    OCLTiling tiling = OCLTilingTuner::Tune(this->xcl_param_.kernel_name(),
+        *params, limits);
+    burstchannels_ = tiling.burstchannels;
+    rpofm = tiling.rpofm;
+    burstoc = tiling.burstoc;
+  }
+
   params->rpofm = rpofm;
   params->burstydim = burstoc;
   params->burstchannels = burstchannels_;
   params->rpo = params->inchannels / burstchannels_;
   params->pool = 0;
   params->pksize = 2;
+  params->outshift = 0;
 
   CHECK(burstoc * (num_ / 16) >= 16);
   CHECK(burstoc * burstchannels_ >= 16);
@@ -143,6 +170,7 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   backward_params->relu = cr_param.relu();
   backward_params->pool = 0;
   backward_params->pksize = 2;
+  backward_params->outshift = 0;
   backward_params->burstydim = params->burstydim;
   backward_params->rpofm = params->rpofm;
 
@@ -153,7 +181,7 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   backward_params_bi->inchannels = this->N_;
   backward_params_bi->outchannels = this->K_;
   backward_params_bi->ksize = 1;
-  backward_params_bi->numimages = this->M_;
+  backward_params_bi->numimages = num_pad_;
 
   backward_params_bi->xtile_pad = 0;
   backward_params_bi->stride = 1;
@@ -163,6 +191,7 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   backward_params_bi->relu = cr_param.relu();
   backward_params_bi->pool = 0;
   backward_params_bi->pksize = 2;
+  backward_params_bi->outshift = 0;
 
   rpofm = num_cu_;
   burstoc = 1;
@@ -217,7 +246,7 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   bias_params->xdim = 1;
   bias_params->inchannels = this->N_;
   bias_params->outchannels = 1;
-  bias_params->numimages = this->M_;
+  bias_params->numimages = num_pad_;
   burstchannels_ = 8 * 256 * 256 / (bias_params->numimages);
 
   if (burstchannels_ > bias_params->inchannels) {
@@ -229,9 +258,12 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
     burstchannels_ = tchannel;
   }
 
+  // Each PE sums at least 16 channels of a burst. The zero channels of
+  // top_aux fill the bursts up, the N_ channels all stay in.
   if (burstchannels_ / num_pe_ < 16) {
-    bias_params->inchannels = 16;
-    burstchannels_ = 16;
+    burstchannels_ = 16 * num_pe_;
+    bias_params->inchannels = (this->N_ + burstchannels_ - 1) /
+      burstchannels_ * burstchannels_;
     use_aux_ = true;
   }
 
@@ -251,8 +283,9 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   bias_params->relu = cr_param.relu();
   bias_params->pool = 0;
   bias_params->pksize = 2;
+  bias_params->outshift = 0;
   vector<int> shape(1);
-  shape[0] = this->M_;
+  shape[0] = num_pad_;
   weights_placeholder.Reshape(shape);
 
   for (int i = 0; i < weights_placeholder.count(); ++i)
@@ -263,17 +296,24 @@ template <typename Dtype>
 void OCLHWCNInnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   kernel_params *bias_params = &ocl_params_bb_;
- 
+  // The kernel params of LayerSetUp are tiled for a batch of M_
+  const int num = bottom[0]->shape(bottom[0]->num_axes() == 2 ? 1 : 3);
+  CHECK_EQ(this->M_, num) << this->layer_param_.name() << ": the batch "
+      << "size is fixed at setup, create the net again to change it";
+
   std::vector<int> top_shape(2);
   top_shape[0] = this->N_;
   top_shape[1] = this->M_;
+  top[0]->set_cpfp(true);
   top[0]->Reshape(top_shape);
 
   top_shape[0] = bias_params->inchannels;
+  top_shape[1] = num_pad_;
   relu_indices.Reshape(top_shape);
 
+  // The bias diff kernel writes every channel of its bursts
   top_shape[0] = 1;
-  top_shape[1] = this->N_;
+  top_shape[1] = bias_params->inchannels;
 
   bias_h.Reshape(top_shape);
 
@@ -290,11 +330,19 @@ void OCLHWCNInnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom
   weight_shape[0] = ocl_params_bi_.burstydim * ocl_params_bi_.rpofm;
   weight_shape[1] = ocl_params_bi_.inchannels;
   
-  if (use_aux_) {
+  // A padded batch takes the top diff through top_aux as well
+  if (use_aux_ || num_pad_ != this->M_) {
     top_shape[0] = bias_params->inchannels;
-    top_shape[1] = this->M_;
+    top_shape[1] = num_pad_;
     top_aux.Reshape(top_shape);
   }
+  if (num_pad_ != this->M_) {
+    vector<int> bottom_shape = bottom[0]->shape();
+    bottom_shape.back() = num_pad_;
+    bottom_pad_.Reshape(bottom_shape);
+    top_shape[0] = this->N_;
+    top_pad_.Reshape(top_shape);
+  }
 
   weights_h_t.Reshape(weight_shape);
   if (this->bias_term_) {
@@ -307,81 +355,107 @@ void OCLHWCNInnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom
 
 template <typename Dtype>
 void OCLHWCNInnerProductLayer<Dtype>::copyToHalf(const Dtype *input,
-    cpfp *output, int size, int xdim, int xdim_pad) {
-  for (int i = 0; i < size; ++i)
-    for (int j = 0; j < xdim_pad; ++j)
-      if (j < xdim)
-        output[i * xdim_pad + j] = cpfp((float)input[i * xdim + j]);
-      else
-        output[i * xdim_pad + j] = cpfp(0);
+    cpfp *output, int size, int xdim, int xdim_pad, int exp) {
+  for (int i = 0; i < size; ++i) {
+    cpfp_from_float(xdim, input + i * xdim, output + i * xdim_pad, exp);
+    for (int j = xdim; j < xdim_pad; ++j)
+      output[i * xdim_pad + j] = cpfp(0);
+  }
+}
+
+template <typename Dtype>
+int OCLHWCNInnerProductLayer<Dtype>::WeightsExp() {
+  return scale_ ? cpfp_scale_exp(caffe_cpu_amax(this->blobs_[0]->count(),
+      this->blobs_[0]->cpu_data())) : 0;
+}
+
+template <typename Dtype>
+const cpfp* OCLHWCNInnerProductLayer<Dtype>::OCLTopDiff(
+    const Blob<Dtype>* top) {
+  const bool packed = this->xcl_param_.packed();
+  if (use_aux_ || num_pad_ != this->M_) {
+    return packed ? this->PackOCLValues(top_aux.cpu_diff(), top_aux.count(),
+        &diff_packed_) : top_aux.ocl_diff();
+  }
+  return packed ? this->PackOCLValues(top->cpu_cpfp_diff(), top->count(),
+      &diff_packed_) : top->ocl_cpfp_diff();
 }
 
 template <typename Dtype>
 void OCLHWCNInnerProductLayer<Dtype>::launchKernel(const cpfp *bottom,
     const cpfp *weights, const cpfp *bias, cpfp *top, int *tags,
     const int *params) {
-  std::vector<cl_event> events;
-  int g = 0;
-  int events_size = 1;
-  events.resize(events_size, 0);
-  
-  clSetKernelArg(this->ocl_kernel, 0, sizeof(cl_mem),
-    (const void *)&bottom);
-  clSetKernelArg(this->ocl_kernel, 1, sizeof(cl_mem),
-    (const void *)&weights);
-  clSetKernelArg(this->ocl_kernel, 2, sizeof(cl_mem),
-    (const void *)&bias);
-  clSetKernelArg(this->ocl_kernel, 3, sizeof(cl_mem),
-    (const void *)&top);
-  clSetKernelArg(this->ocl_kernel, 4, sizeof(cl_mem),
-    (const void *)&tags);
-  clSetKernelArg(this->ocl_kernel, 5, sizeof(cl_mem),
-    (const void *)&params);
-  clSetKernelArg(this->ocl_kernel, 6, sizeof(cl_int),
-      (const void *)&g);
-  clEnqueueTask(oclCommandQueue, this->ocl_kernel, 0, NULL, &(events[g]));
-  clWaitForEvents(events.size(), events.data()); 
+  if (Caffe::mode() == Caffe::OCL_NATIVE) {
+    NativeKernelRunner::Run(this->GetNativeKernel(), (void *)bottom,
+        (void *)weights, (void *)bias, (void *)top, (void *)tags,
+        (int *)params, 1);
+    return;
+  }
+
+  void *args[] = {(void *)bottom, (void *)weights, (void *)bias,
+      (void *)top, (void *)tags, (void *)params};
+  this->EnqueueOCLTasks(args, 6, 1, num_cu_);
 }
 
 template <typename Dtype>
 void OCLHWCNInnerProductLayer<Dtype>::Forward_ocl(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   kernel_params *params = &ocl_params_;
-  const Dtype *weights_dtype = this->blobs_[0]->cpu_data();
-  cpfp *weight_data_temp = weights_h.mutable_cpu_data();
-
-  int oc = params->outchannels;
-  int ic = params->inchannels;
-  int bc = params->burstchannels;
-  int burstoc = params->burstydim;
-  int rpofm = params->rpofm;
-
-  for (int o = 0; o < rpofm; ++o) {
-    for (int b = 0; b < burstoc; ++b) {
-      for (int n = 0; n < ic / bc; ++n) {
-        for (int m = 0; m < bc / num_pe_; ++m) {
-          for (int j = 0; j < num_pe_; ++j) {
-            int burst_idx = m * num_pe_ + j + b * bc;
-            int in_idx = (o * burstoc + b) * ic + m + j * (bc / num_pe_) +
-              n * bc;
-            int out_idx = o * burstoc * ic + n * bc * burstoc + burst_idx;
-            if (o * burstoc + b < oc) {
-              weight_data_temp[out_idx] = cpfp((float)weights_dtype[in_idx]);
-            } else {
-              weight_data_temp[out_idx] = 0;
+  const bool packed = this->xcl_param_.packed();
+  if (!weights_h_version_.Current(*this->blobs_[0], weights_h)) {
+    const Dtype *weights_dtype = this->blobs_[0]->cpu_data();
+    cpfp *weight_data_temp = weights_h.mutable_cpu_data();
+    weights_exp_ = WeightsExp();
+    const float scale = std::ldexp(1.0f, -weights_exp_);
+
+    int oc = params->outchannels;
+    int ic = params->inchannels;
+    int bc = params->burstchannels;
+    int burstoc = params->burstydim;
+    int rpofm = params->rpofm;
+
+    for (int o = 0; o < rpofm; ++o) {
+      for (int b = 0; b < burstoc; ++b) {
+        for (int n = 0; n < ic / bc; ++n) {
+          for (int m = 0; m < bc / num_pe_; ++m) {
+            for (int j = 0; j < num_pe_; ++j) {
+              int burst_idx = m * num_pe_ + j + b * bc;
+              int in_idx = (o * burstoc + b) * ic + m + j * (bc / num_pe_) +
+                n * bc;
+              int out_idx = o * burstoc * ic + n * bc * burstoc + burst_idx;
+              if (o * burstoc + b < oc) {
+                weight_data_temp[out_idx] =
+                  cpfp((float)weights_dtype[in_idx] * scale);
+              } else {
+                weight_data_temp[out_idx] = 0;
+              }
             }
           }
         }
       }
     }
+    if (packed) {
+      this->PackOCLValues(weights_h.cpu_data(), weights_h.count(),
+          &weights_packed_);
+    }
+    weights_h_version_.Update(*this->blobs_[0], weights_h);
   }
-  if (this->bias_term_)
-    copyToHalf(this->blobs_[1]->mutable_cpu_data(), bias_h.mutable_cpu_data(),
-        params->outchannels, 1, 1);
-  else
+  // The kernel sums at the exponent of the input plus that of the weights
+  const int sum_exp = bottom[0]->cpfp_data_exp() + weights_exp_;
+  int top_exp = sum_exp;
+  params->outshift = outshift_ ? top_exp_.OutShift(sum_exp, &top_exp) : 0;
+  if (!this->bias_term_) {
     (bias_h.mutable_cpu_data())[0] = cpfp(0);
+  } else if (!bias_h_version_.Current(*this->blobs_[1], bias_h) ||
+      bias_h_exp_ != sum_exp) {
+    copyToHalf(this->blobs_[1]->cpu_data(), bias_h.mutable_cpu_data(),
+        params->outchannels, 1, 1, sum_exp);
+    bias_h_exp_ = sum_exp;
+    bias_h_version_.Update(*this->blobs_[1], bias_h);
+  }
 
-  const cpfp *weight_data = weights_h.ocl_data();
+  const cpfp *weight_data = packed ? weights_packed_.ocl_data() :
+      weights_h.ocl_data();
   const cpfp *bias_data = bias_h.ocl_data();
 
   params->backward = 0;
@@ -398,17 +472,42 @@ void OCLHWCNInnerProductLayer<Dtype>::Forward_ocl(
   
   const int* k_params = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
+  const bool padded = num_pad_ != this->M_;
   cpfp *top_data;
   int *relu_vals;
   for (int i = 0; i < bottom.size(); i++) {
-    const cpfp *bottom_data =
-      reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
-    top_data = reinterpret_cast<cpfp *>(top[i]->mutable_ocl_data(0, outsize));
+    const cpfp *bottom_data;
+    if (padded) {
+      bottom_data = this->PadOCLImages(bottom[i], false, &bottom_pad_,
+          packed ? &input_packed_ : NULL);
+    } else if (packed) {
+      bottom_data = this->PackOCLValues(bottom[i]->cpu_cpfp_data(),
+          bottom[i]->count(), &input_packed_);
+    } else {
+      bottom_data = bottom[i]->ocl_cpfp_data();
+    }
+    if (packed) {
+      top_data = this->PackedOCLOutput(padded ? top_pad_.count() :
+          top[i]->count(), &output_packed_);
+    } else {
+      top_data = padded ? top_pad_.mutable_ocl_data(0) :
+        top[i]->mutable_ocl_cpfp_data(0);
+    }
     relu_vals = relu_indices.mutable_ocl_data(0);
     launchKernel(bottom_data, weight_data, bias_data, top_data, relu_vals,
         k_params);
+    if (padded) {
+      this->StripOCLImages(&top_pad_, false, top[i],
+          packed ? &output_packed_ : NULL);
+    } else if (packed) {
+      this->UnpackOCLValues(&output_packed_, top[i]->count(),
+          top[i]->mutable_cpu_cpfp_data());
+    }
+    top[i]->set_cpfp_data_exp(top_exp);
+    if (outshift_ && top_exp_.Sample()) {
+      top_exp_.Update(std::ldexp(cpfp_amax(top[i]->count(),
+          top[i]->cpu_cpfp_data()), top_exp));
+    }
   }
 }
 
@@ -418,9 +517,12 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_weights(
     const vector<Blob<Dtype>*>& bottom) {
   kernel_params *params = &ocl_params_bw_;
   params->backward = 1;
+  const bool packed = this->xcl_param_.packed();
   Dtype* weight_diff_dtype = this->blobs_[0]->mutable_cpu_diff();
  
-  cpfp* weight_diff = weights_h.mutable_ocl_diff(0);
+  cpfp* weight_diff = packed ?
+    this->PackedOCLOutput(weights_h.count(), &output_packed_) :
+    weights_h.mutable_ocl_diff(0);
   vector<int> shape(1);
   shape[0] = this->blobs_[0]->shape(1);
 
@@ -436,26 +538,33 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_weights(
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
-
   const cpfp *top_diff;
   int *relu_vals;
   const cpfp *bottom_data;
 
   for (int i = 0; i < bottom.size(); i++) {
-    if (use_aux_) {
-      outsize = sizeof(cpfp) * top_aux.count();
-      top_diff = top_aux.ocl_diff(outsize);
+    top_diff = OCLTopDiff(top[i]);
+    if (num_pad_ != this->M_) {
+      bottom_data = this->PadOCLImages(bottom[i], false, &bottom_pad_,
+          packed ? &input_packed_ : NULL);
+    } else if (packed) {
+      bottom_data = this->PackOCLValues(bottom[i]->cpu_cpfp_data(),
+          bottom[i]->count(), &input_packed_);
     } else {
-      top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+      bottom_data = bottom[i]->ocl_cpfp_data();
     }
-    bottom_data = reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(bottom_data, top_diff, bias_data, weight_diff, relu_vals,
         cr_params_b);
   }
+  if (packed) {
+    this->UnpackOCLValues(&output_packed_, weights_h.count(),
+        weights_h.mutable_cpu_diff());
+  }
   weight_diff = weights_h.mutable_cpu_diff();
+  // The kernel leaves the gradients at the exponent of its sums
+  const float scale = std::ldexp(1.0f, top[0]->cpfp_diff_exp() +
+      bottom[0]->cpfp_data_exp());
 
   int oc = params->outchannels;
   int ic = params->inchannels;
@@ -473,7 +582,8 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_weights(
             int burst_idx = m * num_pe_ + j + b * bc;
             int out_idx = o * burstoc * ic + n * burstoc * bc + burst_idx;
             if (o * burstoc + b < oc)
-              weight_diff_dtype[in_idx] = (Dtype)float(weight_diff[out_idx]);
+              weight_diff_dtype[in_idx] =
+                (Dtype)(float(weight_diff[out_idx]) * scale);
           }
         }
       }
@@ -487,13 +597,19 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_bias(
     const vector<Blob<Dtype>*>& bottom) {
   kernel_params *params = &ocl_params_bb_;
   params->backward = 1;
+  const bool packed = this->xcl_param_.packed();
   vector<int> shape(1);
 
-  const cpfp *weights_data = weights_placeholder.ocl_data();
+  const cpfp *weights_data = packed ?
+    this->PackOCLValues(weights_placeholder.cpu_data(),
+        weights_placeholder.count(), &placeholder_packed_) :
+    weights_placeholder.ocl_data();
 
   shape[0] = weights_h_t.shape(1);
 
-  cpfp *bias_diff = bias_h.mutable_ocl_diff(0);
+  cpfp *bias_diff = packed ?
+    this->PackedOCLOutput(bias_h.count(), &output_packed_) :
+    bias_h.mutable_ocl_diff(0);
 
   shape[0] = sizeof(kernel_params) / sizeof(int);
   param_vals.Reshape(shape);
@@ -506,27 +622,26 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_bias(
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t outsize = sizeof(cpfp) * top[0]->count();
   const cpfp *top_diff;
   int *relu_vals;
   for (int i = 0; i < bottom.size(); i++) {
-    if (use_aux_) {
-      outsize = sizeof(cpfp) * top_aux.count();
-      top_diff = top_aux.ocl_diff(outsize);
-    } else {
-      top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
-    }
+    top_diff = OCLTopDiff(top[i]);
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weights_data, (const cpfp *)bias_diff, bias_diff,
         relu_vals, cr_params_b);
   }
+  if (packed) {
+    this->UnpackOCLValues(&output_packed_, bias_h.count(),
+        bias_h.mutable_cpu_diff());
+  }
   bias_diff = bias_h.mutable_cpu_diff();
   Dtype *bias_diff_out = this->blobs_[1]->mutable_cpu_diff();
+  const float scale = std::ldexp(1.0f, top[0]->cpfp_diff_exp());
   for (int i = 0; i < bias_h.count() / num_pe_; ++i) {
     for (int j = 0; j < num_pe_; ++j)
       if (i + j * bias_h.count() / num_pe_ < this->blobs_[1]->count())
         bias_diff_out[i + j * bias_h.count() / num_pe_] =
-          (Dtype)float(bias_diff[i * num_pe_ + j]);
+          (Dtype)(float(bias_diff[i * num_pe_ + j]) * scale);
   }
 }
 
@@ -536,35 +651,51 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_data(
     const vector<Blob<Dtype>*>& bottom) {
   kernel_params *params = &ocl_params_bi_;
   params->backward = 2;
-
-  const Dtype *weight_data = this->blobs_[0]->cpu_data();
-  cpfp *weight_data_h_t = weights_h_t.mutable_cpu_data();
-
-  int oc = params->outchannels;
-  int ic = params->inchannels;
-  int bc = params->burstchannels;
-  int rpofm = params->rpofm;
-  int burstoc = params->burstydim;
-
-  for (int o = 0; o < rpofm; ++o) {
-    for (int b = 0; b < burstoc; ++b) {
-      for (int n = 0; n < ic / bc; ++n) {
-        for (int m = 0; m < bc / num_pe_; ++m) {
-          for (int j = 0; j < num_pe_; ++j) {
-            int in_idx = (n * bc + m + j * bc / num_pe_) * oc + o *
-              burstoc + b;
-            int burst_idx = m * num_pe_ + j + b * bc;
-            int out_idx = o * burstoc * ic + n * bc * burstoc + burst_idx;
-            if (o * burstoc + b < oc)
-              weight_data_h_t[out_idx] = cpfp((float)weight_data[in_idx]);
-            else
-              weight_data_h_t[out_idx] = 0;
+  const bool packed = this->xcl_param_.packed();
+
+  if (!weights_h_t_version_.Current(*this->blobs_[0], weights_h_t)) {
+    const Dtype *weight_data = this->blobs_[0]->cpu_data();
+    cpfp *weight_data_h_t = weights_h_t.mutable_cpu_data();
+    weights_t_exp_ = WeightsExp();
+    const float scale = std::ldexp(1.0f, -weights_t_exp_);
+
+    int oc = params->outchannels;
+    int ic = params->inchannels;
+    int bc = params->burstchannels;
+    int rpofm = params->rpofm;
+    int burstoc = params->burstydim;
+
+    for (int o = 0; o < rpofm; ++o) {
+      for (int b = 0; b < burstoc; ++b) {
+        for (int n = 0; n < ic / bc; ++n) {
+          for (int m = 0; m < bc / num_pe_; ++m) {
+            for (int j = 0; j < num_pe_; ++j) {
+              int in_idx = (n * bc + m + j * bc / num_pe_) * oc + o *
+                burstoc + b;
+              int burst_idx = m * num_pe_ + j + b * bc;
+              int out_idx = o * burstoc * ic + n * bc * burstoc + burst_idx;
+              if (o * burstoc + b < oc)
+                weight_data_h_t[out_idx] =
+                  cpfp((float)weight_data[in_idx] * scale);
+              else
+                weight_data_h_t[out_idx] = 0;
+            }
           }
         }
       }
     }
+    if (packed) {
+      this->PackOCLValues(weights_h_t.cpu_data(), weights_h_t.count(),
+          &weights_t_packed_);
+    }
+    weights_h_t_version_.Update(*this->blobs_[0], weights_h_t);
   }
-  const cpfp *weight_data_t = weights_h_t.ocl_data();
+  const cpfp *weight_data_t = packed ? weights_t_packed_.ocl_data() :
+      weights_h_t.ocl_data();
+  const int sum_exp = top[0]->cpfp_diff_exp() + weights_t_exp_;
+  int bottom_exp = sum_exp;
+  params->outshift = outshift_ ?
+    bottom_diff_exp_.OutShift(sum_exp, &bottom_exp) : 0;
 
   vector<int> shape(1);
 
@@ -581,24 +712,34 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_data(
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
   const cpfp *top_diff;
   int *relu_vals;
   cpfp *bottom_diff;
 
   for (int i = 0; i < bottom.size(); i++) {
-    if (use_aux_) {
-      outsize = sizeof(cpfp) * top_aux.count();
-      top_diff = top_aux.ocl_diff(outsize);
+    top_diff = OCLTopDiff(top[i]);
+    if (packed) {
+      bottom_diff = this->PackedOCLOutput(num_pad_ != this->M_ ?
+          bottom_pad_.count() : bottom[i]->count(), &output_packed_);
     } else {
-      top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+      bottom_diff = num_pad_ != this->M_ ? bottom_pad_.mutable_ocl_diff(0) :
+        bottom[i]->mutable_ocl_cpfp_diff(0);
     }
-    bottom_diff =
-      reinterpret_cast<cpfp *>(bottom[i]->mutable_ocl_diff(0, insize));
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weight_data_t, bias_data, bottom_diff, relu_vals,
         cr_params_b);
+    if (num_pad_ != this->M_) {
+      this->StripOCLImages(&bottom_pad_, true, bottom[i],
+          packed ? &output_packed_ : NULL);
+    } else if (packed) {
+      this->UnpackOCLValues(&output_packed_, bottom[i]->count(),
+          bottom[i]->mutable_cpu_cpfp_diff());
+    }
+    bottom[i]->set_cpfp_diff_exp(bottom_exp);
+    if (outshift_ && bottom_diff_exp_.Sample()) {
+      bottom_diff_exp_.Update(std::ldexp(cpfp_amax(bottom[i]->count(),
+          bottom[i]->cpu_cpfp_diff()), bottom_exp));
+    }
   }
 }
 
@@ -607,13 +748,12 @@ template <typename Dtype>
 void OCLHWCNInnerProductLayer<Dtype>::Backward_ocl(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  if (use_aux_) {
-    const cpfp *top_diff =
-      reinterpret_cast<const cpfp *>(top[0]->cpu_diff());
+  if (use_aux_ || num_pad_ != this->M_) {
+    const cpfp *top_diff = top[0]->cpu_cpfp_diff();
     cpfp *top_diff_aux = top_aux.mutable_cpu_diff();
     for (int j = 0; j < top_aux.shape(0); ++j)
       for (int k = 0; k < top_aux.shape(1); ++k) 
-        if (j < top[0]->shape(0))
+        if (j < top[0]->shape(0) && k < top[0]->shape(1))
           top_diff_aux[j * top_aux.shape(1) + k] =
             top_diff[j * top[0]->shape(1) + k];
         else
@@ -630,6 +770,21 @@ void OCLHWCNInnerProductLayer<Dtype>::Backward_ocl(
     backward_bias(top, propagate_down, bottom);
 }
 
+template <typename Dtype>
+void OCLHWCNInnerProductLayer<Dtype>::OCLKernelCalls(
+    vector<kernel_params>* calls) const {
+  calls->push_back(ocl_params_);
+  calls->back().backward = 0;
+  calls->push_back(ocl_params_bw_);
+  calls->back().backward = 1;
+  calls->push_back(ocl_params_bi_);
+  calls->back().backward = 2;
+  if (this->bias_term_) {
+    calls->push_back(ocl_params_bb_);
+    calls->back().backward = 1;
+  }
+}
+
 
 INSTANTIATE_CLASS(OCLHWCNInnerProductLayer);
 REGISTER_LAYER_CLASS(OCLHWCNInnerProduct);
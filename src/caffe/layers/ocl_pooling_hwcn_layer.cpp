@@ -10,6 +10,8 @@ namespace caffe {
 template <typename Dtype>
 void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  CHECK(!this->xcl_param_.packed())
+      << "Only OCLHWCNInnerProduct layers run packed kernels";
   PoolingParameter pool_param = this->layer_param_.pooling_param();
   if (pool_param.global_pooling()) {
     CHECK(!(pool_param.has_kernel_size() ||
@@ -64,12 +66,13 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   CRParameter cr_param = this->layer_param_.cr_param(); 
   kernel_params *forward_params = &ocl_params_;
-  int num_ = bottom[0]->shape(3); 
+  // Batches that are not a multiple of 16 images run padded with zero images
+  num_pad_ = (bottom[0]->shape(3) + 15) / 16 * 16;
   forward_params->ydim = bottom[0]->shape(0);
   forward_params->xdim = bottom[0]->shape(1);
   forward_params->inchannels = bottom[0]->shape(2);
   forward_params->outchannels = 1;
-  forward_params->numimages = num_;
+  forward_params->numimages = num_pad_;
   forward_params->ksize = 3;
 
   int burstchannels_ = 16;
@@ -95,6 +98,7 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   forward_params->relu = 0;
   forward_params->pool = 1;
   forward_params->pksize = this->kernel_h_;
+  forward_params->outshift = 0;
 
   // Backward params
   kernel_params *backward_params = &ocl_params_bi_;
@@ -103,7 +107,7 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_params->inchannels = forward_params->inchannels;
   backward_params->outchannels = 1;
   backward_params->ksize = 3;
-  backward_params->numimages = num_;
+  backward_params->numimages = num_pad_;
   backward_params->rpofm = 0;
   backward_params->xtile_pad = 0;
   backward_params->burstydim = 0;
@@ -117,6 +121,7 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_params->pool = 1;
   backward_params->backward = 1;
   backward_params->pksize = this->kernel_h_;
+  backward_params->outshift = 0;
 }
 
 template <typename Dtype>
@@ -124,6 +129,10 @@ void OCLPoolingHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
       << "corresponding to (num, channels, height, width)";
+  // The kernel params of LayerSetUp are set for num_pad_ images
+  CHECK_EQ(num_pad_, (bottom[0]->shape(3) + 15) / 16 * 16)
+      << this->layer_param_.name() << ": the batch size is fixed at setup, "
+      << "create the net again to change it";
   this->num_ = bottom[0]->shape(3);
   this->channels_ = bottom[0]->shape(2);
   this->height_ = bottom[0]->shape(0);
@@ -135,40 +144,36 @@ void OCLPoolingHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       this->width_ + 2 * this->pad_w_ - this->kernel_w_) / this->stride_w_))
       + 1;
  
+  top[0]->set_cpfp(true);
   top[0]->Reshape(this->pooled_height_, this->pooled_width_, this->channels_,
       bottom[0]->shape(3));
 
   relu_indices.Reshape(this->pooled_height_, this->pooled_width_,
-      this->channels_, bottom[0]->shape(3) / 2);
+      this->channels_, num_pad_ / 2);
   weights_placeholder.Reshape(1, 1, 1, 1);
   bias_placeholder.Reshape(1, 1, 1, 1);
+  if (num_pad_ != this->num_) {
+    bottom_pad_.Reshape(this->height_, this->width_, this->channels_,
+        num_pad_);
+    top_pad_.Reshape(this->pooled_height_, this->pooled_width_,
+        this->channels_, num_pad_);
+  }
 }
 
 template <typename Dtype>
 void OCLPoolingHWCNLayer<Dtype>::launchKernel(const cpfp *bottom,
     const cpfp *weights, const cpfp *bias, cpfp *top, int *tags,
     const int *params) {
-  std::vector<cl_event> events;
-  int g = 0;
-  int events_size = 1;
-  events.resize(events_size, 0);
-  
-  clSetKernelArg(this->ocl_kernel, 0, sizeof(cl_mem),
-    (const void *)&bottom);
-  clSetKernelArg(this->ocl_kernel, 1, sizeof(cl_mem),
-    (const void *)&weights);
-  clSetKernelArg(this->ocl_kernel, 2, sizeof(cl_mem),
-    (const void *)&bias);
-  clSetKernelArg(this->ocl_kernel, 3, sizeof(cl_mem),
-    (const void *)&top);
-  clSetKernelArg(this->ocl_kernel, 4, sizeof(cl_mem),
-    (const void *)&tags);
-  clSetKernelArg(this->ocl_kernel, 5, sizeof(cl_mem),
-    (const void *)&params);
-  clSetKernelArg(this->ocl_kernel, 6, sizeof(cl_int),
-      (const void *)&g);
-  clEnqueueTask(oclCommandQueue, this->ocl_kernel, 0, NULL, &(events[g]));
-  clWaitForEvents(events.size(), events.data());
+  if (Caffe::mode() == Caffe::OCL_NATIVE) {
+    NativeKernelRunner::Run(this->GetNativeKernel(), (void *)bottom,
+        (void *)weights, (void *)bias, (void *)top, (void *)tags,
+        (int *)params, 1);
+    return;
+  }
+
+  void *args[] = {(void *)bottom, (void *)weights, (void *)bias,
+      (void *)top, (void *)tags, (void *)params};
+  this->EnqueueOCLTasks(args, 6, 1);
 }
 
 template <typename Dtype>
@@ -188,21 +193,25 @@ void OCLPoolingHWCNLayer<Dtype>::Forward_ocl(
   
   const int* p_params = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
-
   const cpfp *bias_data = bias_placeholder.ocl_data();
   const cpfp *weight_data = weights_placeholder.ocl_data();
   cpfp *top_data;
   int *relu_vals;
+  const bool padded = num_pad_ != bottom[0]->shape(3);
 
   for (int i = 0; i < bottom.size(); i++) {
-    const cpfp* bottom_data =
-      reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
-    top_data = reinterpret_cast<cpfp *>(top[i]->mutable_ocl_data(0, outsize));
+    const cpfp* bottom_data = padded ?
+      this->PadOCLImages(bottom[i], false, &bottom_pad_) :
+      bottom[i]->ocl_cpfp_data();
+    top_data = padded ? top_pad_.mutable_ocl_data(0) :
+      top[i]->mutable_ocl_cpfp_data(0);
     relu_vals = relu_indices.mutable_ocl_data(0);
     launchKernel(bottom_data, weight_data, bias_data, top_data, relu_vals,
         p_params);
+    if (padded)
+      this->StripOCLImages(&top_pad_, false, top[i]);
+    // Max pooling keeps the scale of its input
+    top[i]->set_cpfp_data_exp(bottom[i]->cpfp_data_exp());
   }
 }
 
@@ -226,25 +235,28 @@ void OCLPoolingHWCNLayer<Dtype>::Backward_ocl(const vector<Blob<Dtype>*>& top,
   
   const int* p_params_b = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
- 
   const cpfp *bias_data = bias_placeholder.ocl_data();
   const cpfp *weight_data = weights_placeholder.ocl_data();
   const cpfp *top_diff;
   int *relu_vals;
 
-  cpfp *bottom_diff =
-    reinterpret_cast<cpfp *>(bottom[0]->mutable_cpu_diff());
-  for (int i = 0; i < bottom[0]->count(); ++i)
+  const bool padded = num_pad_ != bottom[0]->shape(3);
+  cpfp *bottom_diff = padded ? bottom_pad_.mutable_cpu_diff() :
+    bottom[0]->mutable_cpu_cpfp_diff();
+  const int count = padded ? bottom_pad_.count() : bottom[0]->count();
+  for (int i = 0; i < count; ++i)
     bottom_diff[i] = cpfp(0);
   for (int i = 0; i < bottom.size(); i++) {
-    cpfp *bottom_diff =
-      reinterpret_cast<cpfp *>(bottom[i]->mutable_ocl_diff(0, insize));
-    top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+    cpfp *bottom_diff = padded ? bottom_pad_.mutable_ocl_diff(0) :
+      bottom[i]->mutable_ocl_cpfp_diff(0);
+    top_diff = padded ? this->PadOCLImages(top[i], true, &top_pad_) :
+      top[i]->ocl_cpfp_diff();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weight_data, bias_data, bottom_diff, relu_vals,
         p_params_b);
+    if (padded)
+      this->StripOCLImages(&bottom_pad_, true, bottom[i]);
+    bottom[i]->set_cpfp_diff_exp(top[i]->cpfp_diff_exp());
   }
 }
 
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/split_layer.hpp"
+#include "caffe/util/cpfp_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -17,6 +19,7 @@ void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     // some strange effects in practice...)
     CHECK_NE(top[i], bottom[0]) << this->type() << " Layer does not "
         "allow in-place computation.";
+    top[i]->set_cpfp(bottom[0]->is_cpfp());
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count_, top[i]->count());
   }
@@ -34,6 +37,29 @@ template <typename Dtype>
 void SplitLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
+  if (bottom[0]->is_cpfp()) {
+    // Scaled diffs are summed at the largest of their exponents
+    int exp = top[0]->cpfp_diff_exp();
+    for (int i = 1; i < top.size(); ++i) {
+      exp = std::max(exp, top[i]->cpfp_diff_exp());
+    }
+    cpfp* bottom_diff = bottom[0]->mutable_cpu_cpfp_diff();
+    cpfp_scale(count_, top[0]->cpfp_diff_exp() - exp, top[0]->cpu_cpfp_diff(),
+        bottom_diff);
+    vector<cpfp> scaled;
+    for (int i = 1; i < top.size(); ++i) {
+      const cpfp* top_diff = top[i]->cpu_cpfp_diff();
+      if (top[i]->cpfp_diff_exp() != exp) {
+        scaled.resize(count_);
+        cpfp_scale(count_, top[i]->cpfp_diff_exp() - exp, top_diff,
+            scaled.data());
+        top_diff = scaled.data();
+      }
+      cpfp_add(count_, bottom_diff, top_diff, bottom_diff);
+    }
+    bottom[0]->set_cpfp_diff_exp(exp);
+    return;
+  }
   if (top.size() == 1) {
     caffe_copy(count_, top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
     return;
@@ -0,0 +1,30 @@
+#ifdef USE_OCL_NATIVE
+#include "caffe/native/kernel_preamble.hpp"
+
+namespace caffe {
+
+namespace native_cr_layer_fb_cpfp {
+#include "../../fpga_caffe/layers/cr_layer_fb_cpfp.cpp"
+}  // namespace native_cr_layer_fb_cpfp
+
+static void cr_layer_fb_cpfp_native(void *input, void *weights, void *bias,
+    void *output, void *tags, int *params, int group_idx, int split_idx,
+    int num_splits) {
+  // No slicing hook in this kernel, slice 0 runs the whole task.
+  if (split_idx != 0) {
+    return;
+  }
+  using native_cr_layer_fb_cpfp::cpfp;
+  using native_cr_layer_fb_cpfp::cpfp16;
+  using native_cr_layer_fb_cpfp::char16;
+  // The host layers never set image_idx; batches are described by params.
+  native_cr_layer_fb_cpfp::cr_layer_fb_cpfp(static_cast<cpfp16 *>(input),
+      static_cast<cpfp16 *>(weights), static_cast<cpfp *>(bias),
+      static_cast<cpfp16 *>(output), static_cast<char16 *>(tags), params,
+      group_idx, 0);
+}
+
+REGISTER_NATIVE_KERNEL(cr_layer_fb_cpfp, cr_layer_fb_cpfp_native);
+
+}  // namespace caffe
+#endif  // USE_OCL_NATIVE
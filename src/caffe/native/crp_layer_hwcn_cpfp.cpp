@@ -0,0 +1,26 @@
+#ifdef USE_OCL_NATIVE
+#include "caffe/native/kernel_preamble.hpp"
+
+namespace caffe {
+
+namespace native_crp_layer_hwcn_cpfp {
+#include "../../fpga_caffe/layers/crp_layer_hwcn_cpfp.cpp"
+}  // namespace native_crp_layer_hwcn_cpfp
+
+static void crp_layer_hwcn_cpfp_native(void *input, void *weights, void *bias,
+    void *output, void *tags, int *params, int group_idx, int split_idx,
+    int num_splits) {
+  using native_crp_layer_hwcn_cpfp::cpfp;
+  using native_crp_layer_hwcn_cpfp::cpfp16;
+  // The kernel computes its own slice of the output feature map loop, the
+  // same way a compute unit does.
+  native_crp_layer_hwcn_cpfp::crp_layer_hwcn_cpfp(
+      static_cast<cpfp16 *>(input), static_cast<cpfp16 *>(weights),
+      static_cast<cpfp *>(bias), static_cast<cpfp16 *>(output),
+      static_cast<short *>(tags), params, group_idx, split_idx, num_splits);
+}
+
+REGISTER_NATIVE_KERNEL(crp_layer_hwcn_cpfp, crp_layer_hwcn_cpfp_native);
+
+}  // namespace caffe
+#endif  // USE_OCL_NATIVE
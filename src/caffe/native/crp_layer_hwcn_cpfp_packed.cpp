@@ -0,0 +1,33 @@
+#ifdef USE_OCL_NATIVE
+#include "caffe/native/kernel_preamble.hpp"
+
+// Ports of packed 256 bit beats, see XCLParameter.packed
+#define CPFP_PACKED
+// The kernel is extern "C", give it a symbol of its own so that it does not
+// clash with the unpacked build in crp_layer_hwcn_cpfp.cpp
+#define crp_layer_hwcn_cpfp crp_layer_hwcn_cpfp_packed
+
+namespace caffe {
+
+namespace native_crp_layer_hwcn_cpfp_packed {
+#include "../../fpga_caffe/layers/crp_layer_hwcn_cpfp.cpp"
+}  // namespace native_crp_layer_hwcn_cpfp_packed
+#undef crp_layer_hwcn_cpfp
+
+static void crp_layer_hwcn_cpfp_packed_native(void *input, void *weights,
+    void *bias, void *output, void *tags, int *params, int group_idx,
+    int split_idx, int num_splits) {
+  using native_crp_layer_hwcn_cpfp_packed::cpfp;
+  using native_crp_layer_hwcn_cpfp_packed::port16;
+  // Slices end on whole beats of the output, see the kernel.
+  native_crp_layer_hwcn_cpfp_packed::crp_layer_hwcn_cpfp_packed(
+      static_cast<port16 *>(input), static_cast<port16 *>(weights),
+      static_cast<cpfp *>(bias), static_cast<port16 *>(output),
+      static_cast<short *>(tags), params, group_idx, split_idx, num_splits);
+}
+
+REGISTER_NATIVE_KERNEL(crp_layer_hwcn_cpfp_packed,
+    crp_layer_hwcn_cpfp_packed_native);
+
+}  // namespace caffe
+#endif  // USE_OCL_NATIVE
@@ -0,0 +1,27 @@
+#ifdef USE_OCL_NATIVE
+#include "caffe/native/kernel_preamble.hpp"
+
+namespace caffe {
+
+namespace native_wcrp_layer_hwcn_cpfp_fw {
+#include "../../fpga_caffe/layers/wcrp_layer_hwcn_cpfp_fw.cpp"
+}  // namespace native_wcrp_layer_hwcn_cpfp_fw
+
+static void wcrp_layer_hwcn_cpfp_fw_native(void *input, void *weights,
+    void *bias, void *output, void *tags, int *params, int group_idx,
+    int split_idx, int num_splits) {
+  if (split_idx != 0) {
+    return;
+  }
+  using native_wcrp_layer_hwcn_cpfp_fw::cpfp;
+  using native_wcrp_layer_hwcn_cpfp_fw::cpfp16;
+  native_wcrp_layer_hwcn_cpfp_fw::wcrp_layer_hwcn_cpfp_fw(
+      static_cast<cpfp16 *>(input), static_cast<cpfp16 *>(weights),
+      static_cast<cpfp *>(bias), static_cast<cpfp16 *>(output),
+      static_cast<short *>(tags), params, group_idx);
+}
+
+REGISTER_NATIVE_KERNEL(wcrp_layer_hwcn_cpfp_fw, wcrp_layer_hwcn_cpfp_fw_native);
+
+}  // namespace caffe
+#endif  // USE_OCL_NATIVE
@@ -0,0 +1,187 @@
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/native_kernel.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The emulated kernels keep their on-chip buffers on the stack. The largest
+// frame is about 1.3 MB, more than some platforms give a new thread, so the
+// workers ask for a stack with plenty of headroom.
+const size_t kNativeStackSize = 16 << 20;
+
+class NativeThreadPool {
+ public:
+  explicit NativeThreadPool(int num_threads)
+      : num_threads_(num_threads), stop_(false) {
+    boost::thread::attributes attrs;
+    attrs.set_stack_size(kNativeStackSize);
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(
+          attrs, boost::bind(&NativeThreadPool::WorkerEntry, this))));
+    }
+  }
+
+  ~NativeThreadPool() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+    work_cond_.notify_all();
+    for (int i = 0; i < threads_.size(); ++i) {
+      threads_[i]->join();
+    }
+  }
+
+  int num_threads() const { return num_threads_; }
+
+  // Queues the tasks and blocks until they have finished. Solvers on
+  // different threads share the pool, each only waits for its own tasks.
+  void Run(const std::vector<boost::function<void()> >& tasks) {
+    boost::mutex::scoped_lock lock(mutex_);
+    int pending = tasks.size();
+    for (int i = 0; i < tasks.size(); ++i) {
+      queue_.push_back(std::make_pair(tasks[i], &pending));
+    }
+    work_cond_.notify_all();
+    while (pending > 0) {
+      done_cond_.wait(lock);
+    }
+  }
+
+ private:
+  void WorkerEntry() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (true) {
+      while (!stop_ && queue_.empty()) {
+        work_cond_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      std::pair<boost::function<void()>, int*> task = queue_.front();
+      queue_.pop_front();
+      lock.unlock();
+      task.first();
+      lock.lock();
+      if (--*task.second == 0) {
+        done_cond_.notify_all();
+      }
+    }
+  }
+
+  int num_threads_;
+  bool stop_;
+  // Tasks with the number of unfinished tasks of the Run call they are from
+  std::deque<std::pair<boost::function<void()>, int*> > queue_;
+  std::vector<boost::shared_ptr<boost::thread> > threads_;
+  boost::mutex mutex_;
+  boost::condition_variable work_cond_;
+  boost::condition_variable done_cond_;
+};
+
+int g_native_threads_ = 0;
+boost::mutex g_native_pool_mutex_;
+NativeThreadPool* g_native_pool_ = NULL;
+
+NativeThreadPool* GetPool(int num_threads) {
+  boost::mutex::scoped_lock lock(g_native_pool_mutex_);
+  if (g_native_pool_ && g_native_pool_->num_threads() != num_threads) {
+    delete g_native_pool_;
+    g_native_pool_ = NULL;
+  }
+  if (!g_native_pool_) {
+    g_native_pool_ = new NativeThreadPool(num_threads);
+  }
+  return g_native_pool_;
+}
+
+}  // namespace
+
+NativeKernelRegistry::KernelRegistry& NativeKernelRegistry::Registry() {
+  static KernelRegistry* g_registry_ = new KernelRegistry();
+  return *g_registry_;
+}
+
+void NativeKernelRegistry::AddKernel(const std::string& name,
+    NativeKernel kernel) {
+  KernelRegistry& registry = Registry();
+  CHECK_EQ(registry.count(name), 0)
+      << "Native kernel " << name << " already registered.";
+  registry[name] = kernel;
+}
+
+NativeKernel NativeKernelRegistry::GetKernel(const std::string& name) {
+  KernelRegistry& registry = Registry();
+  if (registry.count(name) != 1) {
+    std::vector<std::string> names = KernelList();
+    std::string names_str;
+    for (int i = 0; i < names.size(); ++i) {
+      if (i > 0) {
+        names_str += ", ";
+      }
+      names_str += names[i];
+    }
+    LOG(FATAL) << "Unknown native kernel: " << name << " (known kernels: "
+        << names_str << "). Native kernels require USE_OCL_NATIVE.";
+  }
+  return registry[name];
+}
+
+std::vector<std::string> NativeKernelRegistry::KernelList() {
+  KernelRegistry& registry = Registry();
+  std::vector<std::string> names;
+  for (KernelRegistry::iterator iter = registry.begin();
+       iter != registry.end(); ++iter) {
+    names.push_back(iter->first);
+  }
+  return names;
+}
+
+void NativeKernelRunner::set_num_threads(int num_threads) {
+  CHECK_GE(num_threads, 0) << "Native thread count must be non-negative.";
+  g_native_threads_ = num_threads;
+}
+
+int NativeKernelRunner::num_threads() {
+  if (g_native_threads_ > 0) {
+    return g_native_threads_;
+  }
+  int hw_threads = boost::thread::hardware_concurrency();
+  return hw_threads > 0 ? hw_threads : 1;
+}
+
+void NativeKernelRunner::Run(NativeKernel kernel, void *input, void *weights,
+    void *bias, void *output, void *tags, int *params, int numgroups) {
+  CHECK(kernel) << "No native kernel loaded, is there an XCLProgram layer?";
+  int threads = num_threads();
+  if (threads == 1) {
+    for (int g = 0; g < numgroups; ++g) {
+      kernel(input, weights, bias, output, tags, params, g, 0, 1);
+    }
+    return;
+  }
+  // Cut every group into enough slices to give each thread at least one.
+  int num_splits = (threads + numgroups - 1) / numgroups;
+  std::vector<boost::function<void()> > tasks;
+  for (int g = 0; g < numgroups; ++g) {
+    for (int s = 0; s < num_splits; ++s) {
+      tasks.push_back(boost::bind(kernel, input, weights, bias, output, tags,
+          params, g, s, num_splits));
+    }
+  }
+  GetPool(threads)->Run(tasks);
+}
+
+}  // namespace caffe
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "caffe/ocl_kernel_model.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Bytes each port moves per cycle: cpfp16 on the packed data ports, the
+// element type on the others.
+const double kPortWidth[NUM_GMEM_PORTS] = {32, 32, 32, 2, 2, 4};
+// Cycles before the first beat of a memcpy arrives.
+const double kBurstLatency = 64;
+// Cycles for the last iteration of a MAC loop to leave the adder tree.
+const double kPipelineDepth = 4 * HADD_LATENCY;
+const double kBytesPerValue = 2;
+const double kLanes = 16;
+
+inline bool Inside(int i, int dim) {
+  return i >= 0 && i < dim;
+}
+
+// Sums over the output pixels of one channel pass.
+struct WindowCounts {
+  // Taps of all windows that fall inside the image.
+  double taps;
+  // Taps memcpy'd from the input, and taps shifted in the input buffer.
+  double loads;
+  double shifts;
+  // Taps outside the image that are zero filled.
+  double fills;
+  // Windows, i.e. MAC loop invocations.
+  double windows;
+};
+
+// The direct kernels slide a ksize x ksize window and only reload the
+// columns a stride moves in. Rows and columns are independent, so the sums
+// factor into a row sum times a column sum.
+WindowCounts DirectWindows(const kernel_params& p, int ydim_out,
+    int xdim_out) {
+  double rows = 0, cols = 0, col_loads = 0;
+  for (int y = 0; y < ydim_out; ++y) {
+    for (int k = 0; k < p.ksize; ++k) {
+      rows += Inside(y * p.stride - p.pad + k, p.ydim);
+    }
+  }
+  for (int x = 0; x < xdim_out; ++x) {
+    for (int q = 0; q < p.ksize; ++q) {
+      if (Inside(x * p.stride - p.pad + q, p.xdim)) {
+        cols += 1;
+        col_loads += !(x != 0 && q + p.stride < p.ksize);
+      }
+    }
+  }
+  WindowCounts counts = {rows * cols, rows * col_loads,
+      rows * (cols - col_loads), 0,
+      static_cast<double>(ydim_out) * xdim_out};
+  return counts;
+}
+
+// wcrp computes two outputs along x from a 4 wide window, once for every
+// three filter columns, and zero fills the window taps outside the image.
+WindowCounts WinogradWindows(const kernel_params& p, int ydim_out,
+    int xdim_out) {
+  const int xdim_iter = (xdim_out + 1) / 2;
+  const int k_iters = (p.ksize + 2) / 3;
+  double rows = 0, cols = 0, col_loads = 0;
+  for (int y = 0; y < ydim_out; ++y) {
+    for (int k = 0; k < p.ksize; ++k) {
+      rows += Inside(y * p.stride - p.pad + k, p.ydim);
+    }
+  }
+  for (int off = 0; off < k_iters; ++off) {
+    for (int x = 0; x < xdim_iter; ++x) {
+      for (int q = 0; q < 4; ++q) {
+        if (Inside(x * 2 - p.pad + q + off * 3, p.xdim)) {
+          cols += 1;
+          col_loads += !(x >= 2 && p.stride == 1 && q < 2);
+        }
+      }
+    }
+  }
+  const double windows = static_cast<double>(ydim_out) * xdim_iter * k_iters;
+  WindowCounts counts = {rows * xdim_iter * k_iters, rows * col_loads,
+      rows * (cols - col_loads), windows * p.ksize * 4 - rows * cols,
+      windows};
+  return counts;
+}
+
+}  // namespace
+
+double OCLKernelEstimate::ddr_bytes() const {
+  double bytes = 0;
+  for (int i = 0; i < NUM_GMEM_PORTS; ++i) {
+    bytes += gmem_bytes[i];
+  }
+  return bytes;
+}
+
+OCLKernelConfig OCLKernelModel::Config(const std::string& kernel_name) {
+  OCLKernelConfig config = {4, 1, false, false};
+  if (kernel_name.find("16pegrp") != std::string::npos) {
+    config.num_pe = 16;
+  } else if (kernel_name.find("8pegrp") != std::string::npos) {
+    config.num_pe = 8;
+  } else if (kernel_name.find("2pegrp") != std::string::npos) {
+    config.num_pe = 2;
+  }
+  if (kernel_name.find("2mult") != std::string::npos) {
+    config.ocfact = 2;
+  }
+  config.winograd = kernel_name.compare(0, 4, "wcrp") == 0;
+  config.forward_only = config.winograd ||
+    kernel_name.find("_fw") != std::string::npos;
+  return config;
+}
+
+double OCLKernelModel::PeakMACsPerCycle(const OCLKernelConfig& config) {
+  return config.num_pe * kLanes * config.ocfact;
+}
+
+OCLKernelEstimate OCLKernelModel::Estimate(const kernel_params& params,
+    const OCLKernelConfig& config) {
+  CHECK(!config.winograd || params.backward == 0)
+      << "Winograd kernels only run the forward pass";
+  CHECK_GT(params.burstchannels, 0);
+  CHECK_GT(params.burstydim, 0);
+  OCLKernelEstimate est;
+  memset(&est, 0, sizeof(est));
+
+  const bool fw_mode = params.backward == 0;
+  const bool bw_mode = params.backward == 1;
+  // The kernel reads the relu tag owner from the fc slot
+  const bool relu_weights = params.fc == 1;
+  const int ksize2 = params.ksize * params.ksize;
+  // Output rows are taken to be as many as the columns, like the kernel does
+  const int xdim_out =
+    (params.xdim - params.ksize + 2 * params.pad) / params.stride + 1;
+  const int ydim_out = xdim_out;
+  const double pixels = static_cast<double>(ydim_out) * xdim_out;
+  const double img_fact = params.numimages / 16;
+  const double burst_fact = params.burstchannels / config.num_pe;
+  const double wc_fact = (params.burstchannels + 15) / 16;
+  const double ic_fact = (params.inchannels + 15) / 16;
+  const int burstoc = params.burstydim;
+  const int ofm_iters = (params.rpofm + config.ocfact - 1) / config.ocfact;
+  const double rpo = params.rpo;
+
+  // Bursts that carry output channels, and the channels they carry
+  double bursts = 0, channels = 0;
+  for (int o = 0; o < ofm_iters * config.ocfact; ++o) {
+    const int left = params.outchannels - o * burstoc;
+    if (left > 0) {
+      bursts += 1;
+      channels += std::min(left, burstoc);
+    }
+  }
+
+  const WindowCounts win = config.winograd ?
+    WinogradWindows(params, ydim_out, xdim_out) :
+    DirectWindows(params, ydim_out, xdim_out);
+  const double passes = rpo * ofm_iters;
+  double* bytes = est.gmem_bytes;
+  double* count = est.gmem_bursts;
+
+  // Windows, one memcpy per PE bank, and their relu tags in the backward
+  // passes
+  const double bank_beats = burst_fact * img_fact;
+  bytes[GMEM_INPUT] += passes * win.loads * config.num_pe * bank_beats * 32;
+  count[GMEM_INPUT] += passes * win.loads * config.num_pe;
+  if (!fw_mode && params.relu && !relu_weights) {
+    bytes[GMEM_TAGS] += passes * win.loads * config.num_pe * bank_beats * 2;
+    count[GMEM_TAGS] += passes * win.loads * config.num_pe;
+  }
+  est.buffer_cycles += passes * (win.shifts + win.fills) * bank_beats;
+
+  const double out_burst = img_fact * 32;
+  const double filter_burst = ksize2 * wc_fact * 32;
+  if (bw_mode) {
+    // Weight gradients stay on chip for the whole image and are written
+    // once per pass, the output gradients stream in on the weight port.
+    est.buffer_cycles += passes * burstoc * ksize2 * wc_fact;
+    bytes[GMEM_OUTPUT] += rpo * channels * filter_burst;
+    count[GMEM_OUTPUT] += rpo * bursts;
+    bytes[GMEM_WEIGHTS] += rpo * pixels * channels * out_burst;
+    count[GMEM_WEIGHTS] += rpo * pixels * bursts;
+    if (params.relu && relu_weights) {
+      bytes[GMEM_TAGS] += rpo * pixels * channels * img_fact * 2;
+      count[GMEM_TAGS] += rpo * pixels * bursts;
+    }
+  } else {
+    // Outputs are filled with the bias or zero on the first input channel
+    // pass, and read back and accumulated on the others. Winograd also
+    // splits the filter columns into passes.
+    const double col_passes = config.winograd ? (params.ksize + 2) / 3 : 1;
+    const double outputs = ydim_out * (config.winograd ?
+        (xdim_out + 1) / 2 : xdim_out);
+    est.buffer_cycles += ofm_iters * outputs * burstoc * img_fact;
+    bytes[GMEM_OUTPUT] += (2 * rpo * col_passes - 1) * pixels * channels *
+      out_burst;
+    count[GMEM_OUTPUT] += (2 * rpo * col_passes - 1) * pixels * bursts;
+    if (fw_mode && params.relu) {
+      bytes[GMEM_TAGS] += pixels * channels * img_fact * 2;
+      count[GMEM_TAGS] += pixels * bursts;
+    }
+    // Filters are read at the first pixel of every pass, wcrp reads a burst
+    // per filter column.
+    bytes[GMEM_WEIGHTS] += rpo * channels * filter_burst;
+    count[GMEM_WEIGHTS] += rpo * bursts *
+      (config.winograd ? params.ksize : 1);
+    if (config.winograd) {
+      est.buffer_cycles += passes * (3 * col_passes - params.ksize) *
+        burstoc * params.ksize * wc_fact;
+    }
+  }
+  if (fw_mode) {
+    bytes[GMEM_BIAS] += channels * kBytesPerValue;
+    count[GMEM_BIAS] += bursts;
+  }
+  bytes[GMEM_PARAMS] += sizeof(kernel_params);
+  count[GMEM_PARAMS] += 1;
+
+  // Every iteration of the MAC loop runs all PEs on one tap of burstoc
+  // output channels
+  est.mac_cycles = passes * (burstoc * img_fact * burst_fact * win.taps +
+      win.windows * kPipelineDepth);
+  const WindowCounts direct = DirectWindows(params, ydim_out, xdim_out);
+  est.macs = static_cast<double>(params.outchannels) * params.inchannels *
+    params.numimages * direct.taps;
+
+  for (int i = 0; i < NUM_GMEM_PORTS; ++i) {
+    est.memory_cycles += bytes[i] / kPortWidth[i] + count[i] * kBurstLatency;
+  }
+
+  // Host side operands of one group
+  const double in_values = static_cast<double>(params.ydim) * params.xdim *
+    params.inchannels * params.numimages;
+  const double out_values = pixels * params.outchannels * params.numimages;
+  const double filter_values = params.outchannels * ksize2 * ic_fact * 16;
+  est.pcie_bytes = (in_values + out_values + filter_values) * kBytesPerValue;
+  if (fw_mode) {
+    est.pcie_bytes += params.outchannels * kBytesPerValue;
+  }
+  if (params.relu) {
+    // One tag bit per value, on the output in the forward pass
+    est.pcie_bytes += (!fw_mode && !relu_weights ? in_values : out_values) /
+      8;
+  }
+
+  // The groups are separate tasks with the same shape
+  const double groups = params.numgroups;
+  est.macs *= groups;
+  est.mac_cycles *= groups;
+  est.buffer_cycles *= groups;
+  est.memory_cycles *= groups;
+  for (int i = 0; i < NUM_GMEM_PORTS; ++i) {
+    bytes[i] *= groups;
+    count[i] *= groups;
+  }
+  est.pcie_bytes = est.pcie_bytes * groups + sizeof(kernel_params);
+  return est;
+}
+
+}  // namespace caffe
@@ -0,0 +1,221 @@
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/ocl_kernel_registry.hpp"
+
+namespace caffe {
+
+#ifdef USE_OCL
+namespace {
+
+struct DeviceState {
+  // The xclbins loaded on the device, most recently used first. programs
+  // and kernels only ever hold the ones of these xclbins.
+  std::list<std::string> resident;
+  OCLKernelRegistry::ProgramMap programs;
+  OCLKernelRegistry::KernelMap kernels;
+  // Queues of compute units 1 and up, unit 0 uses oclCommandQueue.
+  std::vector<cl_command_queue> queues;
+};
+
+struct RegistryState {
+  RegistryState() : xclbin_dir(".build_release/opencl/src/caffe/layers/"),
+      max_programs(1) {}
+
+  boost::mutex mutex;
+  std::string xclbin_dir;
+  int max_programs;
+  std::map<cl_context, DeviceState> devices;
+};
+
+RegistryState& State() {
+  static RegistryState* g_state_ = new RegistryState();
+  return *g_state_;
+}
+
+// Nets set up concurrently, one per device, each select their own kernels.
+// The selection is freed with its thread.
+boost::thread_specific_ptr<XCLParameter> g_selected_;
+
+// Releases the kernels and the program of one xclbin of a device.
+void ReleaseProgram(DeviceState* device, const std::string& xcl_name) {
+  OCLKernelRegistry::KernelMap::iterator it = device->kernels.begin();
+  while (it != device->kernels.end()) {
+    if (it->first.first == xcl_name) {
+      for (int i = 0; i < it->second.size(); ++i) {
+        clReleaseKernel(it->second[i]);
+      }
+      device->kernels.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  OCLKernelRegistry::ProgramMap::iterator program =
+      device->programs.find(xcl_name);
+  if (program != device->programs.end()) {
+    clReleaseProgram(program->second);
+    device->programs.erase(program);
+  }
+  device->resident.remove(xcl_name);
+}
+
+}  // namespace
+
+cl_kernel OCLKernelRegistry::GetKernel(const std::string& xcl_name,
+    const std::string& kernel_name) {
+  return GetKernels(xcl_name, kernel_name, 1)[0];
+}
+
+std::vector<cl_kernel> OCLKernelRegistry::GetKernels(
+    const std::string& xcl_name, const std::string& kernel_name, int num_cu) {
+  CHECK(!kernel_name.empty()) << "No OCL kernel selected, add an XCLProgram "
+      << "layer or an xcl_param to the layer.";
+  CHECK_GE(num_cu, 1);
+  RegistryState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  CHECK(oclContext) << "No OCL device set on this thread";
+  DeviceState& device = state.devices[oclContext];
+  std::list<std::string>::iterator resident = std::find(
+      device.resident.begin(), device.resident.end(), xcl_name);
+  if (resident != device.resident.end()) {
+    device.resident.splice(device.resident.begin(), device.resident,
+        resident);
+  } else {
+    while (device.resident.size() >= state.max_programs) {
+      // Loading another xclbin reprograms the device, the tasks queued on
+      // it finish first and the kernels of the least recently used xclbin
+      // are invalid from then on.
+      clFinish(oclCommandQueue);
+      for (int i = 0; i < device.queues.size(); ++i) {
+        clFinish(device.queues[i]);
+      }
+      LOG(INFO) << "Reprogramming OCL device, " << device.resident.back()
+          << " is replaced by " << xcl_name;
+      ReleaseProgram(&device, device.resident.back());
+    }
+    device.resident.push_front(xcl_name);
+  }
+  std::pair<std::string, std::string> key(xcl_name, kernel_name);
+  std::vector<cl_kernel>& kernels = device.kernels[key];
+  if (kernels.size() >= num_cu) {
+    return std::vector<cl_kernel>(kernels.begin(), kernels.begin() + num_cu);
+  }
+  cl_int error;
+  ProgramMap::iterator program = device.programs.find(xcl_name);
+  if (program == device.programs.end()) {
+    std::string path = xcl_name;
+    if (xcl_name.find('/') == std::string::npos) {
+      path = state.xclbin_dir + xcl_name;
+    }
+    char *sourceStr;
+    size_t sourceSize = caffe::convertToString(path, &sourceStr);
+    cl_program prog = clCreateProgramWithBinary(oclContext, 1, &oclDevices,
+        &sourceSize, (const unsigned char **)&sourceStr, NULL, &error);
+    delete[] sourceStr;
+    CHECK_EQ(error, CL_SUCCESS) << "Could not load " << path;
+    LOG(INFO) << "Loaded OCL program " << path;
+    program = device.programs.insert(std::make_pair(xcl_name, prog)).first;
+  }
+  // Every cl_kernel of the same name may be scheduled on any free compute
+  // unit, separate instances keep the arguments of concurrent tasks apart.
+  while (kernels.size() < num_cu) {
+    cl_kernel k = clCreateKernel(program->second, kernel_name.c_str(), &error);
+    CHECK_EQ(error, CL_SUCCESS) << "No kernel " << kernel_name << " in "
+        << xcl_name;
+    kernels.push_back(k);
+  }
+  return kernels;
+}
+
+cl_command_queue OCLKernelRegistry::GetQueue(int cu) {
+  if (cu == 0) {
+    return oclCommandQueue;
+  }
+  RegistryState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  std::vector<cl_command_queue>& queues = state.devices[oclContext].queues;
+  while (queues.size() < cu) {
+    cl_int error;
+    cl_command_queue queue = clCreateCommandQueue(oclContext, oclDevices, 0,
+        &error);
+    CHECK_EQ(error, CL_SUCCESS) << "Could not create a command queue";
+    queues.push_back(queue);
+  }
+  return queues[cu - 1];
+}
+
+void OCLKernelRegistry::set_xclbin_dir(const std::string& dir) {
+  RegistryState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  state.xclbin_dir = dir;
+  if (!dir.empty() && dir[dir.size() - 1] != '/') {
+    state.xclbin_dir += '/';
+  }
+}
+
+std::string OCLKernelRegistry::xclbin_dir() {
+  RegistryState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  return state.xclbin_dir;
+}
+
+void OCLKernelRegistry::set_max_programs(int max_programs) {
+  CHECK_GE(max_programs, 1);
+  RegistryState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  state.max_programs = max_programs;
+}
+
+int OCLKernelRegistry::max_programs() {
+  RegistryState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  return state.max_programs;
+}
+
+std::vector<std::string> OCLKernelRegistry::Resident() {
+  RegistryState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  CHECK(oclContext) << "No OCL device set on this thread";
+  const std::list<std::string>& resident = state.devices[oclContext].resident;
+  return std::vector<std::string>(resident.begin(), resident.end());
+}
+
+void OCLKernelRegistry::Select(const XCLParameter& param) {
+  if (!g_selected_.get()) {
+    g_selected_.reset(new XCLParameter());
+  }
+  g_selected_->CopyFrom(param);
+}
+
+XCLParameter OCLKernelRegistry::Selected() {
+  if (!g_selected_.get()) {
+    return XCLParameter();
+  }
+  return *g_selected_;
+}
+
+void OCLKernelRegistry::Clear() {
+  RegistryState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  for (std::map<cl_context, DeviceState>::iterator dev =
+       state.devices.begin(); dev != state.devices.end(); ++dev) {
+    DeviceState& device = dev->second;
+    while (!device.resident.empty()) {
+      ReleaseProgram(&device, device.resident.front());
+    }
+    for (int i = 0; i < device.queues.size(); ++i) {
+      clReleaseCommandQueue(device.queues[i]);
+    }
+  }
+  state.devices.clear();
+}
+#endif
+
+}  // namespace caffe
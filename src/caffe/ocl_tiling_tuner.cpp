@@ -0,0 +1,205 @@
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/ocl_kernel_model.hpp"
+#include "caffe/ocl_tiling_tuner.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Capacities of the crp kernel buffers, in cpfp values.
+const int kInputBufferSize = 8 * 256 * 256;
+const int kWeightBufferSize = 8 * 256 * 16;
+const int kBiasBufferSize = 6144;
+const int kMaxBurstChannels = 2048;
+const int kMaxNumImages = 256;
+
+struct TunerState {
+  TunerState() : loaded(false) {}
+
+  boost::mutex mutex;
+  std::string cache_file;
+  bool loaded;
+  std::map<std::string, OCLTiling> tilings;
+};
+
+TunerState& State() {
+  static TunerState* g_state_ = new TunerState();
+  return *g_state_;
+}
+
+std::string TilingKey(const std::string& kernel_name,
+    const kernel_params& params, const OCLTilingLimits& limits) {
+  std::ostringstream key;
+  key << (kernel_name.empty() ? "none" : kernel_name) << " "
+      << params.inchannels << " " << params.outchannels << " "
+      << params.numimages << " " << params.ksize << " " << params.ydim << " "
+      << params.xdim << " " << params.stride << " " << params.pad << " "
+      << params.numgroups << " " << limits.num_pe << " " << limits.num_cu
+      << " " << limits.burstoc_limit << " " << limits.min_burstchannels;
+  return key.str();
+}
+
+// Lines hold a key followed by burstchannels, rpo, rpofm and burstoc. Later
+// lines win, so a retuned shape only needs to be appended.
+void LoadCache(TunerState* state) {
+  state->loaded = true;
+  if (state->cache_file.empty()) {
+    return;
+  }
+  std::ifstream in(state->cache_file.c_str());
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (fields >> token) {
+      tokens.push_back(token);
+    }
+    if (tokens.size() < 5) {
+      continue;
+    }
+    std::string key = tokens[0];
+    for (int i = 1; i < tokens.size() - 4; ++i) {
+      key += " " + tokens[i];
+    }
+    const int t = tokens.size() - 4;
+    OCLTiling tiling = {atoi(tokens[t].c_str()), atoi(tokens[t + 1].c_str()),
+        atoi(tokens[t + 2].c_str()), atoi(tokens[t + 3].c_str())};
+    state->tilings[key] = tiling;
+  }
+}
+
+}  // namespace
+
+bool OCLTilingTuner::Fits(const kernel_params& params,
+    const OCLTilingLimits& limits, const OCLTiling& tiling) {
+  const int ic = params.inchannels;
+  const int oc = params.outchannels;
+  const int num = params.numimages;
+  const int ksize2 = params.ksize * params.ksize;
+  const int bc = tiling.burstchannels;
+  if (bc < 1 || tiling.rpo < 1 || tiling.rpofm < 1 || tiling.burstoc < 1) {
+    return false;
+  }
+  // Kernel asserts
+  if (bc * tiling.rpo != ic || bc > kMaxBurstChannels ||
+      bc < std::min(limits.min_burstchannels, ic) || num > kMaxNumImages) {
+    return false;
+  }
+  // Passes over part of the channels start on whole 16 channel words, and
+  // the weights are split evenly across the PEs
+  if ((tiling.rpo > 1 && bc % 16 != 0) || (bc != ic && bc % limits.num_pe)) {
+    return false;
+  }
+  // On-chip buffers
+  if (bc * ksize2 * num > kInputBufferSize ||
+      bc * ksize2 * tiling.burstoc > kWeightBufferSize ||
+      tiling.burstoc > limits.burstoc_limit ||
+      tiling.rpofm * tiling.burstoc > kBiasBufferSize) {
+    return false;
+  }
+  // Enough work per burst to cover the adder tree, as checked by the layers
+  if (tiling.burstoc * (num / 16) < 16 || tiling.burstoc * bc * ksize2 < 16) {
+    return false;
+  }
+  return tiling.rpofm * tiling.burstoc >= oc &&
+      tiling.rpofm >= std::min(limits.num_cu, oc);
+}
+
+std::vector<OCLTiling> OCLTilingTuner::Candidates(
+    const kernel_params& params, const OCLTilingLimits& limits) {
+  std::vector<OCLTiling> tilings;
+  const int ic = params.inchannels;
+  const int oc = params.outchannels;
+  for (int bc = ic; bc >= 1; --bc) {
+    if (ic % bc != 0) {
+      continue;
+    }
+    for (int burstoc = 1; burstoc <= limits.burstoc_limit; ++burstoc) {
+      OCLTiling tiling = {bc, ic / bc, (oc + burstoc - 1) / burstoc, burstoc};
+      if (Fits(params, limits, tiling)) {
+        tilings.push_back(tiling);
+      }
+    }
+  }
+  return tilings;
+}
+
+double OCLTilingTuner::Cost(const kernel_params& params,
+    const OCLTilingLimits& limits, const OCLTiling& tiling) {
+  kernel_params tiled = params;
+  Apply(tiling, &tiled);
+  // Ranked on the forward loop nest, which the backward pass wrt data shares
+  tiled.backward = 0;
+  tiled.relu = 0;
+  tiled.fc = 0;
+  OCLKernelConfig config = {limits.num_pe, 1, false, false};
+  return OCLKernelModel::Estimate(tiled, config).cycles();
+}
+
+OCLTiling OCLTilingTuner::Tune(const std::string& kernel_name,
+    const kernel_params& params, const OCLTilingLimits& limits) {
+  const std::string key = TilingKey(kernel_name, params, limits);
+  TunerState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  if (!state.loaded) {
+    LoadCache(&state);
+  }
+  std::map<std::string, OCLTiling>::iterator it = state.tilings.find(key);
+  if (it != state.tilings.end() && Fits(params, limits, it->second)) {
+    return it->second;
+  }
+  std::vector<OCLTiling> tilings = Candidates(params, limits);
+  CHECK(!tilings.empty()) << "No tiling of " << key << " fits the kernel";
+  OCLTiling best = tilings[0];
+  double best_cost = Cost(params, limits, best);
+  for (int i = 1; i < tilings.size(); ++i) {
+    double cost = Cost(params, limits, tilings[i]);
+    if (cost < best_cost) {
+      best = tilings[i];
+      best_cost = cost;
+    }
+  }
+  LOG(INFO) << "Tiling " << key << ": burstchannels " << best.burstchannels
+      << ", rpo " << best.rpo << ", rpofm " << best.rpofm << ", burstoc "
+      << best.burstoc << " out of " << tilings.size() << " candidates";
+  state.tilings[key] = best;
+  if (!state.cache_file.empty()) {
+    std::ofstream out(state.cache_file.c_str(), std::ios::app);
+    out << key << " " << best.burstchannels << " " << best.rpo << " "
+        << best.rpofm << " " << best.burstoc << "\n";
+    LOG_IF(WARNING, !out) << "Could not write " << state.cache_file;
+  }
+  return best;
+}
+
+void OCLTilingTuner::Apply(const OCLTiling& tiling, kernel_params* params) {
+  params->burstchannels = tiling.burstchannels;
+  params->rpo = tiling.rpo;
+  params->rpofm = tiling.rpofm;
+  params->burstydim = tiling.burstoc;
+}
+
+void OCLTilingTuner::set_cache_file(const std::string& path) {
+  TunerState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  state.cache_file = path;
+  state.loaded = false;
+}
+
+std::string OCLTilingTuner::cache_file() {
+  TunerState& state = State();
+  boost::mutex::scoped_lock lock(state.mutex);
+  return state.cache_file;
+}
+
+}  // namespace caffe
@@ -31,6 +31,7 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   Dtype local_rate = rate * net_params_lr[param_id];
   size_t update_history_offset = net_params.size();
   switch (Caffe::mode()) {
+  case Caffe::OCL_NATIVE:
   case Caffe::OCL:
   case Caffe::CPU: {
     // compute square of gradient in update
@@ -17,6 +17,7 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   Dtype delta = this->param_.delta();
   Dtype local_rate = rate * net_params_lr[param_id];
   switch (Caffe::mode()) {
+  case Caffe::OCL_NATIVE:
   case Caffe::OCL:
   case Caffe::CPU: {
     // compute square of gradient in update
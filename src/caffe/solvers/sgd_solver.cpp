@@ -136,6 +136,7 @@ void SGDSolver<Dtype>::Normalize(int param_id) {
 #endif
     break;
   }
+  case Caffe::OCL_NATIVE:
   case Caffe::OCL: {
 #ifdef USE_OCL
     caffe_scal(net_params[param_id]->count(), accum_normalization,
@@ -207,6 +208,7 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
 #endif
     break;
   }
+  case Caffe::OCL_NATIVE:
   case Caffe::OCL: {
 #ifdef USE_OCL
     if (local_decay) {
@@ -272,6 +274,7 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 #endif
     break;
   }
+  case Caffe::OCL_NATIVE:
   case Caffe::OCL: {
 #ifdef USE_OCL
     caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
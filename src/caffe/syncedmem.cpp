@@ -1,12 +1,164 @@
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <utility>
+#include <vector>
+
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
+
+namespace {
+
+boost::mutex version_mutex_;
+uint64_t g_version_ = 0;
+
+}  // namespace
+
+#ifdef USE_OCL
+namespace {
+
+// Maps the cl_mem handles given out by to_ocl back to their owners so that
+// kernel launches, which only see the handles, can attach their events.
+typedef std::map<const void*, SyncedMemory*> OCLBufferMap;
+
+boost::mutex ocl_buffers_mutex_;
+
+OCLBufferMap& OCLBuffers() {
+  static OCLBufferMap* g_ocl_buffers_ = new OCLBufferMap();
+  return *g_ocl_buffers_;
+}
+
+struct PoolBlock {
+  size_t size;
+  cl_context context;
+  cl_mem mem;
+};
+
+typedef std::vector<std::pair<void*, PoolBlock> > PoolFreeList;
+// Buffers are only reused on the device they were created for
+typedef std::pair<cl_context, size_t> PoolKey;
+
+struct PoolState {
+  PoolState() : hits(0), misses(0), bytes_in_use(0), bytes_cached(0) {}
+
+  boost::mutex mutex;
+  // Free blocks by device and size class, and the blocks handed out by host
+  // pointer
+  std::map<PoolKey, PoolFreeList> free_blocks;
+  std::map<void*, PoolBlock> in_use;
+  uint64_t hits;
+  uint64_t misses;
+  size_t bytes_in_use;
+  size_t bytes_cached;
+};
+
+PoolState& Pool() {
+  static PoolState* g_pool_ = new PoolState();
+  return *g_pool_;
+}
+
+// Rounds size up to kAlignment or to the next quarter step between two
+// powers of two, so a reused block wastes at most a fifth of its size.
+size_t PoolSizeClass(size_t size) {
+  if (size <= OCLMemoryPool::kAlignment) {
+    return OCLMemoryPool::kAlignment;
+  }
+  size_t base = OCLMemoryPool::kAlignment;
+  while (base * 2 < size) {
+    base *= 2;
+  }
+  size_t step = base / 4;
+  return (size + step - 1) / step * step;
+}
+
+}  // namespace
+
+void* OCLMemoryPool::Allocate(size_t size) {
+  const size_t block_size = PoolSizeClass(size);
+  PoolState& pool = Pool();
+  boost::mutex::scoped_lock lock(pool.mutex);
+  PoolFreeList& blocks = pool.free_blocks[PoolKey(oclContext, block_size)];
+  std::pair<void*, PoolBlock> block;
+  if (!blocks.empty()) {
+    block = blocks.back();
+    blocks.pop_back();
+    pool.bytes_cached -= block_size;
+    ++pool.hits;
+  } else {
+    CHECK_EQ(posix_memalign(&block.first, kAlignment, block_size), 0)
+        << "Could not allocate " << block_size << " bytes of host memory";
+    cl_int error;
+    block.second.size = block_size;
+    block.second.context = oclContext;
+    block.second.mem = clCreateBuffer(oclContext,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, block_size, block.first,
+        &error);
+    CHECK_EQ(error, CL_SUCCESS) << "Could not create an OCL buffer of "
+        << block_size << " bytes";
+    ++pool.misses;
+  }
+  pool.in_use.insert(block);
+  pool.bytes_in_use += block_size;
+  return block.first;
+}
+
+cl_mem OCLMemoryPool::Buffer(void* ptr) {
+  PoolState& pool = Pool();
+  boost::mutex::scoped_lock lock(pool.mutex);
+  std::map<void*, PoolBlock>::iterator it = pool.in_use.find(ptr);
+  CHECK(it != pool.in_use.end()) << "Pointer not allocated by the OCL pool";
+  return it->second.mem;
+}
+
+void OCLMemoryPool::Free(void* ptr) {
+  PoolState& pool = Pool();
+  boost::mutex::scoped_lock lock(pool.mutex);
+  std::map<void*, PoolBlock>::iterator it = pool.in_use.find(ptr);
+  CHECK(it != pool.in_use.end()) << "Pointer not allocated by the OCL pool";
+  const size_t block_size = it->second.size;
+  pool.free_blocks[PoolKey(it->second.context, block_size)].push_back(*it);
+  pool.in_use.erase(it);
+  pool.bytes_in_use -= block_size;
+  pool.bytes_cached += block_size;
+}
+
+OCLMemoryPool::Stats OCLMemoryPool::GetStats() {
+  PoolState& pool = Pool();
+  boost::mutex::scoped_lock lock(pool.mutex);
+  Stats stats;
+  stats.hits = pool.hits;
+  stats.misses = pool.misses;
+  stats.bytes_in_use = pool.bytes_in_use;
+  stats.bytes_cached = pool.bytes_cached;
+  return stats;
+}
+
+void OCLMemoryPool::Clear() {
+  PoolState& pool = Pool();
+  boost::mutex::scoped_lock lock(pool.mutex);
+  for (std::map<PoolKey, PoolFreeList>::iterator it = pool.free_blocks.begin();
+       it != pool.free_blocks.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      clReleaseMemObject(it->second[i].second.mem);
+      free(it->second[i].first);
+    }
+  }
+  pool.free_blocks.clear();
+  pool.bytes_cached = 0;
+}
+#endif
+
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), ocl_ptr_(NULL), size_(0),
     head_(UNINITIALIZED), own_cpu_data_(false), cpu_malloc_use_cuda_(false),
-    own_gpu_data_(false) {
+    own_gpu_data_(false), ocl_native_(false), ocl_pooled_(false),
+    version_(NextVersion()) {
+#ifdef USE_OCL
+  ocl_event_ = NULL;
+#endif
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -17,7 +169,11 @@ SyncedMemory::SyncedMemory()
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), ocl_ptr_(NULL), size_(size),
     head_(UNINITIALIZED), own_cpu_data_(false), cpu_malloc_use_cuda_(false),
-    own_gpu_data_(false) {
+    own_gpu_data_(false), ocl_native_(false), ocl_pooled_(false),
+    version_(NextVersion()) {
+#ifdef USE_OCL
+  ocl_event_ = NULL;
+#endif
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -27,20 +183,76 @@ SyncedMemory::SyncedMemory(size_t size)
 
 SyncedMemory::~SyncedMemory() {
   check_device();
-  if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
-  }
+  ocl_wait();
+  release_ocl_buffer();
+  free_host();
 
 #ifndef CPU_ONLY
   if (gpu_ptr_ && own_gpu_data_) {
     CUDA_CHECK(cudaFree(gpu_ptr_));
   }
 #endif  // CPU_ONLY
+}
+
+// In Caffe::OCL mode host memory comes from OCLMemoryPool, which keeps it
+// aligned for the device and pairs it with a buffer that can be reused.
+void SyncedMemory::alloc_host(size_t size) {
+#ifdef USE_OCL
+  if (Caffe::mode() == Caffe::OCL) {
+    cpu_ptr_ = OCLMemoryPool::Allocate(size);
+    cpu_malloc_use_cuda_ = false;
+    ocl_pooled_ = true;
+    own_cpu_data_ = true;
+    return;
+  }
+#endif
+  CaffeMallocHost(&cpu_ptr_, size, &cpu_malloc_use_cuda_);
+  own_cpu_data_ = true;
+}
+
+void SyncedMemory::free_host() {
+  if (cpu_ptr_ && own_cpu_data_) {
+#ifdef USE_OCL
+    if (ocl_pooled_) {
+      OCLMemoryPool::Free(cpu_ptr_);
+    } else {
+      CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    }
+#else
+    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+#endif
+  }
+  ocl_pooled_ = false;
+}
 
+void SyncedMemory::create_ocl_buffer(size_t size) {
 #ifdef USE_OCL
-  if (ocl_ptr_) {
-    clReleaseMemObject((cl_mem)ocl_ptr_);
+  if (ocl_pooled_) {
+    ocl_ptr_ = reinterpret_cast<void *>(OCLMemoryPool::Buffer(cpu_ptr_));
+  } else {
+    ocl_ptr_ = reinterpret_cast<void *>(clCreateBuffer(oclContext,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, cpu_ptr_, NULL));
+  }
+  boost::mutex::scoped_lock lock(ocl_buffers_mutex_);
+  OCLBuffers()[ocl_ptr_] = this;
+#endif
+}
+
+// Drops ocl_ptr_, which must not outlive the host memory it wraps. Pooled
+// buffers stay with their block.
+void SyncedMemory::release_ocl_buffer() {
+#ifdef USE_OCL
+  if (ocl_ptr_ && !ocl_native_) {
+    {
+      boost::mutex::scoped_lock lock(ocl_buffers_mutex_);
+      OCLBuffers().erase(ocl_ptr_);
+    }
+    if (!ocl_pooled_) {
+      clReleaseMemObject((cl_mem)ocl_ptr_);
+    }
   }
+  ocl_ptr_ = NULL;
+  ocl_native_ = false;
 #endif
 }
 
@@ -53,10 +265,9 @@ inline void SyncedMemory::to_cpu(size_t size) {
   check_device();
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, tx_size_, &cpu_malloc_use_cuda_);
+    alloc_host(tx_size_);
     caffe_memset(tx_size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
-    own_cpu_data_ = true;
     break;
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
@@ -73,11 +284,16 @@ inline void SyncedMemory::to_cpu(size_t size) {
   case HEAD_AT_OCL:
 #ifdef USE_OCL
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, tx_size_, &cpu_malloc_use_cuda_);
-      own_cpu_data_ = true;
+      alloc_host(tx_size_);
+    }
+    // Native kernels write straight into host memory.
+    if (!ocl_native_) {
+      vector<cl_event> wait_list;
+      AppendOCLWaitList(ocl_ptr_, &wait_list);
+      clEnqueueReadBuffer(oclCommandQueue, (cl_mem)ocl_ptr_, CL_TRUE, 0,
+          tx_size_, cpu_ptr_, wait_list.size(),
+          wait_list.empty() ? NULL : wait_list.data(), NULL);
     }
-    clEnqueueReadBuffer(oclCommandQueue, (cl_mem)ocl_ptr_, CL_TRUE, 0,
-        tx_size_, cpu_ptr_, 0, NULL, NULL);
     head_ = SYNCED;
 #else
     NO_OCL;
@@ -87,6 +303,8 @@ inline void SyncedMemory::to_cpu(size_t size) {
   case SYNCED:
     break;
   }
+  // The device may still be reading the host copy
+  ocl_wait();
 }
 
 inline void SyncedMemory::to_gpu() {
@@ -124,30 +342,29 @@ inline void SyncedMemory::to_ocl(int RW, size_t size) {
     tx_size_ = size;
   else
     tx_size_ = size_;
+  if (Caffe::mode() == Caffe::OCL_NATIVE) {
+    to_ocl_native(tx_size_);
+    return;
+  }
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, tx_size_, &cpu_malloc_use_cuda_);
+    alloc_host(tx_size_);
     caffe_memset(tx_size_, 0, cpu_ptr_);
-    own_cpu_data_ = true;
-    ocl_ptr_ = reinterpret_cast<void *>(clCreateBuffer(oclContext,
-        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, tx_size_, cpu_ptr_, NULL));
+    create_ocl_buffer(tx_size_);
     if (RW)
-      clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_TRUE, 0,
-          tx_size_, cpu_ptr_, 0, NULL, NULL);
+      ocl_write(tx_size_);
     head_ = HEAD_AT_OCL;
     break;
   case HEAD_AT_CPU:
+    // The host alias left from Caffe::OCL_NATIVE mode is no buffer
+    if (ocl_native_) {
+      release_ocl_buffer();
+    }
     if (ocl_ptr_ == NULL) {
-      ocl_ptr_ = reinterpret_cast<void *>(clCreateBuffer(oclContext,
-          CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, tx_size_, cpu_ptr_, NULL));
-      if (RW)
-        clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_TRUE, 0,
-            tx_size_, cpu_ptr_, 0, NULL, NULL);
-    } else {
-      if (RW)
-        clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_TRUE, 0,
-            tx_size_, cpu_ptr_, 0, NULL, NULL);
+      create_ocl_buffer(tx_size_);
     }
+    if (RW)
+      ocl_write(tx_size_);
     head_ = SYNCED;
     break;
   case HEAD_AT_GPU:
@@ -160,6 +377,87 @@ inline void SyncedMemory::to_ocl(int RW, size_t size) {
 #endif
 }
 
+#ifdef USE_OCL
+// Copies the host data to the device. In async mode the copy is left in
+// flight and the host waits for it before touching cpu_ptr_ again.
+void SyncedMemory::ocl_write(size_t size) {
+  vector<cl_event> wait_list;
+  AppendOCLWaitList(ocl_ptr_, &wait_list);
+  if (!Caffe::ocl_async()) {
+    clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_TRUE, 0,
+        size, cpu_ptr_, wait_list.size(),
+        wait_list.empty() ? NULL : wait_list.data(), NULL);
+    return;
+  }
+  cl_event event;
+  clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_FALSE, 0,
+      size, cpu_ptr_, wait_list.size(),
+      wait_list.empty() ? NULL : wait_list.data(), &event);
+  SetOCLEvent(ocl_ptr_, event);
+  clReleaseEvent(event);
+}
+
+void SyncedMemory::SetOCLEvent(const void* ocl_mem, cl_event event) {
+  boost::mutex::scoped_lock lock(ocl_buffers_mutex_);
+  OCLBufferMap::iterator it = OCLBuffers().find(ocl_mem);
+  if (it == OCLBuffers().end()) {
+    return;
+  }
+  SyncedMemory* mem = it->second;
+  clRetainEvent(event);
+  if (mem->ocl_event_) {
+    clReleaseEvent(mem->ocl_event_);
+  }
+  mem->ocl_event_ = event;
+}
+
+void SyncedMemory::AppendOCLWaitList(const void* ocl_mem,
+    vector<cl_event>* wait_list) {
+  boost::mutex::scoped_lock lock(ocl_buffers_mutex_);
+  OCLBufferMap::iterator it = OCLBuffers().find(ocl_mem);
+  if (it != OCLBuffers().end() && it->second->ocl_event_) {
+    wait_list->push_back(it->second->ocl_event_);
+  }
+}
+#endif
+
+inline void SyncedMemory::ocl_wait() {
+#ifdef USE_OCL
+  if (ocl_event_) {
+    clWaitForEvents(1, &ocl_event_);
+    clReleaseEvent(ocl_event_);
+    ocl_event_ = NULL;
+  }
+#endif
+}
+
+// The native kernels run in-process, so the host allocation doubles as the
+// device buffer and no transfers are needed in either direction.
+inline void SyncedMemory::to_ocl_native(size_t size) {
+  switch (head_) {
+  case UNINITIALIZED:
+    CaffeMallocHost(&cpu_ptr_, size, &cpu_malloc_use_cuda_);
+    caffe_memset(size, 0, cpu_ptr_);
+    own_cpu_data_ = true;
+    ocl_ptr_ = cpu_ptr_;
+    ocl_native_ = true;
+    head_ = HEAD_AT_OCL;
+    break;
+  case HEAD_AT_CPU:
+    // A buffer left from Caffe::OCL mode is dropped for the host memory
+    ocl_wait();
+    release_ocl_buffer();
+    ocl_ptr_ = cpu_ptr_;
+    ocl_native_ = true;
+    head_ = SYNCED;
+    break;
+  case HEAD_AT_GPU:
+  case HEAD_AT_OCL:
+  case SYNCED:
+    break;
+  }
+}
+
 const void* SyncedMemory::cpu_data() {
   to_cpu(0);
   return (const void*)cpu_ptr_;
@@ -174,9 +472,10 @@ const void* SyncedMemory::cpu_data(size_t size) {
 void SyncedMemory::set_cpu_data(void* data) {
   check_device();
   CHECK(data);
-  if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
-  }
+  ocl_wait();
+  release_ocl_buffer();
+  free_host();
+  version_ = NextVersion();
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
@@ -219,6 +518,7 @@ void SyncedMemory::set_gpu_data(void* data) {
     CUDA_CHECK(cudaFree(gpu_ptr_));
   }
   gpu_ptr_ = data;
+  version_ = NextVersion();
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
 #else
@@ -229,6 +529,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu(0);
   head_ = HEAD_AT_CPU;
+  version_ = NextVersion();
   return cpu_ptr_;
 }
 
@@ -236,6 +537,7 @@ void* SyncedMemory::mutable_cpu_data(size_t size) {
   check_device();
   to_cpu(size);
   head_ = HEAD_AT_CPU;
+  version_ = NextVersion();
   return cpu_ptr_;
 }
 
@@ -244,6 +546,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  version_ = NextVersion();
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -255,6 +558,7 @@ void* SyncedMemory::mutable_ocl_data() {
 #ifdef USE_OCL
   to_ocl(1, 0);
   head_ = HEAD_AT_OCL;
+  version_ = NextVersion();
   return ocl_ptr_;
 #else
   NO_OCL;
@@ -265,6 +569,7 @@ void* SyncedMemory::mutable_ocl_data(int RW) {
 #ifdef USE_OCL
   to_ocl(RW, 0);
   head_ = HEAD_AT_OCL;
+  version_ = NextVersion();
   return ocl_ptr_;
 #else
   NO_OCL;
@@ -275,6 +580,7 @@ void* SyncedMemory::mutable_ocl_data(int RW, size_t size) {
 #ifdef USE_OCL
   to_ocl(RW, size);
   head_ = HEAD_AT_OCL;
+  version_ = NextVersion();
   return ocl_ptr_;
 #else
   NO_OCL;
@@ -282,6 +588,33 @@ void* SyncedMemory::mutable_ocl_data(int RW, size_t size) {
 }
 
 
+uint64_t SyncedMemory::NextVersion() {
+  boost::mutex::scoped_lock lock(version_mutex_);
+  return ++g_version_;
+}
+
+#ifdef USE_OCL
+void SyncedMemory::async_ocl_push(const cl_command_queue& queue,
+    size_t size) {
+  CHECK(head_ == HEAD_AT_CPU);
+  CHECK(Caffe::mode() == Caffe::OCL);
+  size_t tx_size_ = size != 0 ? size : size_;
+  if (ocl_ptr_ == NULL) {
+    create_ocl_buffer(tx_size_);
+  }
+  vector<cl_event> wait_list;
+  AppendOCLWaitList(ocl_ptr_, &wait_list);
+  cl_event event;
+  clEnqueueWriteBuffer(queue, (cl_mem) ocl_ptr_, CL_FALSE, 0, tx_size_,
+      cpu_ptr_, wait_list.size(), wait_list.empty() ? NULL : wait_list.data(),
+      &event);
+  clFlush(queue);
+  SetOCLEvent(ocl_ptr_, event);
+  clReleaseEvent(event);
+  head_ = SYNCED;
+}
+#endif
+
 #ifndef CPU_ONLY
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   check_device();
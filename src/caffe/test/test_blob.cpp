@@ -68,6 +68,32 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestCpfp) {
+  this->blob_preshaped_->set_cpfp(true);
+  EXPECT_TRUE(this->blob_preshaped_->is_cpfp());
+  EXPECT_EQ(this->blob_preshaped_->count(), 120);
+  EXPECT_EQ(this->blob_preshaped_->data()->size(), 120 * sizeof(cpfp));
+  EXPECT_EQ(this->blob_preshaped_->diff()->size(), 120 * sizeof(cpfp));
+  cpfp* data = this->blob_preshaped_->mutable_cpu_cpfp_data();
+  for (int i = 0; i < 120; ++i) {
+    data[i] = cpfp(static_cast<float>(i % 7) - 3);
+  }
+  // The values go through the proto as floats.
+  BlobProto proto;
+  this->blob_preshaped_->ToProto(&proto);
+  EXPECT_EQ(proto.data_size() + proto.double_data_size(), 120);
+  Blob<TypeParam> blob;
+  blob.set_cpfp(true);
+  blob.FromProto(proto);
+  EXPECT_EQ(blob.data()->size(), 120 * sizeof(cpfp));
+  for (int i = 0; i < 120; ++i) {
+    EXPECT_EQ(static_cast<float>(i % 7) - 3, float(blob.cpu_cpfp_data()[i]));
+  }
+  EXPECT_EQ(blob.asum_data(), this->blob_preshaped_->asum_data());
+  this->blob_preshaped_->set_cpfp(false);
+  EXPECT_EQ(this->blob_preshaped_->data()->size(), 120 * sizeof(TypeParam));
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
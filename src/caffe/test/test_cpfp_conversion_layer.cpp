@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +7,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/cpfp_conversion_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -56,8 +58,7 @@ TYPED_TEST(CPFPConversionLayerTest, TestForwardToCPFP) {
   layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
   layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
 
-  const cpfp* top_data =
-    reinterpret_cast<const cpfp *>(this->blob_top_->cpu_data());
+  const cpfp* top_data = this->blob_top_->cpu_cpfp_data();
   const Dtype* bottom_data = this->blob_bottom_->cpu_data();
 
   for (int i = 0; i < this->blob_top_->count(); ++i) {
@@ -88,8 +89,7 @@ TYPED_TEST(CPFPConversionLayerTest, TestForwardToFloat) {
   layer_to_float->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
   layer_to_float->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
 
-  const cpfp* bottom_data =
-    reinterpret_cast<const cpfp *>(this->blob_top_->cpu_data());
+  const cpfp* bottom_data = this->blob_top_->cpu_cpfp_data();
   const Dtype* top_data = this->blob_top_2_->cpu_data();
 
   for (int i = 0; i < this->blob_top_->count(); ++i) {
@@ -97,4 +97,37 @@ TYPED_TEST(CPFPConversionLayerTest, TestForwardToFloat) {
   }
 }
 
+
+TYPED_TEST(CPFPConversionLayerTest, TestForwardScaled) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Far beyond the range of unscaled cpfp values
+  caffe_scal(this->blob_bottom_->count(), Dtype(1 << 30),
+      this->blob_bottom_->mutable_cpu_data());
+  LayerParameter layer_param;
+  CPFPConversionParameter* cpfp_conversion_param =
+      layer_param.mutable_cpfp_conversion_param();
+  cpfp_conversion_param->set_convert_to(true);
+  cpfp_conversion_param->set_scale(true);
+  shared_ptr<Layer<Dtype> > layer(
+      new CPFPConversionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(cpfp_scale_exp(caffe_cpu_amax(this->blob_bottom_->count(),
+      this->blob_bottom_->cpu_data())), this->blob_top_->cpfp_data_exp());
+
+  this->blob_bottom_vec_.assign(1, this->blob_top_);
+  this->blob_top_vec_.assign(1, this->blob_top_2_);
+  cpfp_conversion_param->set_convert_to(false);
+  shared_ptr<Layer<Dtype> > layer_to_float(
+      new CPFPConversionLayer<Dtype>(layer_param));
+  layer_to_float->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_to_float->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_2_->cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(bottom_data[i], top_data[i], std::fabs(bottom_data[i]) / 32);
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,396 @@
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef USE_OCL_NATIVE
+// The SYNTHESIS branch of cpfp.hpp, which the kernels run, in a namespace
+// of its own as in src/caffe/native. Its includes are pulled in first so
+// that they stay at global scope.
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <limits>
+
+#include "ap_int.h"
+
+#pragma GCC diagnostic ignored "-Wunknown-pragmas"
+
+#define SYNTHESIS
+namespace synthesis {
+#include "fpga_caffe/cpfp.hpp"
+}  // namespace synthesis
+#undef SYNTHESIS
+#undef CPFP_HPP_
+#endif  // USE_OCL_NATIVE
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/cpfp_math.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CPFPMathTest : public ::testing::Test {
+ protected:
+  CPFPMathTest() : values_(1 << FP_WIDTH), mismatches_(0) {
+    for (int i = 0; i < values_.size(); ++i) {
+      values_[i] = cpfp(static_cast<uint16>(i));
+    }
+  }
+
+  // True if value is exactly a normal cpfp number with exponent below
+  // MAX_EXP, i.e. the hardware result cannot be affected by rounding,
+  // saturation or flushing.
+  static bool Representable(double value) {
+    if (value == 0) {
+      return false;
+    }
+    int exp;
+    double frac = std::frexp(std::fabs(value), &exp);
+    double mant = std::ldexp(frac, MANT_SIZE + 1);
+    int biased = exp - 1 + EXP_OFFSET;
+    return mant == std::floor(mant) && biased > 0 && biased < MAX_EXP;
+  }
+
+  static bool InRange(uint16 value) {
+    return ((value >> EXP_SHIFT) & MAX_EXP) != MAX_EXP;
+  }
+
+  // Counts a mismatch of op on the bits a and b. The exhaustive tests check
+  // every pair, so only the first one is kept for the failure message.
+  template <typename T>
+  void Check(const char* op, int a, int b, T expected, T actual) {
+    if (expected != actual && mismatches_++ == 0) {
+      std::ostringstream msg;
+      msg << "first mismatch: " << op << " of 0x" << std::hex << a
+          << " and 0x" << b << std::dec << " is " << actual
+          << ", expected " << expected;
+      first_mismatch_ = msg.str();
+    }
+  }
+
+  std::vector<cpfp> values_;
+  int mismatches_;
+  std::string first_mismatch_;
+};
+
+TEST_F(CPFPMathTest, TestMulExact) {
+  const int count = values_.size();
+  std::vector<cpfp> a(count), y(count);
+  for (int i = 0; i < count; ++i) {
+    a.assign(count, values_[i]);
+    cpfp_mul(count, &a[0], &values_[0], &y[0]);
+    for (int j = 0; j < count; ++j) {
+      uint16 result = static_cast<uint16>(y[j]);
+      Check("mul", i, j, cpfp_mul_bits(i, j), result);
+      double product = static_cast<double>(float(values_[i])) *
+        float(values_[j]);
+      if (Representable(product)) {
+        Check("exact mul", i, j, product, double(float(y[j])));
+      }
+    }
+  }
+  EXPECT_EQ(0, mismatches_) << first_mismatch_;
+}
+
+TEST_F(CPFPMathTest, TestMulSaturateAndFlush) {
+  // Results saturate to the largest value with an exponent below MAX_EXP
+  uint16 max_val = ((MAX_EXP - 1) << EXP_SHIFT) | MAX_MANT;
+  uint16 tiny = (1 << EXP_SHIFT) | 1;
+  EXPECT_EQ(max_val, cpfp_mul_bits(max_val, max_val));
+  EXPECT_EQ(max_val | SIGN_MASK, cpfp_mul_bits(max_val, max_val | SIGN_MASK));
+  EXPECT_EQ(0, cpfp_mul_bits(tiny, tiny));
+  EXPECT_EQ(SIGN_MASK, cpfp_mul_bits(tiny, tiny | SIGN_MASK));
+}
+
+TEST_F(CPFPMathTest, TestAddExact) {
+  const int count = values_.size();
+  std::vector<cpfp> a(count), y(count), d(count);
+  for (int i = 0; i < count; ++i) {
+    a.assign(count, values_[i]);
+    cpfp_add(count, &a[0], &values_[0], &y[0]);
+    cpfp_sub(count, &a[0], &values_[0], &d[0]);
+    for (int j = 0; j < count; ++j) {
+      uint16 result = static_cast<uint16>(y[j]);
+      Check("add", i, j, cpfp_add_bits(i, j), result);
+      Check("sub", i, j, cpfp_add_bits(i, j ^ SIGN_MASK),
+          static_cast<uint16>(d[j]));
+      double sum = static_cast<double>(float(values_[i])) + float(values_[j]);
+      if (InRange(i) && InRange(j) && Representable(sum)) {
+        Check("exact add", i, j, sum, double(float(y[j])));
+      }
+    }
+  }
+  EXPECT_EQ(0, mismatches_) << first_mismatch_;
+}
+
+TEST_F(CPFPMathTest, TestAddRounding) {
+  // 1 + 2^-(MANT_SIZE + 1) is a tie and rounds to even, adding another
+  // ulp of the smaller operand rounds up
+  uint16 one = EXP_OFFSET << EXP_SHIFT;
+  uint16 half_ulp = (EXP_OFFSET - MANT_SIZE - 1) << EXP_SHIFT;
+  uint16 half_ulp_plus = half_ulp | 1;
+  EXPECT_EQ(one, cpfp_add_bits(one, half_ulp));
+  EXPECT_EQ(one + 1, cpfp_add_bits(one, half_ulp_plus));
+  uint16 max_val = ((MAX_EXP - 1) << EXP_SHIFT) | MAX_MANT;
+  EXPECT_EQ(max_val, cpfp_add_bits(max_val, max_val));
+}
+
+TEST_F(CPFPMathTest, TestMaxAndMult2_1) {
+  const int count = values_.size();
+  std::vector<cpfp> a(count), t2(count), y(count), y1(count), y2(count);
+  for (int i = 0; i < count; ++i) {
+    t2[i] = values_[count - 1 - i];
+  }
+  for (int i = 0; i < count; i += 7) {
+    a.assign(count, values_[i]);
+    cpfp_max(count, &a[0], &values_[0], &y[0]);
+    cpfp_mult2_1(count, &values_[0], &t2[0], &a[0], &y1[0], &y2[0]);
+    for (int j = 0; j < count; ++j) {
+      EXPECT_EQ(static_cast<uint16>(max(a[j], values_[j])),
+          static_cast<uint16>(y[j]));
+      EXPECT_EQ(cpfp_mul_bits(j, i), static_cast<uint16>(y1[j]));
+      EXPECT_EQ(cpfp_mul_bits(count - 1 - j, i), static_cast<uint16>(y2[j]));
+    }
+  }
+}
+
+#ifdef USE_OCL_NATIVE
+TEST_F(CPFPMathTest, TestMatchesSynthesis) {
+  // Every pair of values, through the bulk routines and the operators of
+  // the kernels. The SYNTHESIS operators have only been run against a
+  // stand-in ap_int.h, not the one that ships with Vivado HLS, so a
+  // mismatch here may lie with either.
+  const int num = values_.size();
+  std::vector<cpfp> a(num), b(num), t2(num), mul(num), add(num), sub(num),
+      y(num), y1(num), y2(num);
+  for (int i = 0; i < num; ++i) {
+    a.assign(num, values_[i]);
+    for (int j = 0; j < num; ++j) {
+      b[j] = values_[(i + j) % num];
+      t2[j] = values_[(i + 3 * j) % num];
+    }
+    cpfp_mul(num, &a[0], &b[0], &mul[0]);
+    cpfp_add(num, &a[0], &b[0], &add[0]);
+    cpfp_sub(num, &a[0], &b[0], &sub[0]);
+    cpfp_max(num, &a[0], &b[0], &y[0]);
+    cpfp_mult2_1(num, &b[0], &t2[0], &a[0], &y1[0], &y2[0]);
+    const synthesis::cpfp sa(static_cast<uint16>(a[0]));
+    for (int j = 0; j < num; ++j) {
+      const synthesis::cpfp sb(static_cast<uint16>(b[j]));
+      const synthesis::cpfp st2(static_cast<uint16>(t2[j]));
+      synthesis::cpfp s1, s2;
+      mult2_1(sb, st2, sa, &s1, &s2);
+      const int ia = static_cast<uint16>(a[0]);
+      const int ib = static_cast<uint16>(b[j]);
+      Check("mul", ia, ib, static_cast<uint32>(sa * sb),
+          static_cast<uint32>(static_cast<uint16>(mul[j])));
+      Check("add", ia, ib, static_cast<uint32>(sa + sb),
+          static_cast<uint32>(static_cast<uint16>(add[j])));
+      Check("sub", ia, ib, static_cast<uint32>(sa - sb),
+          static_cast<uint32>(static_cast<uint16>(sub[j])));
+      Check("max", ia, ib, static_cast<uint32>(max(sa, sb)),
+          static_cast<uint32>(static_cast<uint16>(y[j])));
+      Check("mult2_1 first", ia, ib, static_cast<uint32>(s1),
+          static_cast<uint32>(static_cast<uint16>(y1[j])));
+      Check("mult2_1 second", ia, ib, static_cast<uint32>(s2),
+          static_cast<uint32>(static_cast<uint16>(y2[j])));
+    }
+  }
+  EXPECT_EQ(0, mismatches_) << first_mismatch_;
+}
+#endif  // USE_OCL_NATIVE
+
+TEST_F(CPFPMathTest, TestBulkConversion) {
+  // Every cpfp value, a sweep of floats across and beyond the cpfp range,
+  // and an odd count so the vector paths leave a scalar tail
+  std::vector<float> x;
+  for (int i = 0; i < values_.size(); ++i) {
+    x.push_back(float(values_[i]));
+  }
+  for (float f = 1e-12; f < 1e12; f *= 1.0001) {
+    x.push_back(f);
+    x.push_back(-f);
+  }
+  x.push_back(0.0f);
+  const int count = x.size();
+  std::vector<double> xd(x.begin(), x.end());
+  std::vector<cpfp> y(count), yd(count);
+  std::vector<float> z(count);
+  std::vector<double> zd(count);
+  cpfp_from_float(count, &x[0], &y[0]);
+  cpfp_from_float(count, &xd[0], &yd[0]);
+  cpfp_to_float(count, &y[0], &z[0]);
+  cpfp_to_float(count, &yd[0], &zd[0]);
+  for (int i = 0; i < count; ++i) {
+    uint16 expected = static_cast<uint16>(cpfp(x[i]));
+    EXPECT_EQ(expected, static_cast<uint16>(y[i]));
+    EXPECT_EQ(expected, static_cast<uint16>(yd[i]));
+    EXPECT_EQ(float(y[i]), z[i]);
+    EXPECT_EQ(static_cast<double>(float(y[i])), zd[i]);
+  }
+}
+
+TEST_F(CPFPMathTest, TestBulkConversionTopBit) {
+  // The encodings of negative values set bit FP_WIDTH - 1, bit 15 in 16-bit
+  // builds (-DEXP_SIZE=7 -DMANT_SIZE=8), where a signed pack would clamp
+  // them. Every lane of the vector paths gets one.
+  const int count = 64;
+  std::vector<float> x(count);
+  for (int i = 0; i < count; ++i) {
+    x[i] = -std::ldexp(1.0f + i / 64.0f, i % 8 - 4);
+  }
+  x[count - 1] = -std::numeric_limits<float>::max();
+  std::vector<cpfp> y(count);
+  cpfp_from_float(count, &x[0], &y[0]);
+  for (int i = 0; i < count; ++i) {
+    uint16 expected = static_cast<uint16>(cpfp(x[i]));
+    EXPECT_EQ(SIGN_MASK, expected & SIGN_MASK);
+    EXPECT_EQ(expected, static_cast<uint16>(y[i])) << "lane " << i;
+  }
+}
+
+TEST_F(CPFPMathTest, TestPackRoundTrip) {
+  // Not a multiple of 16, so the last word is partly filled
+  const int count = values_.size() - 5;
+  std::vector<cpfp16p> words((count + 15) / 16);
+  std::vector<cpfp> y(count);
+  cpfp_pack(count, &values_[0], &words[0]);
+  cpfp_unpack(count, &words[0], &y[0]);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(static_cast<uint16>(values_[i]), static_cast<uint16>(y[i]));
+  }
+  // Value i sits at bit FP_WIDTH * i of its word, the tail is zero
+  const int last = words.size() - 1;
+  EXPECT_EQ(static_cast<uint16>(values_[16 * last + 1]),
+      (words[last].w[0] >> FP_WIDTH) & ((1 << FP_WIDTH) - 1));
+  const int used = count - 16 * last;
+  const int bit = FP_WIDTH * used;
+  EXPECT_EQ(uint64_t(0), words[last].w[bit / 64] >> (bit % 64));
+  for (int j = bit / 64 + 1; j < PACKED_WORDS; ++j) {
+    EXPECT_EQ(uint64_t(0), words[last].w[j]);
+  }
+  // The storage is whole beats holding every word
+  const int bytes = cpfp_packed_count(count) * sizeof(cpfp);
+  EXPECT_EQ(0, bytes % sizeof(cpfp256));
+  EXPECT_LE(words.size() * sizeof(cpfp16p), bytes);
+  EXPECT_GT(words.size() * sizeof(cpfp16p) + sizeof(cpfp256), bytes);
+}
+
+TEST_F(CPFPMathTest, TestPortTransfers) {
+  const int count = values_.size();
+  const int num_words = count / 16;
+  std::vector<cpfp16> x(num_words), y(num_words);
+  memcpy(static_cast<void*>(&x[0]), &values_[0], sizeof(cpfp) * count);
+  std::vector<cpfp256> beats(cpfp_packed_count(count) * sizeof(cpfp) /
+      sizeof(cpfp256));
+  std::vector<cpfp> unpacked(count);
+  // Runs starting and ending at every lane of a beat
+  for (int idx = 0; idx < 4; ++idx) {
+    for (int n = 1; n < 8; ++n) {
+      cpfp_pack(count, &values_[0], reinterpret_cast<cpfp16p*>(&beats[0]));
+      port_read(&y[0], &beats[0], idx, n);
+      EXPECT_EQ(0, memcmp(&x[idx], &y[0], sizeof(cpfp16) * n));
+      // Write the words of the other end of x, the neighbours keep theirs
+      port_write(&beats[0], idx, &x[num_words - n], n);
+      cpfp_unpack(count, reinterpret_cast<cpfp16p*>(&beats[0]),
+          &unpacked[0]);
+      for (int i = 0; i < count; ++i) {
+        const int word = i / 16;
+        const int src = (word >= idx && word < idx + n) ?
+            i + 16 * (num_words - n - idx) : i;
+        EXPECT_EQ(static_cast<uint16>(values_[src]),
+            static_cast<uint16>(unpacked[i]));
+      }
+    }
+  }
+}
+
+TEST_F(CPFPMathTest, TestFormats) {
+  EXPECT_EQ(FP_WIDTH, cpfp::fp_width);
+  EXPECT_EQ(SIGN_MASK, cpfp::sign_mask);
+  EXPECT_EQ(EXP_MASK, cpfp::exp_mask);
+  EXPECT_EQ(EXP_OFFSET, cpfp::exp_offset);
+  // With 8 exponent bits the format is the top half of an IEEE float, so
+  // floats with their low 16 bits clear survive the round trip apart from
+  // denormals, infinities and NaNs
+  typedef cpfp_t<8, 7> bf16;
+  EXPECT_EQ(16, bf16::fp_width);
+  for (uint32 hi = 0; hi < (1 << 16); ++hi) {
+    uint32 exp = (hi >> 7) & 0xFF;
+    if (exp == 0 || exp == 0xFF) {
+      continue;
+    }
+    uint32 bits = hi << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    EXPECT_EQ(hi, bf16::from_float(value));
+    EXPECT_EQ(value, float(bf16(value)));
+  }
+  // Narrow formats round to nearest on conversion and keep the operators
+  typedef cpfp_t<4, 3> fp8;
+  EXPECT_EQ(1.125f, float(fp8(1.1f)));
+  EXPECT_EQ(3.0f, float(fp8(1.5f) * fp8(2.0f)));
+  EXPECT_TRUE(fp8(-1.0f) < fp8(0.5f));
+}
+
+
+TEST_F(CPFPMathTest, TestScaledConversion) {
+  // Values far outside the unscaled cpfp range survive at a matching exponent
+  const int count = 37;
+  std::vector<float> x(count), z(count);
+  for (int i = 0; i < count; ++i) {
+    x[i] = std::ldexp(1.0f + (i % 32) / 32.0f, 40) * (i % 2 ? -1 : 1);
+  }
+  const float amax = std::ldexp(1.0f + 31 / 32.0f, 40);
+  const int exp = cpfp_scale_exp(amax);
+  EXPECT_EQ(41, exp);
+  std::vector<cpfp> y(count), w(count);
+  cpfp_from_float(count, &x[0], &y[0], exp);
+  cpfp_to_float(count, &y[0], &z[0], exp);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(x[i], z[i]);
+  }
+  // Moving to another exponent and back is exact while nothing flushes
+  cpfp_scale(count, -3, &y[0], &w[0]);
+  cpfp_scale(count, 3, &w[0], &w[0]);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(static_cast<uint16>(y[i]), static_cast<uint16>(w[i]));
+  }
+  EXPECT_EQ(amax, std::ldexp(cpfp_amax(count, &y[0]), exp));
+}
+
+TEST_F(CPFPMathTest, TestExpTracker) {
+  CPFPExpTracker tracker;
+  EXPECT_EQ(7, tracker.exp(7));
+  tracker.Update(100.0f);
+  EXPECT_EQ(7, tracker.exp(0));
+  // A smaller max only lowers the exponent once the old one decays
+  tracker.Update(1.0f);
+  EXPECT_EQ(7, tracker.exp(0));
+  for (int i = 0; i < 100; ++i) {
+    tracker.Update(1.0f);
+  }
+  EXPECT_EQ(1, tracker.exp(0));
+  int out_exp;
+  EXPECT_EQ(9, tracker.OutShift(10, &out_exp));
+  EXPECT_EQ(1, out_exp);
+  // Shifts past the range of the kernel are clamped
+  EXPECT_EQ(kCPFPMaxShift, tracker.OutShift(1000, &out_exp));
+  EXPECT_EQ(1000 - kCPFPMaxShift, out_exp);
+  EXPECT_EQ(kCPFPMinShift, tracker.OutShift(-1000, &out_exp));
+  // Samples the first pass and one in every period after it
+  tracker.set_period(3);
+  const bool sampled[] = {true, false, false, true, false, false, true};
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(sampled[i], tracker.Sample());
+  }
+}
+
+}  // namespace caffe
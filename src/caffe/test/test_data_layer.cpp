@@ -196,6 +196,51 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  void TestReadHWCN(bool cpfp_data) {
+    // The conversion runs on the host, GPU mode does not support it
+    if (Caffe::mode() == Caffe::GPU) {
+      return;
+    }
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->mutable_prefetch_hwcn()->set_cpfp(cpfp_data);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    vector<int> hwcn_shape(4);
+    hwcn_shape[0] = 3;
+    hwcn_shape[1] = 4;
+    hwcn_shape[2] = 2;
+    hwcn_shape[3] = 5;
+    EXPECT_TRUE(blob_top_data_->shape() == hwcn_shape);
+
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      EXPECT_TRUE(blob_top_data_->shape() == hwcn_shape);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+      }
+      // The values are integers below 24, which cpfp holds exactly
+      EXPECT_EQ(cpfp_data, blob_top_data_->is_cpfp());
+      for (int s = 0; s < 12; ++s) {
+        for (int c = 0; c < 2; ++c) {
+          for (int n = 0; n < 5; ++n) {
+            const int index = (s * 2 + c) * 5 + n;
+            const float value = cpfp_data ?
+                float(blob_top_data_->cpu_cpfp_data()[index]) :
+                blob_top_data_->cpu_data()[index];
+            EXPECT_EQ(c * 12 + s, value)
+                << "debug: iter " << iter << " s " << s << " c " << c;
+          }
+        }
+      }
+    }
+  }
+
   void TestReadCrop(Phase phase) {
     const Dtype scale = 3;
     LayerParameter param;
@@ -391,6 +436,18 @@ TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
 
+TYPED_TEST(DataLayerTest, TestReadHWCNLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadHWCN(false);
+}
+
+TYPED_TEST(DataLayerTest, TestReadHWCNCPFPLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadHWCN(true);
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLevelDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
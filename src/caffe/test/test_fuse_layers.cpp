@@ -0,0 +1,271 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/cpfp_math.hpp"
+#include "caffe/util/fuse_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FuseOCLLayersTest : public ::testing::Test {
+ protected:
+  void RunFusionTest(
+      const string& input_param_string, const string& output_param_string) {
+    // Test that FuseOCLLayers called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    FuseOCLLayers(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+    // Also test idempotence.
+    NetParameter double_fuse_param;
+    FuseOCLLayers(actual_output_param, &double_fuse_param);
+    EXPECT_EQ(actual_output_param.DebugString(),
+       double_fuse_param.DebugString());
+  }
+};
+
+TEST_F(FuseOCLLayersTest, TestFuseReLUNotPooling) {
+  // The crp kernel pools in a pass of its own, so the pooling layer stays.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  cr_param { num_cu: 4 } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'pool1' "
+      "  type: 'OCLPoolingHWCN' "
+      "  bottom: 'conv1' "
+      "  top: 'pool1' "
+      "  pooling_param { pool: MAX kernel_size: 3 stride: 2 } "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  cr_param { num_cu: 4 relu: 1 } "
+      "} "
+      "layer { "
+      "  name: 'pool1' "
+      "  type: 'OCLPoolingHWCN' "
+      "  bottom: 'conv1' "
+      "  top: 'pool1' "
+      "  pooling_param { pool: MAX kernel_size: 3 stride: 2 } "
+      "} ";
+  this->RunFusionTest(input_proto, expected_output_proto);
+}
+
+TEST_F(FuseOCLLayersTest, TestFuseReLUNotInPlace) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'relu1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'relu1' "
+      "  top: 'conv2' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data' "
+      "  top: 'relu1' "
+      "  cr_param { relu: 1 } "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'relu1' "
+      "  top: 'conv2' "
+      "} ";
+  this->RunFusionTest(input_proto, expected_output_proto);
+}
+
+TEST_F(FuseOCLLayersTest, TestNoFusionSharedOutput) {
+  // The pre-ReLU output feeds another layer, and the pooling averages.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'relu1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "} "
+      "layer { "
+      "  name: 'pool2' "
+      "  type: 'OCLPoolingHWCN' "
+      "  bottom: 'conv2' "
+      "  top: 'pool2' "
+      "  pooling_param { pool: AVE kernel_size: 2 stride: 2 } "
+      "} ";
+  this->RunFusionTest(input_proto, input_proto);
+}
+
+#ifdef USE_OCL_NATIVE
+// A Conv -> ReLU -> Pool chain with the ReLU folded into the convolution,
+// against the same chain with the ReLU run on the host.
+class FuseOCLLayersNetTest : public ::testing::Test {
+ protected:
+  FuseOCLLayersNetTest() {
+    Caffe::set_mode(Caffe::OCL_NATIVE);
+  }
+  virtual ~FuseOCLLayersNetTest() {
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  shared_ptr<Net<float> > NewNet(const string& relu_extra) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        "name: 'TestNetwork' force_backward: true state { phase: TRAIN } "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 16 dim: 16 dim: 8 dim: 8 } } } "
+        "layer { name: 'conv1' type: 'OCLCRHWCN' bottom: 'data' "
+        "  top: 'conv1' "
+        "  xcl_param { xcl_name: 'crp_layer_hwcn_cpfp.xclbin' "
+        "    kernel_name: 'crp_layer_hwcn_cpfp' } "
+        "  convolution_param { num_output: 32 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } } } "
+        "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'relu1' " +
+        relu_extra + " } "
+        "layer { name: 'pool1' type: 'OCLPoolingHWCN' bottom: 'relu1' "
+        "  top: 'pool1' "
+        "  xcl_param { xcl_name: 'crp_layer_hwcn_cpfp.xclbin' "
+        "    kernel_name: 'crp_layer_hwcn_cpfp' } "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } } ",
+        &param));
+    return shared_ptr<Net<float> >(new Net<float>(param));
+  }
+};
+
+TEST_F(FuseOCLLayersNetTest, TestFusedMatchesUnfused) {
+  shared_ptr<Net<float> > fused = NewNet("");
+  ASSERT_FALSE(fused->has_layer("relu1"));
+  // Setting propagate_down keeps FuseOCLLayers off the ReLU, which then
+  // runs on the host between conversions to and from cpfp HWCN.
+  shared_ptr<Net<float> > unfused = NewNet("propagate_down: true");
+  ASSERT_TRUE(unfused->has_layer("relu1"));
+  const vector<shared_ptr<Blob<float> > >& params =
+      fused->layer_by_name("conv1")->blobs();
+  const vector<shared_ptr<Blob<float> > >& unfused_params =
+      unfused->layer_by_name("conv1")->blobs();
+  for (int i = 0; i < params.size(); ++i) {
+    unfused_params[i]->CopyFrom(*params[i]);
+  }
+  Blob<float>* data = fused->input_blobs()[0];
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(data);
+  unfused->input_blobs()[0]->CopyFrom(*data);
+
+  fused->Forward();
+  unfused->Forward();
+  Blob<float>* top = fused->output_blobs()[0];
+  Blob<float>* unfused_top = unfused->output_blobs()[0];
+  for (int i = 0; i < top->count(); ++i) {
+    EXPECT_TRUE(unfused_top->cpu_cpfp_data()[i] == top->cpu_cpfp_data()[i]);
+  }
+
+  // The diffs of the convolution only match if the fused one skips the
+  // words that its ReLU tags clear, and both pooling layers route the diff
+  // through the same argmax tags.
+  Blob<float> top_diff;
+  top_diff.ReshapeLike(*top);
+  filler.Fill(&top_diff);
+  cpfp_from_float(top->count(), top_diff.cpu_data(),
+      top->mutable_cpu_cpfp_diff(), 0);
+  cpfp_from_float(top->count(), top_diff.cpu_data(),
+      unfused_top->mutable_cpu_cpfp_diff(), 0);
+  fused->Backward();
+  unfused->Backward();
+  const Blob<float>* unfused_data = unfused->input_blobs()[0];
+  for (int i = 0; i < data->count(); ++i) {
+    EXPECT_EQ(unfused_data->cpu_diff()[i], data->cpu_diff()[i]);
+  }
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(unfused_params[i]->cpu_diff()[j], params[i]->cpu_diff()[j]);
+    }
+  }
+}
+#endif  // USE_OCL_NATIVE
+
+}  // namespace caffe
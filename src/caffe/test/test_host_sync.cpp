@@ -0,0 +1,99 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/host_sync.hpp"
+#include "caffe/sgd_solvers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostSyncTest : public ::testing::Test {
+ protected:
+  HostSyncTest() {
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  // The inner product layer is given by its type and extra parameters, so
+  // the same net runs on the host and on the OCL kernels.
+  shared_ptr<Solver<float> > NewSolver(int max_iter,
+      const string& ip_type = "InnerProduct", const string& ip_extra = "") {
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        "base_lr: 0.01 momentum: 0.9 weight_decay: 0.001 lr_policy: 'fixed' "
+        "random_seed: 1701 snapshot_after_train: false "
+        "net_param { "
+        "  layer { name: 'data' type: 'DummyData' top: 'data' "
+        "    top: 'targets' dummy_data_param { "
+        "      shape { dim: 4 dim: 16 dim: 2 dim: 2 } "
+        "      shape { dim: 4 dim: 2 } "
+        "      data_filler { type: 'constant' value: 0.5 } "
+        "      data_filler { type: 'constant' value: 1 } } } "
+        "  layer { name: 'ip' type: '" + ip_type + "' bottom: 'data' "
+        "    top: 'ip' " + ip_extra +
+        "    inner_product_param { num_output: 2 "
+        "      weight_filler { type: 'gaussian' std: 0.1 } "
+        "      bias_filler { type: 'gaussian' std: 0.1 } } } "
+        "  layer { name: 'loss' type: 'EuclideanLoss' bottom: 'ip' "
+        "    bottom: 'targets' top: 'loss' } "
+        "}", &param));
+    param.set_max_iter(max_iter);
+    return shared_ptr<Solver<float> >(new SGDSolver<float>(param));
+  }
+
+  // Solves kIters iterations on three synced solvers and checks they end
+  // with the parameters of a single solver.
+  void RunMatchesSingleSolver(const string& ip_type = "InnerProduct",
+      const string& ip_extra = "") {
+    const int kIters = 5;
+    shared_ptr<Solver<float> > single = NewSolver(kIters, ip_type, ip_extra);
+    single->Solve();
+
+    // Every solver sees the same constant batch, so the averaged gradient is
+    // the one of a single solver.
+    vector<int> devices;
+    devices.push_back(0);
+    devices.push_back(1);
+    devices.push_back(2);
+    Caffe::set_solver_count(devices.size());
+    shared_ptr<Solver<float> > root = NewSolver(kIters, ip_type, ip_extra);
+    HostSync<float> sync(root);
+    sync.Run(devices, NULL);
+    Caffe::set_solver_count(1);
+    Caffe::set_solver_rank(0);
+
+    EXPECT_EQ(kIters, root->iter());
+    const vector<Blob<float>*>& expected = single->net()->learnable_params();
+    const vector<Blob<float>*>& actual = root->net()->learnable_params();
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(expected[i]->count(), actual[i]->count());
+      for (int j = 0; j < expected[i]->count(); ++j) {
+        EXPECT_NEAR(expected[i]->cpu_data()[j], actual[i]->cpu_data()[j],
+            1e-5);
+      }
+    }
+  }
+};
+
+TEST_F(HostSyncTest, TestMatchesSingleSolver) {
+  RunMatchesSingleSolver();
+}
+
+#ifdef USE_OCL_NATIVE
+TEST_F(HostSyncTest, TestMatchesSingleSolverNative) {
+  // The solver threads take the mode of the root one, each running its own
+  // slices of the in-process kernels.
+  Caffe::set_mode(Caffe::OCL_NATIVE);
+  RunMatchesSingleSolver("OCLHWCNInnerProduct",
+      "xcl_param { xcl_name: 'crp_layer_hwcn_cpfp.xclbin' "
+      "  kernel_name: 'crp_layer_hwcn_cpfp' } ");
+  Caffe::set_mode(Caffe::CPU);
+}
+#endif  // USE_OCL_NATIVE
+
+}  // namespace caffe
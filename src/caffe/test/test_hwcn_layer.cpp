@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/hwcn_layer.hpp"
+#include "caffe/util/hwcn_transpose.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -113,4 +114,70 @@ TYPED_TEST(HWCNLayerTest, TestForwardHWCNConvertBack) {
   }
 }
 
+TYPED_TEST(HWCNLayerTest, TestForwardBackwardCPFP) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  HWCNParameter* hwcn_param =
+      layer_param.mutable_hwcn_param();
+  hwcn_param->set_convert_to(true);
+  hwcn_param->set_cpfp(true);
+  // Large enough to be split across threads
+  Blob<Dtype> bottom(16, 32, 13, 13);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  HWCNLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+
+  const int count = bottom.count();
+  const Dtype *bottom_data = bottom.cpu_data();
+  const cpfp *top_data = this->blob_top_->cpu_cpfp_data();
+  cpfp *top_diff = this->blob_top_->mutable_cpu_cpfp_diff();
+  for (int i = 0; i < count; ++i) {
+    top_diff[i] = top_data[i];
+  }
+  layer.Backward(this->blob_top_vec_, vector<bool>(1, true), bottom_vec);
+  const Dtype *bottom_diff = bottom.cpu_diff();
+
+  std::vector<int> shape = bottom.shape();
+  for (int n = 0; n < shape[0]; ++n) {
+    for (int c = 0; c < shape[1]; ++c) {
+      for (int h = 0; h < shape[2]; ++h) {
+        for (int w = 0; w < shape[3]; ++w) {
+          int bot_idx = ((n * shape[1] + c) * shape[2] + h) * shape[3] + w;
+          int top_idx = ((h * shape[3] + w) * shape[1] + c) * shape[0] + n;
+          cpfp expected((float)bottom_data[bot_idx]);
+          EXPECT_EQ(static_cast<uint16>(expected),
+              static_cast<uint16>(top_data[top_idx]));
+          EXPECT_EQ(float(expected), bottom_diff[bot_idx]);
+        }
+      }
+    }
+  }
+}
+
+TEST(HWCNBatchTest, TestPadAndStrip) {
+  const int rows = 5;
+  const int num = 3;
+  const int num_pad = 16;
+  vector<cpfp> x(rows * num), padded(rows * num_pad, cpfp(1.0f)),
+      y(rows * num);
+  for (int i = 0; i < x.size(); ++i) {
+    x[i] = cpfp(float(i));
+  }
+  hwcn_resize_batch(rows, num, num_pad, x.data(), padded.data());
+  for (int r = 0; r < rows; ++r) {
+    for (int n = 0; n < num_pad; ++n) {
+      const float expected = n < num ? float(r * num + n) : 0.0f;
+      EXPECT_EQ(expected, float(padded[r * num_pad + n]));
+    }
+  }
+  hwcn_resize_batch(rows, num_pad, num, padded.data(), y.data());
+  for (int i = 0; i < x.size(); ++i) {
+    EXPECT_EQ(float(x[i]), float(y[i]));
+  }
+}
+
 }  // namespace caffe
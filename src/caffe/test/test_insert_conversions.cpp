@@ -0,0 +1,368 @@
+#include <string>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/insert_conversions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class InsertConversionsTest : public ::testing::Test {
+ protected:
+  void RunInsertionTest(
+      const string& input_param_string, const string& output_param_string) {
+    // Test that InsertConversions called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    InsertConversions(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+    // Also test idempotence.
+    NetParameter double_insert_param;
+    InsertConversions(actual_output_param, &double_insert_param);
+    EXPECT_EQ(actual_output_param.DebugString(),
+       double_insert_param.DebugString());
+  }
+};
+
+TEST_F(InsertConversionsTest, TestNoInsertion) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'innerprod' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerprod' "
+      "  top: 'innerprod' "
+      "} ";
+  this->RunInsertionTest(input_proto, input_proto);
+}
+
+TEST_F(InsertConversionsTest, TestInsertion) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "} "
+      "layer { "
+      "  name: 'innerprod' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv2' "
+      "  top: 'innerprod' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'data_hwcn_cpfp' "
+      "  type: 'HWCN' "
+      "  bottom: 'data' "
+      "  top: 'data_hwcn_cpfp' "
+      "  hwcn_param { convert_to: true cpfp: true } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data_hwcn_cpfp' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "} "
+      "layer { "
+      "  name: 'conv2_nchw' "
+      "  type: 'HWCN' "
+      "  bottom: 'conv2' "
+      "  top: 'conv2_nchw' "
+      "  hwcn_param { convert_to: false cpfp: true } "
+      "} "
+      "layer { "
+      "  name: 'innerprod' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv2_nchw' "
+      "  top: 'innerprod' "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+TEST_F(InsertConversionsTest, TestCancelInversePair) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'hwcn1' "
+      "  type: 'HWCN' "
+      "  bottom: 'data' "
+      "  top: 'hwcn1' "
+      "} "
+      "layer { "
+      "  name: 'pad1' "
+      "  type: 'Pad' "
+      "  bottom: 'hwcn1' "
+      "  top: 'pad1' "
+      "  pad_param { axis: 2 pad_to: 4 } "
+      "} "
+      "layer { "
+      "  name: 'cpfp1' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'pad1' "
+      "  top: 'cpfp1' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'cpfp1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'float1' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'conv1' "
+      "  top: 'float1' "
+      "  cpfp_conversion_param { convert_to: false } "
+      "} "
+      "layer { "
+      "  name: 'cpfp2' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'float1' "
+      "  top: 'cpfp2' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'cpfp2' "
+      "  top: 'conv2' "
+      "} "
+      "layer { "
+      "  name: 'float2' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'conv2' "
+      "  top: 'float2' "
+      "  cpfp_conversion_param { convert_to: false } "
+      "} "
+      "layer { "
+      "  name: 'nchw2' "
+      "  type: 'HWCN' "
+      "  bottom: 'float2' "
+      "  top: 'nchw2' "
+      "  hwcn_param { convert_to: false } "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'hwcn1' "
+      "  type: 'HWCN' "
+      "  bottom: 'data' "
+      "  top: 'hwcn1' "
+      "  hwcn_param { convert_to: true cpfp: false } "
+      "} "
+      "layer { "
+      "  name: 'pad1' "
+      "  type: 'Pad' "
+      "  bottom: 'hwcn1' "
+      "  top: 'pad1' "
+      "  pad_param { axis: 2 pad_to: 4 } "
+      "} "
+      "layer { "
+      "  name: 'cpfp1' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'pad1' "
+      "  top: 'cpfp1' "
+      "  cpfp_conversion_param { convert_to: true } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'cpfp1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "} "
+      "layer { "
+      "  name: 'float2' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'conv2' "
+      "  top: 'float2' "
+      "  cpfp_conversion_param { convert_to: false } "
+      "} "
+      "layer { "
+      "  name: 'nchw2' "
+      "  type: 'HWCN' "
+      "  bottom: 'float2' "
+      "  top: 'nchw2' "
+      "  hwcn_param { convert_to: false } "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+TEST_F(InsertConversionsTest, TestPrefetchHWCN) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "  data_param { prefetch_hwcn { cpfp: true } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'SoftmaxWithLoss' "
+      "  bottom: 'conv1' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "  data_param { prefetch_hwcn { cpfp: true } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'conv1_nchw' "
+      "  type: 'HWCN' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1_nchw' "
+      "  hwcn_param { convert_to: false cpfp: true } "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'SoftmaxWithLoss' "
+      "  bottom: 'conv1_nchw' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+
+TEST_F(InsertConversionsTest, TestCPFPScale) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "cpfp_scale: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'OCLHWCNInnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'ip' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'ip' "
+      "  top: 'ip' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "cpfp_scale: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'data_hwcn_cpfp' "
+      "  type: 'HWCN' "
+      "  bottom: 'data' "
+      "  top: 'data_hwcn_cpfp' "
+      "  hwcn_param { convert_to: true cpfp: true scale: true } "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'OCLHWCNInnerProduct' "
+      "  bottom: 'data_hwcn_cpfp' "
+      "  top: 'ip' "
+      "  cr_param { cpfp_scale: true } "
+      "} "
+      "layer { "
+      "  name: 'ip_nchw' "
+      "  type: 'HWCN' "
+      "  bottom: 'ip' "
+      "  top: 'ip_nchw' "
+      "  hwcn_param { convert_to: false cpfp: true scale: true } "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'ip_nchw' "
+      "  top: 'ip_nchw' "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+}  // namespace caffe
@@ -0,0 +1,164 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/native_kernel.hpp"
+#include "caffe/util/cpfp_math.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Splits a row of params[0] outputs per group the same way the crp wrapper
+// splits its ofm loop, and counts how often each output is written.
+static void CountingKernel(void *input, void *weights, void *bias,
+    void *output, void *tags, int *params, int group_idx, int split_idx,
+    int num_splits) {
+  int *out = static_cast<int *>(output) + group_idx * params[0];
+  int begin = params[0] * split_idx / num_splits;
+  int end = params[0] * (split_idx + 1) / num_splits;
+  for (int i = begin; i < end; ++i) {
+    out[i] += group_idx * params[0] + i + 1;
+  }
+}
+
+class NativeKernelRunnerTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    NativeKernelRunner::set_num_threads(0);
+  }
+
+  void RunAndCheck(int num_threads, int numgroups) {
+    NativeKernelRunner::set_num_threads(num_threads);
+    int params[1] = {37};
+    std::vector<int> out(params[0] * numgroups, 0);
+    NativeKernelRunner::Run(CountingKernel, NULL, NULL, NULL, out.data(),
+        NULL, params, numgroups);
+    for (int i = 0; i < out.size(); ++i) {
+      EXPECT_EQ(i + 1, out[i]);
+    }
+  }
+};
+
+TEST_F(NativeKernelRunnerTest, TestSerial) {
+  RunAndCheck(1, 2);
+}
+
+TEST_F(NativeKernelRunnerTest, TestThreaded) {
+  RunAndCheck(4, 1);
+  RunAndCheck(4, 3);
+  RunAndCheck(64, 2);
+}
+
+#ifdef USE_OCL_NATIVE
+
+class NativeCRPKernelTest : public NativeKernelRunnerTest {
+ protected:
+  // A 3x3 convolution of 32 channels to 64 on 32 images of 8x8, in four
+  // rpofm passes, so that each of four threads gets one.
+  NativeCRPKernelTest() : size_(8 * 8 * 64 * 32) {
+    kernel_params* p = &params_;
+    p->inchannels = 32;
+    p->outchannels = 64;
+    p->burstchannels = 32;
+    p->rpo = 1;
+    p->rpofm = 4;
+    p->burstydim = 16;
+    p->ydim = 8;
+    p->xdim = 8;
+    p->xtile_pad = 0;
+    p->ksize = 3;
+    p->numgroups = 1;
+    p->numimages = 32;
+    p->fc = 0;
+    p->relu = 1;
+    p->backward = 0;
+    p->stride = 1;
+    p->pad = 1;
+    p->pool = 0;
+    p->pksize = 2;
+    p->outshift = 0;
+    input_.resize(size_);
+    weights_.resize(size_);
+    bias_.resize(size_);
+    tags_.resize(size_);
+    FillGaussian(&input_);
+    FillGaussian(&weights_);
+    FillGaussian(&bias_);
+  }
+
+  static void FillGaussian(vector<cpfp>* x) {
+    vector<float> values(x->size());
+    caffe_rng_gaussian<float>(values.size(), 0, 1, values.data());
+    cpfp_from_float(values.size(), values.data(), x->data());
+  }
+
+  // Runs the registered crp kernel on num_threads threads and returns the
+  // bits of its output. The output starts out filled with 7, which no
+  // part of the kernel's work leaves behind.
+  vector<uint16> Run(int num_threads) {
+    NativeKernelRunner::set_num_threads(num_threads);
+    vector<cpfp> output(size_, cpfp(7.f));
+    NativeKernelRunner::Run(
+        NativeKernelRegistry::GetKernel("crp_layer_hwcn_cpfp"),
+        input_.data(), weights_.data(), bias_.data(), output.data(),
+        tags_.data(), reinterpret_cast<int*>(&params_), params_.numgroups);
+    return vector<uint16>(output.begin(), output.end());
+  }
+
+  const int size_;
+  kernel_params params_;
+  vector<cpfp> input_, weights_, bias_;
+  vector<short> tags_;
+};
+
+TEST_F(NativeCRPKernelTest, TestThreadsMatchSerial) {
+  // Forward, which also writes the ReLU tags of the backward pass
+  const vector<uint16> forward = Run(1);
+  EXPECT_TRUE(forward == Run(4));
+  EXPECT_TRUE(forward == Run(3));
+  // Backward wrt weights, which sums over the images of the whole task and
+  // skips on the tags of the forward pass
+  params_.backward = 1;
+  params_.fc = 1;
+  const vector<uint16> weights = Run(1);
+  EXPECT_TRUE(weights == Run(4));
+  EXPECT_TRUE(weights == Run(3));
+  params_.fc = 0;
+  params_.backward = 2;
+  params_.inchannels = 64;
+  params_.outchannels = 32;
+  params_.burstchannels = 64;
+  params_.burstydim = 8;
+  const vector<uint16> backward = Run(1);
+  EXPECT_TRUE(backward == Run(4));
+  EXPECT_TRUE(backward == Run(3));
+}
+
+TEST_F(NativeCRPKernelTest, TestOutShift) {
+  // Two input bursts, the sums of the first are written back unscaled and
+  // the shift applies once to the complete sums of the second.
+  params_.rpo = 2;
+  params_.burstchannels = 16;
+  for (int backward = 0; backward <= 2; backward += 2) {
+    params_.backward = backward;
+    params_.outshift = 0;
+    const vector<uint16> sums = Run(1);
+    for (int shift = -3; shift <= 3; shift += 6) {
+      params_.outshift = shift;
+      const vector<uint16> shifted = Run(4);
+      for (int i = 0; i < size_; ++i) {
+        const cpfp sum(sums[i]);
+        EXPECT_EQ(static_cast<uint16>(cpfp(std::ldexp(float(sum), shift))),
+            shifted[i]) << "backward " << backward << " shift " << shift;
+      }
+    }
+  }
+}
+
+#endif  // USE_OCL_NATIVE
+
+}  // namespace caffe
@@ -9,6 +9,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/cpfp_math.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -2601,4 +2602,96 @@ TYPED_TEST(NetTest, TestAllInOneNetDeploy) {
   ASSERT_TRUE(found_data);
 }
 
+#ifdef USE_OCL_NATIVE
+// A chain of OCL layers, each reading the output of the previous one, run
+// with the transfers and kernels in flight and with each of them blocking.
+class OCLNetAsyncTest : public ::testing::Test {
+ protected:
+  OCLNetAsyncTest() {
+    Caffe::set_mode(Caffe::OCL_NATIVE);
+  }
+  virtual ~OCLNetAsyncTest() {
+    Caffe::set_ocl_async(false);
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  static shared_ptr<Net<float> > NewNet() {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        "name: 'TestNetwork' force_backward: true state { phase: TRAIN } "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 16 dim: 16 dim: 8 dim: 8 } } } "
+        "layer { name: 'conv1' type: 'OCLCRHWCN' bottom: 'data' "
+        "  top: 'conv1' cr_param { relu: 1 } "
+        "  xcl_param { xcl_name: 'crp_layer_hwcn_cpfp.xclbin' "
+        "    kernel_name: 'crp_layer_hwcn_cpfp' } "
+        "  convolution_param { num_output: 32 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } } } "
+        "layer { name: 'pool1' type: 'OCLPoolingHWCN' bottom: 'conv1' "
+        "  top: 'pool1' "
+        "  xcl_param { xcl_name: 'crp_layer_hwcn_cpfp.xclbin' "
+        "    kernel_name: 'crp_layer_hwcn_cpfp' } "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } } "
+        "layer { name: 'conv2' type: 'OCLCRHWCN' bottom: 'pool1' "
+        "  top: 'conv2' "
+        "  xcl_param { xcl_name: 'crp_layer_hwcn_cpfp.xclbin' "
+        "    kernel_name: 'crp_layer_hwcn_cpfp' } "
+        "  convolution_param { num_output: 16 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } } } ",
+        &param));
+    return shared_ptr<Net<float> >(new Net<float>(param));
+  }
+};
+
+TEST_F(OCLNetAsyncTest, TestAsyncMatchesBlocking) {
+  shared_ptr<Net<float> > nets[2];
+  Blob<float> top_diff;
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  for (int a = 0; a < 2; ++a) {
+    Caffe::set_ocl_async(a == 1);
+    nets[a] = NewNet();
+    Blob<float>* data = nets[a]->input_blobs()[0];
+    Blob<float>* top = nets[a]->output_blobs()[0];
+    if (a == 0) {
+      filler.Fill(data);
+      top_diff.ReshapeLike(*top);
+      filler.Fill(&top_diff);
+    } else {
+      data->CopyFrom(*nets[0]->input_blobs()[0]);
+      const vector<shared_ptr<Blob<float> > >& params = nets[0]->params();
+      for (int i = 0; i < params.size(); ++i) {
+        nets[1]->params()[i]->CopyFrom(*params[i]);
+      }
+    }
+    // Two passes, the second starts while the first may still be in flight
+    for (int pass = 0; pass < 2; ++pass) {
+      nets[a]->Forward();
+      cpfp_from_float(top->count(), top_diff.cpu_data(),
+          top->mutable_cpu_cpfp_diff(), 0);
+      nets[a]->Backward();
+    }
+  }
+  const Blob<float>* top = nets[0]->output_blobs()[0];
+  const Blob<float>* async_top = nets[1]->output_blobs()[0];
+  for (int i = 0; i < top->count(); ++i) {
+    EXPECT_TRUE(top->cpu_cpfp_data()[i] == async_top->cpu_cpfp_data()[i]);
+  }
+  const Blob<float>* data = nets[0]->input_blobs()[0];
+  const Blob<float>* async_data = nets[1]->input_blobs()[0];
+  for (int i = 0; i < data->count(); ++i) {
+    EXPECT_EQ(data->cpu_diff()[i], async_data->cpu_diff()[i]);
+  }
+  const vector<shared_ptr<Blob<float> > >& params = nets[0]->params();
+  for (int i = 0; i < params.size(); ++i) {
+    const Blob<float>* async_param = nets[1]->params()[i].get();
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(params[i]->cpu_diff()[j], async_param->cpu_diff()[j]);
+    }
+  }
+}
+#endif  // USE_OCL_NATIVE
+
 }  // namespace caffe
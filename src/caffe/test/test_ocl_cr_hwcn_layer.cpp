@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -8,7 +10,13 @@
 #include "caffe/layers/hwcn_layer.hpp"
 #include "caffe/layers/cpfp_conversion_layer.hpp"
 #include "caffe/layers/ocl_cr_hwcn_layer.hpp"
+#include "caffe/layers/ocl_pooling_hwcn_layer.hpp"
+#include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/XCL_program_layer.hpp"
+#include "caffe/native_kernel.hpp"
+#include "caffe/util/cpfp_math.hpp"
+#include "caffe/util/hwcn_transpose.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/test/test_caffe_main.hpp"
 
 namespace caffe {
@@ -149,8 +157,72 @@ template void caffe_conv_relu(const Blob<double>* in,
     const vector<shared_ptr<Blob<double> > >& weights,
     Blob<double>* out);
 
+// Reference backward of the 2D convolution above, without ReLU: the diffs of
+// the input, the filters and the bias for the output diff out_diff.
+template <typename Dtype>
+void caffe_conv_backward(const Blob<Dtype>* in,
+    ConvolutionParameter* conv_param,
+    const vector<shared_ptr<Blob<Dtype> > >& weights,
+    const Blob<Dtype>* out_diff, Blob<Dtype>* in_diff,
+    Blob<Dtype>* weight_diff, Blob<Dtype>* bias_diff) {
+  const int kernel = conv_param->kernel_size(0);
+  const int pad = conv_param->pad_size() ? conv_param->pad(0) : 0;
+  const int stride = conv_param->stride_size() ? conv_param->stride(0) : 1;
+  const int groups = conv_param->group();
+  const int o_g = out_diff->shape(1) / groups;
+  const int k_g = in->shape(1) / groups;
+  in_diff->ReshapeLike(*in);
+  weight_diff->ReshapeLike(*weights[0]);
+  bias_diff->Reshape(vector<int>(1, out_diff->shape(1)));
+  caffe_set(in_diff->count(), Dtype(0), in_diff->mutable_cpu_data());
+  caffe_set(weight_diff->count(), Dtype(0), weight_diff->mutable_cpu_data());
+  caffe_set(bias_diff->count(), Dtype(0), bias_diff->mutable_cpu_data());
+  Dtype* in_diff_data = in_diff->mutable_cpu_data();
+  Dtype* weight_diff_data = weight_diff->mutable_cpu_data();
+  Dtype* bias_diff_data = bias_diff->mutable_cpu_data();
+
+  for (int n = 0; n < out_diff->shape(0); n++) {
+    for (int o = 0; o < out_diff->shape(1); o++) {
+      const int g = o / o_g;
+      for (int y = 0; y < out_diff->shape(2); y++) {
+        for (int x = 0; x < out_diff->shape(3); x++) {
+          const Dtype d = out_diff->data_at(n, o, y, x);
+          bias_diff_data[o] += d;
+          for (int k = 0; k < k_g; k++) {
+            for (int p = 0; p < kernel; p++) {
+              for (int q = 0; q < kernel; q++) {
+                int in_y = y * stride - pad + p;
+                int in_x = x * stride - pad + q;
+                if (in_y >= 0 && in_y < in->shape(2)
+                    && in_x >= 0 && in_x < in->shape(3)) {
+                  const int c = k + g * k_g;
+                  weight_diff_data[weight_diff->offset(o, k, p, q)] +=
+                      d * in->data_at(n, c, in_y, in_x);
+                  in_diff_data[in_diff->offset(n, c, in_y, in_x)] +=
+                      d * weights[0]->data_at(o, k, p, q);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template void caffe_conv_backward(const Blob<float>* in,
+    ConvolutionParameter* conv_param,
+    const vector<shared_ptr<Blob<float> > >& weights,
+    const Blob<float>* out_diff, Blob<float>* in_diff,
+    Blob<float>* weight_diff, Blob<float>* bias_diff);
+template void caffe_conv_backward(const Blob<double>* in,
+    ConvolutionParameter* conv_param,
+    const vector<shared_ptr<Blob<double> > >& weights,
+    const Blob<double>* out_diff, Blob<double>* in_diff,
+    Blob<double>* weight_diff, Blob<double>* bias_diff);
+
 template <typename TypeParam>
-class OCLCRHWCNLayerTest : public OCLDeviceTest<TypeParam> {
+class OCLCRHWCNLayerTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
 
  protected:
@@ -450,5 +522,566 @@ TYPED_TEST(OCLCRHWCNLayerTest, TestForward5x5) {
     EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-1);
   }
 }
+#ifdef USE_OCL_NATIVE
+
+template <typename TypeParam>
+class OCLCRHWCNNativeTest : public OCLCRHWCNLayerTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  // Converts blob_bottom_ to the cpfp HWCN bottom of the OCLCRHWCN layer,
+  // at an exponent picked from its max if scale is set
+  void ConvertBottom(bool scale = false) {
+    LayerParameter layer_param;
+    layer_param.mutable_hwcn_param()->set_convert_to(true);
+    layer_param.mutable_cpfp_conversion_param()->set_convert_to(true);
+    layer_param.mutable_cpfp_conversion_param()->set_scale(scale);
+    HWCNLayer<Dtype> hwcn_layer(layer_param);
+    hwcn_layer.SetUp(this->blob_bottom_vec_hwcn, this->blob_top_vec_hwcn);
+    hwcn_layer.Forward(this->blob_bottom_vec_hwcn, this->blob_top_vec_hwcn);
+    CPFPConversionLayer<Dtype> cpfp_layer(layer_param);
+    cpfp_layer.SetUp(this->blob_bottom_vec_cpfp, this->blob_top_vec_cpfp);
+    cpfp_layer.Forward(this->blob_bottom_vec_cpfp, this->blob_top_vec_cpfp);
+  }
+
+  // The cpfp data or diff of a blob, as raw bits
+  static vector<uint16> Bits(const Blob<Dtype>* blob, bool diff) {
+    const cpfp* x = diff ? blob->cpu_cpfp_diff() : blob->cpu_cpfp_data();
+    vector<uint16> bits(blob->count());
+    for (int i = 0; i < bits.size(); ++i) {
+      bits[i] = static_cast<uint16>(x[i]);
+    }
+    return bits;
+  }
+
+  // Fills blob with -1, 0 and 1, nonzero with probability density. The
+  // sums of a few such products are small integers, which cpfp holds
+  // exactly whatever order the kernel adds them in.
+  static void FillTernary(Blob<Dtype>* blob, Dtype density) {
+    caffe_rng_uniform(blob->count(), Dtype(0), Dtype(1),
+        blob->mutable_cpu_data());
+    Dtype* x = blob->mutable_cpu_data();
+    for (int i = 0; i < blob->count(); ++i) {
+      x[i] = (x[i] < density / 2) ? -1 : (x[i] < density) ? 1 : 0;
+    }
+  }
+
+  // Runs layer forward and backward on the bottom from ConvertBottom(),
+  // which FillTernary filled and which may be multiplied by scale, and
+  // checks the top and all the diffs against caffe_conv_relu and
+  // caffe_conv_backward. The bias and the top diff are multiplied by scale
+  // as well, a power of two. The layer has to be set up without ReLU.
+  void CheckConv(OCLCRHWCNLayer<Dtype>* layer,
+      ConvolutionParameter* convolution_param, Dtype scale = 1) {
+    FillTernary(layer->blobs()[0].get(), 0.125);
+    FillTernary(layer->blobs()[1].get(), 0.5);
+    caffe_scal(layer->blobs()[1]->count(), scale,
+        layer->blobs()[1]->mutable_cpu_data());
+    Blob<Dtype>* top = this->blob_top_cr_out;
+    layer->Forward(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+    const int num = this->blob_bottom_->shape(0);
+    const int spatial = top->shape(0) * top->shape(1);
+    Blob<Dtype> top_data(num, top->shape(2), top->shape(0), top->shape(1));
+    hwcn_to_nchw(num, top->shape(2), spatial, top->cpu_cpfp_data(),
+        top_data.mutable_cpu_data(), top->cpfp_data_exp());
+    Blob<Dtype> ref_top;
+    ref_top.ReshapeLike(top_data);
+    caffe_conv_relu(this->blob_bottom_, convolution_param, layer->blobs(),
+        &ref_top);
+    for (int i = 0; i < ref_top.count(); ++i) {
+      EXPECT_EQ(ref_top.cpu_data()[i], top_data.cpu_data()[i]);
+    }
+
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(top_data);
+    FillTernary(&top_diff, 0.125);
+    caffe_scal(top_diff.count(), scale, top_diff.mutable_cpu_data());
+    const int diff_exp = cpfp_scale_exp(scale);
+    nchw_to_hwcn(num, top->shape(2), spatial, top_diff.cpu_data(),
+        top->mutable_cpu_cpfp_diff(), diff_exp);
+    top->set_cpfp_diff_exp(diff_exp);
+    layer->Backward(this->blob_top_vec_cr, vector<bool>(1, true),
+        this->blob_bottom_vec_cr);
+
+    Blob<Dtype> ref_bottom_diff, ref_weight_diff, ref_bias_diff;
+    caffe_conv_backward(this->blob_bottom_, convolution_param,
+        layer->blobs(), &top_diff, &ref_bottom_diff, &ref_weight_diff,
+        &ref_bias_diff);
+    const Blob<Dtype>* bottom = this->blob_top_cpfp_out;
+    Blob<Dtype> bottom_diff;
+    bottom_diff.ReshapeLike(*this->blob_bottom_);
+    hwcn_to_nchw(num, bottom->shape(2), spatial, bottom->cpu_cpfp_diff(),
+        bottom_diff.mutable_cpu_data(), bottom->cpfp_diff_exp());
+    for (int i = 0; i < bottom_diff.count(); ++i) {
+      EXPECT_EQ(ref_bottom_diff.cpu_data()[i], bottom_diff.cpu_data()[i]);
+    }
+    const Blob<Dtype>* weights = layer->blobs()[0].get();
+    for (int i = 0; i < weights->count(); ++i) {
+      EXPECT_EQ(ref_weight_diff.cpu_data()[i], weights->cpu_diff()[i]);
+    }
+    const Blob<Dtype>* bias = layer->blobs()[1].get();
+    for (int i = 0; i < bias->count(); ++i) {
+      EXPECT_EQ(ref_bias_diff.cpu_data()[i], bias->cpu_diff()[i]);
+    }
+  }
+};
+
+TYPED_TEST_CASE(OCLCRHWCNNativeTest, TestOCLNativeDtypesAndDevices);
+
+TYPED_TEST(OCLCRHWCNNativeTest, TestBackwardReLUSkip) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.set_ocl_enable(true);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(32);
+  convolution_param->add_pad(1);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_weight_filler()->set_std(0.1);
+  Blob<Dtype>* top = this->blob_top_cr_out;
+  vector<bool> propagate_down(1, true);
+
+  // With ReLU the backward passes skip the words of the output diff whose
+  // tags are clear, which the output channels 16 and up never set. In the
+  // second case the weights are positive and the columns 1 to 3 of the 6x6
+  // input negative, each at its own scale, so the output column 2 clears
+  // every tag. Its tiles are skipped whole and column 3 has to read its
+  // window again rather than shift the one of column 1.
+  for (int c = 0; c < 2; ++c) {
+    if (c == 1) {
+      this->blob_bottom_->Reshape(256, 16, 6, 6);
+      FillerParameter filler_param;
+      filler_param.set_value(1.);
+      GaussianFiller<Dtype> filler(filler_param);
+      filler.Fill(this->blob_bottom_);
+      const Dtype column_scale[] = {4, -1, -2, -0.5, 4, 1};
+      Dtype* x = this->blob_bottom_->mutable_cpu_data();
+      for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+        x[i] = column_scale[i % 6] * (1 + std::fabs(x[i]));
+      }
+    }
+    this->ConvertBottom();
+    layer_param.mutable_cr_param()->set_relu(1);
+    OCLCRHWCNLayer<Dtype> relu_layer(layer_param);
+    relu_layer.SetUp(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+    Dtype* bias = relu_layer.blobs()[1]->mutable_cpu_data();
+    for (int i = 16; i < 32; ++i) {
+      bias[i] = -1000;
+    }
+    if (c == 1) {
+      Blob<Dtype>* weights = relu_layer.blobs()[0].get();
+      caffe_abs(weights->count(), weights->cpu_data(),
+          weights->mutable_cpu_data());
+    }
+    relu_layer.Forward(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+    const vector<uint16> relu_top = this->Bits(top, false);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*top);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&top_diff);
+    cpfp_from_float(top->count(), top_diff.cpu_data(),
+        top->mutable_cpu_cpfp_diff(), 0);
+    relu_layer.Backward(this->blob_top_vec_cr, propagate_down,
+        this->blob_bottom_vec_cr);
+    const vector<uint16> skip_diff =
+        this->Bits(this->blob_top_cpfp_out, true);
+
+    // Without ReLU nothing is skipped, the diff is masked on the host
+    // instead
+    layer_param.mutable_cr_param()->set_relu(0);
+    OCLCRHWCNLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      layer.blobs()[i]->CopyFrom(*relu_layer.blobs()[i]);
+    }
+    layer.Forward(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+    cpfp_from_float(top->count(), top_diff.cpu_data(),
+        top->mutable_cpu_cpfp_diff(), 0);
+    cpfp* masked = top->mutable_cpu_cpfp_diff();
+    for (int i = 0; i < top->count(); ++i) {
+      if (relu_top[i] == 0) {
+        masked[i] = cpfp(0);
+      }
+    }
+    layer.Backward(this->blob_top_vec_cr, propagate_down,
+        this->blob_bottom_vec_cr);
+
+    EXPECT_TRUE(skip_diff == this->Bits(this->blob_top_cpfp_out, true)) << c;
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      const Blob<Dtype>* expected = layer.blobs()[i].get();
+      const Blob<Dtype>* actual = relu_layer.blobs()[i].get();
+      for (int j = 0; j < expected->count(); ++j) {
+        EXPECT_EQ(expected->cpu_diff()[j], actual->cpu_diff()[j]) << c;
+      }
+    }
+  }
+}
+
+TYPED_TEST(OCLCRHWCNNativeTest, TestGroupedInputBursts) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.set_ocl_enable(true);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(5);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(256);
+  convolution_param->add_pad(2);
+  convolution_param->set_group(2);
+  layer_param.mutable_cr_param()->set_num_cu(3);
+  this->blob_bottom_->Reshape(16, 64, 4, 4);
+  this->FillTernary(this->blob_bottom_, 0.25);
+  this->ConvertBottom();
+
+  OCLCRHWCNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+  // Both passes over the data take two input bursts per group. Wrt data the
+  // three compute units would split the 32 output channels of a group in
+  // bursts of 11, below the 16 that LayerSetUp CHECKs for a batch of 16.
+  vector<kernel_params> calls;
+  layer.OCLKernelCalls(&calls);
+  const kernel_params& forward_call = calls[0];
+  const kernel_params& data_call = calls[3];
+  ASSERT_EQ(2, data_call.backward);
+  EXPECT_GT(forward_call.rpo, 1);
+  EXPECT_EQ(128, forward_call.rpofm * forward_call.burstydim);
+  EXPECT_GT(data_call.rpo, 1);
+  EXPECT_EQ(16, data_call.burstydim);
+  EXPECT_EQ(32, data_call.rpofm * data_call.burstydim);
+  this->CheckConv(&layer, convolution_param);
+}
+
+TYPED_TEST(OCLCRHWCNNativeTest, TestScaledInputBursts) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.set_ocl_enable(true);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(5);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(256);
+  convolution_param->add_pad(2);
+  convolution_param->set_group(2);
+  layer_param.mutable_cr_param()->set_num_cu(3);
+  layer_param.mutable_cr_param()->set_cpfp_scale(true);
+  layer_param.mutable_cr_param()->set_cpfp_scale_period(2);
+  // Values far outside the cpfp range, which only survive at the exponents
+  // of the blobs. Both passes take two input bursts per group, so the
+  // outputs are shifted on the last one only.
+  const Dtype scales[] = {Dtype(1 << 20), Dtype(1) / (1 << 20)};
+  for (int s = 0; s < 2; ++s) {
+    this->blob_bottom_->Reshape(16, 64, 4, 4);
+    this->FillTernary(this->blob_bottom_, 0.25);
+    caffe_scal(this->blob_bottom_->count(), scales[s],
+        this->blob_bottom_->mutable_cpu_data());
+    this->ConvertBottom(true);
+    OCLCRHWCNLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+    vector<kernel_params> calls;
+    layer.OCLKernelCalls(&calls);
+    EXPECT_GT(calls[0].rpo, 1);
+    EXPECT_GT(calls[3].rpo, 1);
+    // The first pass keeps the exponents of the sums and samples the output
+    // max, the later ones move the outputs to the exponent of the running
+    // max, which the third pass samples again.
+    const Blob<Dtype>* bottom = this->blob_top_cpfp_out;
+    const Blob<Dtype>* top = this->blob_top_cr_out;
+    const int sum_exp = bottom->cpfp_data_exp() + cpfp_scale_exp(1);
+    const int diff_sum_exp = cpfp_scale_exp(scales[s]) + cpfp_scale_exp(1);
+    for (int pass = 0; pass < 3; ++pass) {
+      this->CheckConv(&layer, convolution_param, scales[s]);
+      if (pass == 0) {
+        EXPECT_EQ(sum_exp, top->cpfp_data_exp());
+        EXPECT_EQ(diff_sum_exp, bottom->cpfp_diff_exp());
+      } else {
+        EXPECT_NE(sum_exp, top->cpfp_data_exp());
+        EXPECT_NE(diff_sum_exp, bottom->cpfp_diff_exp());
+      }
+    }
+  }
+}
+
+TYPED_TEST(OCLCRHWCNNativeTest, TestGroupedPartialBurst) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.set_ocl_enable(true);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(240);
+  convolution_param->add_pad(1);
+  convolution_param->set_group(3);
+  layer_param.mutable_cr_param()->set_num_cu(3);
+  this->blob_bottom_->Reshape(16, 144, 4, 4);
+  this->FillTernary(this->blob_bottom_, 0.25);
+  this->ConvertBottom();
+
+  OCLCRHWCNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+  // A single input burst per group, and a last output burst that covers
+  // fewer than the 80 output channels of a group
+  vector<kernel_params> calls;
+  layer.OCLKernelCalls(&calls);
+  const kernel_params& forward_call = calls[0];
+  EXPECT_EQ(1, forward_call.rpo);
+  EXPECT_GT(forward_call.rpofm * forward_call.burstydim, 80);
+  this->CheckConv(&layer, convolution_param);
+}
+
+TYPED_TEST(OCLCRHWCNNativeTest, TestForwardWinograd) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.set_ocl_enable(true);
+  layer_param.set_phase(TEST);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(32);
+  convolution_param->add_pad(1);
+  convolution_param->set_subengine(ConvolutionParameter_SubEngine_WINOGRAD);
+  // Two words of images, and an odd width for a half empty last tile
+  this->blob_bottom_->Reshape(32, 192, 5, 5);
+  this->FillTernary(this->blob_bottom_, 0.25);
+  this->ConvertBottom();
+
+  OCLCRHWCNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+  EXPECT_EQ("wcrp_layer_hwcn_cpfp_fw", layer.xcl_param().kernel_name());
+  vector<kernel_params> calls;
+  layer.OCLKernelCalls(&calls);
+  EXPECT_GT(calls[0].rpo, 1);
+  this->FillTernary(layer.blobs()[0].get(), 0.125);
+  this->FillTernary(layer.blobs()[1].get(), 0.5);
+  layer.Forward(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+
+  // The transforms only halve and add, so the sums stay exact
+  const Blob<Dtype>* top = this->blob_top_cr_out;
+  const int num = this->blob_bottom_->shape(0);
+  Blob<Dtype> top_data(num, top->shape(2), top->shape(0), top->shape(1));
+  hwcn_to_nchw(num, top->shape(2), top->shape(0) * top->shape(1),
+      top->cpu_cpfp_data(), top_data.mutable_cpu_data(),
+      top->cpfp_data_exp());
+  Blob<Dtype> ref_top;
+  ref_top.ReshapeLike(top_data);
+  caffe_conv_relu(this->blob_bottom_, convolution_param, layer.blobs(),
+      &ref_top);
+  for (int i = 0; i < ref_top.count(); ++i) {
+    EXPECT_EQ(ref_top.cpu_data()[i], top_data.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(OCLCRHWCNNativeTest, TestForwardBackwardBatch5) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.set_ocl_enable(true);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(32);
+  convolution_param->add_pad(1);
+  // Padded to a word of 16 images on the way in and stripped on the way out
+  this->blob_bottom_->Reshape(5, 32, 6, 6);
+  this->FillTernary(this->blob_bottom_, 0.25);
+  this->ConvertBottom();
+
+  OCLCRHWCNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+  this->CheckConv(&layer, convolution_param);
+}
+
+TYPED_TEST(OCLCRHWCNNativeTest, TestPoolingBatch5) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.set_ocl_enable(true);
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  pooling_param->set_kernel_size(2);
+  pooling_param->set_stride(2);
+  // Integers up to 63, which cpfp holds exactly. The values of a 2x2
+  // window differ, so both layers agree on where the maximum is.
+  this->blob_bottom_->Reshape(5, 16, 8, 8);
+  Dtype* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_rng_uniform(this->blob_bottom_->count(), Dtype(0), Dtype(1), x);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    const int h = (i / 8) % 8;
+    const int w = i % 8;
+    x[i] = 4 * (std::floor(x[i] * 31) - 15) + (h % 2) * 2 + w % 2;
+  }
+  this->ConvertBottom();
+
+  OCLPoolingHWCNLayer<Dtype> layer(layer_param);
+  Blob<Dtype> top;
+  vector<Blob<Dtype>*> top_vec(1, &top);
+  layer.SetUp(this->blob_bottom_vec_cr, top_vec);
+  layer.Forward(this->blob_bottom_vec_cr, top_vec);
+  PoolingLayer<Dtype> ref_layer(layer_param);
+  vector<Blob<Dtype>*> ref_bottom_vec(1, this->blob_bottom_);
+  Blob<Dtype> ref_top;
+  vector<Blob<Dtype>*> ref_top_vec(1, &ref_top);
+  ref_layer.SetUp(ref_bottom_vec, ref_top_vec);
+  ref_layer.Forward(ref_bottom_vec, ref_top_vec);
+  const int num = 5;
+  const int channels = 16;
+  Blob<Dtype> top_data;
+  top_data.ReshapeLike(ref_top);
+  hwcn_to_nchw(num, channels, 16, top.cpu_cpfp_data(),
+      top_data.mutable_cpu_data(), top.cpfp_data_exp());
+  for (int i = 0; i < ref_top.count(); ++i) {
+    EXPECT_EQ(ref_top.cpu_data()[i], top_data.cpu_data()[i]);
+  }
+
+  this->FillTernary(&top_data, 0.5);
+  caffe_copy(ref_top.count(), top_data.cpu_data(), ref_top.mutable_cpu_diff());
+  nchw_to_hwcn(num, channels, 16, top_data.cpu_data(),
+      top.mutable_cpu_cpfp_diff());
+  top.set_cpfp_diff_exp(0);
+  vector<bool> propagate_down(1, true);
+  layer.Backward(top_vec, propagate_down, this->blob_bottom_vec_cr);
+  ref_layer.Backward(ref_top_vec, propagate_down, ref_bottom_vec);
+  const Blob<Dtype>* bottom = this->blob_top_cpfp_out;
+  Blob<Dtype> bottom_diff;
+  bottom_diff.ReshapeLike(*this->blob_bottom_);
+  hwcn_to_nchw(num, channels, 64, bottom->cpu_cpfp_diff(),
+      bottom_diff.mutable_cpu_data(), bottom->cpfp_diff_exp());
+  for (int i = 0; i < bottom_diff.count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_diff()[i], bottom_diff.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(OCLCRHWCNNativeTest, TestSplitMatchesUnsplit) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.set_ocl_enable(true);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(128);
+  convolution_param->add_pad(1);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_weight_filler()->set_std(0.1);
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_std(0.1);
+  layer_param.mutable_cr_param()->set_relu(1);
+  layer_param.mutable_cr_param()->set_num_cu(4);
+  this->blob_bottom_->Reshape(16, 64, 8, 8);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  this->ConvertBottom();
+  OCLCRHWCNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+  // The forward and both backward passes have output bursts for every
+  // split, the bias pass computes a single one.
+  vector<kernel_params> calls;
+  layer.OCLKernelCalls(&calls);
+  ASSERT_EQ(4, calls.size());
+  EXPECT_GE(calls[0].rpofm, 4);
+  EXPECT_GE(calls[2].rpofm, 4);
+  EXPECT_GE(calls[3].rpofm, 4);
+
+  // Max pooling only runs in the first split of a task
+  LayerParameter pool_layer_param;
+  pool_layer_param.mutable_xcl_param()->CopyFrom(*xcl_param);
+  pool_layer_param.set_ocl_enable(true);
+  PoolingParameter* pooling_param = pool_layer_param.mutable_pooling_param();
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  pooling_param->set_kernel_size(2);
+  pooling_param->set_stride(2);
+  OCLPoolingHWCNLayer<Dtype> pool_layer(pool_layer_param);
+  Blob<Dtype> pool_top;
+  vector<Blob<Dtype>*> pool_top_vec(1, &pool_top);
+  pool_layer.SetUp(this->blob_top_vec_cr, pool_top_vec);
+  Blob<Dtype> pool_top_diff;
+  pool_top_diff.ReshapeLike(pool_top);
+  filler.Fill(&pool_top_diff);
+
+  // The native runner cuts each task in as many splits as it has threads
+  vector<bool> propagate_down(1, true);
+  vector<vector<uint16> > unsplit_bits;
+  vector<vector<Dtype> > unsplit_diffs;
+  for (int num_splits = 1; num_splits <= 4; ++num_splits) {
+    NativeKernelRunner::set_num_threads(num_splits);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      caffe_set(layer.blobs()[i]->count(), Dtype(0),
+          layer.blobs()[i]->mutable_cpu_diff());
+    }
+    // Every output is written again, none keeps the unsplit value
+    Blob<Dtype>* outputs[] = {this->blob_top_cr_out, &pool_top};
+    for (int i = 0; i < 2; ++i) {
+      std::fill(outputs[i]->mutable_cpu_cpfp_data(),
+          outputs[i]->mutable_cpu_cpfp_data() + outputs[i]->count(),
+          cpfp(7.f));
+    }
+    std::fill(this->blob_top_cpfp_out->mutable_cpu_cpfp_diff(),
+        this->blob_top_cpfp_out->mutable_cpu_cpfp_diff() +
+        this->blob_top_cpfp_out->count(), cpfp(7.f));
+    layer.Forward(this->blob_bottom_vec_cr, this->blob_top_vec_cr);
+    pool_layer.Forward(this->blob_top_vec_cr, pool_top_vec);
+    cpfp_from_float(pool_top.count(), pool_top_diff.cpu_data(),
+        pool_top.mutable_cpu_cpfp_diff(), 0);
+    pool_layer.Backward(pool_top_vec, propagate_down, this->blob_top_vec_cr);
+    layer.Backward(this->blob_top_vec_cr, propagate_down,
+        this->blob_bottom_vec_cr);
+
+    vector<vector<uint16> > bits;
+    bits.push_back(this->Bits(this->blob_top_cr_out, false));
+    bits.push_back(this->Bits(&pool_top, false));
+    bits.push_back(this->Bits(this->blob_top_cr_out, true));
+    bits.push_back(this->Bits(this->blob_top_cpfp_out, true));
+    vector<vector<Dtype> > diffs;
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      const Dtype* diff = layer.blobs()[i]->cpu_diff();
+      diffs.push_back(vector<Dtype>(diff, diff + layer.blobs()[i]->count()));
+    }
+    if (num_splits == 1) {
+      unsplit_bits = bits;
+      unsplit_diffs = diffs;
+      continue;
+    }
+    for (int i = 0; i < bits.size(); ++i) {
+      EXPECT_TRUE(unsplit_bits[i] == bits[i])
+          << "blob " << i << " with " << num_splits << " splits";
+    }
+    for (int i = 0; i < diffs.size(); ++i) {
+      EXPECT_TRUE(unsplit_diffs[i] == diffs[i])
+          << "param " << i << " with " << num_splits << " splits";
+    }
+  }
+  NativeKernelRunner::set_num_threads(0);
+}
+
+#endif  // USE_OCL_NATIVE
+
 #endif  // USE_OCL
 }  // namespace caffe
@@ -9,9 +9,12 @@
 #include "caffe/layers/hwcn_layer.hpp"
 #include "caffe/layers/ocl_inner_product_hwcn_layer.hpp"
 #include "caffe/layers/XCL_program_layer.hpp"
+#include "caffe/native_kernel.hpp"
+#include "caffe/util/cpfp_math.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -57,7 +60,7 @@ template void caffe_inner_product(const Blob<double>* in,
     Blob<double>* out);
 
 template <typename TypeParam>
-class OCLHWCNInnerProductLayerTest : public OCLDeviceTest<TypeParam> {
+class OCLHWCNInnerProductLayerTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
  protected:
   OCLHWCNInnerProductLayerTest()
@@ -119,7 +122,9 @@ class OCLHWCNInnerProductLayerTest : public OCLDeviceTest<TypeParam> {
   vector<Blob<Dtype>*> prog_top_;
 };
 
-TYPED_TEST_CASE(OCLHWCNInnerProductLayerTest, TestDtypesAndDevices);
+typedef ::testing::Types<OCLDevice<float>, OCLDevice<double> >
+    OCLHWCNInnerProductDevices;
+TYPED_TEST_CASE(OCLHWCNInnerProductLayerTest, OCLHWCNInnerProductDevices);
 /*
 TYPED_TEST(OCLHWCNInnerProductLayerTest, TestSetUp) {
   typedef typename TypeParam::Dtype Dtype;
@@ -210,6 +215,257 @@ TYPED_TEST(OCLHWCNInnerProductLayerTest, TestForward) {
   }
 }
 
+#ifdef USE_OCL_NATIVE
+
+template <typename TypeParam>
+class OCLHWCNInnerProductNativeTest
+    : public OCLHWCNInnerProductLayerTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  // Fills blob with -1, 0 and 1, nonzero with probability density, so that
+  // the sums of the kernel are exact.
+  static void FillTernary(Blob<Dtype>* blob, Dtype density) {
+    caffe_rng_uniform(blob->count(), Dtype(0), Dtype(1),
+        blob->mutable_cpu_data());
+    Dtype* x = blob->mutable_cpu_data();
+    for (int i = 0; i < blob->count(); ++i) {
+      x[i] = (x[i] < density / 2) ? -1 : (x[i] < density) ? 1 : 0;
+    }
+  }
+
+  // Converts blob_bottom_, a single pixel so that its HWCN and NCHW orders
+  // agree, to the cpfp bottom of the inner product layer, at an exponent
+  // picked from its max if scale is set
+  void ConvertBottom(LayerParameter layer_param, bool scale = false) {
+    layer_param.mutable_hwcn_param()->set_convert_to(true);
+    HWCNLayer<Dtype> hwcn_layer(layer_param);
+    hwcn_layer.SetUp(this->blob_bottom_vec_hwcn, this->blob_top_vec_hwcn);
+    hwcn_layer.Forward(this->blob_bottom_vec_hwcn, this->blob_top_vec_hwcn);
+    layer_param.mutable_cpfp_conversion_param()->set_convert_to(true);
+    layer_param.mutable_cpfp_conversion_param()->set_scale(scale);
+    CPFPConversionLayer<Dtype> cpfp_layer(layer_param);
+    cpfp_layer.SetUp(this->blob_bottom_vec_cpfp, this->blob_top_vec_cpfp);
+    cpfp_layer.Forward(this->blob_bottom_vec_cpfp, this->blob_top_vec_cpfp);
+  }
+
+  // Runs layer forward and backward on the bottom from ConvertBottom(),
+  // which FillTernary filled and which may be multiplied by scale, and
+  // checks the top and all the diffs against caffe_inner_product and its
+  // gradients. The bias and the top diff are multiplied by scale as well, a
+  // power of two.
+  void CheckInnerProduct(OCLHWCNInnerProductLayer<Dtype>* layer,
+      InnerProductParameter* inner_product_param, Dtype scale = 1) {
+    const int M = this->blob_bottom_->shape(0);
+    const int K = this->blob_bottom_->count(1);
+    const int N = inner_product_param->num_output();
+    FillTernary(layer->blobs()[0].get(), 0.125);
+    FillTernary(layer->blobs()[1].get(), 0.5);
+    caffe_scal(N, scale, layer->blobs()[1]->mutable_cpu_data());
+    layer->Forward(this->blob_bottom_vec_ip, this->blob_top_vec_ip);
+    Blob<Dtype> ref_top(M, N, 1, 1);
+    caffe_inner_product(this->blob_bottom_, inner_product_param,
+        layer->blobs(), &ref_top);
+    // The top is N x M
+    Blob<Dtype>* top = this->blob_top_ip_out;
+    Blob<Dtype> top_data;
+    top_data.ReshapeLike(*top);
+    cpfp_to_float(top->count(), top->cpu_cpfp_data(),
+        top_data.mutable_cpu_data(), top->cpfp_data_exp());
+    for (int m = 0; m < M; ++m) {
+      for (int n = 0; n < N; ++n) {
+        EXPECT_EQ(ref_top.cpu_data()[m * N + n],
+            top_data.cpu_data()[n * M + m]);
+      }
+    }
+
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*top);
+    FillTernary(&top_diff, 0.25);
+    caffe_scal(top_diff.count(), scale, top_diff.mutable_cpu_data());
+    const int diff_exp = cpfp_scale_exp(scale);
+    cpfp_from_float(top->count(), top_diff.cpu_data(),
+        top->mutable_cpu_cpfp_diff(), diff_exp);
+    top->set_cpfp_diff_exp(diff_exp);
+    layer->Backward(this->blob_top_vec_ip, vector<bool>(1, true),
+        this->blob_bottom_vec_ip);
+    const Dtype* dy = top_diff.cpu_data();
+    const Dtype* x = this->blob_bottom_->cpu_data();
+    const Dtype* w = layer->blobs()[0]->cpu_data();
+    const Blob<Dtype>* bottom = this->blob_top_cpfp_out;
+    Blob<Dtype> bottom_diff;
+    bottom_diff.ReshapeLike(*bottom);
+    cpfp_to_float(bottom->count(), bottom->cpu_cpfp_diff(),
+        bottom_diff.mutable_cpu_data(), bottom->cpfp_diff_exp());
+    for (int k = 0; k < K; ++k) {
+      for (int m = 0; m < M; ++m) {
+        Dtype ref = 0;
+        for (int n = 0; n < N; ++n) {
+          ref += w[n * K + k] * dy[n * M + m];
+        }
+        EXPECT_EQ(ref, bottom_diff.cpu_data()[k * M + m]);
+      }
+    }
+    for (int n = 0; n < N; ++n) {
+      Dtype ref_bias = 0;
+      for (int m = 0; m < M; ++m) {
+        ref_bias += dy[n * M + m];
+      }
+      EXPECT_EQ(ref_bias, layer->blobs()[1]->cpu_diff()[n]);
+      for (int k = 0; k < K; ++k) {
+        Dtype ref = 0;
+        for (int m = 0; m < M; ++m) {
+          ref += dy[n * M + m] * x[m * K + k];
+        }
+        EXPECT_EQ(ref, layer->blobs()[0]->cpu_diff()[n * K + k]);
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(OCLHWCNInnerProductNativeTest, TestOCLNativeDtypesAndDevices);
+
+TYPED_TEST(OCLHWCNInnerProductNativeTest, TestPackedMatchesUnpacked) {
+  typedef typename TypeParam::Dtype Dtype;
+  // 16 words or one word of 16 images per output channel, and 21 channels
+  // whose output rows end inside a beat, so the forward task runs whole.
+  const int nums[] = {256, 16, 16};
+  const int num_outputs[] = {64, 64, 21};
+  for (int c = 0; c < 3; ++c) {
+    this->blob_bottom_->Reshape(nums[c], 128, 2, 1);
+    FillerParameter filler_param;
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(num_outputs[c]);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_weight_filler()->set_std(0.1);
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_std(0.1);
+    XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+    xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+    xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+
+    layer_param.mutable_hwcn_param()->set_convert_to(true);
+    HWCNLayer<Dtype> hwcn_layer(layer_param);
+    hwcn_layer.SetUp(this->blob_bottom_vec_hwcn, this->blob_top_vec_hwcn);
+    hwcn_layer.Forward(this->blob_bottom_vec_hwcn, this->blob_top_vec_hwcn);
+    layer_param.mutable_cpfp_conversion_param()->set_convert_to(true);
+    CPFPConversionLayer<Dtype> cpfp_layer(layer_param);
+    cpfp_layer.SetUp(this->blob_bottom_vec_cpfp, this->blob_top_vec_cpfp);
+    cpfp_layer.Forward(this->blob_bottom_vec_cpfp, this->blob_top_vec_cpfp);
+
+    // Forward and backward of the unpacked kernel, then of the packed one
+    // with the same weights. Both carry the same cpfp values, so the outputs
+    // and diffs match bit for bit. Several threads cut the tasks into slices,
+    // the packed ones only on whole beats of the output.
+    NativeKernelRunner::set_num_threads(4);
+    Blob<Dtype>* bottom = this->blob_top_cpfp_out;
+    Blob<Dtype>* top = this->blob_top_ip_out;
+    vector<bool> propagate_down(1, true);
+    vector<uint16> top_data[2], bottom_diff[2];
+    vector<Dtype> weight_diff[2];
+    shared_ptr<OCLHWCNInnerProductLayer<Dtype> > layers[2];
+    for (int p = 0; p < 2; ++p) {
+      xcl_param->set_packed(p == 1);
+      layers[p].reset(new OCLHWCNInnerProductLayer<Dtype>(layer_param));
+      layers[p]->SetUp(this->blob_bottom_vec_ip, this->blob_top_vec_ip);
+      if (p == 1) {
+        for (int i = 0; i < layers[0]->blobs().size(); ++i) {
+          layers[1]->blobs()[i]->CopyFrom(*layers[0]->blobs()[i]);
+        }
+      }
+      layers[p]->Forward(this->blob_bottom_vec_ip, this->blob_top_vec_ip);
+      const cpfp* y = top->cpu_cpfp_data();
+      for (int i = 0; i < top->count(); ++i) {
+        top_data[p].push_back(static_cast<uint16>(y[i]));
+      }
+      // The output doubles as the gradient of the loss
+      caffe_copy(top->count(), y, top->mutable_cpu_cpfp_diff());
+      layers[p]->Backward(this->blob_top_vec_ip, propagate_down,
+          this->blob_bottom_vec_ip);
+      const cpfp* dx = bottom->cpu_cpfp_diff();
+      for (int i = 0; i < bottom->count(); ++i) {
+        bottom_diff[p].push_back(static_cast<uint16>(dx[i]));
+      }
+      const Blob<Dtype>* weights = layers[p]->blobs()[0].get();
+      weight_diff[p].assign(weights->cpu_diff(),
+          weights->cpu_diff() + weights->count());
+    }
+    NativeKernelRunner::set_num_threads(0);
+    EXPECT_TRUE(top_data[0] == top_data[1]) << num_outputs[c];
+    EXPECT_TRUE(bottom_diff[0] == bottom_diff[1]);
+    EXPECT_TRUE(weight_diff[0] == weight_diff[1]);
+  }
+}
+
+TYPED_TEST(OCLHWCNInnerProductNativeTest, TestForwardBackwardBatch5) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(32);
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  this->blob_bottom_->Reshape(5, 64, 1, 1);
+  this->FillTernary(this->blob_bottom_, 0.25);
+  this->ConvertBottom(layer_param);
+  OCLHWCNInnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_ip, this->blob_top_vec_ip);
+  this->CheckInnerProduct(&layer, inner_product_param);
+}
+
+TYPED_TEST(OCLHWCNInnerProductNativeTest, TestScaledBatch5) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(64);
+  XCLParameter* xcl_param = layer_param.mutable_xcl_param();
+  xcl_param->set_xcl_name("crp_layer_hwcn_cpfp.xclbin");
+  xcl_param->set_kernel_name("crp_layer_hwcn_cpfp");
+  layer_param.mutable_cr_param()->set_cpfp_scale(true);
+  layer_param.mutable_cr_param()->set_cpfp_scale_period(2);
+  // Values far outside the cpfp range, which only survive at the exponents
+  // of the blobs. The forward pass takes two input bursts, so the outputs
+  // are shifted on the last one only.
+  const Dtype scales[] = {Dtype(1 << 20), Dtype(1) / (1 << 20)};
+  for (int s = 0; s < 2; ++s) {
+    this->blob_bottom_->Reshape(5, 4096, 1, 1);
+    this->FillTernary(this->blob_bottom_, 0.25);
+    caffe_scal(this->blob_bottom_->count(), scales[s],
+        this->blob_bottom_->mutable_cpu_data());
+    this->ConvertBottom(layer_param, true);
+    OCLHWCNInnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_ip, this->blob_top_vec_ip);
+    vector<kernel_params> calls;
+    layer.OCLKernelCalls(&calls);
+    EXPECT_GT(calls[0].rpo, 1);
+    // The first pass keeps the exponents of the sums and samples the output
+    // max, the later ones move the outputs to the exponent of the running
+    // max, which the third pass samples again.
+    const Blob<Dtype>* bottom = this->blob_top_cpfp_out;
+    const Blob<Dtype>* top = this->blob_top_ip_out;
+    const int sum_exp = bottom->cpfp_data_exp() + cpfp_scale_exp(1);
+    const int diff_sum_exp = cpfp_scale_exp(scales[s]) + cpfp_scale_exp(1);
+    for (int pass = 0; pass < 3; ++pass) {
+      this->CheckInnerProduct(&layer, inner_product_param, scales[s]);
+      if (pass == 0) {
+        EXPECT_EQ(sum_exp, top->cpfp_data_exp());
+        EXPECT_EQ(diff_sum_exp, bottom->cpfp_diff_exp());
+      } else {
+        EXPECT_NE(sum_exp, top->cpfp_data_exp());
+        EXPECT_NE(diff_sum_exp, bottom->cpfp_diff_exp());
+      }
+    }
+  }
+}
+
+#endif  // USE_OCL_NATIVE
+
 #endif  // USE_OCL
 
 }  // namespace caffe
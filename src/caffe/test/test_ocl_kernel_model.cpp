@@ -0,0 +1,121 @@
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "caffe/ocl_kernel_model.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class OCLKernelModelTest : public ::testing::Test {
+ protected:
+  OCLKernelModelTest() {
+    memset(&params_, 0, sizeof(params_));
+    params_.inchannels = 64;
+    params_.outchannels = 64;
+    params_.burstchannels = 64;
+    params_.rpo = 1;
+    params_.rpofm = 4;
+    params_.burstydim = 16;
+    params_.numimages = 64;
+    params_.ksize = 3;
+    params_.ydim = 14;
+    params_.xdim = 14;
+    params_.stride = 1;
+    params_.pad = 1;
+    params_.numgroups = 1;
+  }
+
+  kernel_params params_;
+};
+
+TEST_F(OCLKernelModelTest, TestConfig) {
+  OCLKernelConfig config = OCLKernelModel::Config("crp_layer_hwcn_cpfp");
+  EXPECT_EQ(4, config.num_pe);
+  EXPECT_EQ(1, config.ocfact);
+  EXPECT_FALSE(config.winograd);
+  EXPECT_FALSE(config.forward_only);
+  config = OCLKernelModel::Config("crp_layer_hwcn_cpfp_8pegrp");
+  EXPECT_EQ(8, config.num_pe);
+  config = OCLKernelModel::Config("crp_layer_hwcn_cpfp_2mult");
+  EXPECT_EQ(2, config.ocfact);
+  EXPECT_EQ(128, OCLKernelModel::PeakMACsPerCycle(config));
+  config = OCLKernelModel::Config("wcrp_layer_hwcn_cpfp_fw");
+  EXPECT_TRUE(config.winograd);
+  EXPECT_TRUE(config.forward_only);
+}
+
+TEST_F(OCLKernelModelTest, TestPointwiseTraffic) {
+  params_.ksize = 1;
+  params_.pad = 0;
+  OCLKernelConfig config = OCLKernelModel::Config("crp_layer_hwcn_cpfp");
+  OCLKernelEstimate est = OCLKernelModel::Estimate(params_, config);
+  const double in_bytes = 14 * 14 * 64 * 64 * 2;
+  const double out_bytes = 14 * 14 * 64 * 64 * 2;
+  EXPECT_EQ(64.0 * 64 * 64 * 14 * 14, est.macs);
+  // Every output channel pass reads the input once, outputs are written once
+  EXPECT_EQ(4 * in_bytes, est.gmem_bytes[GMEM_INPUT]);
+  EXPECT_EQ(out_bytes, est.gmem_bytes[GMEM_OUTPUT]);
+  EXPECT_EQ(64 * 64 * 2, est.gmem_bytes[GMEM_WEIGHTS]);
+  EXPECT_EQ(64 * 2, est.gmem_bytes[GMEM_BIAS]);
+  // A second input channel pass reads the partial sums back
+  params_.burstchannels = 32;
+  params_.rpo = 2;
+  est = OCLKernelModel::Estimate(params_, config);
+  EXPECT_EQ(4 * in_bytes, est.gmem_bytes[GMEM_INPUT]);
+  EXPECT_EQ(3 * out_bytes, est.gmem_bytes[GMEM_OUTPUT]);
+}
+
+TEST_F(OCLKernelModelTest, TestScaling) {
+  OCLKernelConfig config = OCLKernelModel::Config("crp_layer_hwcn_cpfp");
+  OCLKernelEstimate base = OCLKernelModel::Estimate(params_, config);
+  EXPECT_FALSE(base.memory_bound());
+  EXPECT_LE(base.macs, base.mac_cycles *
+      OCLKernelModel::PeakMACsPerCycle(config));
+  // Twice the PEs halve the MAC loop but not the traffic
+  config = OCLKernelModel::Config("crp_layer_hwcn_cpfp_8pegrp");
+  OCLKernelEstimate wide = OCLKernelModel::Estimate(params_, config);
+  EXPECT_LT(wide.mac_cycles, 0.6 * base.mac_cycles);
+  EXPECT_EQ(base.ddr_bytes(), wide.ddr_bytes());
+  // Winograd needs fewer MAC loop iterations for a 3x3 filter
+  config = OCLKernelModel::Config("wcrp_layer_hwcn_cpfp_fw");
+  OCLKernelEstimate winograd = OCLKernelModel::Estimate(params_, config);
+  EXPECT_LT(winograd.mac_cycles, base.mac_cycles);
+  EXPECT_EQ(base.macs, winograd.macs);
+  // Groups run back to back
+  config = OCLKernelModel::Config("crp_layer_hwcn_cpfp");
+  params_.numgroups = 2;
+  OCLKernelEstimate grouped = OCLKernelModel::Estimate(params_, config);
+  EXPECT_EQ(2 * base.cycles(), grouped.cycles());
+}
+
+TEST_F(OCLKernelModelTest, TestFullyConnected) {
+  params_.inchannels = 4096;
+  params_.burstchannels = 1024;
+  params_.rpo = 4;
+  params_.outchannels = 4096;
+  params_.rpofm = 256;
+  params_.numimages = 16;
+  params_.ksize = 1;
+  params_.ydim = 1;
+  params_.xdim = 1;
+  params_.pad = 0;
+  OCLKernelConfig config = OCLKernelModel::Config("crp_layer_hwcn_cpfp");
+  OCLKernelEstimate est = OCLKernelModel::Estimate(params_, config);
+  // Weights are read once, the input once per output channel pass
+  EXPECT_EQ(4096.0 * 4096 * 2, est.gmem_bytes[GMEM_WEIGHTS]);
+  EXPECT_EQ(256.0 * 4096 * 16 * 2, est.gmem_bytes[GMEM_INPUT]);
+}
+
+TEST_F(OCLKernelModelTest, TestShortBurstsAreMemoryBound) {
+  params_.inchannels = 4;
+  params_.burstchannels = 4;
+  params_.numimages = 16;
+  params_.ksize = 1;
+  params_.pad = 0;
+  OCLKernelConfig config = OCLKernelModel::Config("crp_layer_hwcn_cpfp");
+  EXPECT_TRUE(OCLKernelModel::Estimate(params_, config).memory_bound());
+}
+
+}  // namespace caffe
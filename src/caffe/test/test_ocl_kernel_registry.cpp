@@ -0,0 +1,124 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/ocl_kernel_registry.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+#ifdef USE_OCL
+namespace {
+
+void SelectKernel(const std::string& kernel_name) {
+  XCLParameter param;
+  param.set_kernel_name(kernel_name);
+  OCLKernelRegistry::Select(param);
+}
+
+void ReadSelected(std::string* kernel_name) {
+  *kernel_name = OCLKernelRegistry::Selected().kernel_name();
+}
+
+}  // namespace
+
+TEST(OCLKernelRegistrySelectTest, TestSelectIsPerThread) {
+  SelectKernel("main_kernel");
+  std::string other = "unset";
+  boost::thread reader(boost::bind(&ReadSelected, &other));
+  reader.join();
+  EXPECT_EQ("", other);
+  // Selections of finished threads are dropped with them and never show up
+  // in a later thread, even one reusing the id.
+  for (int i = 0; i < 16; ++i) {
+    boost::thread selector(boost::bind(&SelectKernel, "thread_kernel"));
+    selector.join();
+    boost::thread later(boost::bind(&ReadSelected, &other));
+    later.join();
+    EXPECT_EQ("", other);
+  }
+  EXPECT_EQ("main_kernel", OCLKernelRegistry::Selected().kernel_name());
+  OCLKernelRegistry::Select(XCLParameter());
+}
+
+// The same xclbin named once relative to xclbin_dir and once by its path
+// is two xclbins for the registry, so these tests need only one binary.
+class OCLKernelRegistryTest : public ::testing::Test {
+ protected:
+  OCLKernelRegistryTest()
+      : xcl_a_("crp_layer_hwcn_cpfp.xclbin"),
+        xcl_b_(OCLKernelRegistry::xclbin_dir() + xcl_a_),
+        kernel_("crp_layer_hwcn_cpfp") {}
+
+  virtual void SetUp() {
+    OCLKernelRegistry::Clear();
+  }
+
+  virtual void TearDown() {
+    OCLKernelRegistry::Clear();
+    OCLKernelRegistry::set_max_programs(1);
+  }
+
+  const std::string xcl_a_;
+  const std::string xcl_b_;
+  const std::string kernel_;
+};
+
+TEST_F(OCLKernelRegistryTest, TestKernelsAreShared) {
+  cl_kernel kernel = OCLKernelRegistry::GetKernel(xcl_a_, kernel_);
+  EXPECT_EQ(kernel, OCLKernelRegistry::GetKernel(xcl_a_, kernel_));
+  std::vector<cl_kernel> kernels =
+      OCLKernelRegistry::GetKernels(xcl_a_, kernel_, 2);
+  ASSERT_EQ(2, kernels.size());
+  EXPECT_EQ(kernel, kernels[0]);
+  EXPECT_NE(kernels[0], kernels[1]);
+  EXPECT_EQ(kernels[1], OCLKernelRegistry::GetKernels(xcl_a_, kernel_, 2)[1]);
+  std::vector<std::string> resident = OCLKernelRegistry::Resident();
+  ASSERT_EQ(1, resident.size());
+  EXPECT_EQ(xcl_a_, resident[0]);
+}
+
+TEST_F(OCLKernelRegistryTest, TestSwitchReprograms) {
+  OCLKernelRegistry::GetKernel(xcl_a_, kernel_);
+  OCLKernelRegistry::GetKernel(xcl_b_, kernel_);
+  std::vector<std::string> resident = OCLKernelRegistry::Resident();
+  ASSERT_EQ(1, resident.size());
+  EXPECT_EQ(xcl_b_, resident[0]);
+  OCLKernelRegistry::GetKernel(xcl_a_, kernel_);
+  resident = OCLKernelRegistry::Resident();
+  ASSERT_EQ(1, resident.size());
+  EXPECT_EQ(xcl_a_, resident[0]);
+}
+
+TEST_F(OCLKernelRegistryTest, TestSwitchKeepsResidentPrograms) {
+  OCLKernelRegistry::set_max_programs(2);
+  cl_kernel kernel_a = OCLKernelRegistry::GetKernel(xcl_a_, kernel_);
+  cl_kernel kernel_b = OCLKernelRegistry::GetKernel(xcl_b_, kernel_);
+  // Both programs stay loaded, switching back returns the same kernels
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(kernel_a, OCLKernelRegistry::GetKernel(xcl_a_, kernel_));
+    EXPECT_EQ(kernel_b, OCLKernelRegistry::GetKernel(xcl_b_, kernel_));
+  }
+  std::vector<std::string> resident = OCLKernelRegistry::Resident();
+  ASSERT_EQ(2, resident.size());
+  EXPECT_EQ(xcl_b_, resident[0]);
+  EXPECT_EQ(xcl_a_, resident[1]);
+  // A third xclbin evicts the least recently used one
+  OCLKernelRegistry::GetKernel(xcl_a_, kernel_);
+  std::string xcl_c = OCLKernelRegistry::xclbin_dir() + "./" + xcl_a_;
+  OCLKernelRegistry::GetKernel(xcl_c, kernel_);
+  resident = OCLKernelRegistry::Resident();
+  ASSERT_EQ(2, resident.size());
+  EXPECT_EQ(xcl_c, resident[0]);
+  EXPECT_EQ(xcl_a_, resident[1]);
+  EXPECT_EQ(kernel_a, OCLKernelRegistry::GetKernel(xcl_a_, kernel_));
+}
+#endif  // USE_OCL
+
+}  // namespace caffe
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/ocl_tiling_tuner.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class OCLTilingTunerTest : public ::testing::Test {
+ protected:
+  OCLTilingTunerTest() {
+    memset(&params_, 0, sizeof(params_));
+    params_.inchannels = 96;
+    params_.outchannels = 100;
+    params_.numimages = 64;
+    params_.ksize = 3;
+    params_.ydim = 13;
+    params_.xdim = 13;
+    params_.stride = 1;
+    params_.pad = 1;
+    params_.numgroups = 1;
+    limits_.num_pe = 4;
+    limits_.num_cu = 1;
+    limits_.burstoc_limit = 16 * 256 / params_.numimages;
+    limits_.min_burstchannels = 4;
+  }
+
+  kernel_params params_;
+  OCLTilingLimits limits_;
+};
+
+TEST_F(OCLTilingTunerTest, TestCandidatesFit) {
+  std::vector<OCLTiling> tilings =
+    OCLTilingTuner::Candidates(params_, limits_);
+  ASSERT_GT(tilings.size(), 0);
+  for (int i = 0; i < tilings.size(); ++i) {
+    const OCLTiling& t = tilings[i];
+    EXPECT_TRUE(OCLTilingTuner::Fits(params_, limits_, t));
+    EXPECT_EQ(params_.inchannels, t.burstchannels * t.rpo);
+    EXPECT_LE(t.burstchannels, 2048);
+    EXPECT_LE(t.burstoc, limits_.burstoc_limit);
+    EXPECT_GE(t.rpofm * t.burstoc, params_.outchannels);
+    // No output channel pass is left empty
+    EXPECT_LT((t.rpofm - 1) * t.burstoc, params_.outchannels);
+  }
+  // Too large for the weight buffer, and not a divisor of the channels
+  OCLTiling too_wide = {96, 1, 2, 50};
+  EXPECT_FALSE(OCLTilingTuner::Fits(params_, limits_, too_wide));
+  OCLTiling uneven = {40, 2, 7, 15};
+  EXPECT_FALSE(OCLTilingTuner::Fits(params_, limits_, uneven));
+}
+
+TEST_F(OCLTilingTunerTest, TestTuneAvoidsPadding) {
+  OCLTiling tiling = OCLTilingTuner::Tune("test_kernel", params_, limits_);
+  EXPECT_TRUE(OCLTilingTuner::Fits(params_, limits_, tiling));
+  // The greedy fill of 64 channel bursts would compute 128 outputs for 100
+  OCLTiling greedy = {96, 1, 2, 64};
+  limits_.burstoc_limit = 64;
+  params_.numimages = 16;
+  params_.ksize = 1;
+  params_.pad = 0;
+  tiling = OCLTilingTuner::Tune("test_kernel", params_, limits_);
+  EXPECT_TRUE(OCLTilingTuner::Fits(params_, limits_, greedy));
+  EXPECT_LT(OCLTilingTuner::Cost(params_, limits_, tiling),
+      OCLTilingTuner::Cost(params_, limits_, greedy));
+  EXPECT_LT(tiling.rpofm * tiling.burstoc, 128);
+}
+
+TEST_F(OCLTilingTunerTest, TestCacheFile) {
+  std::string cache;
+  MakeTempFilename(&cache);
+  OCLTilingTuner::set_cache_file(cache);
+  OCLTiling tiling = OCLTilingTuner::Tune("cached_kernel", params_, limits_);
+  // A stored tiling that fits is reused even if it is not the cheapest
+  OCLTiling stored = {48, 2, 25, 4};
+  ASSERT_TRUE(OCLTilingTuner::Fits(params_, limits_, stored));
+  FILE* file = fopen(cache.c_str(), "a");
+  fprintf(file, "cached_kernel 96 100 64 3 13 13 1 1 1 4 1 64 4 48 2 25 4\n");
+  fclose(file);
+  OCLTilingTuner::set_cache_file(cache);
+  tiling = OCLTilingTuner::Tune("cached_kernel", params_, limits_);
+  EXPECT_EQ(stored.burstchannels, tiling.burstchannels);
+  EXPECT_EQ(stored.rpo, tiling.rpo);
+  EXPECT_EQ(stored.rpofm, tiling.rpofm);
+  EXPECT_EQ(stored.burstoc, tiling.burstoc);
+  OCLTilingTuner::set_cache_file("");
+  remove(cache.c_str());
+}
+
+}  // namespace caffe
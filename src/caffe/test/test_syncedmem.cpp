@@ -22,6 +22,20 @@ TEST_F(SyncedMemoryTest, TestInitialization) {
   delete p_mem;
 }
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  SyncedMemory other(10);
+  EXPECT_NE(mem.version(), other.version());
+  uint64_t version = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(version, mem.version());
+  mem.mutable_cpu_data();
+  EXPECT_NE(version, mem.version());
+  version = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(version, mem.version());
+}
+
 #ifdef USE_OCL
 
 TEST_F(SyncedMemoryTest, TestAllocationCPUOCL) {
@@ -102,6 +116,102 @@ TEST_F(SyncedMemoryTest, TestOCLWrite) {
   delete pattern;
 }
 
+TEST_F(SyncedMemoryTest, TestOCLNativeAliasesHost) {
+  Caffe::Brew mode = Caffe::mode();
+  Caffe::set_mode(Caffe::OCL_NATIVE);
+  SyncedMemory mem(10);
+  void* cpu_data = mem.mutable_cpu_data();
+  caffe_memset(mem.size(), 1, cpu_data);
+  const void* ocl_data = mem.ocl_data();
+  EXPECT_EQ(ocl_data, cpu_data);
+  EXPECT_EQ(mem.head(), SyncedMemory::SYNCED);
+  // A native kernel writes through the same pointer.
+  caffe_memset(mem.size(), 2, mem.mutable_ocl_data());
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_OCL);
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ((static_cast<const char*>(mem.cpu_data()))[i], 2);
+  }
+  EXPECT_EQ(mem.head(), SyncedMemory::SYNCED);
+  Caffe::set_mode(mode);
+}
+
+TEST_F(SyncedMemoryTest, TestOCLNativeModeSwitch) {
+  Caffe::Brew mode = Caffe::mode();
+  Caffe::set_mode(Caffe::OCL);
+  char data[10];
+  SyncedMemory mem(10);
+  mem.set_cpu_data(data);
+  EXPECT_NE(static_cast<const void*>(data), mem.ocl_data());
+  // The buffer of Caffe::OCL mode gives way to the host alias and back
+  caffe_memset(mem.size(), 1, mem.mutable_cpu_data());
+  Caffe::set_mode(Caffe::OCL_NATIVE);
+  EXPECT_EQ(static_cast<const void*>(data), mem.ocl_data());
+  caffe_memset(mem.size(), 2, mem.mutable_cpu_data());
+  Caffe::set_mode(Caffe::OCL);
+  const void* ocl_data = mem.ocl_data();
+  EXPECT_NE(static_cast<const void*>(data), ocl_data);
+  char pattern[10];
+  clEnqueueReadBuffer(oclCommandQueue, (cl_mem)ocl_data, CL_TRUE, 0, 10,
+      pattern, 0, NULL, NULL);
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(2, pattern[i]);
+  }
+  Caffe::set_mode(mode);
+}
+
+TEST_F(SyncedMemoryTest, TestOCLPoolReuse) {
+  Caffe::Brew mode = Caffe::mode();
+  Caffe::set_mode(Caffe::OCL);
+  OCLMemoryPool::Clear();
+  const void* cpu_data;
+  const void* ocl_data;
+  {
+    SyncedMemory mem(5000);
+    ocl_data = mem.ocl_data();
+    cpu_data = mem.cpu_data();
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(cpu_data) %
+        OCLMemoryPool::kAlignment);
+  }
+  OCLMemoryPool::Stats stats = OCLMemoryPool::GetStats();
+  EXPECT_EQ(0, stats.bytes_in_use);
+  EXPECT_GE(stats.bytes_cached, 5000);
+  // A blob of a size in the same class gets the block and its buffer back
+  SyncedMemory mem(5100);
+  EXPECT_EQ(ocl_data, mem.mutable_ocl_data());
+  EXPECT_EQ(cpu_data, mem.cpu_data());
+  EXPECT_EQ(stats.hits + 1, OCLMemoryPool::GetStats().hits);
+  EXPECT_EQ(stats.misses, OCLMemoryPool::GetStats().misses);
+  Caffe::set_mode(mode);
+}
+
+TEST_F(SyncedMemoryTest, TestAsyncOCLPush) {
+  Caffe::Brew mode = Caffe::mode();
+  Caffe::set_mode(Caffe::OCL);
+  // A queue of its own, as the prefetch thread of the data layers uses
+  cl_int error;
+  cl_command_queue queue = clCreateCommandQueue(oclContext, oclDevices, 0,
+      &error);
+  ASSERT_EQ(CL_SUCCESS, error);
+  SyncedMemory mem(10);
+  caffe_memset(mem.size(), 3, mem.mutable_cpu_data());
+  mem.async_ocl_push(queue, 0);
+  EXPECT_EQ(mem.head(), SyncedMemory::SYNCED);
+  // Readers on the main queue wait for the push through the event of the
+  // buffer
+  const void* ocl_data = mem.ocl_data();
+  vector<cl_event> wait_list;
+  SyncedMemory::AppendOCLWaitList(ocl_data, &wait_list);
+  ASSERT_EQ(1, wait_list.size());
+  char recovered_value[10];
+  clEnqueueReadBuffer(oclCommandQueue, (cl_mem)ocl_data, CL_TRUE, 0, 10,
+      recovered_value, wait_list.size(), wait_list.data(), NULL);
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(3, recovered_value[i]);
+  }
+  clReleaseCommandQueue(queue);
+  Caffe::set_mode(mode);
+}
+
 #endif
 
 #ifndef CPU_ONLY  // GPU test
@@ -0,0 +1,676 @@
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/cpfp_math.hpp"
+
+#if MANT_SIZE > 8
+#error "The cpfp_math add table packs its entries for MANT_SIZE <= 8."
+#endif
+
+namespace caffe {
+
+namespace {
+
+// Multiplier of the SYNTHESIS branch of cpfp.hpp, written with plain
+// integers. The (M + 1) x (M + 1) product is normalized by at most one bit,
+// truncated (or rounded to nearest when ROUND_NEAREST_MULT is set),
+// saturated to the largest finite value on overflow and flushed to zero on
+// underflow or when either input is zero. The sign is kept in all cases.
+inline uint32 MulBits(uint32 a, uint32 b) {
+  uint32 e1 = (a >> EXP_SHIFT) & MAX_EXP;
+  uint32 e2 = (b >> EXP_SHIFT) & MAX_EXP;
+  uint32 mant1 = (a & MANT_MASK) | MANT_NORM;
+  uint32 mant2 = (b & MANT_MASK) | MANT_NORM;
+  uint32 sign = (a ^ b) & SIGN_MASK;
+  uint32 product = mant1 * mant2;
+  uint32 mantres = product >> MANT_SIZE;
+  int eres = static_cast<int>(e1 + e2) - EXP_OFFSET;
+#if ROUND_NEAREST_MULT == 1
+  uint32 last = (product >> MANT_SIZE) & 0x1;
+  uint32 guard = (product >> (MANT_SIZE - 1)) & 0x1;
+  uint32 sticky = (product & (MAX_MANT >> 1)) > 0;
+#endif
+  if ((mantres >> (MANT_SIZE + 1)) & 0x1) {
+#if ROUND_NEAREST_MULT == 1
+    last = (product >> (MANT_SIZE + 1)) & 0x1;
+    sticky |= guard;
+    guard = (product >> MANT_SIZE) & 0x1;
+#endif
+    mantres = product >> (MANT_SIZE + 1);
+    eres++;
+  }
+#if ROUND_NEAREST_MULT == 1
+  if (guard & (sticky | last)) {
+    if (mantres == (MAX_MANT | MANT_NORM))
+      eres++;
+    mantres++;
+  }
+#endif
+  uint32 eresf = eres & MAX_EXP;
+  uint32 mantresf = mantres & MANT_MASK;
+  if (eres >= MAX_EXP) {
+    eresf = MAX_EXP - 1;
+    mantresf = MAX_MANT;
+  } else if ((e1 == 0) || (e2 == 0) || (eres <= 0)) {
+    eresf = 0;
+    mantresf = 0;
+  }
+  return sign | (eresf << EXP_SHIFT) | mantresf;
+}
+
+// The adder only looks at the operands' exponents through the exponent
+// difference (saturated at MANT_SIZE + 4) and whether each of them is zero;
+// the larger exponent is just offset at the end. Everything in between is
+// precomputed per (EOP, saturated difference, zero flags, mantissas) and
+// packed into 16 bits:
+//   [0, MANT_SIZE)              result mantissa
+//   [MANT_SIZE, MANT_SIZE + 5)  exponent adjustment + 16
+//   MANT_SIZE + 5               far path taken
+//   MANT_SIZE + 6               close path result takes the smaller operand's
+//                               sign
+//   MANT_SIZE + 7               close path cancelled to zero
+const int kDiffSlots = MANT_SIZE + 5;
+const int kDeltaShift = MANT_SIZE;
+const int kDeltaBias = 16;
+const int kFarPathBit = MANT_SIZE + 5;
+const int kSign2Bit = MANT_SIZE + 6;
+const int kZeroBit = MANT_SIZE + 7;
+
+inline int AddTableIndex(uint32 eop, uint32 dsat, uint32 z1, uint32 z2,
+    uint32 mant1, uint32 mant2) {
+  int hi = ((eop * kDiffSlots + dsat) * 2 + z1) * 2 + z2;
+  return (((hi << MANT_SIZE) | mant1) << MANT_SIZE) | mant2;
+}
+
+// Leading zero count over MANT_SIZE + 2 bits, the value the leading one
+// detectors in cpfp.hpp produce.
+inline uint32 LeadingZeros(uint32 sum, uint32 *zero_flag) {
+  *zero_flag = (sum == 0);
+  uint32 count = 0;
+  for (int i = MANT_SIZE + 1; i > 0 && !((sum >> i) & 0x1); --i)
+    count++;
+  return (sum == 0) ? 0 : count;
+}
+
+// One entry of the add table: the body of the SYNTHESIS operator+ up to the
+// final exponent selection, with the widths of its ap_uint intermediates.
+uint16 AddTableEntry(uint32 eop, uint32 dsat, uint32 z1, uint32 z2,
+    uint32 mant1_s, uint32 mant2_s) {
+  uint32 fpath_flag = (dsat > 1) || eop;
+  uint32 mant1_large = z1 ? 0 : (mant1_s | MANT_NORM);
+  uint32 mant2_large = z2 ? 0 : (mant2_s | MANT_NORM);
+
+  // Close path
+  uint32 mant1_cpath = (mant1_large << 1) & ((1 << (MANT_SIZE + 2)) - 1);
+  uint32 mant2_cpath = ((dsat == 1) ? mant2_large : mant2_large << 1) &
+    ((1 << (MANT_SIZE + 2)) - 1);
+  int sum_cpath_t = static_cast<int>(mant1_cpath) -
+    static_cast<int>(mant2_cpath);
+  uint32 sign2 = 0;
+  uint32 sum_cpath = sum_cpath_t;
+  if (sum_cpath_t < 0) {
+    sum_cpath = -sum_cpath_t;
+    sign2 = 1;
+  }
+  uint32 zero_flag;
+  uint32 Lshifter = LeadingZeros(sum_cpath, &zero_flag);
+  uint32 sum_cpath_f = (((sum_cpath << Lshifter) &
+    ((1 << (MANT_SIZE + 2)) - 1)) >> 1) & MANT_MASK;
+
+  // Far path
+  uint32 mant2_a = mant2_large << ((MANT_SIZE + 4) - dsat);
+#if ROUND_NEAREST_ADD == 1
+  uint32 sticky = (mant2_a & ((1 << (MANT_SIZE + 1)) - 1)) > 0;
+#else
+  uint32 sticky = 0;
+#endif
+  uint32 mant1_fpath = mant1_large << 3;
+  uint32 mant2_fpath = (mant2_a >> (MANT_SIZE + 1)) | sticky;
+  uint32 sum_fpath = (eop ? mant1_fpath + mant2_fpath :
+    mant1_fpath - mant2_fpath) & ((1 << (MANT_SIZE + 5)) - 1);
+  uint32 sum_t = (sum_fpath >> 3) & ((1 << (MANT_SIZE + 2)) - 1);
+  uint32 guard = (sum_fpath >> 2) & 0x1;
+  uint32 round = (sum_fpath >> 1) & 0x1;
+  sticky = sum_fpath & 0x1;
+  int Rshifter = 0;
+  if ((sum_t >> (MANT_SIZE + 1)) & 0x1) {
+    Rshifter = 1;
+    sticky |= round;
+    round = guard;
+    guard = sum_t & 0x1;
+    sum_t = (sum_fpath >> 4) & ((1 << (MANT_SIZE + 2)) - 1);
+  } else if (((sum_t >> MANT_SIZE) & 0x1) == 0) {
+    Rshifter = -1;
+    guard = round;
+    round = 0;
+    sum_t = (sum_fpath >> 2) & ((1 << (MANT_SIZE + 2)) - 1);
+  }
+  uint32 last = sum_t & 0x1;
+  int rnd_ovfl = 0;
+#if ROUND_NEAREST_ADD == 1
+  if (guard & (last | round | sticky)) {
+    if (sum_t == (MAX_MANT | MANT_NORM))
+      rnd_ovfl = 1;
+    sum_t++;
+  }
+#endif
+  uint32 sum_fpath_f = sum_t & MANT_MASK;
+
+  uint32 mant = fpath_flag ? sum_fpath_f : sum_cpath_f;
+  int delta = fpath_flag ? Rshifter + rnd_ovfl : -static_cast<int>(Lshifter);
+  return mant | ((delta + kDeltaBias) << kDeltaShift) |
+    (fpath_flag << kFarPathBit) | ((!fpath_flag && sign2) << kSign2Bit) |
+    ((!fpath_flag && zero_flag) << kZeroBit);
+}
+
+class AddTableHolder {
+ public:
+  AddTableHolder() : entries_(2 * kDiffSlots * 4 << (2 * MANT_SIZE)) {
+    for (uint32 eop = 0; eop < 2; ++eop)
+      for (uint32 dsat = 0; dsat < kDiffSlots; ++dsat)
+        for (uint32 z1 = 0; z1 < 2; ++z1)
+          for (uint32 z2 = 0; z2 < 2; ++z2)
+            for (uint32 m1 = 0; m1 <= MAX_MANT; ++m1)
+              for (uint32 m2 = 0; m2 <= MAX_MANT; ++m2)
+                entries_[AddTableIndex(eop, dsat, z1, z2, m1, m2)] =
+                  AddTableEntry(eop, dsat, z1, z2, m1, m2);
+  }
+  const uint16* data() const { return &entries_[0]; }
+
+ private:
+  std::vector<uint16> entries_;
+};
+
+const uint16* AddTable() {
+  static AddTableHolder table;
+  return table.data();
+}
+
+inline uint32 AddBits(const uint16* table, uint32 a, uint32 b) {
+  uint32 e1 = (a >> EXP_SHIFT) & MAX_EXP;
+  uint32 e2 = (b >> EXP_SHIFT) & MAX_EXP;
+  uint32 sign1 = (a >> SIGN_SHIFT) & 0x1;
+  uint32 sign2 = (b >> SIGN_SHIFT) & 0x1;
+  // Order the operands by exponent, the first one wins ties
+  bool exp_cmp = (e1 >= e2);
+  uint32 e1_s = exp_cmp ? e1 : e2;
+  uint32 e2_s = exp_cmp ? e2 : e1;
+  uint32 mant1_s = (exp_cmp ? a : b) & MANT_MASK;
+  uint32 mant2_s = (exp_cmp ? b : a) & MANT_MASK;
+  uint32 sign1_s = exp_cmp ? sign1 : sign2;
+  uint32 sign2_s = exp_cmp ? sign2 : sign1;
+  uint32 diff = e1_s - e2_s;
+  uint32 dsat = (diff > MANT_SIZE + 4) ? MANT_SIZE + 4 : diff;
+
+  uint32 entry = table[AddTableIndex(sign1 == sign2, dsat, e1_s == 0,
+      e2_s == 0, mant1_s, mant2_s)];
+  uint32 mant = entry & MANT_MASK;
+  int eres = static_cast<int>(e1_s) +
+    static_cast<int>((entry >> kDeltaShift) & 0x1F) - kDeltaBias;
+  uint32 sign = sign1_s;
+  uint32 eresf = eres & MAX_EXP;
+  if ((entry >> kFarPathBit) & 0x1) {
+    if (eres >= MAX_EXP) {
+      eresf = MAX_EXP - 1;
+      mant = MAX_MANT;
+    } else if (eres <= 0) {
+      eresf = 0;
+      mant = 0;
+    }
+  } else {
+    if ((entry >> kSign2Bit) & 0x1)
+      sign = sign2_s;
+    if ((eres < 1) || ((entry >> kZeroBit) & 0x1)) {
+      eresf = 0;
+      mant = 0;
+    }
+  }
+  return (sign << SIGN_SHIFT) | (eresf << EXP_SHIFT) | mant;
+}
+
+inline uint32 bits(const cpfp& value) {
+  return static_cast<uint16>(value);
+}
+
+// Bits of the float mantissa below the round bit, which float2cpfp folds
+// into its sticky bit.
+const uint32 kStickyMask = 0x7FFFFF & ~(MAX_MANT << (23 - MANT_SIZE)) &
+  ~(MAX_MANT << (21 - MANT_SIZE));
+
+// Values converted per pass when going through a float buffer for Dtype =
+// double.
+const int kConvertChunk = 256;
+
+// Vector forms of float2cpfp and cpfp2float on 32-bit lanes. They follow
+// the scalar code in cpfp.hpp step by step, with selects in place of the
+// conditionals.
+#if defined(__AVX2__)
+inline __m256i Float2CPFP(__m256 x) {
+  const __m256i one = _mm256_set1_epi32(1);
+  __m256i bits = _mm256_castps_si256(x);
+  __m256i exp = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(bits, 23),
+      _mm256_set1_epi32(0xFF)), _mm256_set1_epi32(127));
+  __m256i sign = _mm256_and_si256(_mm256_srli_epi32(bits, 31 - SIGN_SHIFT),
+      _mm256_set1_epi32(SIGN_MASK));
+  __m256i mant = _mm256_and_si256(bits, _mm256_set1_epi32(0x7FFFFF));
+  __m256i guard = _mm256_and_si256(_mm256_srli_epi32(mant, 22 - MANT_SIZE),
+      one);
+  __m256i round = _mm256_and_si256(_mm256_srli_epi32(mant, 21 - MANT_SIZE),
+      one);
+  __m256i mant_noround = _mm256_srli_epi32(mant, 23 - MANT_SIZE);
+  __m256i last = _mm256_and_si256(mant_noround, one);
+  __m256i sticky = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(
+      mant, _mm256_set1_epi32(kStickyMask)), _mm256_setzero_si256()), one);
+  __m256i rnd_val = _mm256_and_si256(guard,
+      _mm256_or_si256(_mm256_or_si256(round, sticky), last));
+  __m256i full = _mm256_cmpeq_epi32(mant_noround,
+      _mm256_set1_epi32(MAX_MANT));
+  __m256i small = _mm256_cmpgt_epi32(_mm256_set1_epi32(EXP_OFFSET), exp);
+  __m256i exp_add = _mm256_and_si256(_mm256_and_si256(full, small), rnd_val);
+  __m256i mant_round = _mm256_blendv_epi8(
+      _mm256_add_epi32(mant_noround, rnd_val),
+      _mm256_andnot_si256(_mm256_cmpeq_epi32(exp_add, one), mant_noround),
+      full);
+  __m256i normal = _mm256_or_si256(_mm256_slli_epi32(_mm256_add_epi32(
+      _mm256_add_epi32(exp, _mm256_set1_epi32(EXP_OFFSET)), exp_add),
+      MANT_SIZE), mant_round);
+  __m256i res = _mm256_blendv_epi8(
+      _mm256_set1_epi32(((MAX_EXP - 1) << MANT_SIZE) | MAX_MANT), normal,
+      _mm256_cmpgt_epi32(_mm256_set1_epi32(EXP_OFFSET + 1), exp));
+  res = _mm256_and_si256(res,
+      _mm256_cmpgt_epi32(exp, _mm256_set1_epi32(-EXP_OFFSET)));
+  return _mm256_or_si256(res, sign);
+}
+
+inline __m256 CPFP2Float(__m256i value) {
+  __m256i sign = _mm256_slli_epi32(_mm256_and_si256(value,
+      _mm256_set1_epi32(SIGN_MASK)), 31 - SIGN_SHIFT);
+  __m256i mant = _mm256_and_si256(value, _mm256_set1_epi32(MANT_MASK));
+  __m256i exp = _mm256_and_si256(_mm256_srli_epi32(value, MANT_SIZE),
+      _mm256_set1_epi32(MAX_EXP));
+  __m256i eresf = _mm256_slli_epi32(_mm256_add_epi32(exp,
+      _mm256_set1_epi32(127 - EXP_OFFSET)), 23);
+  __m256i mantf = _mm256_slli_epi32(mant, 23 - MANT_SIZE);
+  __m256i zero = _mm256_cmpeq_epi32(exp, _mm256_setzero_si256());
+  return _mm256_castsi256_ps(_mm256_or_si256(sign,
+      _mm256_andnot_si256(zero, _mm256_or_si256(eresf, mantf))));
+}
+#elif defined(__SSE2__)
+inline __m128i Select(__m128i mask, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+inline __m128i Float2CPFP(__m128 x) {
+  const __m128i one = _mm_set1_epi32(1);
+  __m128i bits = _mm_castps_si128(x);
+  __m128i exp = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23),
+      _mm_set1_epi32(0xFF)), _mm_set1_epi32(127));
+  __m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 31 - SIGN_SHIFT),
+      _mm_set1_epi32(SIGN_MASK));
+  __m128i mant = _mm_and_si128(bits, _mm_set1_epi32(0x7FFFFF));
+  __m128i guard = _mm_and_si128(_mm_srli_epi32(mant, 22 - MANT_SIZE), one);
+  __m128i round = _mm_and_si128(_mm_srli_epi32(mant, 21 - MANT_SIZE), one);
+  __m128i mant_noround = _mm_srli_epi32(mant, 23 - MANT_SIZE);
+  __m128i last = _mm_and_si128(mant_noround, one);
+  __m128i sticky = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(mant,
+      _mm_set1_epi32(kStickyMask)), _mm_setzero_si128()), one);
+  __m128i rnd_val = _mm_and_si128(guard,
+      _mm_or_si128(_mm_or_si128(round, sticky), last));
+  __m128i full = _mm_cmpeq_epi32(mant_noround, _mm_set1_epi32(MAX_MANT));
+  __m128i small = _mm_cmpgt_epi32(_mm_set1_epi32(EXP_OFFSET), exp);
+  __m128i exp_add = _mm_and_si128(_mm_and_si128(full, small), rnd_val);
+  __m128i mant_round = Select(full,
+      _mm_andnot_si128(_mm_cmpeq_epi32(exp_add, one), mant_noround),
+      _mm_add_epi32(mant_noround, rnd_val));
+  __m128i normal = _mm_or_si128(_mm_slli_epi32(_mm_add_epi32(
+      _mm_add_epi32(exp, _mm_set1_epi32(EXP_OFFSET)), exp_add), MANT_SIZE),
+      mant_round);
+  __m128i res = Select(_mm_cmpgt_epi32(_mm_set1_epi32(EXP_OFFSET + 1), exp),
+      normal, _mm_set1_epi32(((MAX_EXP - 1) << MANT_SIZE) | MAX_MANT));
+  res = _mm_and_si128(res, _mm_cmpgt_epi32(exp, _mm_set1_epi32(-EXP_OFFSET)));
+  return _mm_or_si128(res, sign);
+}
+
+inline __m128 CPFP2Float(__m128i value) {
+  __m128i sign = _mm_slli_epi32(_mm_and_si128(value,
+      _mm_set1_epi32(SIGN_MASK)), 31 - SIGN_SHIFT);
+  __m128i mant = _mm_and_si128(value, _mm_set1_epi32(MANT_MASK));
+  __m128i exp = _mm_and_si128(_mm_srli_epi32(value, MANT_SIZE),
+      _mm_set1_epi32(MAX_EXP));
+  __m128i eresf = _mm_slli_epi32(_mm_add_epi32(exp,
+      _mm_set1_epi32(127 - EXP_OFFSET)), 23);
+  __m128i mantf = _mm_slli_epi32(mant, 23 - MANT_SIZE);
+  __m128i zero = _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+  return _mm_castsi128_ps(_mm_or_si128(sign,
+      _mm_andnot_si128(zero, _mm_or_si128(eresf, mantf))));
+}
+#endif
+
+}  // namespace
+
+uint16 cpfp_mul_bits(uint16 a, uint16 b) {
+  return MulBits(a, b);
+}
+
+uint16 cpfp_add_bits(uint16 a, uint16 b) {
+  return AddBits(AddTable(), a, b);
+}
+
+void cpfp_mul(const int N, const cpfp* a, const cpfp* b, cpfp* y) {
+  int i = 0;
+#if defined(__AVX2__) && ROUND_NEAREST_MULT == 0 && PRODUCT_SIZE <= 16
+  // Same steps as MulBits, 16 values at a time
+  const __m256i exp_mask = _mm256_set1_epi16(MAX_EXP);
+  const __m256i mant_mask = _mm256_set1_epi16(MANT_MASK);
+  const __m256i mant_norm = _mm256_set1_epi16(MANT_NORM);
+  const __m256i sign_mask = _mm256_set1_epi16(SIGN_MASK);
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i exp_offset = _mm256_set1_epi16(EXP_OFFSET);
+  const __m256i max_exp_m1 = _mm256_set1_epi16(MAX_EXP - 1);
+  const __m256i saturated = _mm256_set1_epi16(
+      ((MAX_EXP - 1) << EXP_SHIFT) | MAX_MANT);
+  for (; i + 16 <= N; i += 16) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    __m256i e1 = _mm256_and_si256(_mm256_srli_epi16(va, EXP_SHIFT), exp_mask);
+    __m256i e2 = _mm256_and_si256(_mm256_srli_epi16(vb, EXP_SHIFT), exp_mask);
+    __m256i mant1 = _mm256_or_si256(_mm256_and_si256(va, mant_mask),
+        mant_norm);
+    __m256i mant2 = _mm256_or_si256(_mm256_and_si256(vb, mant_mask),
+        mant_norm);
+    __m256i sign = _mm256_and_si256(_mm256_xor_si256(va, vb), sign_mask);
+    __m256i product = _mm256_mullo_epi16(mant1, mant2);
+    __m256i carry = _mm256_and_si256(
+        _mm256_srli_epi16(product, 2 * MANT_SIZE + 1), one);
+    __m256i mant = _mm256_blendv_epi8(_mm256_srli_epi16(product, MANT_SIZE),
+        _mm256_srli_epi16(product, MANT_SIZE + 1),
+        _mm256_cmpeq_epi16(carry, one));
+    mant = _mm256_and_si256(mant, mant_mask);
+    __m256i eres = _mm256_add_epi16(_mm256_sub_epi16(
+        _mm256_add_epi16(e1, e2), exp_offset), carry);
+    __m256i res = _mm256_or_si256(_mm256_slli_epi16(
+        _mm256_and_si256(eres, exp_mask), EXP_SHIFT), mant);
+    __m256i underflow = _mm256_or_si256(_mm256_or_si256(
+        _mm256_cmpeq_epi16(e1, zero), _mm256_cmpeq_epi16(e2, zero)),
+        _mm256_cmpgt_epi16(one, eres));
+    res = _mm256_andnot_si256(underflow, res);
+    res = _mm256_blendv_epi8(res, saturated,
+        _mm256_cmpgt_epi16(eres, max_exp_m1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i),
+        _mm256_or_si256(res, sign));
+  }
+#endif
+  for (; i < N; ++i) {
+    y[i] = cpfp(static_cast<uint16>(MulBits(bits(a[i]), bits(b[i]))));
+  }
+}
+
+void cpfp_add(const int N, const cpfp* a, const cpfp* b, cpfp* y) {
+  const uint16* table = AddTable();
+  for (int i = 0; i < N; ++i) {
+    y[i] = cpfp(static_cast<uint16>(AddBits(table, bits(a[i]),
+        bits(b[i]))));
+  }
+}
+
+void cpfp_sub(const int N, const cpfp* a, const cpfp* b, cpfp* y) {
+  // operator- is operator+ with the sign of the second operand flipped
+  const uint16* table = AddTable();
+  for (int i = 0; i < N; ++i) {
+    y[i] = cpfp(static_cast<uint16>(AddBits(table, bits(a[i]),
+        bits(b[i]) ^ SIGN_MASK)));
+  }
+}
+
+void cpfp_max(const int N, const cpfp* a, const cpfp* b, cpfp* y) {
+  int i = 0;
+#if defined(__AVX2__) && FP_WIDTH < 16
+  // Map each value to a key whose unsigned order is the order of operator<:
+  // negative values have their magnitude bits inverted, positive values get
+  // the sign bit set.
+  const __m256i sign_mask = _mm256_set1_epi16(SIGN_MASK);
+  const __m256i mag_mask = _mm256_set1_epi16(SIGN_MASK - 1);
+  for (; i + 16 <= N; i += 16) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    __m256i neg_a = _mm256_cmpeq_epi16(_mm256_and_si256(va, sign_mask),
+        sign_mask);
+    __m256i neg_b = _mm256_cmpeq_epi16(_mm256_and_si256(vb, sign_mask),
+        sign_mask);
+    __m256i key_a = _mm256_xor_si256(_mm256_xor_si256(va,
+        _mm256_and_si256(neg_a, mag_mask)), sign_mask);
+    __m256i key_b = _mm256_xor_si256(_mm256_xor_si256(vb,
+        _mm256_and_si256(neg_b, mag_mask)), sign_mask);
+    __m256i res = _mm256_blendv_epi8(va, vb,
+        _mm256_cmpgt_epi16(key_b, key_a));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), res);
+  }
+#endif
+  for (; i < N; ++i) {
+    y[i] = max(a[i], b[i]);
+  }
+}
+
+template <>
+void cpfp_from_float<float>(const int N, const float* x, cpfp* y) {
+  int i = 0;
+  // The values are unsigned, packus keeps all 16 bits where packs would
+  // saturate the ones with the top bit set.
+#if FP_WIDTH <= 16
+#if defined(__AVX2__)
+  for (; i + 16 <= N; i += 16) {
+    __m256i lo = Float2CPFP(_mm256_loadu_ps(x + i));
+    __m256i hi = Float2CPFP(_mm256_loadu_ps(x + i + 8));
+    // packus works within 128-bit halves, restore the element order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi),
+        0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), packed);
+  }
+#elif defined(__SSE4_1__)
+  for (; i + 8 <= N; i += 8) {
+    __m128i lo = Float2CPFP(_mm_loadu_ps(x + i));
+    __m128i hi = Float2CPFP(_mm_loadu_ps(x + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+        _mm_packus_epi32(lo, hi));
+  }
+#elif defined(__SSE2__) && FP_WIDTH < 16
+  for (; i + 8 <= N; i += 8) {
+    __m128i lo = Float2CPFP(_mm_loadu_ps(x + i));
+    __m128i hi = Float2CPFP(_mm_loadu_ps(x + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+        _mm_packs_epi32(lo, hi));
+  }
+#endif
+#endif
+  for (; i < N; ++i) {
+    y[i] = cpfp(x[i]);
+  }
+}
+
+template <>
+void cpfp_from_float<double>(const int N, const double* x, cpfp* y) {
+  float buffer[kConvertChunk];
+  for (int i = 0; i < N; i += kConvertChunk) {
+    int count = std::min(kConvertChunk, N - i);
+    for (int j = 0; j < count; ++j) {
+      buffer[j] = static_cast<float>(x[i + j]);
+    }
+    cpfp_from_float(count, buffer, y + i);
+  }
+}
+
+template <>
+void cpfp_to_float<float>(const int N, const cpfp* x, float* y) {
+  int i = 0;
+#if FP_WIDTH <= 16
+#if defined(__AVX2__)
+  for (; i + 8 <= N; i += 8) {
+    __m256i value = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+    _mm256_storeu_ps(y + i, CPFP2Float(value));
+  }
+#elif defined(__SSE2__)
+  for (; i + 8 <= N; i += 8) {
+    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_ps(y + i, CPFP2Float(_mm_unpacklo_epi16(value, zero)));
+    _mm_storeu_ps(y + i + 4, CPFP2Float(_mm_unpackhi_epi16(value, zero)));
+  }
+#endif
+#endif
+  for (; i < N; ++i) {
+    y[i] = float(x[i]);
+  }
+}
+
+template <>
+void cpfp_to_float<double>(const int N, const cpfp* x, double* y) {
+  float buffer[kConvertChunk];
+  for (int i = 0; i < N; i += kConvertChunk) {
+    int count = std::min(kConvertChunk, N - i);
+    cpfp_to_float(count, x + i, buffer);
+    for (int j = 0; j < count; ++j) {
+      y[i + j] = buffer[j];
+    }
+  }
+}
+
+template <typename Dtype>
+void cpfp_from_float(const int N, const Dtype* x, cpfp* y, const int exp) {
+  if (exp == 0) {
+    cpfp_from_float(N, x, y);
+    return;
+  }
+  // Multiplying by a power of two is exact, only the conversion rounds
+  const float scale = std::ldexp(1.0f, -exp);
+  float buffer[kConvertChunk];
+  for (int i = 0; i < N; i += kConvertChunk) {
+    int count = std::min(kConvertChunk, N - i);
+    for (int j = 0; j < count; ++j) {
+      buffer[j] = static_cast<float>(x[i + j]) * scale;
+    }
+    cpfp_from_float(count, buffer, y + i);
+  }
+}
+
+template <typename Dtype>
+void cpfp_to_float(const int N, const cpfp* x, Dtype* y, const int exp) {
+  cpfp_to_float(N, x, y);
+  if (exp != 0) {
+    const Dtype scale = std::ldexp(Dtype(1), exp);
+    for (int i = 0; i < N; ++i) {
+      y[i] *= scale;
+    }
+  }
+}
+
+template void cpfp_from_float<float>(const int N, const float* x, cpfp* y,
+    const int exp);
+template void cpfp_from_float<double>(const int N, const double* x, cpfp* y,
+    const int exp);
+template void cpfp_to_float<float>(const int N, const cpfp* x, float* y,
+    const int exp);
+template void cpfp_to_float<double>(const int N, const cpfp* x, double* y,
+    const int exp);
+
+void cpfp_scale(const int N, const int exp, const cpfp* x, cpfp* y) {
+  if (exp == 0) {
+    if (x != y) {
+      memcpy(y, x, sizeof(cpfp) * N);
+    }
+    return;
+  }
+  float buffer[kConvertChunk];
+  for (int i = 0; i < N; i += kConvertChunk) {
+    int count = std::min(kConvertChunk, N - i);
+    cpfp_to_float(count, x + i, buffer, exp);
+    cpfp_from_float(count, buffer, y + i);
+  }
+}
+
+float cpfp_amax(const int N, const cpfp* x) {
+  float amax = 0;
+  float buffer[kConvertChunk];
+  for (int i = 0; i < N; i += kConvertChunk) {
+    int count = std::min(kConvertChunk, N - i);
+    cpfp_to_float(count, x + i, buffer);
+    for (int j = 0; j < count; ++j) {
+      amax = std::max(amax, std::fabs(buffer[j]));
+    }
+  }
+  return amax;
+}
+
+int cpfp_scale_exp(float amax) {
+  int exp = 0;
+  if (amax > 0) {
+    std::frexp(amax, &exp);
+  }
+  return exp;
+}
+
+// Share of the running max kept at each update of a CPFPExpTracker, about
+// halving it every 7 updates without a larger value.
+const float kAmaxDecay = 0.9f;
+
+void CPFPExpTracker::set_period(int period) {
+  CHECK_GE(period, 1);
+  period_ = period;
+}
+
+bool CPFPExpTracker::Sample() {
+  return passes_++ % period_ == 0;
+}
+
+void CPFPExpTracker::Update(float amax) {
+  amax_ = std::max(amax, amax_ * kAmaxDecay);
+}
+
+int CPFPExpTracker::exp(int fallback) const {
+  return amax_ > 0 ? cpfp_scale_exp(amax_) : fallback;
+}
+
+int CPFPExpTracker::OutShift(int sum_exp, int* out_exp) const {
+  const int shift = std::min(std::max(sum_exp - exp(sum_exp), kCPFPMinShift),
+      kCPFPMaxShift);
+  *out_exp = sum_exp - shift;
+  return shift;
+}
+
+void cpfp_pack(const int N, const cpfp* x, cpfp16p* y) {
+  for (int i = 0; i < N; i += 16) {
+    cpfp16 val;
+    val = cpfp(0);
+    // cpfp16 is 16 cpfp fields in a row, only its constructors are user
+    // provided, so the bytes can be copied.
+    memcpy(static_cast<void*>(&val), x + i,
+        sizeof(cpfp) * std::min(16, N - i));
+    y[i / 16] = pack16(val);
+  }
+}
+
+void cpfp_unpack(const int N, const cpfp16p* x, cpfp* y) {
+  for (int i = 0; i < N; i += 16) {
+    const cpfp16 val = unpack16(x[i / 16]);
+    memcpy(static_cast<void*>(y + i), &val,
+        sizeof(cpfp) * std::min(16, N - i));
+  }
+}
+
+void cpfp_mult2_1(const int N, const cpfp* t1, const cpfp* t2,
+    const cpfp* u, cpfp* y1, cpfp* y2) {
+  // mult2_1 packs both mantissas into one multiplier operand, but the two
+  // partial products never overlap, so each output is a plain product.
+  cpfp_mul(N, t1, u, y1);
+  cpfp_mul(N, t2, u, y2);
+}
+
+}  // namespace caffe
@@ -0,0 +1,94 @@
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fuse_layers.hpp"
+
+namespace caffe {
+
+// Returns the first layer after layer_idx that is not fused yet and names
+// blob_name as a bottom or a top, or -1.
+static int NextUse(const NetParameter& param, int layer_idx,
+    const string& blob_name, const vector<bool>& fused) {
+  for (int i = layer_idx + 1; i < param.layer_size(); ++i) {
+    if (fused[i]) {
+      continue;
+    }
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      if (layer_param.bottom(j) == blob_name) {
+        return i;
+      }
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      if (layer_param.top(j) == blob_name) {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
+// Whether a layer after layer_idx other than the fused ones reads blob_name.
+static bool ReadAfter(const NetParameter& param, int layer_idx,
+    const string& blob_name, const vector<bool>& fused) {
+  for (int i = layer_idx + 1; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; !fused[i] && j < layer_param.bottom_size(); ++j) {
+      if (layer_param.bottom(j) == blob_name) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Whether layer_param is a single blob layer on blob_name that the
+// convolution can take over.
+static bool SingleBlobLayer(const LayerParameter& layer_param,
+    const string& blob_name) {
+  return layer_param.bottom_size() == 1 && layer_param.top_size() == 1 &&
+      layer_param.bottom(0) == blob_name &&
+      layer_param.loss_weight_size() == 0 &&
+      layer_param.propagate_down_size() == 0;
+}
+
+void FuseOCLLayers(const NetParameter& param, NetParameter* param_fused) {
+  param_fused->CopyFrom(param);
+  param_fused->clear_layer();
+  vector<bool> fused(param.layer_size(), false);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (fused[i]) {
+      continue;
+    }
+    LayerParameter* layer_param = param_fused->add_layer();
+    layer_param->CopyFrom(param.layer(i));
+    if (layer_param->type() != "OCLCRHWCN" || layer_param->top_size() != 1 ||
+        layer_param->loss_weight_size() != 0) {
+      continue;
+    }
+    // A ReLU in place also works for the layers that read the blob after
+    // it, the others must be the only reader of the convolution output.
+    // Pooling stays a layer of its own: the crp kernel pools in a separate
+    // mode, so a fused pooling would still write the convolution output and
+    // launch again.
+    const int next = NextUse(param, i, layer_param->top(0), fused);
+    if (next >= 0 && layer_param->cr_param().relu() == 0) {
+      const LayerParameter& relu_param = param.layer(next);
+      const bool in_place = relu_param.top_size() == 1 &&
+          relu_param.top(0) == layer_param->top(0);
+      if (relu_param.type() == "ReLU" &&
+          SingleBlobLayer(relu_param, layer_param->top(0)) &&
+          relu_param.relu_param().negative_slope() == 0 &&
+          (in_place || !ReadAfter(param, next, layer_param->top(0), fused))) {
+        LOG_IF(INFO, Caffe::root_solver()) << "Fusing " << relu_param.name()
+            << " into " << layer_param->name();
+        layer_param->mutable_cr_param()->set_relu(1);
+        layer_param->set_top(0, relu_param.top(0));
+        fused[next] = true;
+      }
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,143 @@
+#include <algorithm>
+
+#include "caffe/native_kernel.hpp"
+#include "caffe/util/cpfp_math.hpp"
+#include "caffe/util/hwcn_transpose.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Tile edge, a 32 x 32 tile of doubles is 8 KiB and stays in L1.
+const int kTile = 32;
+
+// Tensors below this many elements are not worth waking the thread pool.
+const int kMinParallelCount = 1 << 16;
+
+template <typename Dtype>
+inline void convert_row(const int n, const Dtype* x, Dtype* y,
+    const int exp) {
+  std::copy(x, x + n, y);
+}
+
+template <typename Dtype>
+inline void convert_row(const int n, const Dtype* x, cpfp* y,
+    const int exp) {
+  cpfp_from_float(n, x, y, exp);
+}
+
+template <typename Dtype>
+inline void convert_row(const int n, const cpfp* x, Dtype* y,
+    const int exp) {
+  cpfp_to_float(n, x, y, exp);
+}
+
+// C independent P x Q transposes: for every c, p < P and q < Q,
+// y[c * yc + q * ldy + p] = x[c * xc + p * ldx + q].
+struct TransposeJob {
+  int C, P, Q;
+  const void* x;
+  int xc, ldx;
+  void* y;
+  int yc, ldy;
+  // Exponent of the cpfp side of a conversion
+  int exp;
+};
+
+// Runs slice split_idx of num_splits of a TransposeJob passed as input. The
+// work is cut into strips of kTile rows of one channel, each strip writes
+// its own columns of y, so slices never touch the same output.
+template <typename Stype, typename Dtype>
+void TransposeSlice(void *input, void *weights, void *bias, void *output,
+    void *tags, int *params, int group_idx, int split_idx, int num_splits) {
+  const TransposeJob& job = *static_cast<TransposeJob *>(input);
+  const Stype* x = static_cast<const Stype *>(job.x);
+  Dtype* y = static_cast<Dtype *>(job.y);
+  const int strips = (job.P + kTile - 1) / kTile;
+  const int total = job.C * strips;
+  const int begin = static_cast<int>(
+      static_cast<long long>(total) * split_idx / num_splits);
+  const int end = static_cast<int>(
+      static_cast<long long>(total) * (split_idx + 1) / num_splits);
+  Dtype tile[kTile][kTile];
+  for (int i = begin; i < end; ++i) {
+    const int c = i / strips;
+    const int p0 = (i % strips) * kTile;
+    const int pn = std::min(kTile, job.P - p0);
+    const Stype* xs = x + static_cast<long long>(c) * job.xc +
+        static_cast<long long>(p0) * job.ldx;
+    Dtype* ys = y + static_cast<long long>(c) * job.yc + p0;
+    for (int q0 = 0; q0 < job.Q; q0 += kTile) {
+      const int qn = std::min(kTile, job.Q - q0);
+      // Rows of x are contiguous, so the conversion runs on whole rows
+      for (int p = 0; p < pn; ++p) {
+        convert_row(qn, xs + static_cast<long long>(p) * job.ldx + q0,
+            tile[p], job.exp);
+      }
+      for (int q = 0; q < qn; ++q) {
+        Dtype* yq = ys + static_cast<long long>(q0 + q) * job.ldy;
+        for (int p = 0; p < pn; ++p) {
+          yq[p] = tile[p][q];
+        }
+      }
+    }
+  }
+}
+
+template <typename Stype, typename Dtype>
+void RunTranspose(TransposeJob* job) {
+  NativeKernel kernel = TransposeSlice<Stype, Dtype>;
+  if (static_cast<long long>(job->C) * job->P * job->Q < kMinParallelCount) {
+    kernel(job, NULL, NULL, NULL, NULL, NULL, 0, 0, 1);
+  } else {
+    NativeKernelRunner::Run(kernel, job, NULL, NULL, NULL, NULL, NULL, 1);
+  }
+}
+
+}  // namespace
+
+template <typename Stype, typename Dtype>
+void nchw_to_hwcn(const int N, const int C, const int HW, const Stype* x,
+    Dtype* y, const int exp) {
+  // With a single pixel the channels are the rows to transpose, which keeps
+  // the tiles full for fully connected layers.
+  const int channels = HW == 1 ? 1 : C;
+  const int pixels = HW == 1 ? C : HW;
+  TransposeJob job = {channels, N, pixels, x, pixels, channels * pixels,
+      y, N, channels * N, exp};
+  RunTranspose<Stype, Dtype>(&job);
+}
+
+template <typename Stype, typename Dtype>
+void hwcn_to_nchw(const int N, const int C, const int HW, const Stype* x,
+    Dtype* y, const int exp) {
+  const int channels = HW == 1 ? 1 : C;
+  const int pixels = HW == 1 ? C : HW;
+  TransposeJob job = {channels, pixels, N, x, N, channels * N,
+      y, pixels, channels * pixels, exp};
+  RunTranspose<Stype, Dtype>(&job);
+}
+
+#define INSTANTIATE_HWCN_TRANSPOSE(Stype, Dtype)                             \
+  template void nchw_to_hwcn<Stype, Dtype>(const int N, const int C,         \
+      const int HW, const Stype* x, Dtype* y, const int exp);                \
+  template void hwcn_to_nchw<Stype, Dtype>(const int N, const int C,         \
+      const int HW, const Stype* x, Dtype* y, const int exp)
+
+INSTANTIATE_HWCN_TRANSPOSE(float, float);
+INSTANTIATE_HWCN_TRANSPOSE(double, double);
+INSTANTIATE_HWCN_TRANSPOSE(float, cpfp);
+INSTANTIATE_HWCN_TRANSPOSE(double, cpfp);
+INSTANTIATE_HWCN_TRANSPOSE(cpfp, float);
+INSTANTIATE_HWCN_TRANSPOSE(cpfp, double);
+
+void hwcn_resize_batch(const int rows, const int in_num, const int out_num,
+    const cpfp* x, cpfp* y) {
+  const int num = std::min(in_num, out_num);
+  for (int r = 0; r < rows; ++r) {
+    std::copy(x + r * in_num, x + r * in_num + num, y + r * out_num);
+    std::fill(y + r * out_num + num, y + (r + 1) * out_num, cpfp(0));
+  }
+}
+
+}  // namespace caffe
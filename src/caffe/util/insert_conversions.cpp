@@ -0,0 +1,324 @@
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/insert_conversions.hpp"
+
+namespace caffe {
+
+// A blob format, NCHW floats unless flagged
+enum {
+  kNCHW = 0,
+  kHWCN = 1,
+  kCPFP = 2
+};
+
+static string FormatName(int format) {
+  return string((format & kHWCN) ? "hwcn" : "nchw") +
+      ((format & kCPFP) ? "_cpfp" : "");
+}
+
+static bool IsOCLLayer(const LayerParameter& layer_param) {
+  return layer_param.type() == "OCLCRHWCN" ||
+      layer_param.type() == "OCLPoolingHWCN" ||
+      layer_param.type() == "OCLHWCNInnerProduct";
+}
+
+static bool IsConversionLayer(const LayerParameter& layer_param) {
+  return layer_param.type() == "HWCN" ||
+      layer_param.type() == "CPFPConversion";
+}
+
+// The format a layer reads bottom_format in. bottom_format is the format
+// of the bottom in the input net, which Pad and conversion layers keep.
+static int RequiredFormat(const LayerParameter& layer_param,
+    int bottom_format) {
+  if (IsOCLLayer(layer_param)) {
+    return kHWCN | kCPFP;
+  } else if (layer_param.type() == "HWCN") {
+    const HWCNParameter& hwcn_param = layer_param.hwcn_param();
+    if (hwcn_param.convert_to()) {
+      return kNCHW;
+    }
+    return kHWCN | (hwcn_param.cpfp() ? kCPFP : 0);
+  } else if (layer_param.type() == "CPFPConversion") {
+    if (layer_param.cpfp_conversion_param().convert_to()) {
+      return bottom_format & ~kCPFP;
+    }
+    return bottom_format | kCPFP;
+  } else if (layer_param.type() == "Pad") {
+    return bottom_format & ~kCPFP;
+  }
+  return kNCHW;
+}
+
+// The format of top top_idx of a layer reading its bottoms in
+// bottom_format.
+static int ProducedFormat(const LayerParameter& layer_param,
+    int bottom_format, int top_idx) {
+  if (IsOCLLayer(layer_param)) {
+    return kHWCN | kCPFP;
+  } else if (layer_param.type() == "HWCN") {
+    const HWCNParameter& hwcn_param = layer_param.hwcn_param();
+    if (hwcn_param.convert_to()) {
+      return kHWCN | (hwcn_param.cpfp() ? kCPFP : 0);
+    }
+    return kNCHW;
+  } else if (layer_param.type() == "CPFPConversion") {
+    if (layer_param.cpfp_conversion_param().convert_to()) {
+      return bottom_format | kCPFP;
+    }
+    return bottom_format & ~kCPFP;
+  } else if (layer_param.type() == "Pad") {
+    return bottom_format;
+  } else if (layer_param.data_param().has_prefetch_hwcn() && top_idx == 0) {
+    // Prefetching data layers hand out the images as HWCN
+    return kHWCN | (layer_param.data_param().prefetch_hwcn().cpfp() ?
+        kCPFP : 0);
+  }
+  return kNCHW;
+}
+
+// The format one conversion layer takes from towards to. An HWCN layer
+// also converts to or from cpfp, but only on its HWCN side.
+static int NextFormat(int from, int to) {
+  if ((from & kHWCN) == (to & kHWCN)) {
+    return to;
+  } else if (from & kHWCN) {
+    return kNCHW;
+  } else if (from & kCPFP) {
+    return kNCHW;
+  }
+  return to;
+}
+
+static void ConfigureConversionLayer(const string& layer_name,
+    const string& bottom_name, const string& top_name, int from, int to,
+    LayerParameter* layer_param) {
+  layer_param->Clear();
+  layer_param->set_name(layer_name);
+  layer_param->add_bottom(bottom_name);
+  layer_param->add_top(top_name);
+  if ((from & kHWCN) == (to & kHWCN)) {
+    layer_param->set_type("CPFPConversion");
+    layer_param->mutable_cpfp_conversion_param()->set_convert_to(to & kCPFP);
+  } else {
+    layer_param->set_type("HWCN");
+    HWCNParameter* hwcn_param = layer_param->mutable_hwcn_param();
+    hwcn_param->set_convert_to(to & kHWCN);
+    hwcn_param->set_cpfp(((to & kHWCN) ? to : from) & kCPFP);
+  }
+}
+
+namespace {
+
+// The blob of the output net holding the latest value of a blob
+struct BlobVersion {
+  string name;
+  int format;
+};
+
+class ConversionInserter {
+ public:
+  explicit ConversionInserter(NetParameter* param_converted)
+      : param_converted_(param_converted) {}
+
+  void Run(const NetParameter& param);
+
+ private:
+  // Returns the blob of the output net holding version in format, adding
+  // conversion layers as needed.
+  string Convert(const BlobVersion& version, int format);
+  // A name no blob of the nets has yet
+  string UniqueName(const string& name);
+  // Forgets the copies of blob_name, whose value changes.
+  void Invalidate(const string& blob_name);
+  // Whether the top of the conversion layer_idx can be left as a view of
+  // its bottom: a later layer reads it, and no layer before the last of
+  // them writes over the bottom in place.
+  bool CanDrop(const NetParameter& param, int layer_idx);
+
+  NetParameter* param_converted_;
+  // Blob name of the input net -> latest value
+  map<string, BlobVersion> current_;
+  // Format of each blob of the input net
+  map<string, int> declared_;
+  // (blob, format) -> blob of the output net holding it in that format
+  map<pair<string, int>, string> converted_;
+  // (blob, format) -> layer and top names of a dropped conversion to it
+  map<pair<string, int>, pair<string, string> > dropped_;
+  set<string> used_names_;
+};
+
+void ConversionInserter::Run(const NetParameter& param) {
+  param_converted_->CopyFrom(param);
+  param_converted_->clear_layer();
+  for (int i = 0; i < param.input_size(); ++i) {
+    BlobVersion version = { param.input(i), kNCHW };
+    current_[param.input(i)] = version;
+    declared_[param.input(i)] = kNCHW;
+    used_names_.insert(param.input(i));
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    for (int j = 0; j < param.layer(i).top_size(); ++j) {
+      used_names_.insert(param.layer(i).top(j));
+    }
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      if (current_.find(blob_name) == current_.end()) {
+        LOG(FATAL) << "Unknown bottom blob '" << blob_name << "' (layer '"
+                   << layer_param.name() << "', bottom index " << j << ")";
+      }
+    }
+    // A conversion read by later layers leaves its top as another view of
+    // its bottom, the readers convert the bottom themselves.
+    if (IsConversionLayer(layer_param) && layer_param.bottom_size() == 1 &&
+        layer_param.top_size() == 1 &&
+        layer_param.top(0) != layer_param.bottom(0) &&
+        layer_param.loss_weight_size() == 0 &&
+        layer_param.propagate_down_size() == 0 && CanDrop(param, i)) {
+      const BlobVersion& version = current_[layer_param.bottom(0)];
+      const int format = ProducedFormat(layer_param,
+          declared_[layer_param.bottom(0)], 0);
+      dropped_[make_pair(version.name, format)] =
+          make_pair(layer_param.name(), layer_param.top(0));
+      current_[layer_param.top(0)] = version;
+      declared_[layer_param.top(0)] = format;
+      used_names_.erase(layer_param.top(0));
+      continue;
+    }
+    // Convert the bottoms first, the conversions run before the layer.
+    vector<string> bottoms(layer_param.bottom_size());
+    int bottom_format = kNCHW;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      bottom_format = RequiredFormat(layer_param, declared_[blob_name]);
+      bottoms[j] = Convert(current_[blob_name], bottom_format);
+    }
+    LayerParameter* converted_param = param_converted_->add_layer();
+    converted_param->CopyFrom(layer_param);
+    map<string, string> in_place;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      converted_param->set_bottom(j, bottoms[j]);
+      in_place[layer_param.bottom(j)] = bottoms[j];
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      const string& blob_name = layer_param.top(j);
+      const int top_format = ProducedFormat(layer_param, bottom_format, j);
+      BlobVersion version = { blob_name, top_format };
+      if (in_place.find(blob_name) != in_place.end()) {
+        version.name = in_place[blob_name];
+        converted_param->set_top(j, version.name);
+      }
+      Invalidate(version.name);
+      current_[blob_name] = version;
+      declared_[blob_name] = top_format;
+    }
+  }
+}
+
+string ConversionInserter::Convert(const BlobVersion& version, int format) {
+  string name = version.name;
+  int from = version.format;
+  while (from != format) {
+    const int to = NextFormat(from, format);
+    const pair<string, int> key = make_pair(version.name, to);
+    if (converted_.find(key) == converted_.end()) {
+      string layer_name, top_name;
+      if (dropped_.find(key) != dropped_.end()) {
+        layer_name = dropped_[key].first;
+        top_name = UniqueName(dropped_[key].second);
+        dropped_.erase(key);
+      } else {
+        top_name = UniqueName(version.name + "_" + FormatName(to));
+        layer_name = top_name;
+      }
+      ConfigureConversionLayer(layer_name, name, top_name, from, to,
+          param_converted_->add_layer());
+      converted_[key] = top_name;
+    }
+    name = converted_[key];
+    from = to;
+  }
+  return name;
+}
+
+string ConversionInserter::UniqueName(const string& name) {
+  string unique_name = name;
+  for (int i = 1; used_names_.find(unique_name) != used_names_.end(); ++i) {
+    ostringstream numbered;
+    numbered << name << "_" << i;
+    unique_name = numbered.str();
+  }
+  used_names_.insert(unique_name);
+  return unique_name;
+}
+
+void ConversionInserter::Invalidate(const string& blob_name) {
+  map<pair<string, int>, string>::iterator it = converted_.begin();
+  while (it != converted_.end()) {
+    if (it->first.first == blob_name || it->second == blob_name) {
+      converted_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool ConversionInserter::CanDrop(const NetParameter& param, int layer_idx) {
+  const string& top_name = param.layer(layer_idx).top(0);
+  int last_read = -1;
+  for (int i = layer_idx + 1; i < param.layer_size(); ++i) {
+    for (int j = 0; j < param.layer(i).bottom_size(); ++j) {
+      if (param.layer(i).bottom(j) == top_name) {
+        last_read = i;
+      }
+    }
+  }
+  const string& source = current_[param.layer(layer_idx).bottom(0)].name;
+  for (int i = layer_idx + 1; i < last_read; ++i) {
+    for (int j = 0; j < param.layer(i).top_size(); ++j) {
+      const string& blob_name = param.layer(i).top(j);
+      if (current_.find(blob_name) != current_.end() &&
+          current_[blob_name].name == source) {
+        return false;
+      }
+    }
+  }
+  return last_read >= 0;
+}
+
+}  // namespace
+
+// Turns on the cpfp scaling of every layer reading or writing cpfp blobs
+static void EnableCPFPScale(NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    if (layer_param->type() == "HWCN") {
+      layer_param->mutable_hwcn_param()->set_scale(true);
+    } else if (layer_param->type() == "CPFPConversion") {
+      layer_param->mutable_cpfp_conversion_param()->set_scale(true);
+    } else if (layer_param->type() == "OCLCRHWCN" ||
+        layer_param->type() == "OCLHWCNInnerProduct") {
+      layer_param->mutable_cr_param()->set_cpfp_scale(true);
+    }
+  }
+}
+
+void InsertConversions(const NetParameter& param,
+    NetParameter* param_converted) {
+  ConversionInserter inserter(param_converted);
+  inserter.Run(param);
+  if (param.cpfp_scale()) {
+    EnableCPFPScale(param_converted);
+  }
+}
+
+}  // namespace caffe
@@ -370,6 +370,16 @@ double caffe_cpu_asum<double>(const int n, const double* x) {
   return cblas_dasum(n, x, 1);
 }
 
+template <>
+float caffe_cpu_amax<float>(const int n, const float* x) {
+  return n > 0 ? std::fabs(x[cblas_isamax(n, x, 1)]) : 0;
+}
+
+template <>
+double caffe_cpu_amax<double>(const int n, const double* x) {
+  return n > 0 ? std::fabs(x[cblas_idamax(n, x, 1)]) : 0;
+}
+
 template <>
 void caffe_cpu_scale<float>(const int n, const float alpha, const float *x,
                             float* y) {
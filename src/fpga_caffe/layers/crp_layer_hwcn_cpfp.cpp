@@ -132,11 +132,16 @@ extern "C" {
  *                max pooling mode
  * params:        Engine specific parameters used for controlling the output
  *                and compute modes
- * group_idx:     Group index used for forward convolution only currently
+ * group_idx:     Group index, each group runs as its own task in all modes
+ *
+ * Built with CPFP_PACKED, input, weights and output hold 256 bit beats of
+ * packed values, see port16. Neighbouring bursts can then share a beat, so
+ * splits only end on whole beats of the output, see PACKED_ALIGN_WORDS.
  */ 
 
-void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
-    cpfp16 *output, short *tagVals, int *params, int group_idx) { 
+void crp_layer_hwcn_cpfp(port16 *input, port16 *weights, cpfp *bias,
+    port16 *output, short *tagVals, int *params, int group_idx, int split_idx,
+    int num_splits) { 
 // Ports 
 #pragma HLS data_pack variable=weights
 #pragma HLS data_pack variable=output
@@ -154,6 +159,8 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
 #pragma HLS INTERFACE s_axilite port=tagVals bundle=control
 #pragma HLS INTERFACE s_axilite port=params bundle=control
 #pragma HLS INTERFACE s_axilite port=group_idx bundle=control
+#pragma HLS INTERFACE s_axilite port=split_idx bundle=control
+#pragma HLS INTERFACE s_axilite port=num_splits bundle=control
 #pragma HLS INTERFACE s_axilite port=return bundle=control
 
   // Input tile buffer
@@ -206,6 +213,16 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
   short inMask[16 * 256];
 #pragma HLS ARRAY_PARTITION variable=inMask cyclic factor=16 dim=1
 
+  // Multiply steps with at least one ReLU tag set in the backward passes.
+  // Wrt data a step is a window position and input word, wrt weights an
+  // output diff word of a burst, listed per image word.
+  short stepFilt[2 * 256 * 16];
+  short stepWoff[2 * 256 * 16];
+  short actB[8 * 256];
+  ap_uint<5> actImg[16];
+  short actStart[16];
+  short actCount[16];
+
   cpfp multRes[OCFACT][4][16];
 #pragma HLS ARRAY_PARTITION variable=multRes complete dim=1
 #pragma HLS ARRAY_PARTITION variable=multRes complete dim=2
@@ -281,8 +298,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
   ap_uint<10> xdim = params[7];
   // Kernel size, only square kernels support currently
   ap_uint<5> ksize = params[9];
-  // Number of groups for group convolution, currently only supported in
-  // forward path
+  // Number of groups for group convolution
   short numgroups = params[10];
   // Number of input/output images, this should be a multiple of 16 and
   // burstoc * numImages / 16 should be >= 12
@@ -305,6 +321,10 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
   short operation = params[17];
   // Pooling size, 2 or 3 supported currently
   ap_uint<3> pksize = params[18];
+  // Power of two the convolution outputs are multiplied by on their last
+  // write, which moves them to the exponent of a scaled output blob. The
+  // pooling modes keep the scale of their input and ignore it.
+  short outshift = params[19];
 
   assert((pksize == 2) || (pksize == 3));
   assert(ksize <= 11);
@@ -317,6 +337,10 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
   bool fwMode = (backward == 0);
   bool poolMode = (operation == 1);
 
+  assert((outshift >= 1 - EXP_OFFSET) && (outshift < MAX_EXP - EXP_OFFSET));
+  cpfp16 outScale;
+  outScale = cpfp(uint32((outshift + EXP_OFFSET) << EXP_SHIFT));
+
   ap_uint<10> xdim_out = ((xdim - ksize + 2 * pad) / stride) + 1;
   ap_uint<10> ydim_out = xdim_out;
 
@@ -340,7 +364,44 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
   short out_div = ocrdfact / OCFACT;
   // Reduced amount of ouput feature map iterations 
   short ofm_iters = (ocrdfact % OCFACT == 0) ? out_div : out_div + 1;
-  
+
+  // Range of output feature map iterations computed by this call. Each
+  // iteration writes its own bursts of output channels, so a task can be
+  // split across the compute units of a multi-CU build, or across host
+  // threads in the emulation (src/caffe/native).
+  // Splits start on multiples of ofm_step iterations.
+  short ofm_step = 1;
+#ifdef CPFP_PACKED
+  // Packed splits must not share a beat of the output, port_write reads
+  // back and rewrites the beats at either end of a burst. The output rows
+  // and the slices of a split have to be whole runs of PACKED_ALIGN_WORDS
+  // words, otherwise the first split runs the whole task.
+  int ofmWords = (bwMode) ? OCFACT * burstoc * ksize * ksize * icFact :
+    OCFACT * burstoc * imgFact;
+  int rowWords = (bwMode) ? outChannels * ksize * ksize * icFact :
+    outChannels * imgFact;
+  if (rowWords % PACKED_ALIGN_WORDS != 0) {
+    if (split_idx != 0)
+      return;
+    num_splits = 1;
+  }
+  while ((ofm_step * ofmWords) % PACKED_ALIGN_WORDS != 0)
+    ofm_step++;
+#endif
+  short ofm_chunks = (ofm_iters + ofm_step - 1) / ofm_step;
+  short ofm_begin = ofm_step * (ofm_chunks * split_idx / num_splits);
+  short ofm_end = ofm_step * (ofm_chunks * (split_idx + 1) / num_splits);
+  if (ofm_begin > ofm_iters)
+    ofm_begin = ofm_iters;
+  if (ofm_end > ofm_iters)
+    ofm_end = ofm_iters;
+
+  // The backward passes skip the work of words whose ReLU tags are all
+  // clear. Wrt weights the tags of the output diff are read first, so that
+  // tiles without a single active word are not read or computed at all.
+  bool skipW = bwMode && relu && (reluWeights == 1);
+  bool skipIn = (backward == 2) && relu && (reluWeights == 0);
+
   if (!poolMode) {
     if (fwMode) {
     // Read in bias data 
@@ -363,9 +424,29 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
     }
     // Read in the input data
     for (int n = 0; n < rpo; ++n) {
-      for (int o = 0; o < ofm_iters; ++o) {
+      for (int o = ofm_begin; o < ofm_end; ++o) {
         for (int y = 0; y < ydim_out; ++y) {
+          // Whether inBuf holds the window of the previous x to shift from
+          bool shiftEnable = false;
           for (int x = 0; x < xdim_out; ++x) {
+            bool tileActive = true;
+            if (skipW) {
+              tileActive = false;
+              for (int k = 0; k < OCFACT; ++k) {
+                int tIdx = (((y * xdim_out + x) * numgroups + group_idx) *
+                    outChannels + (o * OCFACT + k) * burstoc) * imgFact;
+                short tSize = burstoc * imgFact;
+                if ((o * OCFACT + k) * burstoc + burstoc > outChannels)
+                  tSize = (outChannels - (o * OCFACT + k) * burstoc) * imgFact;
+                if ((o * OCFACT + k) * burstoc < outChannels) {
+                  memcpy(wBufRelu[k], tagVals + tIdx, sizeof(short) * tSize);
+                  TILE_SCAN: for (int i = 0; i < tSize; ++i) {
+#pragma HLS pipeline
+                    tileActive |= (wBufRelu[k][i] != 0);
+                  }
+                }
+              }
+            }
             ap_uint<4> yk_off = 0;
             ap_uint<4> xk_off = 0;
             ap_uint<4> yksize = 0;
@@ -401,8 +482,9 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                   }
                 }
 
-                if (in_y >= 0 && in_y < ydim && in_x >= 0 && in_x < xdim) {
-                  if ((x != 0) && (q + stride < ksize)) {
+                if (in_y >= 0 && in_y < ydim && in_x >= 0 && in_x < xdim &&
+                    tileActive) {
+                  if (shiftEnable && (q + stride < ksize)) {
                     // Shift input to the left rather than doing a memory
                     // transfer for each window (stride of one only)
                     short q_off = burstFact * imgFact * stride;
@@ -420,19 +502,22 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                     }
                   } else {
                     // If we can't shift the data then we need to transfer
-                    // from on-board memory
+                    // from on-board memory. The whole burst is read, words
+                    // with every tag clear only pass relu_bw with every
+                    // enable low.
                     for (int j = 0; j < 4; ++j) {
                       int f_inIdx = inIdx + j * burstFact * imgFact;
-                      memcpy(inBuf[j] + inBufIdx, input + f_inIdx,
-                          sizeof(cpfp16) * inSize);
-                      if ((backward != 0) && relu && (reluWeights == 0))
+                      if ((backward != 0) && relu && (reluWeights == 0)) {
                         memcpy(inBufRelu[j] + inBufIdx, tagVals + f_inIdx,
                             sizeof(short) * inSize);
+                      }
+                      port_read(inBuf[j] + inBufIdx, input, f_inIdx, inSize);
                     }
                   }
                 }
               }
             }
+            shiftEnable = tileActive;
 
             if ((n == 0) && (fwMode)) {
               // Set the output to be the bias
@@ -486,7 +571,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                   && (!bwMode);
 
                 if (readEnable)
-                  memcpy(outBuf[k], output + outIdx, sizeof(cpfp16) * outSize);
+                  port_read(outBuf[k], output, outIdx, outSize);
               }
             }
 
@@ -516,23 +601,73 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
               wSize = mode_select(wSizeFW, wSizeBW, bwMode);
 
               bool readEnable = ((o * OCFACT + k) * burstoc < outChannels) &&
-                ((bwMode) || ((x == 0) && (y == 0)));
-              if (readEnable) {
-                memcpy(wBuf[k], weights + wIdx, sizeof(cpfp16) * wSize);
-                if (relu && (reluWeights == 1) && (bwMode))
-                  memcpy(wBufRelu[k], tagVals + wIdx, sizeof(short) * wSize);
+                ((bwMode) || ((x == 0) && (y == 0))) && tileActive;
+              // Read as a whole burst even when skipping, see the input
+              if (readEnable)
+                port_read(wBuf[k], weights, wIdx, wSize);
+            }
+
+            // List the multiply steps that have work. Wrt weights a step is
+            // active if any of the OCFACT bursts has a tag set for the word,
+            // wrt data if any of the four input banks has.
+            short numSteps = 0;
+            for (int yo = 0; yo < yksize; ++yo) {
+              for (int xo = 0; xo < xksize; ++xo) {
+                for (int w = 0; w < burstFact; ++w) {
+                  short filt = (yk_off + yo) * ksize + xk_off + xo;
+                  bool active = !skipIn;
+                  STEP_SCAN: for (int img = 0; (img < imgFact) && skipIn;
+                      ++img) {
+#pragma HLS pipeline
+                    for (int j = 0; j < 4; ++j)
+                      active |= (inBufRelu[j][(filt * burstFact + w) *
+                          imgFact + img] != 0);
+                  }
+                  if (active) {
+                    stepFilt[numSteps] = filt;
+                    stepWoff[numSteps] = w;
+                    numSteps++;
+                  }
+                }
+              }
+            }
+            ap_uint<5> numImgs = 0;
+            short numWords = 0;
+            for (int img = 0; img < imgFact; ++img) {
+              short count = 0;
+              WORD_SCAN: for (int b = 0; b < burstoc; ++b) {
+#pragma HLS pipeline
+                bool active = !skipW;
+                for (int k = 0; k < OCFACT; ++k)
+                  active |= skipW && (wBufRelu[k][b * imgFact + img] != 0);
+                if (active) {
+                  actB[numWords + count] = b;
+                  count++;
+                }
+              }
+              if (count > 0) {
+                actImg[numImgs] = img;
+                actStart[numImgs] = numWords;
+                actCount[numImgs] = count;
+                numImgs++;
+                numWords += count;
               }
             }
 
             ap_uint<10> w_off_fw = 0, w_off_bw = 0;
             ap_uint<6> img_off_fw = 0, img_off_bw = 0;
             ap_uint<10> iter_fw = 0, iter_bw = 0;
-            ap_uint<4> xdim_off_fw = 0, ydim_off_fw = 0;
             ap_uint<4> xdim_off_bw = 0, ydim_off_bw = 0;
             ap_uint<2> counter_bw = 0, counter_fw = 0;
             ap_uint<8> b_off_fw = 0, b_off_bw = 0;
-            int mac_iterations = burstoc * yksize * xksize * imgFact
-              * burstFact;
+            short step_fw = 0, b_pos_bw = 0;
+            ap_uint<5> img_pos_bw = 0;
+            int mac_iterations_fw = numSteps * burstoc * imgFact;
+            int mac_iterations_bw = numWords * yksize * xksize * burstFact;
+            int mac_iterations = mode_select(mac_iterations_fw,
+                mac_iterations_bw, bwMode);
+            if (!tileActive)
+              mac_iterations = 0;
             MAC_LOOP: for (int i = 0; i < mac_iterations; ++i, ++iter_bw,
               ++iter_fw, ++counter_bw) {
 #pragma HLS pipeline
@@ -544,34 +679,24 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
               if (iter_fw == imgFact) {
                 if (b_off_fw == burstoc - 1) {
                   b_off_fw = 0;
-                  if (w_off_fw == burstFact - 1) {
-                    counter_fw = 0;
-                    w_off_fw = 0;
-                    if (xdim_off_fw == xksize - 1) {
-                      xdim_off_fw = 0;
-                      ydim_off_fw++;
-                    } else {
-                      xdim_off_fw++;
-                    }
-                  } else {
-                    counter_fw++;
-                    w_off_fw++;
-                  }
+                  step_fw++;
                 } else {
                   b_off_fw++;
                 }
                 iter_fw = 0;
               }
               img_off_fw = iter_fw;
+              w_off_fw = stepWoff[step_fw];
+              counter_fw = w_off_fw & 0x3;
               // BW index calculation
               if (iter_bw == burstFact) {
-                if (b_off_bw == burstoc - 1) {
-                  b_off_bw = 0;
+                if (b_pos_bw == actCount[img_pos_bw] - 1) {
+                  b_pos_bw = 0;
                   if (xdim_off_bw == xksize - 1) {
                     xdim_off_bw = 0;
                     if (ydim_off_bw == yksize - 1) {
                       ydim_off_bw = 0;
-                      img_off_bw++;
+                      img_pos_bw++;
                     } else {
                       ydim_off_bw++;
                     }
@@ -579,16 +704,17 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                     xdim_off_bw++;
                   }
                 } else {
-                  b_off_bw++;
+                  b_pos_bw++;
                 }
                 iter_bw = 0;
               }
               w_off_bw = iter_bw;
+              img_off_bw = actImg[img_pos_bw];
+              b_off_bw = actB[actStart[img_pos_bw] + b_pos_bw];
 
               if (counter_bw > counter_bw_lim)
                 counter_bw = 0;
-              short filt_off_fw = (yk_off + ydim_off_fw) * ksize + xk_off +
-                xdim_off_fw;
+              short filt_off_fw = stepFilt[step_fw];
               short filt_off_bw = (yk_off + ydim_off_bw) * ksize + xk_off +
                 xdim_off_bw;
               short wIdxFW = (b_off_fw * ksize * ksize + filt_off_fw) * wcFact
@@ -695,8 +821,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                     finalOut[k][j] = addTreeS2[k][j];
                 }
                 bool reluFWEnable = relu && fwMode && (n == rpo - 1)
-                  && (w_off_fw == burstFact - 1) && (xdim_off_fw == xksize - 1)
-                  && (ydim_off_fw == yksize - 1);
+                  && (step_fw == numSteps - 1);
                 // 16 Accumulations, forward accumulate every cycle, backward
                 // accumulate every four cycles. In the forward path ReLU is
                 // applied when all accumulations for an output are computed.
@@ -735,14 +860,24 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                     outSize);
               }
 
+              // Scale the outputs once all of their input bursts are summed
+              bool scaleEnable = writeEnable && (outshift != 0) &&
+                (bwMode || (n == rpo - 1));
+              if (scaleEnable) {
+                for (int i = 0; i < outSize; ++i) {
+#pragma HLS pipeline
+                  outBuf[k][i] = outBuf[k][i] * outScale;
+                }
+              }
+
               if (writeEnable)
-                memcpy(output + outIdx, outBuf[k], sizeof(cpfp16) * outSize);
+                port_write(output, outIdx, outBuf[k], outSize);
             }
           }
         }
       }
     }
-  } else {
+  } else if (split_idx == 0) {
     // Max Pooling, 2x2 or 3x3
     short pooled_height = ydim - pksize;
     if ((pooled_height & 0x1) == 1)
@@ -766,8 +901,8 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                     inChannels + c * burstChannels) * imgFact;
                 if ((hstart + h < ydim) && (wstart + w < xdim) &&
                     (h < pksize) && (w < pksize))
-                  memcpy(poolInBuf[h * 3 + w], input + inIdx,
-                      sizeof(cpfp16) * imgFact * burstChannels);
+                  port_read(poolInBuf[h * 3 + w], input, inIdx,
+                      imgFact * burstChannels);
                 else
                   for (int n = 0; n < imgFact * burstChannels; ++n)
 #pragma HLS pipeline
@@ -800,8 +935,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
             // Write the output and tags to on-board memory
             int outIdx = ((ph * pooled_width + pw) * inChannels +
                 c * burstChannels) * imgFact;
-            memcpy(output + outIdx, poolOutBuf, sizeof(cpfp16) *
-                imgFact * burstChannels);
+            port_write(output, outIdx, poolOutBuf, imgFact * burstChannels);
             memcpy(tagVals + outIdx * 16, outMask,
                 sizeof(short) * numImages * burstChannels);
           }
@@ -817,8 +951,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
             int inIdx = ((ph * pooled_width + pw) * inChannels + c *
                 burstChannels) * imgFact;
             // Read the input diffs and the tag values
-            memcpy(poolInBufBW, input + inIdx, sizeof(cpfp16) * imgFact *
-                burstChannels);
+            port_read(poolInBufBW, input, inIdx, imgFact * burstChannels);
             memcpy(inMask, tagVals + inIdx * 16, sizeof(short) * numImages *
                 burstChannels);
 
@@ -830,8 +963,8 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                   c * burstChannels) * imgFact;
                 if ((ph != 0) && (hstart < ydim) && (wstart + w < xdim) &&
                     ((pw == 0) || (w != 0))) {
-                  memcpy(poolOutBufBW[w], output + outIdx,
-                    sizeof(cpfp16) * imgFact * burstChannels); 
+                  port_read(poolOutBufBW[w], output, outIdx,
+                    imgFact * burstChannels);
                 }
               }
             }
@@ -875,8 +1008,8 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                 int outIdx = (((hstart + h) * xdim + (wstart + w))
                     * inChannels + c * burstChannels) * imgFact;
                 if ((hstart + h < ydim) && (wstart + w < xdim))
-                  memcpy(output + outIdx, poolOutBufBW[h * 3 + w],
-                      sizeof(cpfp16) * imgFact * burstChannels);
+                  port_write(output, outIdx, poolOutBufBW[h * 3 + w],
+                      imgFact * burstChannels);
               }
             }
             // Shift output window to the left
@@ -9,11 +9,19 @@ XOCC = xocc
 KERNEL_NAME = crp_layer_hwcn_cpfp
 KERNEL_SRCS = $(KERNEL_NAME).cpp
 NK = 1
+# PACKED=1 builds the kernel with 12-bit packed cpfp ports (CPFP_PACKED),
+# only OCLHWCNInnerProduct layers with xcl_param { packed: true } run these
+PACKED ?= 0
 
 DSA = xilinx:adm-pcie-8k5:2ddr:3.2
 
 XCLBIN_NAME=$(KERNEL_NAME)
 
+ifeq (${PACKED}, 1)
+	XCL_OPT += -DCPFP_PACKED
+	XCLBIN_NAME=$(KERNEL_NAME)_packed
+endif
+
 INCLUDE_DIR=../../../include/
 
 ifeq (${SDA_FLOW}, cpu_emu)
@@ -133,6 +133,7 @@ TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1F_CPFP) {
     clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
         0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
 
+    int split_idx = 0, num_splits = 1;
     for (int g = 0; g < params[i].numgroups; ++g) {
       clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
           &this->ocl_input);
@@ -148,6 +149,8 @@ TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1F_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_int), &split_idx);
+      clSetKernelArg(this->ocl.oclKernel, 8, sizeof(cl_int), &num_splits);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -251,6 +254,7 @@ TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1B_CPFP) {
     clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
         0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
 
+    int split_idx = 0, num_splits = 1;
     for (int g = 0; g < params[i].numgroups; ++g) {
       clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
           &this->ocl_input);
@@ -266,6 +270,8 @@ TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1B_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_int), &split_idx);
+      clSetKernelArg(this->ocl.oclKernel, 8, sizeof(cl_int), &num_splits);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
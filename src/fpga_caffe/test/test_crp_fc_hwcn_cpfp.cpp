@@ -187,6 +187,7 @@ TYPED_TEST(CRPFCHWCNCPFPTest, TestFCReLU1x1F_CPFP) {
     clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
         0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
 
+    int split_idx = 0, num_splits = 1;
     for (int g = 0; g < params[i].numgroups; ++g) {
       clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
           &this->ocl_input);
@@ -202,6 +203,8 @@ TYPED_TEST(CRPFCHWCNCPFPTest, TestFCReLU1x1F_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_int), &split_idx);
+      clSetKernelArg(this->ocl.oclKernel, 8, sizeof(cl_int), &num_splits);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -305,6 +308,7 @@ TYPED_TEST(CRPFCHWCNCPFPTest, TestFCReLU1x1B_CPFP) {
     clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
         0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
 
+    int split_idx = 0, num_splits = 1;
     for (int g = 0; g < params[i].numgroups; ++g) {
       clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
           &this->ocl_input);
@@ -320,6 +324,8 @@ TYPED_TEST(CRPFCHWCNCPFPTest, TestFCReLU1x1B_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_int), &split_idx);
+      clSetKernelArg(this->ocl.oclKernel, 8, sizeof(cl_int), &num_splits);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
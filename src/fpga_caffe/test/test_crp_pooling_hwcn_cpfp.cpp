@@ -130,6 +130,7 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP2x2F_Pool_CPFP) {
     clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
         0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
 
+    int split_idx = 0, num_splits = 1;
     for (int g = 0; g < params[i].numgroups; ++g) {
       clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
           &this->ocl_input);
@@ -145,6 +146,8 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP2x2F_Pool_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_int), &split_idx);
+      clSetKernelArg(this->ocl.oclKernel, 8, sizeof(cl_int), &num_splits);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -250,6 +253,7 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP2x2B_Pool_CPFP) {
     clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
         0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
 
+    int split_idx = 0, num_splits = 1;
     for (int g = 0; g < params[i].numgroups; ++g) {
       clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
           &this->ocl_input);
@@ -265,6 +269,8 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP2x2B_Pool_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_int), &split_idx);
+      clSetKernelArg(this->ocl.oclKernel, 8, sizeof(cl_int), &num_splits);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -361,6 +367,7 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3F_Pool_CPFP) {
     clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
         0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
 
+    int split_idx = 0, num_splits = 1;
     for (int g = 0; g < params[i].numgroups; ++g) {
       clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
           &this->ocl_input);
@@ -376,6 +383,8 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3F_Pool_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_int), &split_idx);
+      clSetKernelArg(this->ocl.oclKernel, 8, sizeof(cl_int), &num_splits);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -503,6 +512,7 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3B_Pool_CPFP) {
     clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
         0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
 
+    int split_idx = 0, num_splits = 1;
     for (int g = 0; g < params[i].numgroups; ++g) {
       clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
           &this->ocl_input);
@@ -518,6 +528,8 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3B_Pool_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_int), &split_idx);
+      clSetKernelArg(this->ocl.oclKernel, 8, sizeof(cl_int), &num_splits);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -7,6 +7,7 @@ namespace bp = boost::python;
 #include <glog/logging.h>
 
 #include <cstring>
+#include <iomanip>
 #include <map>
 #include <string>
 #include <vector>
@@ -19,6 +20,7 @@ using caffe::Blob;
 using caffe::Caffe;
 using caffe::Net;
 using caffe::Layer;
+using caffe::NativeKernelRunner;
 using caffe::Solver;
 using caffe::shared_ptr;
 using caffe::string;
@@ -49,7 +51,31 @@ DEFINE_string(weights, "",
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
 
-DEFINE_int32(ocl, -1, "Run using OCL mode.");
+DEFINE_string(ocl, "",
+    "Optional; run in OCL mode on given accelerator IDs separated by ','. "
+    "Use '-ocl all' to run on all available accelerators. Training on "
+    "several devices multiplies the effective batch size by their number.");
+DEFINE_bool(ocl_native, false,
+    "Optional; run the OCL layers with the kernels linked into the host "
+    "process instead of on the device. Requires a USE_OCL_NATIVE build. "
+    "With -ocl, trains one native solver per listed ID.");
+DEFINE_int32(ocl_native_threads, 0,
+    "Optional; number of host threads running native kernels, 0 to use "
+    "every core.");
+DEFINE_bool(ocl_async, false,
+    "Optional; enqueue OCL transfers and kernels without waiting on each "
+    "one, the host only blocks when it reads data still in use.");
+DEFINE_string(xclbin_dir, "",
+    "Optional; directory holding the xclbins named by the XCLProgram "
+    "layers, defaults to .build_release/opencl/src/caffe/layers/.");
+DEFINE_int32(ocl_programs_per_device, 1,
+    "Optional; number of xclbins an OCL device holds at once, loading "
+    "another one reprograms the device.");
+DEFINE_string(ocl_tiling_cache, "",
+    "Optional; file keeping the tilings chosen for layers with "
+    "cr_param { autotune: true }, reused by later runs.");
+DEFINE_double(fpga_clock_mhz, 250,
+    "Optional; kernel clock that fpga_estimate converts cycles with.");
 
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
@@ -111,6 +137,26 @@ static void get_gpus(vector<int>* gpus) {
   }
 }
 
+// Parse OCL device ids or use all available accelerators
+static void get_ocl_devices(vector<int>* devices) {
+  if (FLAGS_ocl == "all") {
+    CHECK(!FLAGS_ocl_native) << "Native mode needs explicit device IDs";
+    for (int i = 0; i < Caffe::OCLDeviceCount(); ++i) {
+      devices->push_back(i);
+    }
+  } else if (FLAGS_ocl.size()) {
+    vector<string> strings;
+    boost::split(strings, FLAGS_ocl, boost::is_any_of(","));
+    for (int i = 0; i < strings.size(); ++i) {
+      devices->push_back(boost::lexical_cast<int>(strings[i]));
+    }
+  } else {
+    CHECK_EQ(devices->size(), 0);
+    return;
+  }
+  CHECK_GT(devices->size(), 0) << "No OCL accelerator found";
+}
+
 // Parse phase from flags
 caffe::Phase get_phase_from_flags(caffe::Phase default_value) {
   if (FLAGS_phase == "")
@@ -210,15 +256,29 @@ int train() {
 
   vector<int> gpus;
   get_gpus(&gpus);
+  vector<int> ocl_devices;
+  get_ocl_devices(&ocl_devices);
   if (gpus.size() == 0) {
-    if (FLAGS_ocl >= 0) {
-      LOG(INFO) << "Use FPGA.";
-      Caffe::SetOCLDevice();
+    if (FLAGS_ocl_native) {
+      LOG(INFO) << "Use native FPGA kernels.";
+      Caffe::set_mode(Caffe::OCL_NATIVE);
+      NativeKernelRunner::set_num_threads(FLAGS_ocl_native_threads);
+    } else if (ocl_devices.size()) {
+      ostringstream s;
+      for (int i = 0; i < ocl_devices.size(); ++i) {
+        s << (i ? ", " : "") << ocl_devices[i];
+      }
+      LOG(INFO) << "Use FPGAs " << s.str();
+      Caffe::SetOCLDevice(ocl_devices[0]);
       Caffe::set_mode(Caffe::OCL);
+      Caffe::set_ocl_async(FLAGS_ocl_async);
     } else {
       LOG(INFO) << "Use CPU.";
       Caffe::set_mode(Caffe::CPU);
     }
+    if (ocl_devices.size() > 1) {
+      Caffe::set_solver_count(ocl_devices.size());
+    }
   } else {
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
@@ -262,6 +322,10 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (gpus.size() == 0 && ocl_devices.size() > 1) {
+    caffe::HostSync<float> sync(solver);
+    sync.Run(ocl_devices,
+        FLAGS_snapshot.size() > 0 ? FLAGS_snapshot.c_str() : NULL);
   } else {
     solver->Solve();
   }
@@ -289,9 +353,17 @@ int test() {
 #endif
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
-  } else if (FLAGS_ocl >= 0) {
-    Caffe::SetOCLDevice();
+  } else if (FLAGS_ocl_native) {
+    LOG(INFO) << "Use native FPGA kernels.";
+    Caffe::set_mode(Caffe::OCL_NATIVE);
+    NativeKernelRunner::set_num_threads(FLAGS_ocl_native_threads);
+  } else if (FLAGS_ocl.size()) {
+    vector<int> ocl_devices;
+    get_ocl_devices(&ocl_devices);
+    LOG(INFO) << "Use FPGA with device ID " << ocl_devices[0];
+    Caffe::SetOCLDevice(ocl_devices[0]);
     Caffe::set_mode(Caffe::OCL);
+    Caffe::set_ocl_async(FLAGS_ocl_async);
   } else {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
@@ -360,9 +432,17 @@ int time() {
     LOG(INFO) << "Use GPU with device ID " << gpus[0];
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
-  } else if (FLAGS_ocl >= 0) {
-    Caffe::SetOCLDevice();
+  } else if (FLAGS_ocl_native) {
+    LOG(INFO) << "Use native FPGA kernels.";
+    Caffe::set_mode(Caffe::OCL_NATIVE);
+    NativeKernelRunner::set_num_threads(FLAGS_ocl_native_threads);
+  } else if (FLAGS_ocl.size()) {
+    vector<int> ocl_devices;
+    get_ocl_devices(&ocl_devices);
+    LOG(INFO) << "Use FPGA with device ID " << ocl_devices[0];
+    Caffe::SetOCLDevice(ocl_devices[0]);
     Caffe::set_mode(Caffe::OCL);
+    Caffe::set_ocl_async(FLAGS_ocl_async);
   } else {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
@@ -406,6 +486,10 @@ int time() {
       layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
       forward_time_per_layer[i] += timer.MicroSeconds();
     }
+    // In async mode the per layer times only cover enqueueing the work
+    if (Caffe::ocl_async()) {
+      Caffe::SynchronizeOCL();
+    }
     forward_time += forward_timer.MicroSeconds();
     backward_timer.Start();
     for (int i = layers.size() - 1; i >= 0; --i) {
@@ -414,6 +498,9 @@ int time() {
                           bottom_vecs[i]);
       backward_time_per_layer[i] += timer.MicroSeconds();
     }
+    if (Caffe::ocl_async()) {
+      Caffe::SynchronizeOCL();
+    }
     backward_time += backward_timer.MicroSeconds();
     LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
       << iter_timer.MilliSeconds() << " ms.";
@@ -436,11 +523,107 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+#ifdef USE_OCL
+  if (Caffe::mode() == Caffe::OCL) {
+    caffe::OCLMemoryPool::Stats stats = caffe::OCLMemoryPool::GetStats();
+    LOG(INFO) << "OCL buffer pool: " << stats.hits << " hits, "
+      << stats.misses << " misses, " << stats.bytes_in_use
+      << " bytes in use, " << stats.bytes_cached << " bytes cached.";
+  }
+#endif
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
 RegisterBrewFunction(time);
 
+#ifdef USE_OCL
+// FPGA estimate: predict the kernel time and traffic of the OCL layers of a
+// model from the kernel model, without a device.
+int fpga_estimate() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to estimate.";
+  caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
+  vector<string> stages = get_stages_from_flags();
+
+  // Setting the layers up is enough to get their kernel_params
+  Caffe::set_mode(Caffe::CPU);
+  Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+
+  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+  const vector<bool>& layer_need_backward = caffe_net.layer_need_backward();
+  const vector<vector<bool> >& bottom_need_backward =
+      caffe_net.bottom_need_backward();
+  const char* pass_names[] = {"forward", "bw weights", "bw data"};
+  const double cycles_per_ms = FLAGS_fpga_clock_mhz * 1000;
+  const double mb = 1 << 20;
+  double forward_ms = 0, backward_ms = 0, ddr_bytes = 0, pcie_bytes = 0;
+  int calls_total = 0, calls_memory_bound = 0;
+  LOG(INFO) << "*** Estimate at " << FLAGS_fpga_clock_mhz << " MHz ***";
+  LOG(INFO) << std::setw(10) << "layer" << std::setw(12) << "pass"
+    << std::setw(10) << "ms" << std::setw(8) << "MAC %"
+    << std::setw(10) << "in MB" << std::setw(10) << "out MB"
+    << std::setw(10) << "w MB" << std::setw(10) << "tags MB"
+    << std::setw(10) << "PCIe MB" << std::setw(8) << "op/B"
+    << std::setw(8) << "bound";
+  for (int i = 0; i < layers.size(); ++i) {
+    vector<kernel_params> calls;
+    layers[i]->OCLKernelCalls(&calls);
+    if (calls.empty()) {
+      continue;
+    }
+    const caffe::string& kernel_name = layers[i]->xcl_param().kernel_name();
+    caffe::OCLKernelConfig config = caffe::OCLKernelModel::Config(kernel_name);
+    for (int j = 0; j < calls.size(); ++j) {
+      const int pass = calls[j].backward;
+      if (pass != 0 && (phase == caffe::TEST || !layer_need_backward[i])) {
+        continue;
+      }
+      if (pass == 2 && !bottom_need_backward[i][0]) {
+        continue;
+      }
+      if (pass != 0 && config.forward_only) {
+        LOG(WARNING) << layers[i]->layer_param().name() << ": " << kernel_name
+          << " has no backward passes";
+        break;
+      }
+      caffe::OCLKernelEstimate est =
+        caffe::OCLKernelModel::Estimate(calls[j], config);
+      const double ms = est.cycles() / cycles_per_ms;
+      const double utilization = 100 * est.macs /
+        (est.cycles() * caffe::OCLKernelModel::PeakMACsPerCycle(config));
+      LOG(INFO) << std::setw(10) << layers[i]->layer_param().name()
+        << std::setw(12) << pass_names[pass]
+        << std::setw(10) << std::setprecision(4) << ms
+        << std::setw(8) << std::setprecision(3) << utilization
+        << std::setw(10) << est.gmem_bytes[caffe::GMEM_INPUT] / mb
+        << std::setw(10) << est.gmem_bytes[caffe::GMEM_OUTPUT] / mb
+        << std::setw(10) << est.gmem_bytes[caffe::GMEM_WEIGHTS] / mb
+        << std::setw(10) << est.gmem_bytes[caffe::GMEM_TAGS] / mb
+        << std::setw(10) << est.pcie_bytes / mb
+        << std::setw(8) << 2 * est.macs / est.ddr_bytes()
+        << std::setw(8) << (est.memory_bound() ? "memory" : "compute");
+      if (pass == 0) {
+        forward_ms += ms;
+      } else {
+        backward_ms += ms;
+      }
+      ddr_bytes += est.ddr_bytes();
+      pcie_bytes += est.pcie_bytes;
+      calls_total++;
+      calls_memory_bound += est.memory_bound();
+    }
+  }
+  LOG(INFO) << "Forward pass: " << forward_ms << " ms.";
+  LOG(INFO) << "Backward pass: " << backward_ms << " ms.";
+  LOG(INFO) << "DDR traffic: " << ddr_bytes / mb << " MB, PCIe traffic if "
+    << "every call goes through the host: " << pcie_bytes / mb << " MB.";
+  LOG(INFO) << calls_memory_bound << " of " << calls_total
+    << " kernel calls are memory bound.";
+  LOG(INFO) << "*** Estimate ends ***";
+  return 0;
+}
+RegisterBrewFunction(fpga_estimate);
+#endif
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -453,9 +636,17 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  fpga_estimate   estimate the FPGA time of the OCL layers");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+#ifdef USE_OCL
+  if (!FLAGS_xclbin_dir.empty()) {
+    caffe::OCLKernelRegistry::set_xclbin_dir(FLAGS_xclbin_dir);
+  }
+  caffe::OCLKernelRegistry::set_max_programs(FLAGS_ocl_programs_per_device);
+  caffe::OCLTilingTuner::set_cache_file(FLAGS_ocl_tiling_cache);
+#endif
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
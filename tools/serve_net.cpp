@@ -0,0 +1,660 @@
+// Serves a trained net on a local Unix socket, grouping the single image
+// requests that arrive close together into batches.
+//
+// A client connects to -socket and writes requests back to back. A request
+// is the float32 values of one image for every input of the net, in the
+// order of the net's inputs. Every request is answered, in order, with the
+// float32 values of that image in every output of the net.
+//
+// The first request of a batch waits at most -batch_timeout_ms for others
+// to join it. Batches are assembled on a thread of their own while the
+// previous one runs through Net::Forward, and the p50 and p99 latencies and
+// the throughput are logged every -report_interval seconds. With several
+// accelerators each runs a copy of the net on the batches in turn.
+//
+// Usage:
+//    serve_net -model deploy.prototxt -weights net.caffemodel
+//        [-socket path] [-ocl ID[,ID...] | -ocl_native] [-batch_size N]
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/bind.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/thread.hpp"
+#include "boost/weak_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+
+using boost::posix_time::ptime;
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::NativeKernelRunner;
+using caffe::Net;
+using caffe::NetParameter;
+using caffe::shared_ptr;
+using caffe::string;
+using caffe::Timer;
+using caffe::vector;
+
+DEFINE_string(model, "",
+    "The deploy net definition protocol buffer text file, its Input layers "
+    "set the per image shape of the requests.");
+DEFINE_string(weights, "",
+    "The trained weights to serve.");
+DEFINE_string(socket, "/tmp/caffe_serve.sock",
+    "Optional; path of the Unix socket to listen on.");
+DEFINE_string(ocl, "",
+    "Optional; run in OCL mode on given accelerator IDs separated by ','. "
+    "Use '-ocl all' to run on all available accelerators. Each one runs a "
+    "copy of the net, taking the batches in turn.");
+DEFINE_bool(ocl_native, false,
+    "Optional; run the OCL layers with the kernels linked into the host "
+    "process instead of on the device. Requires a USE_OCL_NATIVE build. "
+    "With -ocl, runs one native copy of the net per listed ID.");
+DEFINE_int32(ocl_native_threads, 0,
+    "Optional; number of host threads running native kernels, 0 to use "
+    "every core.");
+DEFINE_bool(ocl_async, false,
+    "Optional; enqueue OCL transfers and kernels without waiting on each "
+    "one.");
+DEFINE_string(xclbin_dir, "",
+    "Optional; directory holding the xclbins named by the XCLProgram "
+    "layers.");
+DEFINE_int32(ocl_programs_per_device, 1,
+    "Optional; number of xclbins an OCL device holds at once.");
+DEFINE_int32(batch_size, 0,
+    "Optional; images per forward pass, 0 to time the candidate sizes of "
+    "the backend at startup and take the one with the highest throughput.");
+DEFINE_int32(max_batch_size, 256,
+    "Optional; largest batch size timed when choosing one.");
+DEFINE_double(latency_target_ms, 0,
+    "Optional; when choosing the batch size, leave out sizes whose forward "
+    "pass takes longer than this, 0 for no limit.");
+DEFINE_int32(tune_iterations, 5,
+    "Optional; forward passes timed per candidate batch size.");
+DEFINE_double(batch_timeout_ms, 2,
+    "Optional; how long the first request of a batch waits for others to "
+    "join it.");
+DEFINE_int32(report_interval, 10,
+    "Optional; seconds between latency and throughput reports.");
+DEFINE_int32(max_requests, 0,
+    "Optional; exit after answering this many requests, 0 to serve until "
+    "killed.");
+
+// A queue whose consumer can give up waiting at a deadline, or be woken for
+// good by close().
+template <typename T>
+class DeadlineQueue {
+ public:
+  DeadlineQueue() : closed_(false) {}
+
+  void push(const T& t) {
+    boost::mutex::scoped_lock lock(mutex_);
+    queue_.push_back(t);
+    condition_.notify_one();
+  }
+
+  // Returns false once the queue is closed.
+  bool pop(T* t) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (queue_.empty() && !closed_) {
+      condition_.wait(lock);
+    }
+    return take(t);
+  }
+
+  // Returns false if nothing was pushed before deadline or the queue is
+  // closed.
+  bool pop(const ptime& deadline, T* t) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (queue_.empty() && !closed_) {
+      if (!condition_.timed_wait(lock, deadline) && queue_.empty()) {
+        return false;
+      }
+    }
+    return take(t);
+  }
+
+  // Makes every pop fail from now on. What is left can still be taken with
+  // try_pop.
+  void close() {
+    boost::mutex::scoped_lock lock(mutex_);
+    closed_ = true;
+    condition_.notify_all();
+  }
+
+  bool try_pop(T* t) {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (queue_.empty()) {
+      return false;
+    }
+    *t = queue_.front();
+    queue_.pop_front();
+    return true;
+  }
+
+ private:
+  bool take(T* t) {
+    if (closed_) {
+      return false;
+    }
+    *t = queue_.front();
+    queue_.pop_front();
+    return true;
+  }
+
+  bool closed_;
+  std::deque<T> queue_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+// Closed once its reader has stopped and all its requests are answered.
+struct Connection {
+  explicit Connection(int fd) : fd(fd) {}
+  ~Connection() { close(fd); }
+  int fd;
+};
+
+struct Request {
+  shared_ptr<Connection> connection;
+  vector<float> data;
+  ptime arrival;
+};
+
+struct Batch {
+  // Batches are answered in the order they were assembled
+  int64_t sequence;
+  vector<Request*> requests;
+  // The values of every net input, batch_size images each
+  vector<vector<float> > inputs;
+};
+
+static bool ReadFull(int fd, void* buffer, size_t size) {
+  char* p = static_cast<char*>(buffer);
+  while (size > 0) {
+    const ssize_t n = recv(fd, p, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool WriteFull(int fd, const void* buffer, size_t size) {
+  const char* p = static_cast<const char*>(buffer);
+  while (size > 0) {
+    const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Returns the value below which a fraction q of values lie.
+static double Percentile(vector<double>* values, double q) {
+  const int k = std::min<int>(values->size() - 1, q * values->size());
+  std::nth_element(values->begin(), values->begin() + k, values->end());
+  return (*values)[k];
+}
+
+class Server {
+ public:
+  // nets are copies of the same net, each on the OCL device of the same
+  // index in devices, or -1 outside Caffe::OCL mode.
+  Server(const vector<Net<float>*>& nets, const vector<int>& devices,
+      int batch_size)
+    : nets_(nets), devices_(devices), batch_size_(batch_size),
+      request_size_(0), batches_(kBatches * nets.size()), stopping_(false),
+      next_batch_(0), next_answer_(0), answered_(0) {
+    CHECK_EQ(nets_.size(), devices_.size());
+    const vector<Blob<float>*>& inputs = nets_[0]->input_blobs();
+    for (int i = 0; i < inputs.size(); ++i) {
+      CHECK_EQ(inputs[i]->shape(0), batch_size_);
+      input_size_.push_back(inputs[i]->count(1));
+      request_size_ += input_size_.back();
+    }
+    for (int i = 0; i < batches_.size(); ++i) {
+      batches_[i].inputs.resize(inputs.size());
+      for (int j = 0; j < inputs.size(); ++j) {
+        batches_[i].inputs[j].resize(inputs[j]->count());
+      }
+      free_.push(&batches_[i]);
+    }
+  }
+
+  // Listens on path and runs the forward passes of each net on a thread of
+  // its own, which switches to the net's device. Returns once
+  // -max_requests are answered and every thread has stopped.
+  void Serve(const string& path) {
+    const int fd = Listen(path);
+    LOG(INFO) << "Listening on " << path << ", " << request_size_
+        << " values per request, batches of " << batch_size_ << " on "
+        << nets_.size() << " copies of the net.";
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&Server::Accept, this, fd));
+    threads.create_thread(boost::bind(&Server::Assemble, this));
+    report_start_ = boost::get_system_time();
+    for (int i = 0; i < nets_.size(); ++i) {
+      threads.create_thread(boost::bind(&Server::Work, this, i,
+          Caffe::mode(), Caffe::ocl_async()));
+    }
+    {
+      boost::mutex::scoped_lock lock(answer_mutex_);
+      while (FLAGS_max_requests <= 0 || answered_ < FLAGS_max_requests) {
+        answered_condition_.wait(lock);
+      }
+      Report(boost::get_system_time());
+    }
+    Stop(fd);
+    threads.join_all();
+    // Accept has returned, so no reader is added any more
+    readers_.join_all();
+    Request* request;
+    while (requests_.try_pop(&request)) {
+      delete request;
+    }
+    Batch* batch;
+    while (full_.try_pop(&batch)) {
+      Drop(batch);
+    }
+    close(fd);
+    unlink(path.c_str());
+  }
+
+ protected:
+  // Batches per net, one is filled while the other runs
+  static const int kBatches = 2;
+
+  // Wakes every thread blocked on a socket, a queue or its turn to answer.
+  // The connections are shut down rather than closed, their descriptors
+  // stay valid until the last request holding them is gone.
+  void Stop(int fd) {
+    {
+      boost::mutex::scoped_lock connection_lock(connection_mutex_);
+      boost::mutex::scoped_lock answer_lock(answer_mutex_);
+      stopping_ = true;
+      answered_condition_.notify_all();
+      for (int i = 0; i < connections_.size(); ++i) {
+        shared_ptr<Connection> connection = connections_[i].lock();
+        if (connection) {
+          shutdown(connection->fd, SHUT_RDWR);
+        }
+      }
+    }
+    shutdown(fd, SHUT_RDWR);
+    requests_.close();
+    free_.close();
+    full_.close();
+  }
+
+  // Deletes the requests of a batch that will not be answered.
+  static void Drop(Batch* batch) {
+    for (int j = 0; j < batch->requests.size(); ++j) {
+      delete batch->requests[j];
+    }
+    batch->requests.clear();
+  }
+
+  // Runs batches through nets_[i]. The answers wait for those of the
+  // batches assembled before, so that every connection is answered in order.
+  void Work(int i, Caffe::Brew mode, bool ocl_async) {
+    if (devices_[i] >= 0) {
+      Caffe::SetOCLDevice(devices_[i]);
+    }
+    Caffe::set_mode(mode);
+    Caffe::set_ocl_async(ocl_async);
+    Net<float>* net = nets_[i];
+    Batch* batch;
+    while (full_.pop(&batch)) {
+      const vector<Blob<float>*>& inputs = net->input_blobs();
+      for (int j = 0; j < inputs.size(); ++j) {
+        caffe::caffe_copy(inputs[j]->count(), batch->inputs[j].data(),
+            inputs[j]->mutable_cpu_data());
+      }
+      net->Forward();
+      boost::mutex::scoped_lock lock(answer_mutex_);
+      while (!stopping_ && next_answer_ != batch->sequence) {
+        answered_condition_.wait(lock);
+      }
+      if (stopping_) {
+        Drop(batch);
+        return;
+      }
+      Answer(net, batch);
+      ++next_answer_;
+      const ptime now = boost::get_system_time();
+      if (now - report_start_ >=
+          boost::posix_time::seconds(FLAGS_report_interval)) {
+        Report(now);
+      }
+      answered_condition_.notify_all();
+      lock.unlock();
+      free_.push(batch);
+    }
+  }
+
+  static int Listen(const string& path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    CHECK_LT(path.size(), sizeof(addr.sun_path))
+        << "Socket path too long: " << path;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0) << "socket: " << strerror(errno);
+    unlink(path.c_str());
+    CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0)
+        << "Cannot bind " << path << ": " << strerror(errno);
+    CHECK_EQ(listen(fd, SOMAXCONN), 0) << "listen: " << strerror(errno);
+    return fd;
+  }
+
+  void Accept(int fd) {
+    for (;;) {
+      const int client = accept(fd, NULL, NULL);
+      boost::mutex::scoped_lock lock(connection_mutex_);
+      if (stopping_) {
+        if (client >= 0) {
+          close(client);
+        }
+        return;
+      }
+      if (client < 0) {
+        if (errno != EINTR) {
+          LOG(ERROR) << "accept: " << strerror(errno);
+        }
+        continue;
+      }
+      shared_ptr<Connection> connection(new Connection(client));
+      // Forget the connections that are gone
+      int live = 0;
+      for (int i = 0; i < connections_.size(); ++i) {
+        if (!connections_[i].expired()) {
+          connections_[live++] = connections_[i];
+        }
+      }
+      connections_.resize(live);
+      connections_.push_back(connection);
+      readers_.create_thread(boost::bind(&Server::Read, this, connection));
+    }
+  }
+
+  void Read(shared_ptr<Connection> connection) {
+    for (;;) {
+      Request* request = new Request();
+      request->connection = connection;
+      request->data.resize(request_size_);
+      if (!ReadFull(connection->fd, request->data.data(),
+          sizeof(float) * request_size_)) {
+        delete request;
+        return;
+      }
+      request->arrival = boost::get_system_time();
+      requests_.push(request);
+    }
+  }
+
+  // Fills the free batches with the requests that arrive before the
+  // deadline of their first one.
+  void Assemble() {
+    const boost::posix_time::time_duration timeout =
+        boost::posix_time::microseconds(
+        static_cast<int64_t>(FLAGS_batch_timeout_ms * 1000));
+    Batch* batch;
+    while (free_.pop(&batch)) {
+      batch->sequence = next_batch_++;
+      batch->requests.clear();
+      Request* request;
+      if (!requests_.pop(&request)) {
+        return;
+      }
+      const ptime deadline = request->arrival + timeout;
+      do {
+        const int slot = batch->requests.size();
+        const float* data = request->data.data();
+        for (int i = 0; i < input_size_.size(); ++i) {
+          std::copy(data, data + input_size_[i],
+              batch->inputs[i].begin() + slot * input_size_[i]);
+          data += input_size_[i];
+        }
+        batch->requests.push_back(request);
+      } while (batch->requests.size() < batch_size_ &&
+          requests_.pop(deadline, &request));
+      full_.push(batch);
+    }
+  }
+
+  void Answer(Net<float>* net, Batch* batch) {
+    const vector<Blob<float>*>& outputs = net->output_blobs();
+    vector<float> answer;
+    for (int j = 0; j < batch->requests.size(); ++j) {
+      Request* request = batch->requests[j];
+      answer.clear();
+      for (int i = 0; i < outputs.size(); ++i) {
+        const int size = outputs[i]->count(1);
+        const float* data = outputs[i]->cpu_data() + j * size;
+        answer.insert(answer.end(), data, data + size);
+      }
+      if (!WriteFull(request->connection->fd, answer.data(),
+          sizeof(float) * answer.size())) {
+        LOG(WARNING) << "Dropped the answer to a closed connection.";
+      }
+      latencies_.push_back((boost::get_system_time() - request->arrival)
+          .total_microseconds() / 1000.0);
+      delete request;
+    }
+    answered_ += batch->requests.size();
+    batch_fill_.push_back(batch->requests.size());
+  }
+
+  void Report(const ptime& now) {
+    const double seconds =
+        (now - report_start_).total_microseconds() / 1000000.0;
+    if (!latencies_.empty()) {
+      double fill = 0;
+      for (int i = 0; i < batch_fill_.size(); ++i) {
+        fill += batch_fill_[i];
+      }
+      fill /= batch_fill_.size() * batch_size_;
+      const int count = latencies_.size();
+      LOG(INFO) << count << " requests in " << seconds << " s: "
+          << count / seconds << " requests/s, latency p50 "
+          << Percentile(&latencies_, 0.5) << " ms, p99 "
+          << Percentile(&latencies_, 0.99) << " ms, batches "
+          << fill * 100 << "% full.";
+    }
+    latencies_.clear();
+    batch_fill_.clear();
+    report_start_ = now;
+  }
+
+  const vector<Net<float>*> nets_;
+  const vector<int> devices_;
+  const int batch_size_;
+  // Values per image of each net input, and of a request
+  vector<int> input_size_;
+  int request_size_;
+  vector<Batch> batches_;
+  DeadlineQueue<Batch*> free_;
+  DeadlineQueue<Batch*> full_;
+  DeadlineQueue<Request*> requests_;
+  // Set once by Stop while holding both connection_mutex_ and
+  // answer_mutex_, so either one guards reading it
+  bool stopping_;
+  // The connections and their reader threads are guarded by
+  // connection_mutex_
+  boost::mutex connection_mutex_;
+  vector<boost::weak_ptr<Connection> > connections_;
+  boost::thread_group readers_;
+  // Only touched by Assemble
+  int64_t next_batch_;
+  // The answers and the statistics since report_start_ are guarded by
+  // answer_mutex_
+  boost::mutex answer_mutex_;
+  boost::condition_variable answered_condition_;
+  int64_t next_answer_;
+  int answered_;
+  ptime report_start_;
+  vector<double> latencies_;
+  vector<int> batch_fill_;
+};
+
+// Parses -ocl, as tools/caffe does.
+static void get_ocl_devices(vector<int>* devices) {
+  if (FLAGS_ocl == "all") {
+    CHECK(!FLAGS_ocl_native) << "Native mode needs explicit device IDs";
+    for (int i = 0; i < Caffe::OCLDeviceCount(); ++i) {
+      devices->push_back(i);
+    }
+  } else if (FLAGS_ocl.size()) {
+    vector<string> strings;
+    boost::split(strings, FLAGS_ocl, boost::is_any_of(","));
+    for (int i = 0; i < strings.size(); ++i) {
+      devices->push_back(boost::lexical_cast<int>(strings[i]));
+    }
+  } else {
+    return;
+  }
+  CHECK_GT(devices->size(), 0) << "No OCL accelerator found";
+}
+
+// Builds the net for batches of num images.
+static shared_ptr<Net<float> > NewNet(const NetParameter& param, int num) {
+  NetParameter net_param(param);
+  net_param.mutable_state()->set_phase(caffe::TEST);
+  int num_inputs = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    caffe::LayerParameter* layer = net_param.mutable_layer(i);
+    if (layer->type() != "Input") {
+      continue;
+    }
+    caffe::InputParameter* input = layer->mutable_input_param();
+    for (int j = 0; j < input->shape_size(); ++j) {
+      input->mutable_shape(j)->set_dim(0, num);
+      ++num_inputs;
+    }
+  }
+  CHECK_GT(num_inputs, 0) << "Need a deploy net with Input layers to serve.";
+  shared_ptr<Net<float> > net(new Net<float>(net_param));
+  if (FLAGS_weights.size()) {
+    net->CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  return net;
+}
+
+// Times the forward pass at each candidate batch size and returns the one
+// with the highest throughput. The OCL kernels take words of 16 images, so
+// there the candidates are multiples of 16, on the CPU powers of two.
+static int ChooseBatchSize(const NetParameter& param) {
+  const bool ocl = Caffe::mode() == Caffe::OCL ||
+      Caffe::mode() == Caffe::OCL_NATIVE;
+  int best = 0;
+  double best_rate = 0;
+  for (int num = ocl ? 16 : 1; num <= FLAGS_max_batch_size; num *= 2) {
+    shared_ptr<Net<float> > net = NewNet(param, num);
+    // The first pass allocates the buffers
+    net->Forward();
+    Timer timer;
+    timer.Start();
+    for (int i = 0; i < FLAGS_tune_iterations; ++i) {
+      net->Forward();
+    }
+    if (Caffe::ocl_async()) {
+      Caffe::SynchronizeOCL();
+    }
+    const double ms = timer.MicroSeconds() / 1000 / FLAGS_tune_iterations;
+    const double rate = num * 1000 / ms;
+    LOG(INFO) << "Batch size " << num << ": " << ms << " ms per forward "
+        << "pass, " << rate << " images/s.";
+    // Larger batches only take longer
+    if (FLAGS_latency_target_ms > 0 && ms > FLAGS_latency_target_ms) {
+      break;
+    }
+    if (rate > best_rate) {
+      best = num;
+      best_rate = rate;
+    }
+  }
+  CHECK_GT(best, 0) << "No batch size meets -latency_target_ms.";
+  return best;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("serves a net on a Unix socket\n"
+      "usage: serve_net -model deploy.prototxt -weights net.caffemodel "
+      "[-socket path] [-ocl ID[,ID...] | -ocl_native]");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to serve.";
+#ifdef USE_OCL
+  if (!FLAGS_xclbin_dir.empty()) {
+    caffe::OCLKernelRegistry::set_xclbin_dir(FLAGS_xclbin_dir);
+  }
+  caffe::OCLKernelRegistry::set_max_programs(FLAGS_ocl_programs_per_device);
+#endif
+  vector<int> ocl_devices;
+  get_ocl_devices(&ocl_devices);
+  // The device of each copy of the net, -1 where there is none to select
+  vector<int> devices(std::max<int>(ocl_devices.size(), 1), -1);
+  if (FLAGS_ocl_native) {
+    LOG(INFO) << "Use native FPGA kernels.";
+    Caffe::set_mode(Caffe::OCL_NATIVE);
+    NativeKernelRunner::set_num_threads(FLAGS_ocl_native_threads);
+  } else if (ocl_devices.size()) {
+    std::ostringstream s;
+    for (int i = 0; i < ocl_devices.size(); ++i) {
+      s << (i ? ", " : "") << ocl_devices[i];
+    }
+    LOG(INFO) << "Use FPGAs " << s.str();
+    devices = ocl_devices;
+    Caffe::SetOCLDevice(devices[0]);
+    Caffe::set_mode(Caffe::OCL);
+    Caffe::set_ocl_async(FLAGS_ocl_async);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  const int batch_size = FLAGS_batch_size > 0 ? FLAGS_batch_size :
+      ChooseBatchSize(param);
+  LOG(INFO) << "Serving with batch size " << batch_size << ".";
+  vector<shared_ptr<Net<float> > > nets;
+  vector<Net<float>*> net_ptrs;
+  for (int i = 0; i < devices.size(); ++i) {
+    if (devices[i] >= 0) {
+      Caffe::SetOCLDevice(devices[i]);
+    }
+    nets.push_back(NewNet(param, batch_size));
+    net_ptrs.push_back(nets.back().get());
+  }
+  Server server(net_ptrs, devices, batch_size);
+  server.Serve(FLAGS_socket);
+  return 0;
+}